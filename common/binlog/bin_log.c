@@ -47,6 +47,18 @@ int bin_put_v2(int fd, const uint8_t *buf, uint32_t len, uint64_t sid)
     return bin_write_internal_v2(fd, buf, len, &ts, sid);
 }
 
+int bin_put_v3(int fd, const uint8_t *buf, uint32_t len, uint64_t sid)
+{
+    uint64_t ts = 0;
+    return bin_write_internal_v3(fd, buf, len, &ts, sid);
+}
+
+int bin_put_batch_v3(int fd, const bin_rec_t *recs, int cnt)
+{
+    uint64_t ts = 0;
+    return bin_write_batch_internal_v3(fd, recs, cnt, &ts);
+}
+
 int bin_get_ts(int fd, off_t *offset, uint64_t *timestamp)
 {
     return bin_read_ts(fd, offset, timestamp);
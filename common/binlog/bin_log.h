@@ -16,6 +16,8 @@ extern int bin_get(int fd, uint8_t **buf, uint32_t *len, off_t *offset, MallocFu
 extern int bin_get_v2(int fd, uint8_t **buf, uint32_t *len, off_t *offset, MallocFunc f, uint64_t *sid);
 extern int bin_put(int fd, const uint8_t *buf, uint32_t len);
 extern int bin_put_v2(int fd, const uint8_t *buf, uint32_t len, uint64_t sid);
+extern int bin_put_v3(int fd, const uint8_t *buf, uint32_t len, uint64_t sid);
+extern int bin_put_batch_v3(int fd, const bin_rec_t *recs, int cnt);
 extern int bin_get_ts(int fd, off_t *offset, uint64_t *timestamp);
 
 #endif
@@ -8,18 +8,23 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 
 #include "file_util.h"
 #include "rotate_file.h"
 #include "meta_file.h"
 #include "zmalloc.h"
 #include "pf_crc.h"
+#include "crc32c.h"
 #include "pf_file.h"
 #include "log.h"
 #include "bin_log_impl.h"
 
 static const uint16_t BIN_MAGIC_NUM = 0xfefd;
 static const uint16_t BIN_MAGIC_NUM_V2 = 0xfefe;
+static const uint16_t BIN_MAGIC_NUM_V3 = 0xfeff;
 
 uint64_t bin_timestamp()
 {
@@ -100,11 +105,110 @@ int bin_write_internal_v2(int fd, const uint8_t *buf, uint32_t len, uint64_t *ts
     return BL_FILE_OK;
 }
 
+static void bin_fill_v3(bin_header_t *h, bin_ext_v3_t *e,
+                        const uint8_t *buf, uint32_t len, uint64_t ts, uint64_t sid)
+{
+    h->magic = BIN_MAGIC_NUM_V3;
+    h->crc   = 0;
+    h->ts    = ts;
+    h->len   = len;
+
+    e->sid   = sid;
+    e->crc   = crc32c(0, buf, len);
+    e->hcrc  = crc32c(crc32c(0, h, sizeof(*h)), e, offsetof(bin_ext_v3_t, hcrc));
+}
+
+static int bin_check_v3(const bin_header_t *h, const bin_ext_v3_t *e)
+{
+    return e->hcrc == crc32c(crc32c(0, h, sizeof(*h)), e, offsetof(bin_ext_v3_t, hcrc));
+}
+
+int bin_write_internal_v3(int fd, const uint8_t *buf, uint32_t len, uint64_t *ts, uint64_t sid)
+{
+    int          i;
+    bin_header_t h;
+    bin_ext_v3_t e;
+    struct iovec bin_iov[3];
+
+    bin_fill_v3(&h, &e, buf, len, bin_timestamp(), sid);
+
+    bin_iov[0].iov_base = (void *)&h;
+    bin_iov[0].iov_len  = sizeof(bin_header_t);
+
+    bin_iov[1].iov_base = (void *)&e;
+    bin_iov[1].iov_len  = sizeof(bin_ext_v3_t);
+
+    bin_iov[2].iov_base = (void *)buf;
+    bin_iov[2].iov_len  = len;
+
+    i = writev(fd, bin_iov, 3);
+    if (i != (signed)(sizeof(bin_header_t) + sizeof(bin_ext_v3_t) + len))
+    {
+        return BL_FILE_SYS_ERR; 
+    }
+
+    if (ts) *ts = h.ts;
+
+    return BL_FILE_OK;
+}
+
+/* records per writev, each record takes 3 iovecs */
+#define BIN_BATCH_RECS 256
+
+int bin_write_batch_internal_v3(int fd, const bin_rec_t *recs, int cnt, uint64_t *ts)
+{
+    int          i, n;
+    ssize_t      ret;
+    size_t       total;
+    bin_header_t h[BIN_BATCH_RECS];
+    bin_ext_v3_t e[BIN_BATCH_RECS];
+    struct iovec bin_iov[BIN_BATCH_RECS * 3];
+    uint64_t     now = bin_timestamp();
+
+    while (cnt > 0)
+    {
+        n = cnt > BIN_BATCH_RECS ? BIN_BATCH_RECS : cnt;
+        total = 0;
+        for (i = 0; i < n; i++)
+        {
+            bin_fill_v3(&h[i], &e[i], recs[i].buf, recs[i].len, now, recs[i].sid);
+
+            bin_iov[i * 3].iov_base = (void *)&h[i];
+            bin_iov[i * 3].iov_len  = sizeof(bin_header_t);
+
+            bin_iov[i * 3 + 1].iov_base = (void *)&e[i];
+            bin_iov[i * 3 + 1].iov_len  = sizeof(bin_ext_v3_t);
+
+            bin_iov[i * 3 + 2].iov_base = (void *)recs[i].buf;
+            bin_iov[i * 3 + 2].iov_len  = recs[i].len;
+
+            total += sizeof(bin_header_t) + sizeof(bin_ext_v3_t) + recs[i].len;
+        }
+
+        ret = writev(fd, bin_iov, n * 3);
+        if (ret != (ssize_t)total)
+        {
+            log_error("writev batch ret [%d] len[%u], error[%s]", (int)ret, (unsigned)total, strerror(errno));
+            return BL_FILE_SYS_ERR; 
+        }
+
+        recs += n;
+        cnt -= n;
+    }
+
+    if (ts) *ts = now;
+
+    return BL_FILE_OK;
+}
+
 static int bin_read_internal_v2(int fd, uint8_t **buf, uint32_t *len, off_t offset, uint64_t *ts, uint64_t *sid)
 {
     bin_header_t h;
+    bin_ext_v3_t e;
     ssize_t      n = 0;
     int          v2_flag = 0;
+    int          v3_flag = 0;
+    int          crc_ok = 0;
 
     //log_debug("try to read [%u]", offset);
     file_set_pos(fd, offset);
@@ -112,11 +216,37 @@ static int bin_read_internal_v2(int fd, uint8_t **buf, uint32_t *len, off_t offs
     {
         /* magic num is matched and len valid */
         if ((h.magic == BIN_MAGIC_NUM 
-            || h.magic == BIN_MAGIC_NUM_V2) 
+            || h.magic == BIN_MAGIC_NUM_V2
+            || h.magic == BIN_MAGIC_NUM_V3) 
             && IS_RECORD_LEN_VALID(h.len))
         {
             v2_flag = (h.magic == BIN_MAGIC_NUM_V2) ? 1 : 0;
-            if (v2_flag)
+            v3_flag = (h.magic == BIN_MAGIC_NUM_V3) ? 1 : 0;
+            if (v3_flag)
+            {
+                n = read(fd, &e, sizeof(e));
+                if (n == 0)
+                {
+                    log_debug("read V3 header, file EOF");
+                    return BL_FILE_EOF;
+                }
+                else if (n != sizeof(e))
+                {
+                    log_error("read V3 header error[%s] ret[%d]", strerror(errno), n);
+                    return BL_FILE_SYS_ERR; 
+                }
+
+                /* check header before reading a content of up to RECORD_MAX_SIZE */
+                if (!bin_check_v3(&h, &e))
+                {
+                    log_error("offset [%d] header crc invalid, try next one", offset);
+                    offset += 1;
+                    file_set_pos(fd, offset);
+                    continue;
+                }
+                *sid = e.sid;
+            }
+            else if (v2_flag)
             {
                 n = read(fd, sid, sizeof(uint64_t));
                 if (n != sizeof(uint64_t))
@@ -144,11 +274,19 @@ static int bin_read_internal_v2(int fd, uint8_t **buf, uint32_t *len, off_t offs
                 return BL_FILE_SYS_ERR; 
             }
 
-            pf_crc16_t* crc_p = pf_crc16_start();
-            pf_crc16_append(crc_p, *buf, h.len);
+            if (v3_flag)
+            {
+                crc_ok = (e.crc == crc32c(0, *buf, h.len));
+            }
+            else
+            {
+                pf_crc16_t* crc_p = pf_crc16_start();
+                pf_crc16_append(crc_p, *buf, h.len);
+                crc_ok = (h.crc == pf_crc16_finish(crc_p));
+            }
 
             /* CRC matched */
-            if(h.crc == pf_crc16_finish(crc_p))
+            if (crc_ok)
             {
                 *ts = h.ts;
                 *len = h.len;
@@ -181,6 +319,272 @@ static int bin_read_internal_v2(int fd, uint8_t **buf, uint32_t *len, off_t offs
     return BL_FILE_SYS_ERR; 
 }
 
+/* read block of bin_reader if not mmaped */
+#define BIN_READ_BLOCK (1024 * 1024)
+
+void bin_reader_init(bin_reader_t *r, int fd, off_t offset, int flags)
+{
+    memset(r, 0x00, sizeof(*r));
+    r->fd     = fd;
+    r->flags  = flags;
+    r->offset = offset;
+}
+
+void bin_reader_destroy(bin_reader_t *r)
+{
+    if (r->map)
+    {
+        munmap(r->map, r->map_len);
+        r->map = NULL;
+    }
+    if (r->buf)
+    {
+        zfree(r->buf);
+        r->buf = NULL;
+    }
+    r->map_len = 0;
+    r->buf_cap = 0;
+    r->buf_len = 0;
+}
+
+/* map the whole file again if it has grown */
+static int bin_reader_remap(bin_reader_t *r)
+{
+    struct stat st;
+    void       *m;
+
+    if (fstat(r->fd, &st) != 0)
+    {
+        log_error("fstat fd[%d] error[%s]", r->fd, strerror(errno));
+        r->err = 1;
+        return -1;
+    }
+
+    if ((size_t)st.st_size <= r->map_len)
+    {
+        return 0;
+    }
+
+    m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, r->fd, 0);
+    if (m == MAP_FAILED)
+    {
+        /* fall back to block read */
+        log_info("mmap fd[%d] size[%"PRIu64"] error[%s], use read", r->fd, (uint64_t)st.st_size, strerror(errno));
+        r->flags &= ~BIN_READER_MMAP;
+        return -1;
+    }
+    madvise(m, st.st_size, MADV_SEQUENTIAL);
+
+    if (r->map)
+    {
+        munmap(r->map, r->map_len);
+    }
+    r->map     = (uint8_t *)m;
+    r->map_len = st.st_size;
+
+    return 0;
+}
+
+/**
+ * get at least need bytes at off, *avail is set to the bytes available there.
+ * NULL if not enough data (EOF) or r->err set.
+ */
+static const uint8_t *bin_reader_peek(bin_reader_t *r, off_t off, size_t need, size_t *avail)
+{
+    ssize_t n;
+    size_t  want;
+
+    if (r->flags & BIN_READER_MMAP)
+    {
+        if ((size_t)off + need > r->map_len)
+        {
+            bin_reader_remap(r);
+        }
+        if (r->flags & BIN_READER_MMAP)
+        {
+            if ((size_t)off + need > r->map_len)
+            {
+                return NULL;
+            }
+            *avail = r->map_len - off;
+            return r->map + off;
+        }
+    }
+
+    if (off >= r->buf_off && (size_t)(off - r->buf_off) + need <= r->buf_len)
+    {
+        *avail = r->buf_len - (off - r->buf_off);
+        return r->buf + (off - r->buf_off);
+    }
+
+    /* refill from off */
+    want = need > BIN_READ_BLOCK ? need : BIN_READ_BLOCK;
+    if (want > r->buf_cap)
+    {
+        zfree(r->buf);
+        r->buf = (uint8_t *)zmalloc(want);
+        r->buf_cap = want;
+    }
+
+    r->buf_off = off;
+    r->buf_len = 0;
+    while (r->buf_len < r->buf_cap)
+    {
+        n = pread(r->fd, r->buf + r->buf_len, r->buf_cap - r->buf_len, off + r->buf_len);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            log_error("pread fd[%d] offset[%"PRIu64"] error[%s]", r->fd, (uint64_t)(off + r->buf_len), strerror(errno));
+            r->err = 1;
+            return NULL;
+        }
+        if (n == 0)
+        {
+            break;
+        }
+        r->buf_len += n;
+    }
+
+    if (r->buf_len < need)
+    {
+        return NULL;
+    }
+
+    *avail = r->buf_len;
+    return r->buf;
+}
+
+/* find the next offset after off that may start a record */
+static off_t bin_reader_resync(bin_reader_t *r, off_t off)
+{
+    const uint8_t *p;
+    const uint8_t *q;
+    size_t         avail;
+    off_t          cur = off + 1;
+
+    /* all magic nums are 0xfeXX, 0xfe is the second byte */
+    while ((p = bin_reader_peek(r, cur, 2, &avail)) != NULL)
+    {
+        q = (const uint8_t *)memchr(p + 1, 0xfe, avail - 1);
+        if (q == NULL)
+        {
+            cur += avail - 1;
+            continue;
+        }
+
+        if (q[-1] == (BIN_MAGIC_NUM & 0xff)
+            || q[-1] == (BIN_MAGIC_NUM_V2 & 0xff)
+            || q[-1] == (BIN_MAGIC_NUM_V3 & 0xff))
+        {
+            return cur + (q - 1 - p);
+        }
+        cur += q - p;
+    }
+
+    return cur;
+}
+
+int bin_reader_next(bin_reader_t *r, const uint8_t **buf, uint32_t *len, uint64_t *ts, uint64_t *sid)
+{
+    const uint8_t *p;
+    size_t         avail;
+    size_t         hlen;
+    bin_header_t   h;
+    bin_ext_v3_t   e;
+    int            crc_ok;
+    off_t          off = r->offset;
+    off_t          next;
+
+    while (1)
+    {
+        p = bin_reader_peek(r, off, sizeof(h), &avail);
+        if (p == NULL)
+        {
+            break;
+        }
+        memcpy(&h, p, sizeof(h));
+
+        if ((h.magic == BIN_MAGIC_NUM 
+            || h.magic == BIN_MAGIC_NUM_V2
+            || h.magic == BIN_MAGIC_NUM_V3) 
+            && IS_RECORD_LEN_VALID(h.len))
+        {
+            hlen = sizeof(h);
+            if (h.magic == BIN_MAGIC_NUM_V2)
+            {
+                hlen += sizeof(uint64_t);
+            }
+            else if (h.magic == BIN_MAGIC_NUM_V3)
+            {
+                hlen += sizeof(e);
+            }
+
+            p = bin_reader_peek(r, off, hlen, &avail);
+            if (p == NULL)
+            {
+                break;
+            }
+
+            crc_ok = 1;
+            if (h.magic == BIN_MAGIC_NUM_V3)
+            {
+                memcpy(&e, p + sizeof(h), sizeof(e));
+                /* check header before waiting for a content of up to RECORD_MAX_SIZE */
+                crc_ok = bin_check_v3(&h, &e);
+            }
+
+            if (crc_ok)
+            {
+                p = bin_reader_peek(r, off, hlen + h.len, &avail);
+                if (p == NULL)
+                {
+                    /* the record may be written partly */
+                    break;
+                }
+
+                if (h.magic == BIN_MAGIC_NUM_V3)
+                {
+                    crc_ok = (e.crc == crc32c(0, p + hlen, h.len));
+                }
+                else
+                {
+                    pf_crc16_t* crc_p = pf_crc16_start();
+                    pf_crc16_append(crc_p, p + hlen, h.len);
+                    crc_ok = (h.crc == pf_crc16_finish(crc_p));
+                }
+            }
+
+            /* CRC matched */
+            if (crc_ok)
+            {
+                if (h.magic == BIN_MAGIC_NUM_V3)
+                {
+                    *sid = e.sid;
+                }
+                else if (h.magic == BIN_MAGIC_NUM_V2)
+                {
+                    memcpy(sid, p + sizeof(h), sizeof(uint64_t));
+                }
+
+                *buf = p + hlen;
+                *len = h.len;
+                *ts  = h.ts;
+                r->offset = off + hlen + h.len;
+                return BL_FILE_OK;
+            }
+        }
+
+        /* skip to the next possible magic num */
+        next = bin_reader_resync(r, off);
+        log_error("offset [%"PRIu64"] record invalid, skip [%"PRIu64"] bytes",
+                  (uint64_t)off, (uint64_t)(next - off));
+        off = next;
+        r->offset = off;
+    }
+
+    return r->err ? BL_FILE_SYS_ERR : BL_FILE_EOF;
+}
+
 int bin_read(int fd, uint8_t **buf, uint32_t *len, off_t *offset, uint64_t *ts, MallocFunc f, uint64_t *sid)
 {
     int ret      = 0;
@@ -598,6 +1002,30 @@ int bin_write_v2(bin_meta_t *bm, const uint8_t *buf, uint32_t len, uint64_t sid)
     return ret;    
 }
 
+int bin_write_v3(bin_meta_t *bm, const uint8_t *buf, uint32_t len, uint64_t sid)
+{
+    int ret; 
+    uint64_t  ts  = 0;
+    rt_file_t *rt = &bm->rt;
+
+    if (rt_need_rotate(rt))
+    {
+        rt_switch_file(rt);    
+    }
+
+    ret = bin_write_internal_v3(rt->fd, buf, len, &ts, sid);
+    log_debug("bin write ret[%d]", ret);
+
+    bm->curr_ts = ts;
+    bm->curr_offset = file_pos(rt->fd);  
+    if (bm->need_persist)
+    {
+        meta_update(bm);
+    }
+
+    return ret;    
+}
+
 static int get_next_file_ts(rt_file_t *rt, uint64_t *out_ts)
 {
     uint64_t    ts = 0;
@@ -686,4 +1114,68 @@ int bin_read2(bin_meta_t *bm, uint8_t **buf, uint32_t *len, MallocFunc f, uint64
     return ret;    
 }
 
+/* same as bin_read2, but *buf is a view of r, valid until next read */
+int bin_read3(bin_meta_t *bm, bin_reader_t *r, const uint8_t **buf, uint32_t *len, uint64_t *sid)
+{
+    uint64_t    ts  = 0;
+    rt_file_t  *rt  = &bm->rt;
+    int         ret; 
+    int         i;
+
+    if (r->fd != rt->fd || r->offset != (off_t)bm->curr_offset)
+    {
+        /* file switched or offset reset outside */
+        bin_reader_destroy(r);
+        bin_reader_init(r, rt->fd, bm->curr_offset, r->flags);
+    }
+
+    ret = bin_reader_next(r, buf, len, &ts, sid);
+    if (ret == BL_FILE_SYS_ERR)
+    {
+        return ret;
+    }
+
+    bm->curr_offset = r->offset;  
+
+    if (ret == BL_FILE_OK) 
+    {
+        bm->curr_ts = ts;
+    }
+    else if (ret == BL_FILE_EOF)
+    {
+        i = get_next_file_ts(rt, &ts);
+        if (i < 0)
+        {
+            return BL_FILE_EOF;
+        }
+        /* we need next timestamp larger, so we can switch file */
+        if (ts < bm->curr_ts)
+        {
+            log_info("file large [%"PRIu64"], but next file ts[%"PRIu64"] less than current ts[%"PRIu64"] ", bm->curr_offset, ts, bm->curr_ts);
+            return BL_FILE_EOF;
+        }
+
+        if (rt_switch_file(rt) < 0)
+        {
+            log_error("file eof, read switch file error");
+            return -1;
+        }
+        else
+        {
+            ret = BL_FILE_SWITCH;
+        }
+
+        bm->curr_offset = 0;
+        bin_reader_destroy(r);
+        bin_reader_init(r, rt->fd, 0, r->flags);
+    }
+
+    if (bm->need_persist)
+    {
+        meta_update(bm);
+    }
+
+    return ret;    
+}
+
 
@@ -9,6 +9,10 @@
  * --------------------------------------
  * |MAGIC|CRC|content size|TIMESTAMP|content|
  * --------------------------------------
+ *
+ * v2 inserts SID between HEADER and content.
+ * v3 inserts SID|CRC32C|HEADER CRC32C instead, CRC of HEADER is unused(0),
+ * CRC32C covers content and HEADER CRC32C covers HEADER|SID|CRC32C.
  */
 #include <inttypes.h>
 #include "meta_file.h"
@@ -39,14 +43,60 @@ typedef struct bin_header
     uint64_t ts;
 }bin_header_t;
 
+/* follows bin_header_t in v3 records */
+typedef struct bin_ext_v3
+{
+    uint64_t sid;
+    uint32_t crc;   /* crc32c of content */
+    uint32_t hcrc;  /* crc32c of header and the fields above */
+}bin_ext_v3_t;
+
+/* one record of a batch write */
+typedef struct bin_rec
+{
+    const uint8_t *buf;
+    uint32_t len;
+    uint64_t sid;
+}bin_rec_t;
+
+/* flags of bin_reader_init() */
+#define BIN_READER_MMAP     0x01  /* mmap the file, only if it won't be truncated while reading */
+
+/**
+ * sequential reader of binlog file, mmaped or read in large blocks.
+ * records are handed out as views into the map/buffer, which are valid
+ * until the next call on the reader.
+ */
+typedef struct bin_reader
+{
+    int       fd;
+    int       flags;
+    int       err;
+    uint8_t  *map;       /* mmap of the file */
+    size_t    map_len;
+    uint8_t  *buf;       /* block buffer if not mmaped */
+    size_t    buf_cap;
+    size_t    buf_len;
+    off_t     buf_off;
+    off_t     offset;    /* offset of next record */
+}bin_reader_t;
+
 uint64_t bin_timestamp();
 int bin_read(int fd, uint8_t **buf, uint32_t *len, off_t *offset, uint64_t *ts, MallocFunc f, uint64_t *sid);
 int bin_write_internal(int fd, const uint8_t *buf, uint32_t len, uint64_t *ts);
 int bin_write_internal_v2(int fd, const uint8_t *buf, uint32_t len, uint64_t *ts, uint64_t sid);
+int bin_write_internal_v3(int fd, const uint8_t *buf, uint32_t len, uint64_t *ts, uint64_t sid);
+int bin_write_batch_internal_v3(int fd, const bin_rec_t *recs, int cnt, uint64_t *ts);
 int bin_read_ts(int fd, off_t *offset, uint64_t *ts);
 int bin_init(bin_meta_t *bm, uint8_t *path, uint8_t *prefix, off_t max_size, int max_idx, uint64_t ts, int meta_persist, uint8_t *meta_name, int flags, mode_t mode);
 int bin_write_v2(bin_meta_t *bm, const uint8_t *buf, uint32_t len, uint64_t sid);
+int bin_write_v3(bin_meta_t *bm, const uint8_t *buf, uint32_t len, uint64_t sid);
 int bin_read2(bin_meta_t *bm, uint8_t **buf, uint32_t *len, MallocFunc f, uint64_t *sid);
+int bin_read3(bin_meta_t *bm, bin_reader_t *r, const uint8_t **buf, uint32_t *len, uint64_t *sid);
 void bin_destroy(bin_meta_t *bm);
 
+void bin_reader_init(bin_reader_t *r, int fd, off_t offset, int flags);
+int bin_reader_next(bin_reader_t *r, const uint8_t **buf, uint32_t *len, uint64_t *ts, uint64_t *sid);
+void bin_reader_destroy(bin_reader_t *r);
+
 #endif
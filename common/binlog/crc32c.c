@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "crc32c.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CRC32C_HAS_SSE42 1
+#include <nmmintrin.h>
+#endif
+
+/* reflected Castagnoli polynomial */
+#define CRC32C_POLY 0x82f63b78
+
+static uint32_t crc32c_table[8][256];
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+typedef uint32_t (*crc32c_func)(uint32_t, const void *, size_t);
+static crc32c_func crc32c_impl = NULL;
+
+static void crc32c_init_table()
+{
+    uint32_t i, j, c;
+
+    for (i = 0; i < 256; i++)
+    {
+        c = i;
+        for (j = 0; j < 8; j++)
+        {
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        }
+        crc32c_table[0][i] = c;
+    }
+
+    for (i = 0; i < 256; i++)
+    {
+        c = crc32c_table[0][i];
+        for (j = 1; j < 8; j++)
+        {
+            c = crc32c_table[0][c & 0xff] ^ (c >> 8);
+            crc32c_table[j][i] = c;
+        }
+    }
+}
+
+static void crc32c_init()
+{
+    crc32c_init_table();
+    crc32c_impl = crc32c_hw_available() ? crc32c_hw : crc32c_sw;
+}
+
+uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+    uint64_t w;
+
+    pthread_once(&crc32c_once, crc32c_init);
+
+    crc = ~crc;
+    while (len > 0 && ((uintptr_t)p & 7))
+    {
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+
+    /* little endian only, the same as the binlog header */
+    while (len >= 8)
+    {
+        memcpy(&w, p, sizeof(w));
+        w ^= crc;
+        crc = crc32c_table[7][w & 0xff]
+            ^ crc32c_table[6][(w >> 8) & 0xff]
+            ^ crc32c_table[5][(w >> 16) & 0xff]
+            ^ crc32c_table[4][(w >> 24) & 0xff]
+            ^ crc32c_table[3][(w >> 32) & 0xff]
+            ^ crc32c_table[2][(w >> 40) & 0xff]
+            ^ crc32c_table[1][(w >> 48) & 0xff]
+            ^ crc32c_table[0][w >> 56];
+        p += 8;
+        len -= 8;
+    }
+
+    while (len > 0)
+    {
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+
+    return ~crc;
+}
+
+#ifdef CRC32C_HAS_SSE42
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+    uint64_t c = ~crc;
+    uint64_t w;
+
+    while (len > 0 && ((uintptr_t)p & 7))
+    {
+        c = _mm_crc32_u8((uint32_t)c, *p++);
+        len--;
+    }
+
+    while (len >= 8)
+    {
+        memcpy(&w, p, sizeof(w));
+        c = _mm_crc32_u64(c, w);
+        p += 8;
+        len -= 8;
+    }
+
+    while (len > 0)
+    {
+        c = _mm_crc32_u8((uint32_t)c, *p++);
+        len--;
+    }
+
+    return ~(uint32_t)c;
+}
+
+int crc32c_hw_available()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2") ? 1 : 0;
+}
+#else
+uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t len)
+{
+    return crc32c_sw(crc, buf, len);
+}
+
+int crc32c_hw_available()
+{
+    return 0;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+    pthread_once(&crc32c_once, crc32c_init);
+    return crc32c_impl(crc, buf, len);
+}
@@ -0,0 +1,20 @@
+#ifndef __CRC32C_H_DEF__
+#define __CRC32C_H_DEF__
+
+#include <stddef.h>
+#include <inttypes.h>
+
+/**
+ * CRC32C (Castagnoli) of binlog records.
+ * crc: value returned by the previous call, 0 for the first one
+ */
+extern uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+/* slicing-by-8 implementation */
+extern uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len);
+
+/* SSE4.2 implementation, only valid if crc32c_hw_available() */
+extern uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t len);
+extern int crc32c_hw_available();
+
+#endif
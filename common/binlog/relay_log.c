@@ -66,7 +66,7 @@ int relay_init(relay_info_t *ri, uint8_t *path, uint8_t *ip, uint64_t ts, int po
 int relay_write(relay_info_t *ri, const uint8_t *buf, uint32_t len, uint64_t remote_ts, uint64_t sid)
 {
     ri->bm.remote_ts = remote_ts; 
-    return bin_write_v2(&ri->bm, buf, len, sid);
+    return bin_write_v3(&ri->bm, buf, len, sid);
 }
 
 int relay_read(relay_info_t *ri, uint8_t **buf, uint32_t *len, MallocFunc f, uint64_t *sid)
@@ -9,6 +9,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/inotify.h>
 
 #include "pf_file.h"
 #include "replica_proto.h"
@@ -95,13 +98,190 @@ static void destroy_arg(repl_thread_arg_t *arg)
     }
 }
 
+/* master stream batch */
+#define REPL_BATCH_BYTES    (256 * 1024)
+#define REPL_BATCH_RECS     512
+/* max wait for binlog growth, then send FIN again */
+#define REPL_IDLE_WAIT_MS   1000
+
+/* totals of all master threads */
+static uint64_t g_repl_sent_bytes = 0;
+static uint64_t g_repl_sent_recs = 0;
+static uint64_t g_repl_filtered_recs = 0;
+
+typedef struct repl_batch
+{
+    uint8_t        *buf;        /* packed frames */
+    uint32_t        cap;
+    uint32_t        len;
+    int             cnt;
+    uint32_t        off[REPL_BATCH_RECS];    /* offset of frame in buf */
+    const char     *recs[REPL_BATCH_RECS];
+    int             lens[REPL_BATCH_RECS];
+    char            drop[REPL_BATCH_RECS];
+    struct iovec    iov[REPL_BATCH_RECS];
+    uint64_t        last_ts;
+}repl_batch_t;
+
+static int repl_batch_full(repl_batch_t *b, uint32_t len)
+{
+    return b->cnt >= REPL_BATCH_RECS
+        || (b->cnt > 0 && b->len + REPL_FRAME_SIZE(len) > b->cap);
+}
+
+static void repl_batch_add(repl_batch_t *b, const uint8_t *rec, uint32_t len, uint64_t ts)
+{
+    const uint32_t need = b->len + REPL_FRAME_SIZE(len);
+
+    if (need > b->cap)
+    {
+        /* a record larger than the batch */
+        b->buf = (uint8_t *)zrealloc(b->buf, need);
+        b->cap = need;
+    }
+
+    b->off[b->cnt] = b->len;
+    b->len += repl_pack_rec(b->buf + b->len, rec, len, ts);
+    b->cnt++;
+    b->last_ts = ts;
+}
+
+/* filter records of the batch in bulk, send the rest with one writev */
+static int repl_batch_flush(repl_batch_t *b, repl_thread_arg_t *arg)
+{
+    int         i;
+    int         n = 0;
+    int         sent = 0;
+    size_t      total = 0;
+    uint32_t    end;
+
+    if (b->cnt == 0)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < b->cnt; i++)
+    {
+        b->recs[i] = (const char *)b->buf + b->off[i] + sizeof(repl_header_t);
+        b->lens[i] = (i + 1 < b->cnt ? b->off[i + 1] : b->len) - b->off[i] - sizeof(repl_header_t);
+        b->drop[i] = 0;
+    }
+
+    if (arg->filter_bulk)
+    {
+        arg->filter_bulk(b->recs, b->lens, b->cnt, arg->slave_ds_key, b->drop);
+    }
+    else
+    {
+        for (i = 0; i < b->cnt; i++)
+        {
+            b->drop[i] = arg->filter(b->recs[i], b->lens[i], arg->slave_ds_key) ? 1 : 0;
+        }
+    }
+
+    /* adjacent frames to be sent share one iovec */
+    for (i = 0; i < b->cnt; i++)
+    {
+        if (b->drop[i])
+        {
+            continue;
+        }
+
+        end = i + 1 < b->cnt ? b->off[i + 1] : b->len;
+        if (n > 0 && (uint8_t *)b->iov[n - 1].iov_base + b->iov[n - 1].iov_len == b->buf + b->off[i])
+        {
+            b->iov[n - 1].iov_len += end - b->off[i];
+        }
+        else
+        {
+            b->iov[n].iov_base = b->buf + b->off[i];
+            b->iov[n].iov_len  = end - b->off[i];
+            n++;
+        }
+        total += end - b->off[i];
+        sent++;
+    }
+
+    __sync_fetch_and_add(&g_repl_filtered_recs, b->cnt - sent);
+    b->cnt = 0;
+    b->len = 0;
+
+    if (n == 0)
+    {
+        return 0;
+    }
+
+    if (repl_send_frames(arg->fd, b->iov, n, total) < 0)
+    {
+        return -1;
+    }
+
+    __sync_fetch_and_add(&g_repl_sent_bytes, total);
+    __sync_fetch_and_add(&g_repl_sent_recs, sent);
+    log_debug("send to slave recs [%d] len [%u]", sent, (unsigned)total);
+
+    return 0;
+}
+
+/* watch binlog dir, so master wakes up on binlog growth instead of polling */
+static int repl_watch_binlog(const char *path)
+{
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+    {
+        log_error("inotify_init1() error[%s], poll binlog", strerror(errno));
+        return -1;
+    }
+
+    if (inotify_add_watch(fd, path, IN_MODIFY | IN_CREATE | IN_MOVED_TO) < 0)
+    {
+        log_error("inotify_add_watch() [%s] error[%s], poll binlog", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* wait for binlog growth, return 1 if timeout */
+static int repl_wait_binlog(int ifd, ladder_timer_t *ti, int timeout_ms)
+{
+    struct pollfd   pfd;
+    char            ev[4096];
+    int             ret;
+
+    if (ifd < 0)
+    {
+        ladder_timer_sleep(ti);
+        return 1;
+    }
+
+    pfd.fd      = ifd;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    ret = poll(&pfd, 1, timeout_ms);
+    if (ret <= 0)
+    {
+        return 1;
+    }
+
+    /* drain events, we only care about wakeup */
+    while (read(ifd, ev, sizeof(ev)) > 0);
+
+    return 0;
+}
+
 static void *master_worker(void *param)
 {
     int                     i;
     bin_meta_t              bm;
-    char                   *buf;
+    bin_reader_t            rd;
+    repl_batch_t           *batch = NULL;
+    const uint8_t          *rec;
     uint32_t                len;
     int                     ret;
+    int                     ifd = -1;
+    int                     pending_fin = 1;
     uint64_t                curr_ts = 0;
 
     /* timer */
@@ -118,6 +298,8 @@ static void *master_worker(void *param)
 
 
     memset(&bm, 0x00, sizeof(bin_meta_t));
+    /* binlog may be truncated when reused, so read by blocks instead of mmap */
+    bin_reader_init(&rd, -1, 0, 0);
     ladder_timer_init(&ti, usec_arr, 4);
 
     log_debug("master start!");
@@ -168,6 +350,11 @@ static void *master_worker(void *param)
     log_debug("master get binlog, try to sync");
 
     ladder_timer_reset(&ti);
+    ifd = repl_watch_binlog(arg->path);
+
+    batch = (repl_batch_t *)zcalloc(sizeof(*batch));
+    batch->cap = REPL_BATCH_BYTES;
+    batch->buf = (uint8_t *)zmalloc(batch->cap);
 
     heartbeat_inter = time(0);
     while (1)
@@ -175,12 +362,15 @@ static void *master_worker(void *param)
         /* FIXME */
         //mng_print_thread_status();
 
+        ret = 0;
+
         /* send heartbeat */
         curr_time = time(0);
         if (curr_time - heartbeat_inter > 3)
         {
             heartbeat_inter = curr_time;
-            if (repl_send_slave(arg->fd, NULL, REPL_FLAG_HEARTBEAT, 0, 0) < 0)
+            if (repl_batch_flush(batch, arg) < 0
+                || repl_send_slave(arg->fd, NULL, REPL_FLAG_HEARTBEAT, 0, 0) < 0)
             {
                 log_error("repl send to slave heartbeat error, peer[%s:%d], error[%s]",
                         arg->ip, arg->port, strerror(errno));
@@ -188,39 +378,47 @@ static void *master_worker(void *param)
             }
         }
 
-        i = bin_read2(&bm, &buf, &len, zmalloc, &sid);
+        i = bin_read3(&bm, &rd, &rec, &len, &sid);
         if (i == BL_FILE_OK)
         {
+            ladder_timer_reset(&ti);
+            pending_fin = 1;
+
             /* do not send same sid log */
             if (sid == arg->slave_sid)
             {
                 log_debug("get same slave sid [%"PRIu64"] log, drop it", sid);
-                ladder_timer_reset(&ti);
-                zfree(buf);
+                __sync_fetch_and_add(&g_repl_filtered_recs, 1);
                 continue;
             }
 
-            /* do not send filter log */ 
-            if (arg->filter(buf, len, arg->slave_ds_key))
+            /* records are filtered in bulk when the batch is sent */
+            if (repl_batch_full(batch, len))
             {
-                log_debug("filter record");
-                ladder_timer_reset(&ti);
-                zfree(buf);
-                continue;
-
+                ret = repl_batch_flush(batch, arg);
+                grp->master_lag_us = bin_timestamp() - batch->last_ts;
             }
-            
+
             curr_ts = bm.curr_ts;
-            ret = repl_send_slave(arg->fd, (uint8_t *)buf, REPL_FLAG_DATA, len, curr_ts);
-            //log_debug("send to slave len [%d] data:\n%s",len, hex_dump(buf, len));
-            log_debug("send to slave len [%d]",len);
-            ladder_timer_reset(&ti);
-            zfree(buf);
+            repl_batch_add(batch, rec, len, curr_ts);
         }
         else if (i == BL_FILE_EOF)
         {
-            ret = repl_send_slave(arg->fd, NULL, REPL_FLAG_FIN, 0, 0);
-            ladder_timer_sleep(&ti);
+            /* caught up */
+            ret = repl_batch_flush(batch, arg);
+            grp->master_lag_us = 0;
+
+            if (ret == 0 && pending_fin)
+            {
+                ret = repl_send_slave(arg->fd, NULL, REPL_FLAG_FIN, 0, 0);
+                pending_fin = 0;
+            }
+
+            if (ret == 0 && repl_wait_binlog(ifd, &ti, REPL_IDLE_WAIT_MS))
+            {
+                /* tell the slave it is synced from time to time */
+                pending_fin = 1;
+            }
         }
         else if (i == BL_FILE_SWITCH)
         {
@@ -229,7 +427,11 @@ static void *master_worker(void *param)
         }
         else
         {
-            ret = repl_send_slave(arg->fd, NULL, REPL_FLAG_ERR, 0, 0);
+            ret = repl_batch_flush(batch, arg);
+            if (ret == 0)
+            {
+                ret = repl_send_slave(arg->fd, NULL, REPL_FLAG_ERR, 0, 0);
+            }
             ladder_timer_sleep(&ti);
         }
        
@@ -247,13 +449,32 @@ master_error:
 
     /* don't close , let free res do it */
     /* close(arg->fd);*/
+    if (ifd >= 0)
+    {
+        close(ifd);
+    }
+    if (batch)
+    {
+        zfree(batch->buf);
+        zfree(batch);
+    }
+    bin_reader_destroy(&rd);
     bin_destroy(&bm);
     return NULL;
 }
 
+void repl_get_master_stat(repl_master_stat_t *st)
+{
+    st->sent_bytes    = __sync_add_and_fetch(&g_repl_sent_bytes, 0);
+    st->sent_recs     = __sync_add_and_fetch(&g_repl_sent_recs, 0);
+    st->filtered_recs = __sync_add_and_fetch(&g_repl_filtered_recs, 0);
+    st->max_lag_us    = mng_get_master_lag(&st->masters);
+}
+
 int repl_bin_master_start(const char *path, const char *prefix,
                 off_t max_size, int max_idx, int net_fd, uint64_t ts, void *res, freeres_func func,
-                uint64_t master_sid, uint64_t slave_sid, const char *slave_ds_key, filter_func filter)
+                uint64_t master_sid, uint64_t slave_sid, const char *slave_ds_key, filter_func filter,
+                filter_bulk_func filter_bulk)
 {
     pthread_t               th;
     repl_thread_arg_t      *arg;
@@ -288,6 +509,7 @@ int repl_bin_master_start(const char *path, const char *prefix,
     arg->master_sid  = master_sid; 
     arg->slave_ds_key= zstrdup(slave_ds_key); 
     arg->filter      = filter; 
+    arg->filter_bulk = filter_bulk; 
 
     if (mng_thread_create(REPL_MASTER_TH, &th, NULL, master_worker, arg) != 0)
     {
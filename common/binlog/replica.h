@@ -3,9 +3,20 @@
 
 #include "replica_thread_mng.h"
 
+typedef struct repl_master_stat
+{
+    int         masters;        /* running master threads */
+    uint64_t    sent_bytes;
+    uint64_t    sent_recs;
+    uint64_t    filtered_recs;  /* not sent to slave */
+    uint64_t    max_lag_us;
+}repl_master_stat_t;
+
 extern int repl_bin_master_start(const char *path, const char *prefix,
                 off_t max_size, int max_idx, int net_fd, uint64_t ts, void *res, freeres_func func,
-                uint64_t master_sid, uint64_t slave_sid, const char *slave_ds_key, filter_func filter);
+                uint64_t master_sid, uint64_t slave_sid, const char *slave_ds_key, filter_func filter,
+                filter_bulk_func filter_bulk);
+extern void repl_get_master_stat(repl_master_stat_t *st);
 extern int repl_bin_slave_start(const char *master_ip, int master_port,
                 const char *path, uint64_t ts, int redo_port, uint64_t sid, char *ds_key);
 #endif
@@ -9,6 +9,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/uio.h>
 
 #include "pf_file.h"
 #include "tcp_util.h"
@@ -16,11 +17,27 @@
 #include "zmalloc.h"
 #include "log.h"
 
-int repl_send_slave(int net_fd, uint8_t *rec, uint8_t flag, uint32_t len, uint64_t ts)
+static void repl_fill_header(repl_header_t *header, uint8_t flag, uint32_t len, uint64_t ts)
 {
-    int i;
     uint32_t net_len;
     uint64_t net_ts;
+
+    memset(header, 0x00, sizeof(*header));
+    header->magic[0] = REPL_MAGIC_1;
+    header->magic[1] = REPL_MAGIC_2;
+
+    header->flag = flag;
+
+    net_len = htonl(len);
+    memcpy(header->len, &net_len, sizeof(net_len));
+
+    net_ts = hton64(&ts);
+    memcpy(header->ts, &net_ts, sizeof(net_ts));
+}
+
+int repl_send_slave(int net_fd, uint8_t *rec, uint8_t flag, uint32_t len, uint64_t ts)
+{
+    int i;
     struct iovec repl_iov[2];
     repl_header_t header;
 
@@ -30,16 +47,7 @@ int repl_send_slave(int net_fd, uint8_t *rec, uint8_t flag, uint32_t len, uint64
         return -1;
     }
 
-    header.magic[0] = REPL_MAGIC_1;
-    header.magic[1] = REPL_MAGIC_2;
-
-    header.flag = flag;
-
-    net_len = htonl(len);
-    memcpy(header.len, &net_len, sizeof(net_len));
-
-    net_ts = hton64(&ts);
-    memcpy(header.ts, &net_ts, sizeof(net_ts));
+    repl_fill_header(&header, flag, len, ts);
 
     repl_iov[0].iov_base = (void *)&header;
     repl_iov[0].iov_len  = sizeof(repl_header_t);
@@ -56,6 +64,33 @@ int repl_send_slave(int net_fd, uint8_t *rec, uint8_t flag, uint32_t len, uint64
     return 0;
 }
 
+/* pack a data frame the same as repl_send_slave() sends into dst,
+ * which must have REPL_FRAME_SIZE(len) bytes */
+uint32_t repl_pack_rec(uint8_t *dst, const uint8_t *rec, uint32_t len, uint64_t ts)
+{
+    repl_header_t header;
+
+    repl_fill_header(&header, REPL_FLAG_DATA, len, ts);
+    memcpy(dst, &header, sizeof(header));
+    memcpy(dst + sizeof(header), rec, len);
+
+    return REPL_FRAME_SIZE(len);
+}
+
+/* send packed frames */
+int repl_send_frames(int net_fd, struct iovec *iov, int cnt, size_t total)
+{
+    int i;
+
+    i = pf_writev_n(net_fd, PF_FD_NONBLOCK, iov, cnt, -1);
+    if (i != (int)total)
+    {
+        log_error("send bin records to slave error, ret [%d] len [%u], error[%s]", i, (unsigned)total, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
 /* slave will consider master is down if not recv data in MAX_RECV_MASTER_TIMEOUT */ 
 #define MAX_RECV_MASTER_TIMEOUT (3 * 60 * 1000)
 //#define MAX_RECV_MASTER_TIMEOUT (5000)
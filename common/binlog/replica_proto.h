@@ -23,7 +23,14 @@ typedef struct repl_header
     uint64_t    ts[8]; 
 }repl_header_t;
 
+/* bytes of a data frame: header + record */
+#define REPL_FRAME_SIZE(len) (sizeof(repl_header_t) + (len))
+
+struct iovec;
+
 int repl_send_slave(int net_fd, uint8_t *rec, uint8_t flag, uint32_t len, uint64_t ts);
+uint32_t repl_pack_rec(uint8_t *dst, const uint8_t *rec, uint32_t len, uint64_t ts);
+int repl_send_frames(int net_fd, struct iovec *iov, int cnt, size_t total);
 int repl_recv_master(int net_fd, uint8_t **rec, uint32_t *len, uint64_t *ts);
 int repl_slave_init_send(int net_fd, uint64_t ts, uint64_t sid, const char *ds_key);
 int repl_slave_redo_send_data(int net_fd, uint8_t *rec, uint32_t len, uint64_t sid);
@@ -196,4 +196,27 @@ void  mng_print_thread_status()
     }
 }
 
+/* max lag of all master threads */
+uint64_t mng_get_master_lag(int *masters)
+{
+    int i;
+    int cnt = 0;
+    uint64_t lag = 0;
+    repl_thread_grp_t *grp = manager.grp_arr;
 
+    for (i = 0; i < REPL_MAX_GRP_NUM; i++)
+    {
+        if (grp->net_mark[0] != 0 && grp->ths[REPL_MASTER_TH].arg != NULL)
+        {
+            cnt++;
+            if (grp->master_lag_us > lag)
+            {
+                lag = grp->master_lag_us;
+            }
+        }    
+        grp++;
+    }
+
+    if (masters) *masters = cnt;
+    return lag;
+}
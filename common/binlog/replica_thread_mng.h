@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <pthread.h>
+#include <inttypes.h>
 
 #define REPL_MAX_GRP_NUM  256 
 
@@ -23,6 +24,8 @@ typedef enum
 
 typedef void (*freeres_func)(void *c);
 typedef int (*filter_func)(const char *bl_ptr, int bl_len, const char *ds_key); 
+/* filter cnt records at once, drop[i] is set to 1 if record i is forbidden */
+typedef void (*filter_bulk_func)(const char **bl_ptrs, const int *bl_lens, int cnt, const char *ds_key, char *drop); 
 
 typedef struct
 {
@@ -41,6 +44,7 @@ typedef struct
     void                   *res;
     freeres_func            free_res;
     filter_func             filter; 
+    filter_bulk_func        filter_bulk; 
 }repl_thread_arg_t;
 
 typedef struct
@@ -57,6 +61,7 @@ typedef struct
     char                    net_mark[64];
     repl_thread_t           ths[3]; 
     uint64_t                remote_ts;
+    uint64_t                master_lag_us;  /* now - ts of last record sent, 0 if caught up */
 }repl_thread_grp_t;
 
 typedef struct
@@ -72,6 +77,7 @@ extern void  mng_print_thread_status();
 extern int mng_thread_create(int type, pthread_t *thread, const pthread_attr_t *attr, void *(*start_routine)(void*), repl_thread_arg_t *arg);
 extern int is_thread_should_stop(repl_thread_t *rt);
 extern int is_grp_all_dead(repl_thread_grp_t *grp);
+extern uint64_t mng_get_master_lag(int *masters);
 
 
 #endif
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "pf_crc.h"
+#include "crc32c.h"
+
+/* bytes checksummed per size per implementation */
+#define BENCH_TOTAL (256ULL * 1024 * 1024)
+
+static uint64_t now_us(void)
+{
+    struct timespec cur;
+    clock_gettime(CLOCK_MONOTONIC, &cur);
+    return (uint64_t)cur.tv_sec * 1000000ULL + cur.tv_nsec / 1000ULL;
+}
+
+static uint32_t crc16_rec(uint32_t crc, const void *buf, size_t len)
+{
+    pf_crc16_t *crc_p = pf_crc16_start();
+    pf_crc16_append(crc_p, buf, len);
+    return crc ^ pf_crc16_finish(crc_p);
+}
+
+typedef uint32_t (*crc_func)(uint32_t, const void *, size_t);
+
+static void bench(const char *name, crc_func f, const uint8_t *buf, size_t len)
+{
+    uint64_t loops = BENCH_TOTAL / len;
+    uint64_t i;
+    uint32_t crc = 0;
+
+    if (loops == 0) loops = 1;
+
+    const uint64_t start = now_us();
+    for (i = 0; i < loops; i++)
+    {
+        crc = f(crc, buf, len);
+    }
+    const uint64_t cost = now_us() - start;
+
+    printf("%-10s len=%-8zu loops=%-9"PRIu64" cost=%-9"PRIu64"us %8.1f MB/s (crc=%08x)\n",
+           name, len, loops, cost,
+           cost ? (double)(loops * len) / cost : 0.0, crc);
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t sizes[] = {64, 512, 4096, 65536, 1024 * 1024};
+    size_t max = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+    size_t i;
+
+    (void)argc;
+    (void)argv;
+
+    uint8_t *buf = (uint8_t *)malloc(max);
+    for (i = 0; i < max; i++)
+    {
+        buf[i] = (uint8_t)rand();
+    }
+
+    if (crc32c_sw(0, "123456789", 9) != 0xe3069283
+        || crc32c_hw(0, "123456789", 9) != 0xe3069283)
+    {
+        printf("crc32c check value mismatch\n");
+        return -1;
+    }
+
+    printf("sse4.2: %s\n", crc32c_hw_available() ? "yes" : "no");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        bench("crc16", crc16_rec, buf, sizes[i]);
+        bench("crc32c-sw", crc32c_sw, buf, sizes[i]);
+        if (crc32c_hw_available())
+        {
+            bench("crc32c-hw", crc32c_hw, buf, sizes[i]);
+        }
+    }
+
+    free(buf);
+    return 0;
+}
@@ -232,6 +232,137 @@ void consistent_hash_destory(serv_node_info_t *sni)
 	}
 }
 
+/* index of the first vnode with end >= hcode, count if none */
+static uint32_t ch_lower_bound(const serv_vnode_t *v, uint32_t lo, uint32_t hi, uint64_t hcode)
+{
+    while (lo < hi)
+    {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (v[mid].end < hcode)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+ch_route_t* ch_route_create(serv_node_info_t *sni)
+{
+    ch_route_t *route;
+    uint32_t    count;
+    uint32_t    s;
+
+    if (sni == NULL || sni->num_vpoints <= 0)
+    {
+        return NULL;
+    }
+
+    route = malloc(sizeof(ch_route_t));
+    if (route == NULL)
+    {
+        return NULL;
+    }
+    route->sni = sni;
+    count = sni->num_vpoints;
+
+    for (s = 0; s < CH_SLOT_CNT; s++)
+    {
+        const uint64_t start = (uint64_t)s << (64 - CH_SLOT_BITS);
+        route->first[s] = ch_lower_bound(sni->v_servers, 0, count, start);
+    }
+    route->first[CH_SLOT_CNT] = count;
+
+    for (s = 0; s < CH_SLOT_CNT; s++)
+    {
+        /* a key of the slot goes to a vnode in [first[s], first[s + 1]],
+         * count means past the last one, which wraps to the first one */
+        const uint32_t lo = route->first[s];
+        const uint32_t hi = route->first[s + 1];
+        const int point = sni->v_servers[lo == count ? 0 : lo].sn->point;
+        uint32_t j;
+
+        route->owner[s] = point;
+        for (j = lo + 1; j <= hi; j++)
+        {
+            if (sni->v_servers[j == count ? 0 : j].sn->point != point)
+            {
+                route->owner[s] = -1;
+                break;
+            }
+        }
+    }
+
+    return route;
+}
+
+void ch_route_destroy(ch_route_t *route)
+{
+    if (route)
+    {
+        consistent_hash_destory(route->sni);
+        free(route);
+    }
+}
+
+int ch_route_point(const ch_route_t *route, const char *server_key)
+{
+    int i;
+
+    if (route == NULL || server_key == NULL)
+    {
+        return -1;
+    }
+    for (i = 0; i < route->sni->numpoints; i++)
+    {
+        if (strcmp(route->sni->servers[i].server_key, server_key) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int ch_route_get(const ch_route_t *route, const char *key, int key_len)
+{
+    const serv_node_info_t *sni;
+    uint64_t hcode;
+    uint32_t slot;
+    uint32_t idx;
+
+    if (route == NULL || key == NULL)
+    {
+        return -1;
+    }
+
+    hcode = ch_hash(key, key_len);
+    slot = (uint32_t)(hcode >> (64 - CH_SLOT_BITS));
+    if (route->owner[slot] >= 0)
+    {
+        return route->owner[slot];
+    }
+
+    sni = route->sni;
+    idx = ch_lower_bound(sni->v_servers, route->first[slot], route->first[slot + 1], hcode);
+    if (idx == (uint32_t)sni->num_vpoints)
+    {
+        idx = 0;
+    }
+    return sni->v_servers[idx].sn->point;
+}
+
+void ch_route_get_bulk(const ch_route_t *route, const char *const keys[], const int key_lens[], int cnt, int points[])
+{
+    int i;
+    for (i = 0; i < cnt; i++)
+    {
+        points[i] = keys[i] ? ch_route_get(route, keys[i], key_lens[i]) : -1;
+    }
+}
+
 #if 0
 void gen_random(char *s, const int len)
 {
@@ -32,5 +32,29 @@ extern serv_node_info_t* consistent_hash_init(const char *const nodes[], int cou
 extern serv_node_t* ch_get_server(serv_node_info_t *sni, const char *key, int key_len);
 extern void consistent_hash_destory(serv_node_info_t *sni);
 
+/* routing table over the ring: the hash space is cut into CH_SLOT_CNT
+ * slots by the high bits of ch_hash(), a slot inside one vnode range has
+ * its owner precomputed, only a slot holding a vnode boundary searches
+ * the few vnodes ending in it. the result is the same as ch_get_server().
+ * it is immutable after created and can be read by threads without lock */
+#define CH_SLOT_BITS                   14
+#define CH_SLOT_CNT                    (1 << CH_SLOT_BITS)
+
+typedef struct ch_route
+{
+    serv_node_info_t *sni;
+    int16_t          owner[CH_SLOT_CNT];       /* point of servers, -1: search */
+    uint32_t         first[CH_SLOT_CNT + 1];   /* first vnode ending in or after the slot */
+}ch_route_t;
+
+/* sni is taken over on success, released by ch_route_destroy() */
+extern ch_route_t* ch_route_create(serv_node_info_t *sni);
+extern void ch_route_destroy(ch_route_t *route);
+/* return: point of the server in sni->servers, -1 if the server_key is absent */
+extern int ch_route_point(const ch_route_t *route, const char *server_key);
+/* return: point of the server owning the key, -1 if no server */
+extern int ch_route_get(const ch_route_t *route, const char *key, int key_len);
+extern void ch_route_get_bulk(const ch_route_t *route, const char *const keys[], const int key_lens[], int cnt, int points[]);
+
 #endif /* _CONSISTENCE_HASH_H_ */
 
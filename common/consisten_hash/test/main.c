@@ -182,8 +182,35 @@ int main(int argc, char **argv)
     free(cnt);
     cnt = 0;
 
-    consistent_hash_destory(cont);
+    /* the route table must give the same server as the ring */
+    ch_route_t *route = ch_route_create(cont);
+    if (route == 0)
+    {
+        printf("ch_route_create() fail\n");
+        consistent_hash_destory(cont);
+        return 1;
+    }
+    int direct = 0;
+    for (i = 0; i < CH_SLOT_CNT; i++)
+    {
+        direct += route->owner[i] >= 0 ? 1 : 0;
+    }
+    int mismatch = 0;
+    for (i = 0; i < num; i++)
+    {
+        get_randon_key(key, sizeof(key));
+        const int key_len = strlen(key);
+        serv = ch_get_server(cont, key, key_len);
+        if (serv == 0 || (int)serv->point != ch_route_get(route, key, key_len))
+        {
+            mismatch++;
+        }
+    }
+    printf("route: %d of %d slots owned by one server, %d mismatch in %d keys\n"
+           , direct, CH_SLOT_CNT, mismatch, num);
+
+    ch_route_destroy(route);
 
-    return 0;
+    return mismatch == 0 ? 0 : 1;
 }
 
@@ -0,0 +1,1543 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "log_dbe.h"
+
+/* crc32 | klen | vlen | type */
+#define LDB_HDR_SIZE        13
+#define LDB_REC_PUT         1
+#define LDB_REC_DEL         2
+
+#define LDB_MAX_LEVEL       24
+/* a sealed segment is compacted when so many percent of it is dead */
+#define LDB_GC_PCT          50
+/* bytes of records moved by compaction under one hold of the locks */
+#define LDB_GC_BATCH        (1 << 20)
+#define LDB_GC_INTERVAL_MS  1000
+/* bytes of records written by one ldb_write() of ldb_merge() */
+#define LDB_MERGE_BATCH     (1 << 20)
+
+#define REC_SIZE(kl, vl)    ((uint64_t)LDB_HDR_SIZE + (kl) + (vl))
+
+typedef struct ldb_node
+{
+    uint64_t off;           /* of the last record of the key */
+    uint32_t seg;
+    uint32_t klen;
+    uint32_t vlen;
+    int      level;
+    struct ldb_node *next[];    /* key follows */
+} ldb_node_t;
+
+#define NODE_KEY(n)         ((char *)&(n)->next[(n)->level])
+
+typedef struct ldb_seg
+{
+    uint32_t id;
+    int      fd;
+    uint64_t size;
+    uint64_t dead;          /* overwritten or deleted records */
+    uint64_t tombs;         /* tombstones, dropped when the segment is the oldest */
+} ldb_seg_t;
+
+/* lock order: gc_lock, wr_lock, lock.
+ * the index is changed only under wr_lock and lock both, so a writer
+ * holding wr_lock reads it without lock, the segment array likewise */
+struct ldb
+{
+    char    *dir;
+    int      read_only;
+    uint64_t seg_size;
+
+    pthread_mutex_t  wr_lock;   /* one writer at a time */
+    pthread_rwlock_t lock;      /* index and segments */
+    ldb_node_t *head;
+    int      level;
+    uint32_t rnd;
+    uint64_t keys;
+    ldb_seg_t *segs;            /* sorted by id, the last one is active */
+    int      seg_cnt;
+    int      seg_cap;
+
+    ldb_key_filter_t kf;
+    ldb_val_filter_t vf;
+    volatile int frozen;
+
+    pthread_mutex_t gc_lock;    /* one compaction at a time */
+    pthread_mutex_t gc_mutex;
+    pthread_cond_t  gc_cond;
+    pthread_t gc_tid;
+    int gc_running;
+    int gc_stop;
+
+    uint64_t compactions;
+    uint64_t moved_bytes;
+    uint64_t filtered_keys;
+    uint64_t corrupt_bytes;
+};
+
+struct ldb_iter
+{
+    ldb_t   *db;
+    char    *prefix;
+    size_t   plen;
+    uint32_t min_seg;
+    char    *last;              /* key returned last time */
+    size_t   last_len;
+    size_t   last_cap;
+    int      started;
+};
+
+/* records of a segment being compacted */
+typedef struct gc_rec
+{
+    int         type;
+    int         drop;           /* by the filters */
+    const char *k;
+    uint32_t    ks;
+    const char *v;
+    uint32_t    vs;
+    uint64_t    off;
+} gc_rec_t;
+
+/*---------------------------------- crc32 ----------------------------------*/
+
+static uint32_t sc_crc_tab[256];
+static pthread_once_t sc_crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init()
+{
+    uint32_t i, j;
+    for (i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (j = 0; j < 8; j++)
+        {
+            c = (c & 1) ? (c >> 1) ^ 0xEDB88320U : c >> 1;
+        }
+        sc_crc_tab[i] = c;
+    }
+}
+
+static uint32_t crc32(const char *buf, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)buf;
+    uint32_t c = 0xFFFFFFFFU;
+    while (len--)
+    {
+        c = sc_crc_tab[(c ^ *p++) & 0xFF] ^ (c >> 8);
+    }
+    return c ^ 0xFFFFFFFFU;
+}
+
+/*--------------------------------- records ---------------------------------*/
+
+static size_t rec_encode(char *buf, int type, const char *k, size_t ks, const char *v, size_t vs)
+{
+    uint32_t u = (uint32_t)ks;
+    memcpy(buf + 4, &u, 4);
+    u = (uint32_t)vs;
+    memcpy(buf + 8, &u, 4);
+    buf[12] = (char)type;
+    memcpy(buf + LDB_HDR_SIZE, k, ks);
+    if (vs)
+    {
+        memcpy(buf + LDB_HDR_SIZE + ks, v, vs);
+    }
+    u = crc32(buf + 4, LDB_HDR_SIZE - 4 + ks + vs);
+    memcpy(buf, &u, 4);
+    return REC_SIZE(ks, vs);
+}
+
+/* return: size of the record at p, 0 - broken */
+static size_t rec_parse(const char *p, size_t avail, int check, int *type,
+                        const char **k, uint32_t *ks, const char **v, uint32_t *vs)
+{
+    uint32_t crc;
+    if (avail < LDB_HDR_SIZE)
+    {
+        return 0;
+    }
+    memcpy(&crc, p, 4);
+    memcpy(ks, p + 4, 4);
+    memcpy(vs, p + 8, 4);
+    *type = p[12];
+    const uint64_t size = REC_SIZE(*ks, *vs);
+    if ((*type != LDB_REC_PUT && *type != LDB_REC_DEL) || *ks == 0 || size > avail)
+    {
+        return 0;
+    }
+    if (check && crc32(p + 4, size - 4) != crc)
+    {
+        return 0;
+    }
+    *k = p + LDB_HDR_SIZE;
+    *v = p + LDB_HDR_SIZE + *ks;
+    return size;
+}
+
+static int pwrite_full(int fd, const char *buf, size_t len, uint64_t off)
+{
+    while (len > 0)
+    {
+        const ssize_t ret = pwrite(fd, buf, len, (off_t)off);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        buf += ret;
+        len -= ret;
+        off += ret;
+    }
+    return 0;
+}
+
+static int pread_full(int fd, char *buf, size_t len, uint64_t off)
+{
+    while (len > 0)
+    {
+        const ssize_t ret = pread(fd, buf, len, (off_t)off);
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ret <= 0)
+        {
+            return -1;
+        }
+        buf += ret;
+        len -= ret;
+        off += ret;
+    }
+    return 0;
+}
+
+/*-------------------------------- segments ---------------------------------*/
+
+static void seg_path(const ldb_t *db, uint32_t id, char *path, size_t size)
+{
+    snprintf(path, size, "%s/%08u.ldb", db->dir, id);
+}
+
+static ldb_seg_t *seg_find(const ldb_t *db, uint32_t id)
+{
+    int l = 0;
+    int r = db->seg_cnt - 1;
+    while (l <= r)
+    {
+        const int m = (l + r) >> 1;
+        if (db->segs[m].id == id)
+        {
+            return &db->segs[m];
+        }
+        if (db->segs[m].id < id)
+        {
+            l = m + 1;
+        }
+        else
+        {
+            r = m - 1;
+        }
+    }
+    return NULL;
+}
+
+static ldb_seg_t *seg_add(ldb_t *db, uint32_t id, int fd, uint64_t size)
+{
+    if (db->seg_cnt == db->seg_cap)
+    {
+        const int cap = db->seg_cap ? db->seg_cap * 2 : 16;
+        ldb_seg_t *segs = realloc(db->segs, cap * sizeof(ldb_seg_t));
+        if (segs == NULL)
+        {
+            return NULL;
+        }
+        db->segs = segs;
+        db->seg_cap = cap;
+    }
+    ldb_seg_t *s = &db->segs[db->seg_cnt++];
+    memset(s, 0, sizeof(*s));
+    s->id = id;
+    s->fd = fd;
+    s->size = size;
+    return s;
+}
+
+static int seg_create(ldb_t *db, uint32_t id)
+{
+    char path[PATH_MAX];
+    seg_path(db, id, path, sizeof(path));
+    const int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return LDB_ERR_IO;
+    }
+    if (seg_add(db, id, fd, 0) == NULL)
+    {
+        close(fd);
+        unlink(path);
+        return LDB_ERR_IO;
+    }
+    return LDB_OK;
+}
+
+/* make the entries created or unlinked in dir durable */
+static int dir_sync(const ldb_t *db)
+{
+    const int fd = open(db->dir, O_RDONLY);
+    if (fd < 0)
+    {
+        return LDB_ERR_IO;
+    }
+    const int ret = fsync(fd);
+    close(fd);
+    return ret == 0 ? LDB_OK : LDB_ERR_IO;
+}
+
+static void seg_remove(ldb_t *db, uint32_t id)
+{
+    ldb_seg_t *s = seg_find(db, id);
+    if (s == NULL)
+    {
+        return;
+    }
+    char path[PATH_MAX];
+    seg_path(db, id, path, sizeof(path));
+    close(s->fd);
+    unlink(path);
+    const int idx = s - db->segs;
+    memmove(s, s + 1, (db->seg_cnt - idx - 1) * sizeof(ldb_seg_t));
+    db->seg_cnt--;
+}
+
+/*--------------------------------- index -----------------------------------*/
+
+static int key_cmp(const char *k1, size_t l1, const char *k2, size_t l2)
+{
+    const int ret = memcmp(k1, k2, l1 < l2 ? l1 : l2);
+    if (ret != 0)
+    {
+        return ret;
+    }
+    return l1 < l2 ? -1 : l1 > l2 ? 1 : 0;
+}
+
+static ldb_node_t *node_new(int level, const char *k, size_t klen)
+{
+    ldb_node_t *n = malloc(sizeof(ldb_node_t) + level * sizeof(ldb_node_t *) + klen);
+    if (n == NULL)
+    {
+        return NULL;
+    }
+    memset(n, 0, sizeof(ldb_node_t) + level * sizeof(ldb_node_t *));
+    n->level = level;
+    n->klen = (uint32_t)klen;
+    memcpy(NODE_KEY(n), k, klen);
+    return n;
+}
+
+/* the first node >= key (> key if gt), update[i] is the last node before it at level i */
+static ldb_node_t *find(const ldb_t *db, const char *k, size_t klen, int gt, ldb_node_t **update)
+{
+    ldb_node_t *x = db->head;
+    int i;
+    for (i = db->level - 1; i >= 0; i--)
+    {
+        for (;;)
+        {
+            ldb_node_t *nx = x->next[i];
+            if (nx == NULL)
+            {
+                break;
+            }
+            const int cmp = key_cmp(NODE_KEY(nx), nx->klen, k, klen);
+            if (cmp > 0 || (cmp == 0 && !gt))
+            {
+                break;
+            }
+            x = nx;
+        }
+        if (update)
+        {
+            update[i] = x;
+        }
+    }
+    return x->next[0];
+}
+
+static ldb_node_t *find_eq(const ldb_t *db, const char *k, size_t klen)
+{
+    ldb_node_t *n = find(db, k, klen, 0, NULL);
+    if (n && key_cmp(NODE_KEY(n), n->klen, k, klen) == 0)
+    {
+        return n;
+    }
+    return NULL;
+}
+
+static int random_level(ldb_t *db)
+{
+    int level = 1;
+    while (level < LDB_MAX_LEVEL)
+    {
+        db->rnd = db->rnd * 1103515245 + 12345;
+        if (((db->rnd >> 16) & 3) != 0)
+        {
+            break;
+        }
+        level++;
+    }
+    return level;
+}
+
+static void mark_dead(ldb_t *db, uint32_t seg, uint64_t size)
+{
+    ldb_seg_t *s = seg_find(db, seg);
+    if (s)
+    {
+        s->dead += size;
+    }
+}
+
+static int index_put(ldb_t *db, const char *k, size_t klen, uint32_t seg, uint64_t off, uint32_t vlen)
+{
+    ldb_node_t *update[LDB_MAX_LEVEL];
+    ldb_node_t *n = find(db, k, klen, 0, update);
+    int i;
+    if (n && key_cmp(NODE_KEY(n), n->klen, k, klen) == 0)
+    {
+        mark_dead(db, n->seg, REC_SIZE(n->klen, n->vlen));
+        n->seg = seg;
+        n->off = off;
+        n->vlen = vlen;
+        return 0;
+    }
+
+    const int level = random_level(db);
+    n = node_new(level, k, klen);
+    if (n == NULL)
+    {
+        return -1;
+    }
+    if (level > db->level)
+    {
+        for (i = db->level; i < level; i++)
+        {
+            update[i] = db->head;
+        }
+        db->level = level;
+    }
+    n->seg = seg;
+    n->off = off;
+    n->vlen = vlen;
+    for (i = 0; i < level; i++)
+    {
+        n->next[i] = update[i]->next[i];
+        update[i]->next[i] = n;
+    }
+    db->keys++;
+    return 0;
+}
+
+/* return: 1 - deleted; 0 - not found */
+static int index_del(ldb_t *db, const char *k, size_t klen)
+{
+    ldb_node_t *update[LDB_MAX_LEVEL];
+    ldb_node_t *n = find(db, k, klen, 0, update);
+    int i;
+    if (n == NULL || key_cmp(NODE_KEY(n), n->klen, k, klen) != 0)
+    {
+        return 0;
+    }
+    mark_dead(db, n->seg, REC_SIZE(n->klen, n->vlen));
+    for (i = 0; i < n->level; i++)
+    {
+        if (update[i]->next[i] == n)
+        {
+            update[i]->next[i] = n->next[i];
+        }
+    }
+    free(n);
+    while (db->level > 1 && db->head->next[db->level - 1] == NULL)
+    {
+        db->level--;
+    }
+    db->keys--;
+    return 1;
+}
+
+static void index_free(ldb_t *db)
+{
+    ldb_node_t *n = db->head->next[0];
+    while (n)
+    {
+        ldb_node_t *next = n->next[0];
+        free(n);
+        n = next;
+    }
+    memset(db->head->next, 0, LDB_MAX_LEVEL * sizeof(ldb_node_t *));
+    db->level = 1;
+    db->keys = 0;
+}
+
+/* index the records written at base of segment seg, under lock */
+static int apply_locked(ldb_t *db, uint32_t seg, uint64_t base, const char *buf, size_t len)
+{
+    size_t pos = 0;
+    while (pos < len)
+    {
+        int type;
+        const char *k, *v;
+        uint32_t ks, vs;
+        const size_t size = rec_parse(buf + pos, len - pos, 0, &type, &k, &ks, &v, &vs);
+        if (size == 0)
+        {
+            return -1;
+        }
+        if (type == LDB_REC_PUT)
+        {
+            if (index_put(db, k, ks, seg, base + pos, vs) != 0)
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            ldb_seg_t *s = seg_find(db, seg);
+            if (index_del(db, k, ks))
+            {
+                s->tombs += size;
+            }
+            else
+            {
+                /* nothing to delete, useless at once */
+                s->dead += size;
+            }
+        }
+        pos += size;
+    }
+    return 0;
+}
+
+/*--------------------------------- writes ----------------------------------*/
+
+/* append records to the active segment, under wr_lock */
+static int append(ldb_t *db, const char *buf, size_t len)
+{
+    ldb_seg_t *act = &db->segs[db->seg_cnt - 1];
+    if (act->size > 0 && act->size + len > db->seg_size)
+    {
+        /* compaction relies on a sealed segment being on disk */
+        if (fdatasync(act->fd) != 0)
+        {
+            return LDB_ERR_IO;
+        }
+        pthread_rwlock_wrlock(&db->lock);
+        const int ret = seg_create(db, act->id + 1);
+        pthread_rwlock_unlock(&db->lock);
+        if (ret != LDB_OK)
+        {
+            return ret;
+        }
+        act = &db->segs[db->seg_cnt - 1];
+    }
+
+    /* readers go on, the records are invisible till indexed.
+     * if it fails, the part written is overwritten by the next one */
+    const uint64_t off = act->size;
+    if (pwrite_full(act->fd, buf, len, off) != 0)
+    {
+        return LDB_ERR_IO;
+    }
+
+    pthread_rwlock_wrlock(&db->lock);
+    act->size += len;
+    const int ret = apply_locked(db, act->id, off, buf, len);
+    pthread_rwlock_unlock(&db->lock);
+    return ret == 0 ? LDB_OK : LDB_ERR_IO;
+}
+
+int ldb_write(ldb_t *db, const ldb_kv_t *puts, size_t put_cnt, const ldb_kv_t *dels, size_t del_cnt)
+{
+    size_t i;
+    uint64_t total = 0;
+    if (db == NULL || db->read_only)
+    {
+        return LDB_ERR_ARG;
+    }
+    for (i = 0; i < put_cnt; i++)
+    {
+        if (puts[i].k == NULL || puts[i].ks == 0 || puts[i].ks > UINT32_MAX || puts[i].vs > UINT32_MAX)
+        {
+            return LDB_ERR_ARG;
+        }
+        total += REC_SIZE(puts[i].ks, puts[i].vs);
+    }
+    for (i = 0; i < del_cnt; i++)
+    {
+        if (dels[i].k == NULL || dels[i].ks == 0 || dels[i].ks > UINT32_MAX)
+        {
+            return LDB_ERR_ARG;
+        }
+        total += REC_SIZE(dels[i].ks, 0);
+    }
+    if (total == 0)
+    {
+        return LDB_OK;
+    }
+
+    char *buf = malloc(total);
+    if (buf == NULL)
+    {
+        return LDB_ERR_IO;
+    }
+    size_t len = 0;
+    for (i = 0; i < put_cnt; i++)
+    {
+        len += rec_encode(buf + len, LDB_REC_PUT, puts[i].k, puts[i].ks, puts[i].v, puts[i].vs);
+    }
+    for (i = 0; i < del_cnt; i++)
+    {
+        len += rec_encode(buf + len, LDB_REC_DEL, dels[i].k, dels[i].ks, NULL, 0);
+    }
+
+    pthread_mutex_lock(&db->wr_lock);
+    const int ret = append(db, buf, len);
+    pthread_mutex_unlock(&db->wr_lock);
+    free(buf);
+    return ret;
+}
+
+int ldb_put(ldb_t *db, const char *k, size_t ks, const char *v, size_t vs)
+{
+    ldb_kv_t kv;
+    kv.k = (char *)k;
+    kv.ks = ks;
+    kv.v = (char *)v;
+    kv.vs = vs;
+    return ldb_write(db, &kv, 1, NULL, 0);
+}
+
+int ldb_del(ldb_t *db, const char *k, size_t ks)
+{
+    ldb_kv_t kv;
+    kv.k = (char *)k;
+    kv.ks = ks;
+    kv.v = NULL;
+    kv.vs = 0;
+    return ldb_write(db, NULL, 0, &kv, 1);
+}
+
+static int has_prefix(const ldb_node_t *n, const char *prefix, size_t len)
+{
+    return n->klen >= len && memcmp(NODE_KEY(n), prefix, len) == 0;
+}
+
+int ldb_pdel(ldb_t *db, const char *prefix, size_t len)
+{
+    if (db == NULL || db->read_only || (prefix == NULL && len > 0))
+    {
+        return LDB_ERR_ARG;
+    }
+
+    pthread_mutex_lock(&db->wr_lock);
+
+    /* no one else changes the index under wr_lock */
+    size_t total = 0;
+    ldb_node_t *first = find(db, prefix, len, 0, NULL);
+    ldb_node_t *n;
+    for (n = first; n && has_prefix(n, prefix, len); n = n->next[0])
+    {
+        total += REC_SIZE(n->klen, 0);
+    }
+
+    int ret = LDB_OK;
+    if (total > 0)
+    {
+        char *buf = malloc(total);
+        if (buf == NULL)
+        {
+            ret = LDB_ERR_IO;
+        }
+        else
+        {
+            size_t pos = 0;
+            for (n = first; n && has_prefix(n, prefix, len); n = n->next[0])
+            {
+                pos += rec_encode(buf + pos, LDB_REC_DEL, NODE_KEY(n), n->klen, NULL, 0);
+            }
+            ret = append(db, buf, pos);
+            free(buf);
+        }
+    }
+
+    pthread_mutex_unlock(&db->wr_lock);
+    return ret;
+}
+
+int ldb_get(ldb_t *db, const char *k, size_t ks, char **v, size_t *vs, ldb_alloc_t f)
+{
+    if (db == NULL || k == NULL || ks == 0 || v == NULL || f == NULL)
+    {
+        return LDB_ERR_ARG;
+    }
+    *v = NULL;
+    if (vs)
+    {
+        *vs = 0;
+    }
+
+    pthread_rwlock_rdlock(&db->lock);
+    const ldb_node_t *n = find_eq(db, k, ks);
+    if (n == NULL)
+    {
+        pthread_rwlock_unlock(&db->lock);
+        return LDB_NOT_FOUND;
+    }
+    const ldb_seg_t *s = seg_find(db, n->seg);
+    char *buf = f(n->vlen + 1);
+    int ret = LDB_OK;
+    if (buf == NULL)
+    {
+        ret = LDB_ERR_IO;
+    }
+    else if (s == NULL || pread_full(s->fd, buf, n->vlen, n->off + LDB_HDR_SIZE + n->klen) != 0)
+    {
+        /* allocated by f, the caller has its free(), hand it back empty */
+        ret = LDB_ERR_IO;
+        buf[0] = 0;
+        *v = buf;
+    }
+    else
+    {
+        buf[n->vlen] = 0;
+        *v = buf;
+        if (vs)
+        {
+            *vs = n->vlen;
+        }
+    }
+    pthread_rwlock_unlock(&db->lock);
+    return ret;
+}
+
+/*------------------------------- compaction --------------------------------*/
+
+static char *read_seg(int fd, uint64_t size)
+{
+    char *buf = malloc(size ? size : 1);
+    if (buf && size > 0 && pread_full(fd, buf, size, 0) != 0)
+    {
+        free(buf);
+        buf = NULL;
+    }
+    return buf;
+}
+
+/* move the live ones of recs into the active segment, under wr_lock */
+static int gc_commit(ldb_t *db, uint32_t id, int oldest, gc_rec_t *recs, int cnt, char *out)
+{
+    size_t len = 0;
+    uint64_t moved = 0;
+    int dropped = 0;
+    int i;
+    for (i = 0; i < cnt; i++)
+    {
+        gc_rec_t *r = &recs[i];
+        const ldb_node_t *n = find_eq(db, r->k, r->ks);
+        if (r->type == LDB_REC_PUT)
+        {
+            if (n == NULL || n->seg != id || n->off != r->off)
+            {
+                /* overwritten or deleted later */
+                r->type = 0;
+            }
+            else if (r->drop)
+            {
+                /* a tombstone hides the records of older segments */
+                if (!oldest)
+                {
+                    len += rec_encode(out + len, LDB_REC_DEL, r->k, r->ks, NULL, 0);
+                }
+                dropped++;
+            }
+            else
+            {
+                len += rec_encode(out + len, LDB_REC_PUT, r->k, r->ks, r->v, r->vs);
+                moved += REC_SIZE(r->ks, r->vs);
+            }
+        }
+        else if (n == NULL && !oldest)
+        {
+            /* still deleted, older segments may have the key */
+            len += rec_encode(out + len, LDB_REC_DEL, r->k, r->ks, NULL, 0);
+        }
+    }
+
+    int ret = len > 0 ? append(db, out, len) : LDB_OK;
+    if (ret != LDB_OK)
+    {
+        return ret;
+    }
+
+    pthread_rwlock_wrlock(&db->lock);
+    if (oldest && dropped > 0)
+    {
+        for (i = 0; i < cnt; i++)
+        {
+            if (recs[i].type == LDB_REC_PUT && recs[i].drop)
+            {
+                index_del(db, recs[i].k, recs[i].ks);
+            }
+        }
+    }
+    db->moved_bytes += moved;
+    db->filtered_keys += dropped;
+    pthread_rwlock_unlock(&db->lock);
+    return LDB_OK;
+}
+
+/* rewrite the live records of a sealed segment and remove it, under gc_lock */
+static int compact_seg(ldb_t *db, uint32_t id)
+{
+    pthread_rwlock_rdlock(&db->lock);
+    const ldb_seg_t *s = seg_find(db, id);
+    if (s == NULL || s == &db->segs[db->seg_cnt - 1])
+    {
+        pthread_rwlock_unlock(&db->lock);
+        return LDB_ERR_ARG;
+    }
+    /* sealed, nothing writes it, and only compaction closes it */
+    const int fd = s->fd;
+    const uint64_t size = s->size;
+    const int oldest = s == &db->segs[0];
+    pthread_rwlock_unlock(&db->lock);
+
+    char *buf = read_seg(fd, size);
+    char *out = malloc(LDB_GC_BATCH);
+    int cap = 1024;
+    gc_rec_t *recs = malloc(cap * sizeof(gc_rec_t));
+    if (buf == NULL || out == NULL || recs == NULL)
+    {
+        free(buf);
+        free(out);
+        free(recs);
+        return LDB_ERR_IO;
+    }
+
+    int ret = LDB_OK;
+    int cnt = 0;
+    uint64_t batch = 0;
+    uint64_t pos = 0;
+    while (pos < size && ret == LDB_OK)
+    {
+        gc_rec_t r;
+        const size_t rsize = rec_parse(buf + pos, size - pos, 0, &r.type, &r.k, &r.ks, &r.v, &r.vs);
+        if (rsize == 0)
+        {
+            /* the broken tail was counted as dead when replaying */
+            break;
+        }
+        r.off = pos;
+        r.drop = 0;
+        if (r.type == LDB_REC_PUT)
+        {
+            int expire = 0;
+            if ((db->kf && db->kf((void *)r.k, r.ks) != 0)
+                || (db->vf && db->vf(r.v, r.vs, &expire) != 0))
+            {
+                r.drop = 1;
+            }
+        }
+        pos += rsize;
+
+        if (batch + rsize > LDB_GC_BATCH && cnt > 0)
+        {
+            pthread_mutex_lock(&db->wr_lock);
+            ret = gc_commit(db, id, oldest, recs, cnt, out);
+            pthread_mutex_unlock(&db->wr_lock);
+            cnt = 0;
+            batch = 0;
+        }
+        if (rsize > LDB_GC_BATCH)
+        {
+            /* a huge one goes alone */
+            char *big = malloc(rsize);
+            if (big == NULL)
+            {
+                ret = LDB_ERR_IO;
+                break;
+            }
+            pthread_mutex_lock(&db->wr_lock);
+            ret = gc_commit(db, id, oldest, &r, 1, big);
+            pthread_mutex_unlock(&db->wr_lock);
+            free(big);
+            continue;
+        }
+        if (cnt == cap)
+        {
+            gc_rec_t *more = realloc(recs, cap * 2 * sizeof(gc_rec_t));
+            if (more == NULL)
+            {
+                ret = LDB_ERR_IO;
+                break;
+            }
+            recs = more;
+            cap *= 2;
+        }
+        recs[cnt++] = r;
+        batch += rsize;
+    }
+
+    pthread_mutex_lock(&db->wr_lock);
+    if (ret == LDB_OK && cnt > 0)
+    {
+        ret = gc_commit(db, id, oldest, recs, cnt, out);
+    }
+    /* the moved records are on disk before their source goes away */
+    if (ret == LDB_OK && fdatasync(db->segs[db->seg_cnt - 1].fd) != 0)
+    {
+        ret = LDB_ERR_IO;
+    }
+    if (ret == LDB_OK)
+    {
+        pthread_rwlock_wrlock(&db->lock);
+        seg_remove(db, id);
+        db->compactions++;
+        pthread_rwlock_unlock(&db->lock);
+        /* with the new segments created by append() */
+        ret = dir_sync(db);
+    }
+    pthread_mutex_unlock(&db->wr_lock);
+
+    free(buf);
+    free(out);
+    free(recs);
+    return ret;
+}
+
+/* return: 1 - a sealed segment worth compacting is found */
+static int pick_seg(ldb_t *db, uint32_t *id)
+{
+    int i;
+    int found = 0;
+    pthread_rwlock_rdlock(&db->lock);
+    for (i = 0; i + 1 < db->seg_cnt; i++)
+    {
+        const ldb_seg_t *s = &db->segs[i];
+        uint64_t garbage = s->dead;
+        if (i == 0)
+        {
+            /* the tombstones of the oldest one can be dropped */
+            garbage += s->tombs;
+        }
+        if (garbage * 100 >= s->size * LDB_GC_PCT)
+        {
+            *id = s->id;
+            found = 1;
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&db->lock);
+    return found;
+}
+
+static void *gc_thread(void *arg)
+{
+    ldb_t *db = (ldb_t *)arg;
+    for (;;)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += LDB_GC_INTERVAL_MS / 1000;
+        ts.tv_nsec += (LDB_GC_INTERVAL_MS % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L)
+        {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&db->gc_mutex);
+        if (!db->gc_stop)
+        {
+            pthread_cond_timedwait(&db->gc_cond, &db->gc_mutex, &ts);
+        }
+        const int stop = db->gc_stop;
+        pthread_mutex_unlock(&db->gc_mutex);
+        if (stop)
+        {
+            break;
+        }
+
+        uint32_t id;
+        while (!db->gc_stop && !db->frozen && pick_seg(db, &id))
+        {
+            pthread_mutex_lock(&db->gc_lock);
+            const int ret = db->frozen ? LDB_OK : compact_seg(db, id);
+            pthread_mutex_unlock(&db->gc_lock);
+            if (ret != LDB_OK)
+            {
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+int ldb_compact(ldb_t *db)
+{
+    if (db == NULL || db->read_only || db->frozen)
+    {
+        return LDB_ERR_ARG;
+    }
+
+    pthread_mutex_lock(&db->gc_lock);
+    pthread_rwlock_rdlock(&db->lock);
+    const uint32_t active = db->seg_cnt > 0 ? db->segs[db->seg_cnt - 1].id : 0;
+    pthread_rwlock_unlock(&db->lock);
+
+    /* the sealed ones when called, from the oldest */
+    int ret = LDB_OK;
+    for (;;)
+    {
+        pthread_rwlock_rdlock(&db->lock);
+        const uint32_t id = db->seg_cnt > 1 ? db->segs[0].id : active;
+        pthread_rwlock_unlock(&db->lock);
+        if (id >= active || (ret = compact_seg(db, id)) != LDB_OK)
+        {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&db->gc_lock);
+    return ret;
+}
+
+void ldb_freeze(ldb_t *db, int frozen)
+{
+    if (db == NULL)
+    {
+        return;
+    }
+    /* wait for the compaction running */
+    pthread_mutex_lock(&db->gc_lock);
+    db->frozen = frozen;
+    pthread_mutex_unlock(&db->gc_lock);
+}
+
+void ldb_set_filter(ldb_t *db, ldb_key_filter_t kf, ldb_val_filter_t vf)
+{
+    if (db)
+    {
+        pthread_mutex_lock(&db->gc_lock);
+        db->kf = kf;
+        db->vf = vf;
+        pthread_mutex_unlock(&db->gc_lock);
+    }
+}
+
+/*-------------------------------- open/close -------------------------------*/
+
+static int id_cmp(const void *p1, const void *p2)
+{
+    const uint32_t a = *(const uint32_t *)p1;
+    const uint32_t b = *(const uint32_t *)p2;
+    return a < b ? -1 : a > b ? 1 : 0;
+}
+
+/* ids of NNNNNNNN.ldb in dir, sorted */
+static int list_segs(const char *dir, uint32_t **pids, int *pcnt)
+{
+    DIR *d = opendir(dir);
+    if (d == NULL)
+    {
+        return errno == ENOENT ? LDB_OK : LDB_ERR_IO;
+    }
+    uint32_t *ids = NULL;
+    int cnt = 0;
+    int cap = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL)
+    {
+        char *end;
+        if (strlen(de->d_name) != 12 || strcmp(de->d_name + 8, ".ldb") != 0)
+        {
+            continue;
+        }
+        const unsigned long id = strtoul(de->d_name, &end, 10);
+        if (end != de->d_name + 8)
+        {
+            continue;
+        }
+        if (cnt == cap)
+        {
+            cap = cap ? cap * 2 : 16;
+            uint32_t *more = realloc(ids, cap * sizeof(uint32_t));
+            if (more == NULL)
+            {
+                free(ids);
+                closedir(d);
+                return LDB_ERR_IO;
+            }
+            ids = more;
+        }
+        ids[cnt++] = (uint32_t)id;
+    }
+    closedir(d);
+    if (cnt > 1)
+    {
+        qsort(ids, cnt, sizeof(uint32_t), id_cmp);
+    }
+    *pids = ids;
+    *pcnt = cnt;
+    return LDB_OK;
+}
+
+/* rebuild the index from one segment */
+static int replay_seg(ldb_t *db, uint32_t id, int last)
+{
+    char path[PATH_MAX];
+    seg_path(db, id, path, sizeof(path));
+    const int fd = open(path, db->read_only ? O_RDONLY : O_RDWR);
+    if (fd < 0)
+    {
+        return LDB_ERR_IO;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return LDB_ERR_IO;
+    }
+    const uint64_t size = st.st_size;
+    ldb_seg_t *s = seg_add(db, id, fd, size);
+    char *buf = s ? read_seg(fd, size) : NULL;
+    if (buf == NULL)
+    {
+        if (s)
+        {
+            db->seg_cnt--;
+        }
+        close(fd);
+        return LDB_ERR_IO;
+    }
+
+    uint64_t pos = 0;
+    while (pos < size)
+    {
+        int type;
+        const char *k, *v;
+        uint32_t ks, vs;
+        const size_t rsize = rec_parse(buf + pos, size - pos, 1, &type, &k, &ks, &v, &vs);
+        if (rsize == 0)
+        {
+            break;
+        }
+        if (apply_locked(db, id, pos, buf + pos, rsize) != 0)
+        {
+            free(buf);
+            return LDB_ERR_IO;
+        }
+        pos += rsize;
+    }
+    free(buf);
+
+    if (pos < size)
+    {
+        db->corrupt_bytes += size - pos;
+        s = seg_find(db, id);
+        if (last && !db->read_only && ftruncate(fd, (off_t)pos) == 0)
+        {
+            /* a torn tail of the last write */
+            s->size = pos;
+        }
+        else
+        {
+            s->dead += size - pos;
+        }
+    }
+    return LDB_OK;
+}
+
+int ldb_open(const char *dir, int read_only, uint64_t seg_size, ldb_t **pdb)
+{
+    if (dir == NULL || pdb == NULL)
+    {
+        return LDB_ERR_ARG;
+    }
+    pthread_once(&sc_crc_once, crc_init);
+    if (!read_only && mkdir(dir, 0755) != 0 && errno != EEXIST)
+    {
+        return LDB_ERR_IO;
+    }
+
+    ldb_t *db = calloc(1, sizeof(ldb_t));
+    if (db == NULL)
+    {
+        return LDB_ERR_IO;
+    }
+    db->dir = strdup(dir);
+    db->read_only = read_only;
+    db->seg_size = seg_size ? seg_size : LDB_SEG_SIZE;
+    db->head = node_new(LDB_MAX_LEVEL, "", 0);
+    db->level = 1;
+    db->rnd = (uint32_t)time(NULL);
+    pthread_mutex_init(&db->wr_lock, NULL);
+    pthread_rwlock_init(&db->lock, NULL);
+    pthread_mutex_init(&db->gc_lock, NULL);
+    pthread_mutex_init(&db->gc_mutex, NULL);
+    pthread_cond_init(&db->gc_cond, NULL);
+    if (db->dir == NULL || db->head == NULL)
+    {
+        ldb_close(db);
+        return LDB_ERR_IO;
+    }
+
+    uint32_t *ids = NULL;
+    int cnt = 0;
+    int ret = list_segs(dir, &ids, &cnt);
+    int i;
+    for (i = 0; i < cnt && ret == LDB_OK; i++)
+    {
+        ret = replay_seg(db, ids[i], i == cnt - 1);
+    }
+    free(ids);
+
+    if (ret == LDB_OK && !read_only && db->seg_cnt == 0)
+    {
+        ret = seg_create(db, 1);
+    }
+    if (ret != LDB_OK)
+    {
+        ldb_close(db);
+        return ret;
+    }
+    *pdb = db;
+    return LDB_OK;
+}
+
+int ldb_start(ldb_t *db)
+{
+    if (db == NULL)
+    {
+        return LDB_ERR_ARG;
+    }
+    if (db->read_only || db->gc_running)
+    {
+        return LDB_OK;
+    }
+    if (pthread_create(&db->gc_tid, NULL, gc_thread, db) != 0)
+    {
+        return LDB_ERR_IO;
+    }
+    db->gc_running = 1;
+    return LDB_OK;
+}
+
+void ldb_close(ldb_t *db)
+{
+    int i;
+    if (db == NULL)
+    {
+        return;
+    }
+    if (db->gc_running)
+    {
+        pthread_mutex_lock(&db->gc_mutex);
+        db->gc_stop = 1;
+        pthread_cond_signal(&db->gc_cond);
+        pthread_mutex_unlock(&db->gc_mutex);
+        pthread_join(db->gc_tid, NULL);
+    }
+    for (i = 0; i < db->seg_cnt; i++)
+    {
+        if (!db->read_only && i == db->seg_cnt - 1)
+        {
+            fdatasync(db->segs[i].fd);
+        }
+        close(db->segs[i].fd);
+    }
+    if (db->head)
+    {
+        index_free(db);
+        free(db->head);
+    }
+    free(db->segs);
+    free(db->dir);
+    pthread_mutex_destroy(&db->wr_lock);
+    pthread_rwlock_destroy(&db->lock);
+    pthread_mutex_destroy(&db->gc_lock);
+    pthread_mutex_destroy(&db->gc_mutex);
+    pthread_cond_destroy(&db->gc_cond);
+    free(db);
+}
+
+int ldb_clear(ldb_t *db)
+{
+    if (db == NULL || db->read_only)
+    {
+        return LDB_ERR_ARG;
+    }
+    pthread_mutex_lock(&db->gc_lock);
+    pthread_mutex_lock(&db->wr_lock);
+    pthread_rwlock_wrlock(&db->lock);
+    const uint32_t next = db->seg_cnt > 0 ? db->segs[db->seg_cnt - 1].id + 1 : 1;
+    index_free(db);
+    while (db->seg_cnt > 0)
+    {
+        seg_remove(db, db->segs[0].id);
+    }
+    const int ret = seg_create(db, next);
+    pthread_rwlock_unlock(&db->lock);
+    pthread_mutex_unlock(&db->wr_lock);
+    pthread_mutex_unlock(&db->gc_lock);
+    return ret;
+}
+
+int ldb_merge(ldb_t *db, const char *dir)
+{
+    if (db == NULL || db->read_only || dir == NULL)
+    {
+        return LDB_ERR_ARG;
+    }
+    ldb_t *src = NULL;
+    int ret = ldb_open(dir, 1, 0, &src);
+    if (ret != LDB_OK)
+    {
+        return ret;
+    }
+    ldb_iter_t *it = ldb_iter_prefix(src, NULL, 0);
+    if (it == NULL)
+    {
+        ldb_close(src);
+        return LDB_ERR_IO;
+    }
+
+    int cap = 256;
+    int cnt = 0;
+    size_t bytes = 0;
+    ldb_kv_t *kvs = malloc(cap * sizeof(ldb_kv_t));
+    ret = kvs ? LDB_OK : LDB_ERR_IO;
+    while (ret == LDB_OK)
+    {
+        ldb_kv_t kv;
+        const int more = ldb_iter_next(it, &kv.k, &kv.ks, &kv.v, &kv.vs, malloc) == LDB_OK;
+        if (more)
+        {
+            if (cnt == cap)
+            {
+                ldb_kv_t *bigger = realloc(kvs, cap * 2 * sizeof(ldb_kv_t));
+                if (bigger == NULL)
+                {
+                    free(kv.k);
+                    free(kv.v);
+                    ret = LDB_ERR_IO;
+                    break;
+                }
+                kvs = bigger;
+                cap *= 2;
+            }
+            kvs[cnt++] = kv;
+            bytes += kv.ks + kv.vs;
+        }
+        if (cnt > 0 && (!more || bytes >= LDB_MERGE_BATCH))
+        {
+            ret = ldb_write(db, kvs, cnt, NULL, 0);
+            while (cnt > 0)
+            {
+                cnt--;
+                free(kvs[cnt].k);
+                free(kvs[cnt].v);
+            }
+            bytes = 0;
+        }
+        if (!more)
+        {
+            break;
+        }
+    }
+    while (cnt > 0)
+    {
+        cnt--;
+        free(kvs[cnt].k);
+        free(kvs[cnt].v);
+    }
+    free(kvs);
+    ldb_iter_free(it);
+    ldb_close(src);
+    return ret;
+}
+
+/*-------------------------------- iterators --------------------------------*/
+
+ldb_iter_t *ldb_iter_prefix(ldb_t *db, const char *prefix, size_t len)
+{
+    if (db == NULL || (prefix == NULL && len > 0))
+    {
+        return NULL;
+    }
+    ldb_iter_t *it = calloc(1, sizeof(ldb_iter_t));
+    if (it == NULL)
+    {
+        return NULL;
+    }
+    it->db = db;
+    if (len > 0)
+    {
+        it->prefix = malloc(len);
+        if (it->prefix == NULL)
+        {
+            free(it);
+            return NULL;
+        }
+        memcpy(it->prefix, prefix, len);
+        it->plen = len;
+    }
+    return it;
+}
+
+ldb_iter_t *ldb_iter_recent(ldb_t *db, int segs)
+{
+    ldb_iter_t *it = ldb_iter_prefix(db, NULL, 0);
+    if (it && segs > 0)
+    {
+        pthread_rwlock_rdlock(&db->lock);
+        if (db->seg_cnt > 0)
+        {
+            const uint32_t last = db->segs[db->seg_cnt - 1].id;
+            it->min_seg = last >= (uint32_t)segs ? last - segs + 1 : 0;
+        }
+        pthread_rwlock_unlock(&db->lock);
+    }
+    return it;
+}
+
+int ldb_iter_next(ldb_iter_t *it, char **k, size_t *ks, char **v, size_t *vs, ldb_alloc_t f)
+{
+    if (it == NULL || k == NULL || v == NULL || f == NULL)
+    {
+        return LDB_ERR_ARG;
+    }
+    ldb_t *db = it->db;
+    *k = NULL;
+    *v = NULL;
+
+    pthread_rwlock_rdlock(&db->lock);
+    /* seek again from the last key, the skiplist may have changed */
+    const ldb_node_t *n = it->started
+        ? find(db, it->last, it->last_len, 1, NULL)
+        : find(db, it->prefix, it->plen, 0, NULL);
+    while (n && has_prefix(n, it->prefix, it->plen) && n->seg < it->min_seg)
+    {
+        n = n->next[0];
+    }
+    if (n == NULL || !has_prefix(n, it->prefix, it->plen))
+    {
+        pthread_rwlock_unlock(&db->lock);
+        return LDB_NOT_FOUND;
+    }
+
+    if (n->klen > it->last_cap)
+    {
+        char *last = realloc(it->last, n->klen);
+        if (last == NULL)
+        {
+            pthread_rwlock_unlock(&db->lock);
+            return LDB_ERR_IO;
+        }
+        it->last = last;
+        it->last_cap = n->klen;
+    }
+    memcpy(it->last, NODE_KEY(n), n->klen);
+    it->last_len = n->klen;
+    it->started = 1;
+
+    const ldb_seg_t *s = seg_find(db, n->seg);
+    char *kb = f(n->klen + 1);
+    char *vb = f(n->vlen + 1);
+    int ret = LDB_OK;
+    if (kb && vb && s && pread_full(s->fd, vb, n->vlen, n->off + LDB_HDR_SIZE + n->klen) == 0)
+    {
+        memcpy(kb, NODE_KEY(n), n->klen);
+        kb[n->klen] = 0;
+        vb[n->vlen] = 0;
+        *k = kb;
+        *v = vb;
+        if (ks)
+        {
+            *ks = n->klen;
+        }
+        if (vs)
+        {
+            *vs = n->vlen;
+        }
+        kb = vb = NULL;
+    }
+    else
+    {
+        ret = LDB_ERR_IO;
+    }
+    pthread_rwlock_unlock(&db->lock);
+
+    if (ret != LDB_OK)
+    {
+        /* allocated by f, the caller has its free(), hand them back empty */
+        if (kb)
+        {
+            kb[0] = 0;
+            *k = kb;
+        }
+        if (vb)
+        {
+            vb[0] = 0;
+            *v = vb;
+        }
+    }
+    return ret;
+}
+
+void ldb_iter_free(ldb_iter_t *it)
+{
+    if (it)
+    {
+        free(it->prefix);
+        free(it->last);
+        free(it);
+    }
+}
+
+void ldb_get_stat(ldb_t *db, ldb_stat_t *st)
+{
+    int i;
+    memset(st, 0, sizeof(*st));
+    if (db == NULL)
+    {
+        return;
+    }
+    pthread_rwlock_rdlock(&db->lock);
+    st->keys = db->keys;
+    st->segs = db->seg_cnt;
+    st->active_seg = db->seg_cnt > 0 ? db->segs[db->seg_cnt - 1].id : 0;
+    for (i = 0; i < db->seg_cnt; i++)
+    {
+        st->disk_bytes += db->segs[i].size;
+        st->dead_bytes += db->segs[i].dead;
+    }
+    st->compactions = db->compactions;
+    st->moved_bytes = db->moved_bytes;
+    st->filtered_keys = db->filtered_keys;
+    st->corrupt_bytes = db->corrupt_bytes;
+    pthread_rwlock_unlock(&db->lock);
+}
@@ -0,0 +1,90 @@
+#ifndef _LOG_DBE_H_
+#define _LOG_DBE_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/* a small log-structured kv engine, the reference of dbe_if.h:
+ * - values are appended to segment files (NNNNNNNN.ldb) of a directory,
+ *   a record is crc32 | klen | vlen | type | key | val, a delete is a
+ *   tombstone record, the index is rebuilt by replaying the segments
+ * - the index is a skiplist in memory sorted by key bytes, it keeps where
+ *   the last record of a key is, a get is one lookup and one pread
+ * - a compaction thread rewrites the live records of a segment mostly
+ *   dead into the active one and removes it, the key and value filters
+ *   drop records on the way */
+
+#define LDB_OK              0
+#define LDB_NOT_FOUND       1
+#define LDB_ERR_CORRUPTION  2
+#define LDB_ERR_IO          3
+#define LDB_ERR_ARG         5
+
+#define LDB_SEG_SIZE        (64ULL << 20)
+
+/* same layout as kvec_t of hidb2 */
+typedef struct ldb_kv
+{
+    char   *k;
+    size_t  ks;
+    char   *v;
+    size_t  vs;
+} ldb_kv_t;
+
+typedef void *(*ldb_alloc_t)(size_t size);
+/* return !0: the record is dropped by compaction */
+typedef int (*ldb_key_filter_t)(void *key, size_t len);
+typedef int (*ldb_val_filter_t)(const char *val, size_t len, int *expire);
+
+typedef struct ldb_stat
+{
+    uint64_t keys;
+    uint32_t segs;
+    uint32_t active_seg;
+    uint64_t disk_bytes;
+    uint64_t dead_bytes;
+    uint64_t compactions;
+    uint64_t moved_bytes;       /* live bytes rewritten by compaction */
+    uint64_t filtered_keys;     /* dropped by the filters */
+    uint64_t corrupt_bytes;     /* skipped when replaying */
+} ldb_stat_t;
+
+typedef struct ldb ldb_t;
+typedef struct ldb_iter ldb_iter_t;
+
+/* seg_size: 0 - LDB_SEG_SIZE; the directory is created if missing */
+extern int ldb_open(const char *dir, int read_only, uint64_t seg_size, ldb_t **pdb);
+/* start the compaction thread */
+extern int ldb_start(ldb_t *db);
+extern void ldb_close(ldb_t *db);
+
+extern int ldb_get(ldb_t *db, const char *k, size_t ks, char **v, size_t *vs, ldb_alloc_t f);
+extern int ldb_put(ldb_t *db, const char *k, size_t ks, const char *v, size_t vs);
+extern int ldb_del(ldb_t *db, const char *k, size_t ks);
+/* puts and dels are appended with one write */
+extern int ldb_write(ldb_t *db, const ldb_kv_t *puts, size_t put_cnt, const ldb_kv_t *dels, size_t del_cnt);
+/* delete all keys beginning with prefix */
+extern int ldb_pdel(ldb_t *db, const char *prefix, size_t len);
+extern int ldb_clear(ldb_t *db);
+/* load all keys of another engine directory */
+extern int ldb_merge(ldb_t *db, const char *dir);
+
+extern void ldb_set_filter(ldb_t *db, ldb_key_filter_t kf, ldb_val_filter_t vf);
+/* compact all sealed segments now, whatever their dead ratio */
+extern int ldb_compact(ldb_t *db);
+/* no segment is removed by compaction till unfreeze, for copying files */
+extern void ldb_freeze(ldb_t *db, int frozen);
+
+/* keys beginning with prefix in key order, len 0 for all keys */
+extern ldb_iter_t *ldb_iter_prefix(ldb_t *db, const char *prefix, size_t len);
+/* keys whose last record is in the newest segs segments, segs <= 0 for all */
+extern ldb_iter_t *ldb_iter_recent(ldb_t *db, int segs);
+/* the iterator sees the changes after it is created.
+ * k and v are allocated by f and end with '\0' (not counted in ks, vs)
+ * return: LDB_NOT_FOUND - no more */
+extern int ldb_iter_next(ldb_iter_t *it, char **k, size_t *ks, char **v, size_t *vs, ldb_alloc_t f);
+extern void ldb_iter_free(ldb_iter_t *it);
+
+extern void ldb_get_stat(ldb_t *db, ldb_stat_t *st);
+
+#endif /* _LOG_DBE_H_ */
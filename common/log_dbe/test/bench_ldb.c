@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "log_dbe.h"
+
+#define TEST_DIR        "ldb_test"
+#define MERGE_DIR       "ldb_merge"
+#define BENCH_DIR       "ldb_bench"
+#define BENCH_KEYS      (1 << 18)
+#define BENCH_VAL       128
+/* small segments to make compaction busy */
+#define TEST_SEG_SIZE   (64 << 10)
+
+#define CHECK(cond) \
+    do \
+    { \
+        if (!(cond)) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+static uint64_t now_us(void)
+{
+    struct timespec cur;
+    clock_gettime(CLOCK_MONOTONIC, &cur);
+    return (uint64_t)cur.tv_sec * 1000000ULL + cur.tv_nsec / 1000ULL;
+}
+
+static void rm_dir(const char *dir)
+{
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd) != 0)
+    {
+        fprintf(stderr, "failed: %s\n", cmd);
+    }
+}
+
+static void expect(ldb_t *db, const char *k, const char *v)
+{
+    char *got = NULL;
+    size_t len = 0;
+    const int ret = ldb_get(db, k, strlen(k), &got, &len, malloc);
+    if (v == NULL)
+    {
+        CHECK(ret == LDB_NOT_FOUND);
+        return;
+    }
+    CHECK(ret == LDB_OK);
+    CHECK(len == strlen(v) && memcmp(got, v, len) == 0 && got[len] == 0);
+    free(got);
+}
+
+static int count_iter(ldb_iter_t *it)
+{
+    char *k, *v;
+    size_t ks, vs;
+    int cnt = 0;
+    char last[64] = "";
+    while (ldb_iter_next(it, &k, &ks, &v, &vs, malloc) == LDB_OK)
+    {
+        CHECK(strcmp(last, k) < 0);
+        snprintf(last, sizeof(last), "%s", k);
+        free(k);
+        free(v);
+        cnt++;
+    }
+    ldb_iter_free(it);
+    return cnt;
+}
+
+/* drop keys beginning with "x" */
+static int key_filter(void *key, size_t len)
+{
+    return len > 0 && ((char *)key)[0] == 'x';
+}
+
+/* drop values "expired" */
+static int val_filter(const char *val, size_t len, int *expire)
+{
+    *expire = 0;
+    return len == 7 && memcmp(val, "expired", 7) == 0;
+}
+
+static void test_basic()
+{
+    ldb_t *db;
+    char k[32], v[32];
+    int i;
+
+    rm_dir(TEST_DIR);
+    CHECK(ldb_open(TEST_DIR, 0, TEST_SEG_SIZE, &db) == LDB_OK);
+    CHECK(ldb_put(db, "a", 1, "1", 1) == LDB_OK);
+    CHECK(ldb_put(db, "b", 1, "2", 1) == LDB_OK);
+    CHECK(ldb_put(db, "a", 1, "3", 1) == LDB_OK);
+    expect(db, "a", "3");
+    expect(db, "b", "2");
+    expect(db, "c", NULL);
+    CHECK(ldb_del(db, "b", 1) == LDB_OK);
+    expect(db, "b", NULL);
+    CHECK(ldb_put(db, "e", 1, "", 0) == LDB_OK);
+    expect(db, "e", "");
+    CHECK(ldb_put(db, "", 0, "x", 1) == LDB_ERR_ARG);
+
+    for (i = 0; i < 100; i++)
+    {
+        snprintf(k, sizeof(k), "p:%03d", i);
+        snprintf(v, sizeof(v), "v%d", i);
+        CHECK(ldb_put(db, k, strlen(k), v, strlen(v)) == LDB_OK);
+    }
+    CHECK(count_iter(ldb_iter_prefix(db, "p:", 2)) == 100);
+    CHECK(count_iter(ldb_iter_prefix(db, "p:05", 4)) == 10);
+    CHECK(count_iter(ldb_iter_prefix(db, NULL, 0)) == 102);
+
+    CHECK(ldb_pdel(db, "p:00", 4) == LDB_OK);
+    CHECK(count_iter(ldb_iter_prefix(db, "p:", 2)) == 90);
+    expect(db, "p:005", NULL);
+    expect(db, "p:010", "v10");
+    expect(db, "p:099", "v99");
+    ldb_close(db);
+
+    /* replay */
+    CHECK(ldb_open(TEST_DIR, 0, TEST_SEG_SIZE, &db) == LDB_OK);
+    expect(db, "a", "3");
+    expect(db, "b", NULL);
+    expect(db, "p:050", "v50");
+    CHECK(count_iter(ldb_iter_prefix(db, NULL, 0)) == 92);
+    ldb_close(db);
+
+    /* a torn tail is cut off */
+    int fd = open(TEST_DIR "/00000001.ldb", O_WRONLY | O_APPEND);
+    CHECK(fd >= 0);
+    CHECK(write(fd, "\x01\x02\x03\x04\x05", 5) == 5);
+    close(fd);
+    ldb_stat_t st;
+    CHECK(ldb_open(TEST_DIR, 0, TEST_SEG_SIZE, &db) == LDB_OK);
+    ldb_get_stat(db, &st);
+    CHECK(st.corrupt_bytes == 5);
+    CHECK(ldb_put(db, "z", 1, "26", 2) == LDB_OK);
+    ldb_close(db);
+    CHECK(ldb_open(TEST_DIR, 1, 0, &db) == LDB_OK);
+    ldb_get_stat(db, &st);
+    CHECK(st.corrupt_bytes == 0);
+    expect(db, "z", "26");
+    expect(db, "a", "3");
+    CHECK(ldb_put(db, "y", 1, "1", 1) == LDB_ERR_ARG);
+    ldb_close(db);
+    printf("basic: ok\n");
+}
+
+static void test_compact()
+{
+    ldb_t *db;
+    ldb_stat_t st;
+    char k[32], v[256];
+    int i, round;
+
+    rm_dir(TEST_DIR);
+    CHECK(ldb_open(TEST_DIR, 0, TEST_SEG_SIZE, &db) == LDB_OK);
+    for (round = 0; round < 4; round++)
+    {
+        for (i = 0; i < 2000; i++)
+        {
+            snprintf(k, sizeof(k), "%c:%05d", i % 10 == 0 ? 'x' : 'k', i);
+            if (i % 7 == 0 && round == 3)
+            {
+                snprintf(v, sizeof(v), "expired");
+            }
+            else
+            {
+                snprintf(v, sizeof(v), "value");
+                memset(v + 5, '.', 100);
+                snprintf(v + 100, sizeof(v) - 100, "%d", round);
+            }
+            CHECK(ldb_put(db, k, strlen(k), v, strlen(v)) == LDB_OK);
+        }
+    }
+    for (i = 0; i < 2000; i += 3)
+    {
+        snprintf(k, sizeof(k), "k:%05d", i);
+        CHECK(ldb_del(db, k, strlen(k)) == LDB_OK);
+    }
+    /* seal them all, the active segment is never compacted */
+    memset(v, '.', 100);
+    for (i = 0; i < 1000; i++)
+    {
+        CHECK(ldb_put(db, "pad", 3, v, 100) == LDB_OK);
+    }
+    ldb_get_stat(db, &st);
+    const uint64_t before = st.disk_bytes;
+    CHECK(st.segs > 4);
+
+    ldb_set_filter(db, key_filter, val_filter);
+    ldb_freeze(db, 1);
+    CHECK(ldb_compact(db) == LDB_ERR_ARG);
+    ldb_freeze(db, 0);
+    CHECK(ldb_compact(db) == LDB_OK);
+    ldb_get_stat(db, &st);
+    printf("compact: %" PRIu64 " -> %" PRIu64 " bytes, %u segs, %" PRIu64 " keys, %" PRIu64 " filtered\n",
+           before, st.disk_bytes, st.segs, st.keys, st.filtered_keys);
+    CHECK(st.disk_bytes < before / 2);
+    CHECK(st.compactions > 0);
+
+    /* expected: k keys, not deleted, not expired */
+    int live = 1;
+    for (i = 0; i < 2000; i++)
+    {
+        const int expired = i % 7 == 0;
+        const int deleted = i % 3 == 0;
+        snprintf(k, sizeof(k), "%c:%05d", i % 10 == 0 ? 'x' : 'k', i);
+        if (i % 10 == 0 || deleted || expired)
+        {
+            expect(db, k, NULL);
+        }
+        else
+        {
+            snprintf(v, sizeof(v), "value");
+            memset(v + 5, '.', 100);
+            snprintf(v + 100, sizeof(v) - 100, "3");
+            expect(db, k, v);
+            live++;
+        }
+    }
+    CHECK(st.keys == (uint64_t)live);
+    ldb_set_filter(db, NULL, NULL);
+    ldb_close(db);
+
+    /* the tombstones carried forward still hide the old records */
+    CHECK(ldb_open(TEST_DIR, 0, TEST_SEG_SIZE, &db) == LDB_OK);
+    ldb_get_stat(db, &st);
+    CHECK(st.keys == (uint64_t)live);
+    CHECK(count_iter(ldb_iter_prefix(db, NULL, 0)) == live);
+    CHECK(count_iter(ldb_iter_recent(db, 1)) <= live);
+
+    /* the background thread compacts what is overwritten */
+    CHECK(ldb_start(db) == LDB_OK);
+    for (round = 0; round < 3; round++)
+    {
+        for (i = 0; i < 2000; i++)
+        {
+            snprintf(k, sizeof(k), "k:%05d", i);
+            CHECK(ldb_put(db, k, strlen(k), v, 100) == LDB_OK);
+        }
+    }
+    sleep(2);
+    ldb_get_stat(db, &st);
+    printf("compact: background %" PRIu64 " compactions, %" PRIu64 " of %" PRIu64 " bytes dead\n",
+           st.compactions, st.dead_bytes, st.disk_bytes);
+    CHECK(st.compactions > 0);
+    CHECK(st.keys == 2001);
+    ldb_close(db);
+
+    /* merge */
+    rm_dir(MERGE_DIR);
+    CHECK(ldb_open(MERGE_DIR, 0, 0, &db) == LDB_OK);
+    CHECK(ldb_put(db, "k:00001", 7, "old", 3) == LDB_OK);
+    CHECK(ldb_merge(db, TEST_DIR) == LDB_OK);
+    ldb_get_stat(db, &st);
+    CHECK(st.keys == 2001);
+    CHECK(ldb_clear(db) == LDB_OK);
+    ldb_get_stat(db, &st);
+    CHECK(st.keys == 0 && st.segs == 1);
+    ldb_close(db);
+    printf("compact: ok\n");
+}
+
+static void bench()
+{
+    ldb_t *db;
+    char k[32], v[BENCH_VAL];
+    int i;
+
+    rm_dir(BENCH_DIR);
+    CHECK(ldb_open(BENCH_DIR, 0, 0, &db) == LDB_OK);
+    memset(v, 'v', sizeof(v));
+    srand(1);
+
+    uint64_t start = now_us();
+    for (i = 0; i < BENCH_KEYS; i++)
+    {
+        snprintf(k, sizeof(k), "key:%08d", rand() % BENCH_KEYS);
+        CHECK(ldb_put(db, k, strlen(k), v, sizeof(v)) == LDB_OK);
+    }
+    uint64_t cost = now_us() - start;
+    printf("bench: put %d, %" PRIu64 " us, %.0f ops/s\n", BENCH_KEYS, cost, BENCH_KEYS * 1e6 / cost);
+
+    start = now_us();
+    int found = 0;
+    for (i = 0; i < BENCH_KEYS; i++)
+    {
+        char *got;
+        snprintf(k, sizeof(k), "key:%08d", rand() % BENCH_KEYS);
+        if (ldb_get(db, k, strlen(k), &got, NULL, malloc) == LDB_OK)
+        {
+            free(got);
+            found++;
+        }
+    }
+    cost = now_us() - start;
+    printf("bench: get %d (%d found), %" PRIu64 " us, %.0f ops/s\n", BENCH_KEYS, found, cost,
+           BENCH_KEYS * 1e6 / cost);
+
+    start = now_us();
+    const int cnt = count_iter(ldb_iter_prefix(db, NULL, 0));
+    cost = now_us() - start;
+    printf("bench: iterate %d, %" PRIu64 " us\n", cnt, cost);
+    ldb_close(db);
+
+    start = now_us();
+    CHECK(ldb_open(BENCH_DIR, 1, 0, &db) == LDB_OK);
+    cost = now_us() - start;
+    printf("bench: replay, %" PRIu64 " us\n", cost);
+    ldb_close(db);
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+    test_basic();
+    test_compact();
+    bench();
+    rm_dir(TEST_DIR);
+    rm_dir(MERGE_DIR);
+    rm_dir(BENCH_DIR);
+    return 0;
+}
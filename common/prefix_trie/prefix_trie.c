@@ -0,0 +1,216 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "prefix_trie.h"
+
+/* below it children are scanned, above it binary searched */
+#define PT_LINEAR_MAX   8
+
+typedef struct pt_str
+{
+    const char *s;
+    size_t      len;
+} pt_str_t;
+
+static int str_cmp(const void *p1, const void *p2)
+{
+    const pt_str_t *s1 = (const pt_str_t *)p1;
+    const pt_str_t *s2 = (const pt_str_t *)p2;
+    const size_t len = s1->len < s2->len ? s1->len : s2->len;
+    const int ret = memcmp(s1->s, s2->s, len);
+    if (ret != 0)
+    {
+        return ret;
+    }
+    return s1->len < s2->len ? -1 : s1->len > s2->len ? 1 : 0;
+}
+
+prefix_trie_t *pt_create(const char *const prefixes[], int count)
+{
+    prefix_trie_t *pt;
+    pt_str_t *strs = 0;
+    uint32_t *lo = 0;
+    uint32_t *hi = 0;
+    size_t total = 1;
+    int cnt = 0;
+    int i;
+
+    if (count < 0 || (count > 0 && prefixes == NULL))
+    {
+        return NULL;
+    }
+
+    pt = calloc(1, sizeof(prefix_trie_t));
+    if (pt == NULL)
+    {
+        return NULL;
+    }
+
+    if (count > 0)
+    {
+        strs = malloc(count * sizeof(pt_str_t));
+        if (strs == NULL)
+        {
+            goto fail;
+        }
+        for (i = 0; i < count; i++)
+        {
+            strs[i].s = prefixes[i] ? prefixes[i] : "";
+            strs[i].len = strlen(strs[i].s);
+        }
+        qsort(strs, count, sizeof(pt_str_t), str_cmp);
+
+        /* a prefix covers all strings sorted after it and beginning with it */
+        for (i = 0; i < count; i++)
+        {
+            if (cnt > 0
+                && strs[i].len >= strs[cnt - 1].len
+                && memcmp(strs[i].s, strs[cnt - 1].s, strs[cnt - 1].len) == 0)
+            {
+                continue;
+            }
+            strs[cnt++] = strs[i];
+            total += strs[i].len;
+        }
+    }
+
+    /* one node per byte at most */
+    pt->nodes = calloc(total, sizeof(pt_node_t));
+    lo = malloc(total * sizeof(uint32_t));
+    hi = malloc(total * sizeof(uint32_t));
+    if (pt->nodes == NULL || lo == NULL || hi == NULL)
+    {
+        goto fail;
+    }
+    pt->prefix_cnt = cnt;
+    pt->node_cnt = 1;
+    lo[0] = 0;
+    hi[0] = cnt;
+
+    /* nodes are visited in the order they are allocated (breadth first),
+     * node n at depth d holds strs[lo[n], hi[n]) which share d bytes */
+    {
+        uint32_t n;
+        size_t depth = 0;
+        uint32_t level_end = 1;
+        for (n = 0; n < pt->node_cnt; n++)
+        {
+            if (n == level_end)
+            {
+                depth++;
+                level_end = pt->node_cnt;
+            }
+
+            pt_node_t *node = &pt->nodes[n];
+            uint32_t j = lo[n];
+            if (j < hi[n] && strs[j].len == depth)
+            {
+                /* covered ones are dropped, it is the only one here */
+                node->term = 1;
+                continue;
+            }
+
+            node->first = pt->node_cnt;
+            while (j < hi[n])
+            {
+                const uint8_t c = (uint8_t)strs[j].s[depth];
+                const uint32_t child = pt->node_cnt++;
+                pt->nodes[child].label = c;
+                lo[child] = j;
+                while (j < hi[n] && (uint8_t)strs[j].s[depth] == c)
+                {
+                    j++;
+                }
+                hi[child] = j;
+                node->cnt++;
+            }
+        }
+    }
+
+    free(strs);
+    free(lo);
+    free(hi);
+    return pt;
+
+fail:
+    free(strs);
+    free(lo);
+    free(hi);
+    pt_destroy(pt);
+    return NULL;
+}
+
+void pt_destroy(prefix_trie_t *pt)
+{
+    if (pt)
+    {
+        free(pt->nodes);
+        free(pt);
+    }
+}
+
+static const pt_node_t *find_child(const prefix_trie_t *pt, const pt_node_t *node, uint8_t c)
+{
+    const pt_node_t *child = pt->nodes + node->first;
+    if (node->cnt <= PT_LINEAR_MAX)
+    {
+        int i;
+        for (i = 0; i < node->cnt; i++)
+        {
+            if (child[i].label == c)
+            {
+                return &child[i];
+            }
+        }
+        return NULL;
+    }
+
+    int l = 0;
+    int r = node->cnt - 1;
+    while (l <= r)
+    {
+        const int m = (l + r) >> 1;
+        if (child[m].label == c)
+        {
+            return &child[m];
+        }
+        if (child[m].label < c)
+        {
+            l = m + 1;
+        }
+        else
+        {
+            r = m - 1;
+        }
+    }
+    return NULL;
+}
+
+int pt_match(const prefix_trie_t *pt, const char *key, size_t key_len)
+{
+    const pt_node_t *node;
+    size_t i;
+
+    if (pt == NULL)
+    {
+        return 0;
+    }
+
+    node = pt->nodes;
+    for (i = 0; ; i++)
+    {
+        if (node->term)
+        {
+            return 1;
+        }
+        if (i == key_len || node->cnt == 0)
+        {
+            return 0;
+        }
+        node = find_child(pt, node, (uint8_t)key[i]);
+        if (node == NULL)
+        {
+            return 0;
+        }
+    }
+}
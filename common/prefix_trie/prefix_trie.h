@@ -0,0 +1,34 @@
+#ifndef _PREFIX_TRIE_H_
+#define _PREFIX_TRIE_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/* immutable trie of key prefixes, compiled once from a list and then only
+ * read, so it can be shared by threads without lock.
+ * nodes are laid out breadth first, the children of a node are adjacent
+ * and sorted by their byte, a lookup walks at most one node per key byte
+ * and stops at the first prefix found, whatever the number of prefixes */
+
+typedef struct pt_node
+{
+    uint32_t first;     /* index of the first child */
+    uint16_t cnt;       /* number of children */
+    uint8_t  label;     /* byte on the edge from the parent */
+    uint8_t  term;      /* a prefix ends here */
+} pt_node_t;
+
+typedef struct prefix_trie
+{
+    int          prefix_cnt;    /* prefixes kept, covered ones are dropped */
+    uint32_t     node_cnt;
+    pt_node_t   *nodes;         /* nodes[0] is root */
+} prefix_trie_t;
+
+extern prefix_trie_t *pt_create(const char *const prefixes[], int count);
+extern void pt_destroy(prefix_trie_t *pt);
+
+/* return: 1 - key begins with one of the prefixes; 0 - no */
+extern int pt_match(const prefix_trie_t *pt, const char *key, size_t key_len);
+
+#endif /* _PREFIX_TRIE_H_ */
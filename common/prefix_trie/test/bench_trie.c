@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "prefix_trie.h"
+
+/* keys looked up per prefix count per implementation */
+#define BENCH_KEYS      (1 << 16)
+#define BENCH_LOOPS     16
+#define KEY_MAX         48
+
+static uint64_t now_us(void)
+{
+    struct timespec cur;
+    clock_gettime(CLOCK_MONOTONIC, &cur);
+    return (uint64_t)cur.tv_sec * 1000000ULL + cur.tv_nsec / 1000ULL;
+}
+
+static void rand_str(char *s, int len)
+{
+    static const char dict[] = "abcdefghijklmnopqrstuvwxyz0123456789_:";
+    int i;
+    for (i = 0; i < len; i++)
+    {
+        s[i] = dict[rand() % (sizeof(dict) - 1)];
+    }
+    s[len] = 0;
+}
+
+/* what key_filter did before: strncmp with every prefix */
+static int linear_match(char **prefixes, int cnt, const char *key, int key_len)
+{
+    int i;
+    for (i = 0; i < cnt; i++)
+    {
+        const int prefix_len = strlen(prefixes[i]);
+        if (key_len >= prefix_len && strncmp(prefixes[i], key, prefix_len) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const int counts[] = {10, 100, 1000, 10000};
+    const int max = counts[sizeof(counts) / sizeof(counts[0]) - 1];
+    int i, j, k;
+
+    (void)argc;
+    (void)argv;
+    srand(1);
+
+    char **prefixes = malloc(max * sizeof(char *));
+    for (i = 0; i < max; i++)
+    {
+        prefixes[i] = malloc(KEY_MAX + 1);
+        rand_str(prefixes[i], 4 + rand() % 12);
+    }
+
+    for (k = 0; k < (int)(sizeof(counts) / sizeof(counts[0])); k++)
+    {
+        const int cnt = counts[k];
+
+        /* mixed keys: half begin with a configured prefix, half are random */
+        char **keys = malloc(BENCH_KEYS * sizeof(char *));
+        int *lens = malloc(BENCH_KEYS * sizeof(int));
+        for (i = 0; i < BENCH_KEYS; i++)
+        {
+            keys[i] = malloc(KEY_MAX + 1);
+            if (i & 1)
+            {
+                const char *p = prefixes[rand() % cnt];
+                const int plen = strlen(p);
+                strcpy(keys[i], p);
+                rand_str(keys[i] + plen, rand() % (KEY_MAX - plen));
+            }
+            else
+            {
+                rand_str(keys[i], 8 + rand() % (KEY_MAX - 8));
+            }
+            lens[i] = strlen(keys[i]);
+        }
+
+        uint64_t start = now_us();
+        prefix_trie_t *pt = pt_create((const char *const *)prefixes, cnt);
+        const uint64_t build = now_us() - start;
+
+        /* check against the linear scan */
+        for (i = 0; i < BENCH_KEYS; i++)
+        {
+            if (pt_match(pt, keys[i], lens[i]) != linear_match(prefixes, cnt, keys[i], lens[i]))
+            {
+                printf("mismatch: prefixes=%d, key=%s\n", cnt, keys[i]);
+                return -1;
+            }
+        }
+
+        int hit = 0;
+        start = now_us();
+        for (j = 0; j < BENCH_LOOPS; j++)
+        {
+            for (i = 0; i < BENCH_KEYS; i++)
+            {
+                hit += pt_match(pt, keys[i], lens[i]);
+            }
+        }
+        const uint64_t cost_trie = now_us() - start;
+
+        /* the linear scan is slow, fewer loops */
+        const int loops = cnt >= 1000 ? 1 : BENCH_LOOPS;
+        start = now_us();
+        for (j = 0; j < loops; j++)
+        {
+            for (i = 0; i < BENCH_KEYS; i++)
+            {
+                hit += linear_match(prefixes, cnt, keys[i], lens[i]);
+            }
+        }
+        const uint64_t cost_linear = now_us() - start;
+
+        printf("prefixes=%-6d nodes=%-7u build=%-6"PRIu64"us trie=%7.1fns/key linear=%9.1fns/key (hit=%d)\n",
+               cnt, pt->node_cnt, build,
+               cost_trie * 1000.0 / ((double)BENCH_KEYS * BENCH_LOOPS),
+               cost_linear * 1000.0 / ((double)BENCH_KEYS * loops), hit);
+
+        pt_destroy(pt);
+        for (i = 0; i < BENCH_KEYS; i++)
+        {
+            free(keys[i]);
+        }
+        free(keys);
+        free(lens);
+    }
+
+    for (i = 0; i < max; i++)
+    {
+        free(prefixes[i]);
+    }
+    free(prefixes);
+    return 0;
+}
@@ -5,7 +5,7 @@
 
 #include "ds_type.h"
 
-#include "hidb2/src/db/db_com_def.h"
+#include "dbe_if.h"
 
 /* just for test */
 typedef struct key_val_t
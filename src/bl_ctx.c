@@ -7,12 +7,18 @@
 #include "key_filter.h"
 #include "ds_ctrl.h"
 #include "checkpoint.h"
+#include "write_bl.h"
 #include "codec_key.h"
+#include "miss_filter.h"
+#include "dbe_if.h"
+#include "latency_hist.h"
+#include "key_migrate.h"
 
 #include "ds_log.h"
 #include "util.h"
 #include "ds_util.h"
 #include "serialize.h"
+#include "rds_util.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -41,6 +47,7 @@ typedef struct bl_read_iterator_st
 {
     int fd;
     int offset;
+    bin_reader_t rd;
 } bl_read_iterator;
 
 typedef struct wr_bl_info_st
@@ -59,7 +66,12 @@ typedef struct wr_bl_info_st
 #ifndef _UPD_DBE_BY_PERIODIC_
     char *buf;     /* value of string type obtain from rdb */
     int buf_len;
+    robj *val;     /* value of string type pinned in rdb, serialized by write_dbe */
+    int expire;
     void *dbe;
+    unsigned long long seq; /* seq of binlog record, see server.bl_enq_seq */
+    unsigned char no_bl;    /* for dbe only, not into binlog file */
+    unsigned char inflight; /* counted in sc_dbe_inflight */
 #endif
 } wr_bl_info;
 
@@ -69,8 +81,9 @@ typedef struct wr_bl_arg_st
     unsigned char op_flag;
     unsigned long long ds_id;
     bl_ctx *bl;
-    char *buf;     /* value of string type obtain from rdb */
+    char *buf;     /* serialized op, NULL if serialize fail */
     int buf_len;
+    unsigned long long seq;
 } wr_bl_arg;
 #endif
 
@@ -87,6 +100,64 @@ static void make_list_dbe_data(wr_bl_info *info, upd_dbe_param *param);
 static void make_set_dbe_data(wr_bl_info *info, upd_dbe_param *param);
 static void make_hash_dbe_data(wr_bl_info *info, upd_dbe_param *param);
 static void make_zset_dbe_data(wr_bl_info *info, upd_dbe_param *param);
+
+/* depth gauge of a stage: items queued or being handled by the stage.
+ * peak is written by the only producer of the stage */
+static void stage_inc(volatile int *depth, int *peak, int n)
+{
+    const int d = __sync_add_and_fetch(depth, n);
+    if (d > *peak)
+    {
+        *peak = d;
+    }
+}
+
+static void stage_dec(volatile int *depth, int n)
+{
+    __sync_sub_and_fetch(depth, n);
+}
+
+/* binlog sync state, touched by write_bl thread only */
+static int sc_bl_unsynced = 0;
+static long long sc_bl_last_sync = 0; /* ms */
+
+/* fdatasync current binlog according to server.binlog_fsync, the same
+ * meaning as appendfsync; force - sync now unless the policy is no
+ * ret: 0 - succ or not needed; -1 - fail, the records are still unsynced */
+static int sync_bl_file(bl_ctx *bl, int force)
+{
+    if (sc_bl_unsynced == 0 || bl == 0 || bl->fd_cur == -1
+        || server.binlog_fsync == APPENDFSYNC_NO)
+    {
+        return 0;
+    }
+
+    const long long now = ustime() / 1000;
+    if (force
+        || server.binlog_fsync == APPENDFSYNC_ALWAYS
+        || now - sc_bl_last_sync >= 1000)
+    {
+        if (aof_fsync(bl->fd_cur) == -1)
+        {
+            log_error("fdatasync() binlog fail, fd=%d, idx=%d: %s"
+                    , bl->fd_cur, bl->cur_bl_idx, strerror(errno));
+            return -1;
+        }
+        server.stat_bl_fsyncs++;
+        sc_bl_unsynced = 0;
+        sc_bl_last_sync = now;
+    }
+    return 0;
+}
+
+/* the same as appendfsync always: exit rather than ack records
+ * which are not in the binlog file */
+static void bl_io_fail(const char *what)
+{
+    redisLog(REDIS_WARNING, "Exiting on error %s the binlog: %s", what, strerror(errno));
+    log_error("exit on error %s the binlog", what);
+    exit(1);
+}
 #endif
 
 static int redo_op_rec(redisDb *rdb, const char *buf, int buf_len);
@@ -95,6 +166,7 @@ static int open_binlog_file(const char *path, const char *prefix, int idx, int f
 static int get_binlog_file_size(int fd);
 //static int write_binlog_file(bl_ctx *bl, char *buf, int len, unsigned long long ds_id, int op_flag);
 static int write_binlog_file(bl_ctx *bl, unsigned char cmd, const robj *key, int argc, const robj **argv, unsigned long long ds_id, unsigned char db_id, unsigned char type);
+static int write_bl_to_file(const char *buf, int buf_len, bl_ctx *bl, unsigned long long ds_id, unsigned char op_flag);
 
 #ifdef _UPD_DBE_BY_PERIODIC_
 static int do_op_rec(binlog_tab *blt, const char *buf, int buf_len);
@@ -675,6 +747,7 @@ void *bl_get_read_it(const char *path, int idx, int offset)
         zfree(it);
         return 0;
     }
+    bin_reader_init(&it->rd, it->fd, offset, BIN_READER_MMAP);
 
     return it;
 }
@@ -689,18 +762,23 @@ int bl_get_next_rec(void *iterator, char **buf, int *buf_len, int *next_offset)
         return 1;
     }
 
-    off_t offset = it->offset;
+    const uint8_t *rec = 0;
+    uint32_t rec_len = 0;
+    uint64_t ts = 0;
     uint64_t ds_id = 0;
-    const int ret = bin_get_v2(it->fd, (uint8_t **)buf, (uint32_t*)buf_len, &offset, zmalloc, &ds_id);
+    const int ret = bin_reader_next(&it->rd, &rec, &rec_len, &ts, &ds_id);
     if (ret == 0)
     {
-        it->offset = offset;
+        *buf = (char *)rec;
+        *buf_len = (int)rec_len;
+        it->offset = it->rd.offset;
         *next_offset = it->offset;
         return 0;
     }
     else
     {
         /* end of file */
+        bin_reader_destroy(&it->rd);
         close(it->fd);
         it->fd = -1;
         return ret;
@@ -713,6 +791,7 @@ void bl_release_it(void *iterator)
 
     if (it->fd != -1)
     {
+        bin_reader_destroy(&it->rd);
         close(it->fd);
     }
 
@@ -721,7 +800,8 @@ void bl_release_it(void *iterator)
 
 void bl_release_rec(char *buf)
 {
-    zfree(buf);
+    /* records are views of the iterator, nothing to free */
+    (void)buf;
 }
 
 static int try_open_bl_file(bl_ctx *bl)
@@ -740,8 +820,10 @@ static int try_open_bl_file(bl_ctx *bl)
     return 0;
 }
 
-static void try_switch_bl_file(bl_ctx *bl)
+/* ret: 0 - succ; -1 - the closed binlog can't be synced with policy always */
+static int try_switch_bl_file(bl_ctx *bl)
 {
+    int ret = 0;
     int need_create_fd = 0;
     if (bl->fd_cur ==  -1)
     {
@@ -753,6 +835,12 @@ static void try_switch_bl_file(bl_ctx *bl)
         if (file_size >= 0 && file_size > dbmng_conf.binlog_max_size)
         {
             need_create_fd = 1;
+#ifndef _UPD_DBE_BY_PERIODIC_
+            if (sync_bl_file(bl, 1) != 0 && server.binlog_fsync == APPENDFSYNC_ALWAYS)
+            {
+                ret = -1;
+            }
+#endif
             close(bl->fd_cur);
             bl->fd_cur = -1;
             log_debug("binlog_max_size=%d, bl_idx=%d, file_size=%d"
@@ -777,7 +865,110 @@ static void try_switch_bl_file(bl_ctx *bl)
             log_error("open new binlog fail for idx=%d", bl->cur_bl_idx);
         }
     }
+    return ret;
+}
+
+#ifndef _UPD_DBE_BY_PERIODIC_
+/* take the value by reference instead of serializing it on main thread,
+ * writers copy a string value before changing it in place if refcount != 1,
+ * so the pinned one is not changed until unpinned by main thread */
+static void pin_value_in_rdb(redisDb *rdb, sds key, wr_bl_info *info)
+{
+    robj k;
+    initObject(&k, REDIS_STRING, key);
+
+    robj *value = lookupKey(rdb, &k);
+    if (value)
+    {
+        const time_t expire = getExpire(rdb, &k);
+        incrRefCount(value);
+        info->val = value;
+        info->expire = expire == -1 ? 0 : expire;
+    }
+    else
+    {
+        log_debug("not exist in rdb, key=%s", key);
+    }
+}
+
+static sds make_pending_key(const wr_bl_info *info)
+{
+    sds k = sdsnewlen(&info->db_id, 1);
+    return sdscatlen(k, info->key->ptr, sdslen(info->key->ptr));
+}
+
+/* (db_id, key) -> count of writes queued for dbe and not in dbe yet.
+ * a read from dbe of such a key gets a stale value,
+ * only used by main thread */
+static dict *sc_dbe_inflight = 0;
+
+static void inflight_add(const wr_bl_info *info)
+{
+    if (sc_dbe_inflight == 0)
+    {
+        sc_dbe_inflight = dictCreate(&sdsSetDictType, NULL);
+    }
+    sds k = make_pending_key(info);
+    dictEntry *de = dictFind(sc_dbe_inflight, k);
+    if (de)
+    {
+        sdsfree(k);
+        de->val = (void *)((long)dictGetEntryVal(de) + 1);
+    }
+    else
+    {
+        dictAdd(sc_dbe_inflight, k, (void *)1L);
+    }
+}
+
+int bl_dbe_inflight(int db_id, const sds key)
+{
+    if (sc_dbe_inflight == 0 || dictSize(sc_dbe_inflight) == 0)
+    {
+        return 0;
+    }
+    const unsigned char id = (unsigned char)db_id;
+    sds k = sdsnewlen(&id, 1);
+    k = sdscatlen(k, key, sdslen(key));
+    const int ret = dictFind(sc_dbe_inflight, k) ? 1 : 0;
+    sdsfree(k);
+    return ret;
+}
+
+/* call by main thread, ctx is a list of keys from make_pending_key() */
+void after_dbe_written(void *ctx)
+{
+    list *l = (list *)ctx;
+    listNode *ln;
+    while ((ln = listFirst(l)))
+    {
+        sds k = listNodeValue(ln);
+        dictEntry *de = dictFind(sc_dbe_inflight, k);
+        if (de)
+        {
+            const long n = (long)dictGetEntryVal(de) - 1;
+            if (n <= 0)
+            {
+                dictDelete(sc_dbe_inflight, k);
+            }
+            else
+            {
+                de->val = (void *)n;
+            }
+        }
+        sdsfree(k);
+        listDelNode(l, ln);
+    }
+    listRelease(l);
+}
+#else
+int bl_dbe_inflight(int db_id, const sds key)
+{
+    (void)db_id;
+    (void)key;
+    return 0;
 }
+#endif
 
 /* async mode 2015.05.07 */
 //static int write_binlog_file(bl_ctx *bl, char *buf, int len, unsigned long long ds_id, int op_flag)
@@ -828,7 +1019,8 @@ static int write_binlog_file(bl_ctx *bl, unsigned char cmd, const robj *key, int
         commit_write_bl_task(ctx);
     }
 #else
-    if (server.has_cache == 1 && type == 1)
+    info->no_bl = server.is_slave == 0 && server.has_cache == 0 && server.wr_bl == 0;
+    if (server.has_dbe == 1 && type == 1)
     {
         if (cmd == OP_CMD_DEL)
         {
@@ -836,6 +1028,23 @@ static int write_binlog_file(bl_ctx *bl, unsigned char cmd, const robj *key, int
             dbmng_ctx *dbmngctx = get_entry_ctx(0);
             info->dbe = dbmngctx->db;
         }
+        else if (cmd == OP_CMD_RESTORE)
+        {
+            /* the whole value, only a string is one kv in dbe */
+            dbmng_ctx *dbmngctx = get_entry_ctx(0);
+            pin_value_in_rdb(dbmngctx->rdb, key->ptr, info);
+            if (info->val && info->val->type == REDIS_STRING)
+            {
+                info->dbe = dbmngctx->db;
+            }
+            else if (info->val)
+            {
+                log_error("ignore: restore of type(%d) to dbe, key=%s"
+                        , info->val->type, (const char *)key->ptr);
+                decrRefCount(info->val);
+                info->val = 0;
+            }
+        }
         else
         {
             const char cmd_type = get_blcmd_type(cmd);
@@ -844,7 +1053,7 @@ static int write_binlog_file(bl_ctx *bl, unsigned char cmd, const robj *key, int
                 /* need to update to dbe */
                 dbmng_ctx *dbmngctx = get_entry_ctx(0);
                 info->dbe = dbmngctx->db;
-                get_value_from_rdb(dbmngctx->rdb, key->ptr, &info->buf, &info->buf_len);
+                pin_value_in_rdb(dbmngctx->rdb, key->ptr, info);
             }
             else if (cmd_type != 'k'
                     && cmd_type != '-'
@@ -860,10 +1069,20 @@ static int write_binlog_file(bl_ctx *bl, unsigned char cmd, const robj *key, int
                      , cmd_type, cmd, get_cmdstr(cmd), server.dbe_ver);
             }
         }
+        if (info->dbe)
+        {
+            info->inflight = 1;
+            inflight_add(info);
+            /* dbe_get may have missed the key before the write */
+            mf_drop_neg(key);
+        }
     }
+    info->seq = ++server.bl_enq_seq;
+    stage_inc(&server.handle_bl_depth, &server.handle_bl_peak, 1);
     lockBlWriteList();
     listAddNodeTail(server.bl_writing, info);
     unlockBlWriteList();
+    signalBlWriteList();
 #endif
 
     return 0;
@@ -873,14 +1092,102 @@ static int write_binlog_file(bl_ctx *bl, unsigned char cmd, const robj *key, int
 char gWrblRunning = 1;
 extern void wakeupWrbl();
 extern void linux_thread_setname(char const* threadName);
+
+/* max wait of an idle stage thread, to check gWrblRunning */
+#define STAGE_WAIT_MS       100
+/* max items handed to next stage at once */
+#define STAGE_BATCH_MAX     64
+/* wait before retrying a dbe write that can't go on yet */
+#define STAGE_RETRY_MS      10
+/* tries to migrate a key before its dbe write is skipped */
+#define STAGE_MIGRATE_TRIES 100
+
+static void flush_to_wr_bl(list *l)
+{
+    const int cnt = listLength(l);
+    if (cnt == 0)
+    {
+        return;
+    }
+    stage_inc(&server.wr_bl_depth, &server.wr_bl_peak, cnt);
+    lockWrblList();
+    listJoin(server.wr_bl_list, l);
+    unlockWrblList();
+    signalWrblList();
+    /* one record to write_bl per item, an item is in handle_bl till then,
+     * dbmng_start_cp() waits for it */
+    stage_dec(&server.handle_bl_depth, cnt);
+}
+
+static void flush_to_wr_dbe(list *l)
+{
+    const int cnt = listLength(l);
+    if (cnt == 0)
+    {
+        return;
+    }
+    stage_inc(&server.wr_dbe_depth, &server.wr_dbe_peak, cnt);
+    lockWrDbeList();
+    listJoin(server.wr_dbe_list, l);
+    unlockWrDbeList();
+    signalWrDbeList();
+}
+
+/* refcount of rdb objects is only changed by main thread,
+ * call by stage threads, the list is released by after_unpin_values() */
+static void unpin_values(list *l)
+{
+    if (listLength(l) == 0)
+    {
+        listRelease(l);
+    }
+    else if (gWrblRunning == 0)
+    {
+        /* exiting, main thread may not drain completions any more */
+        log_prompt("leave %lu pinned values at exit", listLength(l));
+        listRelease(l);
+    }
+    else
+    {
+        commit_unpin_values(l);
+    }
+}
+
+/* keys written into dbe (or given up), call by stage threads,
+ * the list is released by after_dbe_written() */
+static void dbe_written(list *l)
+{
+    if (listLength(l) > 0 && gWrblRunning)
+    {
+        commit_dbe_written(l);
+        return;
+    }
+    listNode *ln;
+    while ((ln = listFirst(l)))
+    {
+        sdsfree(listNodeValue(ln));
+        listDelNode(l, ln);
+    }
+    listRelease(l);
+}
+
+/* call by main thread */
+void after_unpin_values(void *ctx)
+{
+    list *l = (list *)ctx;
+    listNode *ln;
+    while ((ln = listFirst(l)))
+    {
+        decrRefCount(listNodeValue(ln));
+        listDelNode(l, ln);
+    }
+    listRelease(l);
+}
 #endif
 
 void *do_handle_write_bl(void *ctx)
 {
-#ifdef _DS_STAT_
     struct timespec ts;
-    wr_bl_stat *tmp = &gWrBlTop[0];
-#endif
 #ifdef _UPD_DBE_BY_PERIODIC_
     async_wr_bl_ctx *wrbl_ctx = (async_wr_bl_ctx *)ctx;
     //log_prompt("wrbl_cnt=%d", wrbl_ctx->cnt);
@@ -891,78 +1198,91 @@ void *do_handle_write_bl(void *ctx)
 #else
     (void)ctx;
     linux_thread_setname("handle_bl");
+    list *batch = listCreate();
+    list *bl_batch = listCreate();
+    list *dbe_batch = listCreate();
+    list *unpin = listCreate();
+    list *written = listCreate();
     for (;;)
     {
         lockBlWriteList();
+        while (listLength(server.bl_writing) == 0 && gWrblRunning)
+        {
+            waitBlWriteList(STAGE_WAIT_MS);
+        }
         const unsigned int l_len = listLength(server.bl_writing);
-        const unsigned int blockCnt = listLength(server.write_bl_clients);
         if (l_len == 0)
         {
             unlockBlWriteList();
-            if (gWrblRunning)
-            {
-                if (blockCnt > 0)
-                {
-                    wakeupWrbl();
-                }
-                msleep(0);
-                continue;
-            }
-            else
-            {
-                log_prompt("wr_bl thread will exit, bl_list_len=%u", l_len);
-                break;
-            }
+            log_prompt("wr_bl thread will exit, bl_list_len=%u", l_len);
+            break;
         }
-        listNode *ln = listFirst(server.bl_writing);
-        wr_bl_info *info = listNodeValue(ln);
-        listDelNode(server.bl_writing, ln);
+        /* take all under one lock */
+        listJoin(batch, server.bl_writing);
         unlockBlWriteList();
+
+        listNode *ln;
+        while ((ln = listFirst(batch)))
+        {
+        wr_bl_info *info = listNodeValue(ln);
+        listDelNode(batch, ln);
+        if (listLength(bl_batch) >= STAGE_BATCH_MAX)
+        {
+            flush_to_wr_bl(bl_batch);
+        }
+        if (listLength(dbe_batch) >= STAGE_BATCH_MAX)
+        {
+            flush_to_wr_dbe(dbe_batch);
+        }
 #endif
 
         bl_ctx *const bl = info->bl;
         const unsigned long long ds_id = info->ds_id;
         const unsigned char op_flag = info->op_flag;
+#ifndef _UPD_DBE_BY_PERIODIC_
+        const unsigned long long seq = info->seq;
+#endif
 
-        int buf_len;
+        int buf_len = 0;
         char *buf = 0;
-#ifdef _DS_STAT_
-        ts = pf_get_time_tick();
-#endif
-        if (info->cmd == 0)
-        {
-            buf = serialize_digsig(info->key, &buf_len, info->db_id);
-        }
-        else
-        {
-            buf = serialize_op(info->cmd, info->key, info->argc, (const robj**)info->argv, info->ts, info->db_id, info->type, &buf_len);
-        }
-#ifdef _DS_STAT_
-        tmp->serialize_dur = pf_get_time_diff_nsec(ts, pf_get_time_tick()) / 1000;
-        tmp->cmd = info->cmd;
-        strncpy(tmp->key, info->key->ptr, sizeof(tmp->key) - 1);
-        tmp->key[sizeof(tmp->key) - 1] = 0;
-        tmp->buf_len = buf_len;
+#ifndef _UPD_DBE_BY_PERIODIC_
+        if (info->no_bl == 0)
 #endif
-        if (buf == 0)
         {
-            log_error("serialize_xx() fail, cmd=%d, key=%s", info->cmd, info->key->ptr);
+            ts = pf_get_time_tick();
+            if (info->cmd == 0)
+            {
+                buf = serialize_digsig(info->key, &buf_len, info->db_id);
+            }
+            else
+            {
+                buf = serialize_op(info->cmd, info->key, info->argc, (const robj**)info->argv, info->ts, info->db_id, info->type, &buf_len);
+            }
+            lh_record(LH_BL_SERIALIZE, pf_get_time_diff_nsec(ts, pf_get_time_tick()) / 1000);
+            if (buf == 0)
+            {
+                log_error("serialize_xx() fail, cmd=%d, key=%s", info->cmd, info->key->ptr);
+            }
         }
 
 #ifndef _UPD_DBE_BY_PERIODIC_
 #if 1
-        if (buf && info->dbe)
+        if ((buf || info->no_bl) && info->dbe)
         {
             /* notice wr_dbe_pthread */
-            lockWrDbeList();
-            listAddNodeTail(server.wr_dbe_list, info);
-            unlockWrDbeList();
+            listAddNodeTail(dbe_batch, info);
         }
         else
 #endif
 #endif
         {
             /* release resource */
+#ifndef _UPD_DBE_BY_PERIODIC_
+            if (info->inflight)
+            {
+                listAddNodeTail(written, make_pending_key(info));
+            }
+#endif
             decrRefCount(info->key);
             info->key = 0;
             if (info->argv)
@@ -980,281 +1300,702 @@ void *do_handle_write_bl(void *ctx)
             {
                 zfree(info->buf);
             }
-#endif
-            zfree(info);
-        }
-
-        if (buf == 0)
-        {
-#ifndef _UPD_DBE_BY_PERIODIC_
-            if (l_len <= (unsigned int)server.wr_bl_que_size && blockCnt > 0)
+            if (info->val)
             {
-                wakeupWrbl();
+                listAddNodeTail(unpin, info->val);
             }
 #endif
-            continue;
+            zfree(info);
         }
 
 #ifndef _UPD_DBE_BY_PERIODIC_
 #if 1
-        /* push into list */
+        /* push into list, even if serialize fail, to move on the synced seq */
         wr_bl_arg *arg = (wr_bl_arg*)zmalloc(sizeof(wr_bl_arg));
         arg->op_flag = op_flag;
         arg->ds_id = ds_id;
         arg->bl = bl;
         arg->buf = buf;
         arg->buf_len = buf_len;
-        lockWrblList();
-        listAddNodeTail(server.wr_bl_list, arg);
-        unlockWrblList();
+        arg->seq = seq;
+        listAddNodeTail(bl_batch, arg);
 #else
         zfree(buf);
 #endif
-        if (l_len <= (unsigned int)server.wr_bl_que_size && blockCnt > 0)
+#else
+        if (buf == 0)
         {
-            wakeupWrbl();
+            continue;
         }
-#else
         write_bl_to_file(buf, buf_len, bl, ds_id, op_flag);
         zfree(buf);
 #endif
     }
+#ifndef _UPD_DBE_BY_PERIODIC_
+        flush_to_wr_bl(bl_batch);
+        flush_to_wr_dbe(dbe_batch);
+        if (listLength(unpin) > 0)
+        {
+            unpin_values(unpin);
+            unpin = listCreate();
+        }
+        if (listLength(written) > 0)
+        {
+            dbe_written(written);
+            written = listCreate();
+        }
+    }
+    listRelease(batch);
+    listRelease(bl_batch);
+    listRelease(dbe_batch);
+    listRelease(unpin);
+    listRelease(written);
+#endif
     return (void*)NULL;
 }
 
-static void write_bl_to_file(const char *buf, int buf_len, bl_ctx *bl, unsigned long long ds_id, unsigned char op_flag)
+/* ret: 0 - succ; -1 - fail */
+static int write_bl_to_file(const char *buf, int buf_len, bl_ctx *bl, unsigned long long ds_id, unsigned char op_flag)
 {
 #ifndef _UPD_DBE_BY_PERIODIC_
     /* open binlog file */
     if (try_open_bl_file(bl) != 0)
     {
-        return;
+        return -1;
     }
 #endif
     const int fd = bl->fd_cur;
-#ifdef _DS_STAT_
-    struct timespec ts;
-    wr_bl_stat *tmp = &gWrBlTop[0];
-    ts = pf_get_time_tick();
-#endif
-    const int32_t ret = bin_put_v2(fd, (const uint8_t *)buf, buf_len, (uint64_t)ds_id);
-#ifdef _DS_STAT_
-    tmp->io_dur = pf_get_time_diff_nsec(ts, pf_get_time_tick()) / 1000;
-    log_test("write bl file(fd=%d, idx=%d): ret=%d, bl_len=%d, dur=%dms"
-        , fd, bl->cur_bl_idx, ret, buf_len, tmp->io_dur);
-#endif
+    const struct timespec ts = pf_get_time_tick();
+    const int32_t ret = bin_put_v3(fd, (const uint8_t *)buf, buf_len, (uint64_t)ds_id);
+    const long long io_dur = pf_get_time_diff_nsec(ts, pf_get_time_tick()) / 1000;
+    lh_record(LH_BL_WRITE, io_dur);
+    log_test("write bl file(fd=%d, idx=%d): ret=%d, bl_len=%d, dur=%lldus"
+        , fd, bl->cur_bl_idx, ret, buf_len, io_dur);
 
     if (ret < 0)
     {
-        log_error("bin_put_v2() fail, fd=%d, len=%d, ret=%d, ds_id=%llu, op_flag=%d",
+        log_error("bin_put_v3() fail, fd=%d, len=%d, ret=%d, ds_id=%llu, op_flag=%d",
             fd, buf_len, ret, ds_id, op_flag);
+        return -1;
     }
 
 #ifndef _UPD_DBE_BY_PERIODIC_
-    try_switch_bl_file(bl);
+    sc_bl_unsynced = 1;
+    return try_switch_bl_file(bl);
+#else
+    return 0;
 #endif
+}
 
-#ifdef _DS_STAT_
-    /* stat */
-    int min_idx = 0;
-    unsigned int k;
-    for (k = 1; k < sizeof(gWrBlTop) / sizeof(gWrBlTop[0]); k++)
+#ifndef _UPD_DBE_BY_PERIODIC_
+/* max records of one group commit */
+#define GROUP_COMMIT_MAX    1024
+
+/* write records of one group with one writev
+ * ret: 0 - succ; -1 - fail */
+static int write_bl_batch_to_file(bl_ctx *bl, const bin_rec_t *recs, int cnt)
+{
+    if (cnt == 1)
     {
-        if (gWrBlTop[k].valid == 0)
-        {
-            min_idx = k;
-            break;
-        }
-        if (gWrBlTop[k].io_dur < gWrBlTop[min_idx].io_dur)
-        {
-            min_idx = k;
-        }
+        return write_bl_to_file((const char *)recs[0].buf, recs[0].len, bl, recs[0].sid, 0);
+    }
+
+    /* open binlog file */
+    if (try_open_bl_file(bl) != 0)
+    {
+        return -1;
     }
-    memcpy(&gWrBlTop[min_idx], &gWrBlTop[0], sizeof(gWrBlTop[0]));
-    gWrBlTop[min_idx].valid = 1;
-    gWrBlTop[min_idx].time = time(NULL);
-    if (tmp->io_dur > gWrBlMax)
+
+    const struct timespec ts = pf_get_time_tick();
+    const int ret = bin_put_batch_v3(bl->fd_cur, recs, cnt);
+    lh_record(LH_BL_WRITE, pf_get_time_diff_nsec(ts, pf_get_time_tick()) / 1000);
+    if (ret < 0)
     {
-        gWrBlMax = tmp->io_dur;
+        log_error("bin_put_batch_v3() fail, fd=%d, cnt=%d, ret=%d", bl->fd_cur, cnt, ret);
+        return -1;
     }
-    if (tmp->io_dur < gWrBlMin || gWrBlMin == 0)
+    sc_bl_unsynced = 1;
+
+    return try_switch_bl_file(bl);
+}
+
+/* records up to seq has been written (and synced if policy is always) */
+static void set_bl_synced_seq(unsigned long long seq)
+{
+    server.bl_synced_seq = seq;
+    __sync_synchronize();
+    if (listLength(server.write_bl_clients) > 0)
     {
-        gWrBlMin = tmp->io_dur;
+        /* some clients are waiting for binlog sync */
+        wakeupWrbl();
     }
-    gWrBlTotal += tmp->io_dur;
-    gWrBlCnt++;
-#endif
 }
 
-#ifndef _UPD_DBE_BY_PERIODIC_
 void *do_write_bl(void *ctx)
 {
     (void)ctx;
     linux_thread_setname("write_bl");
+    list *batch = listCreate();
+    bin_rec_t *recs = (bin_rec_t *)zmalloc(sizeof(bin_rec_t) * GROUP_COMMIT_MAX);
+    wr_bl_arg **args = (wr_bl_arg **)zmalloc(sizeof(wr_bl_arg *) * GROUP_COMMIT_MAX);
+    bl_ctx *last_bl = 0;
     for (;;)
     {
         lockWrblList();
+        while (listLength(server.wr_bl_list) == 0 && gWrblRunning)
+        {
+            waitWrblList(STAGE_WAIT_MS);
+            if (listLength(server.wr_bl_list) == 0)
+            {
+                /* everysec: sync the tail of last group */
+                sync_bl_file(last_bl, 0);
+            }
+        }
         const unsigned int l_len = listLength(server.wr_bl_list);
         if (l_len == 0)
         {
             unlockWrblList();
-            if (gWrblRunning)
+            log_prompt("handle_bl thread will exit, handle_bl_list_len=%u", l_len);
+            break;
+        }
+        listJoin(batch, server.wr_bl_list);
+        unlockWrblList();
+
+        listNode *ln;
+        while (listLength(batch) > 0)
+        {
+            /* group records of the same binlog */
+            int n = 0;
+            int cnt = 0;
+            bl_ctx *bl = 0;
+            while ((ln = listFirst(batch)) && n < GROUP_COMMIT_MAX)
             {
-                msleep(0);
-                continue;
+                wr_bl_arg *info = listNodeValue(ln);
+                if (bl && info->bl != bl)
+                {
+                    break;
+                }
+                bl = info->bl;
+                listDelNode(batch, ln);
+                args[n++] = info;
+                if (info->buf)
+                {
+                    recs[cnt].buf = (const uint8_t *)info->buf;
+                    recs[cnt].len = info->buf_len;
+                    recs[cnt].sid = info->ds_id;
+                    cnt++;
+                }
             }
-            else
+
+            /* the seq is never advanced over records not in the file */
+            if (cnt > 0)
             {
-                log_prompt("handle_bl thread will exit, handle_bl_list_len=%u", l_len);
-                break;
+                if (write_bl_batch_to_file(bl, recs, cnt) != 0)
+                {
+                    bl_io_fail("writing");
+                }
+                server.stat_bl_groups++;
+                server.stat_bl_group_recs += cnt;
             }
-        }
-        listNode *ln = listFirst(server.wr_bl_list);
-        wr_bl_arg *info = listNodeValue(ln);
-        listDelNode(server.wr_bl_list, ln);
-        unlockWrblList();
+            if (sync_bl_file(bl, 0) != 0 && server.binlog_fsync == APPENDFSYNC_ALWAYS)
+            {
+                bl_io_fail("syncing");
+            }
+            last_bl = bl;
 
-        write_bl_to_file(info->buf, info->buf_len, info->bl, info->ds_id, info->op_flag);
-        zfree(info->buf);
-        zfree(info);
+            const unsigned long long seq = args[n - 1]->seq;
+            int i;
+            for (i = 0; i < n; i++)
+            {
+                zfree(args[i]->buf);
+                zfree(args[i]);
+            }
+            stage_dec(&server.wr_bl_depth, n);
+            set_bl_synced_seq(seq);
+        }
     }
+    sync_bl_file(last_bl, 1);
+    listRelease(batch);
+    zfree(recs);
+    zfree(args);
     return (void*)NULL;
 }
 
+/* latest state of a string key or a deleted key, not written into dbe yet */
+typedef struct wr_dbe_pending_st
+{
+    void *dbe;
+    char *pdel_key;  /* pdelete before put */
+    size_t pdel_key_len;
+    kvec_t put;      /* put.k == NULL: no put */
+    robj *val;       /* pinned value of put, put.v is serialized from it at flush */
+    int expire;
+} wr_dbe_pending;
+
+/* (db_id, key) -> wr_dbe_pending, only used by write_dbe thread */
+static dict *sc_wr_pending = 0;
+static long long sc_wr_pending_since = 0; /* ms of the oldest pending write */
+/* values done by write_dbe thread, to be unpinned by main thread */
+static list *sc_unpin = 0;
+/* keys done by write_dbe thread, handed to main thread when nothing is pending */
+static list *sc_written = 0;
+
+/* serialize (and compress) the pinned value out of main thread */
+static void serialize_put(kvec_t *put, robj **val, int expire)
+{
+    if (*val)
+    {
+        int len = 0;
+        put->v = serializeObjExp(*val, &len, expire);
+        put->vs = len;
+        listAddNodeTail(sc_unpin, *val);
+        *val = 0;
+    }
+}
+
+static void drop_put(wr_dbe_pending *p)
+{
+    zfree(p->put.k);
+    if (p->put.v)
+    {
+        zfree(p->put.v);
+    }
+    if (p->val)
+    {
+        /* superseded, never serialized */
+        listAddNodeTail(sc_unpin, p->val);
+        p->val = 0;
+    }
+    memset(&p->put, 0, sizeof(p->put));
+}
+
+static void issue_pending(wr_dbe_pending *p)
+{
+    if (p->pdel_key)
+    {
+        dbe_pdelete(p->dbe, p->pdel_key, p->pdel_key_len);
+        zfree(p->pdel_key);
+        server.stat_wr_dbe_issued++;
+    }
+    if (p->put.k)
+    {
+        serialize_put(&p->put, &p->val, p->expire);
+        dbe_put(p->dbe, p->put.k, p->put.ks, p->put.v, p->put.vs);
+        server.stat_wr_dbe_issued++;
+    }
+    zfree(p);
+}
+
+/* keep the latest state of the key, the param and the pinned value are taken over */
+static void absorb_pending(wr_bl_info *info, upd_dbe_param *param)
+{
+    if (dictSize(sc_wr_pending) == 0)
+    {
+        sc_wr_pending_since = ustime() / 1000;
+    }
+
+    sds k = make_pending_key(info);
+    wr_dbe_pending *p;
+    dictEntry *de = dictFind(sc_wr_pending, k);
+    if (de)
+    {
+        sdsfree(k);
+        p = dictGetEntryVal(de);
+    }
+    else
+    {
+        p = zcalloc(sizeof(wr_dbe_pending));
+        p->dbe = info->dbe;
+        dictAdd(sc_wr_pending, k, p);
+    }
+
+    if (param->pdel_key)
+    {
+        /* the key is deleted, former writes are useless */
+        if (p->pdel_key)
+        {
+            zfree(p->pdel_key);
+            server.stat_wr_dbe_coalesced++;
+        }
+        if (p->put.k)
+        {
+            drop_put(p);
+            server.stat_wr_dbe_coalesced++;
+        }
+        p->pdel_key = param->pdel_key;
+        p->pdel_key_len = param->pdel_key_len;
+    }
+    else
+    {
+        if (p->put.k)
+        {
+            drop_put(p);
+            server.stat_wr_dbe_coalesced++;
+        }
+        p->put = param->one;
+        p->val = info->val;
+        p->expire = info->expire;
+        info->val = 0;
+    }
+}
+
+/* before a collection op of the key, keep the order of ops on it */
+static void flush_pending_key(const wr_bl_info *info)
+{
+    if (dictSize(sc_wr_pending) == 0)
+    {
+        return;
+    }
+    sds k = make_pending_key(info);
+    dictEntry *de = dictFind(sc_wr_pending, k);
+    if (de)
+    {
+        wr_dbe_pending *p = dictGetEntryVal(de);
+        dictDelete(sc_wr_pending, k);
+        issue_pending(p);
+    }
+    sdsfree(k);
+}
+
+/* deletes one by one, puts in one dbe_mput per dbe */
+static void flush_pending()
+{
+    const unsigned long n = dictSize(sc_wr_pending);
+    if (n == 0)
+    {
+        return;
+    }
+
+    void **dbes = zmalloc(sizeof(void *) * n);
+    kvec_t **kvs = zmalloc(sizeof(kvec_t *) * n);
+    size_t *cnts = zcalloc(sizeof(size_t) * n);
+    int groups = 0;
+    int i;
+
+    dictIterator *di = dictGetIterator(sc_wr_pending);
+    dictEntry *de;
+    while ((de = dictNext(di)) != NULL)
+    {
+        wr_dbe_pending *p = dictGetEntryVal(de);
+        if (p->pdel_key)
+        {
+            dbe_pdelete(p->dbe, p->pdel_key, p->pdel_key_len);
+            zfree(p->pdel_key);
+            server.stat_wr_dbe_issued++;
+        }
+        if (p->put.k)
+        {
+            for (i = 0; i < groups; i++)
+            {
+                if (dbes[i] == p->dbe)
+                {
+                    break;
+                }
+            }
+            if (i == groups)
+            {
+                dbes[i] = p->dbe;
+                kvs[i] = zmalloc(sizeof(kvec_t) * n);
+                groups++;
+            }
+            serialize_put(&p->put, &p->val, p->expire);
+            kvs[i][cnts[i]++] = p->put;
+        }
+        zfree(p);
+    }
+    dictReleaseIterator(di);
+    dictEmpty(sc_wr_pending);
+
+    for (i = 0; i < groups; i++)
+    {
+        server.stat_wr_dbe_issued += cnts[i];
+        if (server.dbe_ver == DBE_VER_HIDB)
+        {
+            /* hidb don't support dbe_mput */
+            size_t j;
+            for (j = 0; j < cnts[i]; j++)
+            {
+                dbe_put(dbes[i], kvs[i][j].k, kvs[i][j].ks, kvs[i][j].v, kvs[i][j].vs);
+            }
+            zfree(kvs[i]);
+        }
+        else
+        {
+            /* kv is released by dbe */
+            const int ret = dbe_mput(dbes[i], kvs[i], cnts[i]);
+            if (ret != 0)
+            {
+                log_error("dbe_mput fail, ret=%d, dbe=%p, op_cnt=%zu", ret, dbes[i], cnts[i]);
+            }
+        }
+    }
+    zfree(dbes);
+    zfree(kvs);
+    zfree(cnts);
+}
+
+static int pending_expired()
+{
+    const unsigned long n = dictSize(sc_wr_pending);
+    return n > 0
+        && (n >= (unsigned long)server.wr_dbe_coalesce_max
+            || ustime() / 1000 - sc_wr_pending_since >= server.wr_dbe_coalesce_ms);
+}
+
 void *do_write_dbe(void *ctx)
 {
     (void)ctx;
     linux_thread_setname("write_dbe");
+    list *batch = listCreate();
+    sc_wr_pending = dictCreate(&sdsSetDictType, NULL);
+    sc_unpin = listCreate();
+    sc_written = listCreate();
     for (;;)
     {
         lockWrDbeList();
+        while (listLength(server.wr_dbe_list) == 0 && gWrblRunning)
+        {
+            if (km_running())
+            {
+                /* idle, go on migrating dbe keys */
+                break;
+            }
+            if (dictSize(sc_wr_pending) == 0)
+            {
+                waitWrDbeList(STAGE_WAIT_MS);
+                continue;
+            }
+            const long long left = sc_wr_pending_since + server.wr_dbe_coalesce_ms - ustime() / 1000;
+            if (left <= 0)
+            {
+                break;
+            }
+            waitWrDbeList(left < STAGE_WAIT_MS ? (int)left : STAGE_WAIT_MS);
+        }
         const unsigned int l_len = listLength(server.wr_dbe_list);
         if (l_len == 0)
         {
             unlockWrDbeList();
-            if (gWrblRunning)
+            if (dictSize(sc_wr_pending) > 0)
             {
-                msleep(0);
+                /* window is over, or exit */
+                flush_pending();
+                unpin_values(sc_unpin);
+                sc_unpin = listCreate();
+                dbe_written(sc_written);
+                sc_written = listCreate();
                 continue;
             }
-            else
+            if (gWrblRunning && km_running())
             {
-                log_prompt("wr_dbe thread will exit, dbe_list_len=%u", l_len);
-                break;
+                km_step();
+                continue;
             }
+            log_prompt("wr_dbe thread will exit, dbe_list_len=%u", l_len);
+            break;
         }
-        listNode *ln = listFirst(server.wr_dbe_list);
-        wr_bl_info *info = listNodeValue(ln);
-        listDelNode(server.wr_dbe_list, ln);
+        listJoin(batch, server.wr_dbe_list);
         unlockWrDbeList();
 
-        upd_dbe_param param;
+        /* coalesce writes of string keys, 0: disable */
+        const int coalesce = server.wr_dbe_coalesce_max > 0;
+
+        listNode *ln;
+        while ((ln = listFirst(batch)))
         {
-            /* succ & need to set to dbe, make param */
-            sds key = info->key->ptr;
-            memset(&param, 0, sizeof(param));
+            wr_bl_info *info = listNodeValue(ln);
+            listDelNode(batch, ln);
 
-            if (info->cmd == OP_CMD_DEL)
+            int given_up = 0;
+            if (server.dbe_key_mixed && server.enc_kv && info->dbe)
             {
-                if (server.enc_kv == 0)
+                /* v1 rows of the key are moved to v2 before it's changed,
+                 * a v2 row next to a live v1 one would mix old and new rows */
+                int tries = 0;
+                while (km_migrate_key(info->dbe, info->key->ptr, sdslen(info->key->ptr)) != 0)
                 {
-                    param.pdel_key_len = sdslen(key);
-                    param.pdel_key = zmalloc(param.pdel_key_len + 1);
-                    strncpy(param.pdel_key, key, param.pdel_key_len);
-                    param.pdel_key[param.pdel_key_len] = 0;
-                }
-                else
-                {
-                    param.pdel_key = encode_prefix_key((const char*)key, sdslen(key), 0, &param.pdel_key_len);
+                    if (gWrblRunning == 0 || ++tries >= STAGE_MIGRATE_TRIES)
+                    {
+                        /* only this key is skipped, it stays in flight */
+                        log_error("skip dbe write of a key not migrated, tries=%d, cmd=%d, key=%s"
+                                , tries, info->cmd, (const char*)info->key->ptr);
+                        server.stat_wr_dbe_skipped++;
+                        given_up = 1;
+                        break;
+                    }
+                    usleep(STAGE_RETRY_MS * 1000);
                 }
             }
-            else
+
+            upd_dbe_param param;
+            memset(&param, 0, sizeof(param));
+            if (given_up == 0)
             {
-                param.cmd_type = get_blcmd_type(info->cmd);
-                if (param.cmd_type == KEY_TYPE_STRING)
+                /* succ & need to set to dbe, make param */
+                sds key = info->key->ptr;
+
+                if (info->cmd == OP_CMD_DEL)
                 {
-                    if (info->buf == NULL)
+                    if (server.enc_kv == 0)
                     {
-                        log_error("impossible: string cmd=%d, val=%p, val_len=%d, key=%s"
-                                , info->cmd, info->buf, info->buf_len, (const char*)key);
-                        info->dbe = NULL;
+                        param.pdel_key_len = sdslen(key);
+                        param.pdel_key = zmalloc(param.pdel_key_len + 1);
+                        strncpy(param.pdel_key, key, param.pdel_key_len);
+                        param.pdel_key[param.pdel_key_len] = 0;
                     }
                     else
                     {
-                        if (server.enc_kv == 0)
-                        {
-                            param.one.ks = sdslen(key);
-                            param.one.k = zmalloc(param.one.ks + 1);
-                            strncpy(param.one.k, key, param.one.ks);
-                            param.one.k[param.one.ks] = 0;
-                        }
-                        else
-                        {
-                            param.one.k = encode_string_key((const char*)key, sdslen(key), &(param.one.ks));
-                        }
-                        param.one.v = info->buf;
-                        param.one.vs = info->buf_len;
-                        info->buf = 0;
-                        info->buf_len = 0;
+                        param.pdel_key = encode_prefix_key((const char*)key, sdslen(key), 0, &param.pdel_key_len);
                     }
                 }
-                else if (server.dbe_ver == DBE_VER_HIDB)
-                {
-                    log_error("hidb don't support type(%c), cmd=%d(%s)"
-                            , param.cmd_type, info->cmd, get_cmdstr(info->cmd));
-                    info->dbe = NULL;
-                }
                 else
                 {
-                    if (param.cmd_type == KEY_TYPE_LIST)
-                    {
-                        make_list_dbe_data(info, &param);
-                    }
-                    else if (param.cmd_type == KEY_TYPE_SET)
-                    {
-                        make_set_dbe_data(info, &param);
-                    }
-                    else if (param.cmd_type == KEY_TYPE_ZSET)
+                    /* a restore reaching here has a string value */
+                    param.cmd_type = info->cmd == OP_CMD_RESTORE
+                        ? KEY_TYPE_STRING : get_blcmd_type(info->cmd);
+                    if (param.cmd_type == KEY_TYPE_STRING)
                     {
-                        make_zset_dbe_data(info, &param);
+                        if (info->buf == NULL && info->val == NULL)
+                        {
+                            log_error("impossible: string cmd=%d, val=%p, val_len=%d, key=%s"
+                                    , info->cmd, info->buf, info->buf_len, (const char*)key);
+                            info->dbe = NULL;
+                        }
+                        else
+                        {
+                            if (server.enc_kv == 0)
+                            {
+                                param.one.ks = sdslen(key);
+                                param.one.k = zmalloc(param.one.ks + 1);
+                                strncpy(param.one.k, key, param.one.ks);
+                                param.one.k[param.one.ks] = 0;
+                            }
+                            else
+                            {
+                                param.one.k = encode_string_key((const char*)key, sdslen(key), &(param.one.ks));
+                            }
+                            /* v is serialized from info->val if no buf */
+                            param.one.v = info->buf;
+                            param.one.vs = info->buf_len;
+                            info->buf = 0;
+                            info->buf_len = 0;
+                        }
                     }
-                    else if (param.cmd_type == KEY_TYPE_HASH)
+                    else if (server.dbe_ver == DBE_VER_HIDB)
                     {
-                        make_hash_dbe_data(info, &param);
+                        log_error("hidb don't support type(%c), cmd=%d(%s)"
+                                , param.cmd_type, info->cmd, get_cmdstr(info->cmd));
+                        info->dbe = NULL;
                     }
                     else
                     {
-                        log_error("wrong cmd_type=%c, cmd=%d, key=%s"
-                            , param.cmd_type, info->cmd, (const char*)key);
-                        info->dbe = NULL;
+                        if (param.cmd_type == KEY_TYPE_LIST)
+                        {
+                            make_list_dbe_data(info, &param);
+                        }
+                        else if (param.cmd_type == KEY_TYPE_SET)
+                        {
+                            make_set_dbe_data(info, &param);
+                        }
+                        else if (param.cmd_type == KEY_TYPE_ZSET)
+                        {
+                            make_zset_dbe_data(info, &param);
+                        }
+                        else if (param.cmd_type == KEY_TYPE_HASH)
+                        {
+                            make_hash_dbe_data(info, &param);
+                        }
+                        else
+                        {
+                            log_error("wrong cmd_type=%c, cmd=%d, key=%s"
+                                , param.cmd_type, info->cmd, (const char*)key);
+                            info->dbe = NULL;
+                        }
                     }
                 }
             }
-        }
 
-        /* set to dbe */
-        log_test("do_write_dbe: list_len=%d, dbe=%p", l_len, info->dbe);
-        dbe_set_one_op(info->dbe, &param);
+            /* set to dbe */
+            log_test("do_write_dbe: list_len=%d, dbe=%p", l_len, info->dbe);
+            if (given_up)
+            {
+                /* skipped, logged above */
+            }
+            else if (coalesce && info->dbe
+                && (param.pdel_key || param.cmd_type == KEY_TYPE_STRING))
+            {
+                absorb_pending(info, &param);
+                if (dictSize(sc_wr_pending) >= (unsigned long)server.wr_dbe_coalesce_max)
+                {
+                    flush_pending();
+                }
+            }
+            else
+            {
+                flush_pending_key(info);
+                if (param.cmd_type == KEY_TYPE_STRING && param.one.k)
+                {
+                    serialize_put(&param.one, &info->val, info->expire);
+                }
+                dbe_set_one_op(info->dbe, &param);
+                server.stat_wr_dbe_issued++;
+            }
 
-        /* free resource */
-        decrRefCount(info->key);
-        info->key = 0;
-        if (info->argv)
-        {
-            int j;
-            for (j = 0; j < info->argc; j++)
+            /* free resource, a skipped key is never released from
+             * sc_dbe_inflight, so it's neither evicted nor read from dbe */
+            if (info->inflight && given_up == 0)
+            {
+                listAddNodeTail(sc_written, make_pending_key(info));
+            }
+            decrRefCount(info->key);
+            info->key = 0;
+            if (info->argv)
+            {
+                int j;
+                for (j = 0; j < info->argc; j++)
+                {
+                    decrRefCount(info->argv[j]);
+                }
+                zfree(info->argv);
+                info->argv = 0;
+            }
+            if (info->buf)
+            {
+                zfree(info->buf);
+            }
+            if (info->val)
             {
-                decrRefCount(info->argv[j]);
+                listAddNodeTail(sc_unpin, info->val);
             }
-            zfree(info->argv);
-            info->argv = 0;
+            zfree(info);
+            stage_dec(&server.wr_dbe_depth, 1);
         }
-        if (info->buf)
+
+        if (coalesce == 0 || pending_expired())
         {
-            zfree(info->buf);
+            flush_pending();
         }
-        zfree(info);
+        if (listLength(sc_unpin) > 0)
+        {
+            unpin_values(sc_unpin);
+            sc_unpin = listCreate();
+        }
+        if (listLength(sc_written) > 0 && dictSize(sc_wr_pending) == 0)
+        {
+            /* a coalesced write is in dbe only after its flush */
+            dbe_written(sc_written);
+            sc_written = listCreate();
+        }
+        /* a batch between ones of writes, never starved by them */
+        km_step();
     }
+    listRelease(batch);
+    dictRelease(sc_wr_pending);
+    sc_wr_pending = 0;
+    listRelease(sc_unpin);
+    sc_unpin = 0;
+    dbe_written(sc_written);
+    sc_written = 0;
     return (void*)NULL;
 }
 #endif
@@ -1372,36 +2113,23 @@ handle_next_c:
     }
 #else
     (void)p_ctx;
-    lockBlWriteList();
-    const unsigned int wait_c_cnt = listLength(server.write_bl_clients);
-    if (wait_c_cnt)
-    {
-        log_test("gono wrbl_blocking_c: %u", wait_c_cnt);
-        /* go on startup next c */
-        redisClient *c = 0;
-        ln = listFirst(server.write_bl_clients);
-        c = listNodeValue(ln);
-        listDelNode(server.write_bl_clients, ln);
-        unlockBlWriteList();
-
-        c->wr_bl_block_dur = server.ustime - c->block_start_time;
-        //log_prompt("wait in write_bl_que: %lld(us), cmd=%s, waiting_c=%d, waiting_bl=%d"
-        //        , c->wr_bl_dur, c->argv[0]->ptr, wait_c_cnt, old_cnt);
-
-        c->flags &= (~REDIS_WR_BL_WAIT);
-        aeCreateFileEvent(server.el, c->fd, AE_READABLE, readQueryFromClient, c);
-        //struct redisCommand *cmd = lookupCommand(c->argv[0]->ptr);
-        call(c);
-        resetClient(c);
-        if (c->querybuf && sdslen(c->querybuf) > 0)
+    /* release the clients whose binlog records have been synced */
+    const unsigned long long synced = server.bl_synced_seq;
+    listIter li;
+    listRewind(server.write_bl_clients, &li);
+    while ((ln = listNext(&li)))
+    {
+        redisClient *c = listNodeValue(ln);
+        if (c->bl_wait_seq > synced)
         {
-            log_info("processInputBuff() after_write_bl...");
-            processInputBuffer(c);
+            continue;
         }
-    }
-    else
-    {
+
+        lockBlWriteList();
+        listDelNode(server.write_bl_clients, ln);
         unlockBlWriteList();
+
+        unblock_client_on_bl_sync(c);
     }
 #endif
 }
@@ -23,7 +23,8 @@ extern int bl_write_op(void *binlog, unsigned char cmd, const robj *key, int arg
 extern int bl_write_confirm(void *binlog, const char *key, unsigned char db_id);
 
 extern void *bl_get_read_it(const char *path, int idx, int offset);
-/* return:
+/* *buf points into the iterator (mmap of the file), valid until next call
+ * return:
  * 0 - succ
  * 1 - over
  */
@@ -41,8 +42,12 @@ extern void *do_handle_write_bl(void *ctx);
 #ifndef _UPD_DBE_BY_PERIODIC_
 extern void *do_write_bl(void *ctx);
 extern void *do_write_dbe(void *ctx);
+extern void after_unpin_values(void *ctx);
+extern void after_dbe_written(void *ctx);
 #endif
 extern void after_write_bl(void *ctx);
+/* 1: the key has writes not in dbe yet */
+extern int bl_dbe_inflight(int db_id, const sds key);
 
 extern void redo_bl(redisDb *rdb, void *binlog, int load_bl_cnt);
 extern void reset_bl(void *binlog);
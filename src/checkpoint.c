@@ -7,6 +7,7 @@
 #include "ds_log.h"
 #include "ds_ctrl.h"
 #include "codec_key.h"
+#include "latency_hist.h"
 
 #include <sys/timeb.h>
 
@@ -239,7 +240,6 @@ static void finish_cp_transaction(dbmng_ctx *ctx, int confirm_flg)
 void dbe_set_one_op(void *dbe, void *parameter)
 {
     struct timespec ts;
-    dbe_stat *tmp = &gDbeSetTop[0];
 
     upd_dbe_param *param = (upd_dbe_param *)parameter;
     int j;
@@ -300,8 +300,9 @@ void dbe_set_one_op(void *dbe, void *parameter)
 #endif
     }
 
-    tmp->io_dur = pf_get_time_diff_nsec(ts, pf_get_time_tick()) / 1000;
-    log_test("dbe_set_op: dur=%dms", tmp->io_dur);
+    const long long io_dur = pf_get_time_diff_nsec(ts, pf_get_time_tick()) / 1000;
+    log_test("dbe_set_op: dur=%lldus", io_dur);
+    lh_record(LH_DBE_SET, io_dur);
 
 #if 0   /* free by dbe */
         /* free resource */
@@ -318,41 +319,6 @@ void dbe_set_one_op(void *dbe, void *parameter)
         }
         zfree(param->kv[1]);
 #endif
-
-    {
-        /* for stat. */
-        int min_idx = 0;
-        unsigned int k;
-        for (k = 1; k < sizeof(gDbeSetTop) / sizeof(gDbeSetTop[0]); k++)
-        {
-            if (gDbeSetTop[k].valid == 0)
-            {
-                min_idx = k;
-                break;
-            }
-            if (gDbeSetTop[k].io_dur < gDbeSetTop[min_idx].io_dur)
-            {
-                min_idx = k;
-            }
-        }
-        if (min_idx != 0)
-        {
-            memcpy(&gDbeSetTop[min_idx], &gDbeSetTop[0], sizeof(gDbeSetTop[0]));
-            gDbeSetTop[min_idx].valid = 1;
-            gDbeSetTop[min_idx].time = time(NULL);
-        }
-        if (tmp->io_dur > gDbeSetMax)
-        {
-            gDbeSetMax = tmp->io_dur;
-        }
-        if (tmp->io_dur < gDbeSetMin || gDbeSetMin == 0)
-        {
-            gDbeSetMin = tmp->io_dur;
-        }
-        gDbeSetTotal += tmp->io_dur;
-        gDbeSetCnt++;
-        memset(&gDbeSetTop[0], 0, sizeof(gDbeSetTop[0]));
-    }
 }
 
 void do_dbe_set(dbmng_ctx *ctx)
@@ -106,126 +106,229 @@ static int hex_str_to_int(const char *ptr, int ptr_len, unsigned long long *rslt
     return 0;
 }
 
-char *encode_prefix_key(const char* key, size_t k_len, char key_type, size_t *enc_len)
+/* ret: bytes of v in buf, at most 10 */
+static int varint_put(unsigned char *buf, uint64_t v)
 {
-    if (!key || !enc_len || k_len > 255 || k_len == 0)
+    int n = 0;
+    while (v >= 0x80)
     {
-        return NULL;
+        buf[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
     }
-    //log_prompt("encode_prefix_key: key=%s, type=%c", key, key_type);
-    /* key_len(2 bytes) + key(n bytes) + key_type(1 byte, optional) */
-    const unsigned char key_type_len = key_type == 0 ? 0 : 1;
-    *enc_len = 2 + k_len + key_type_len;
-    char *enc = zmalloc(*enc_len + 1); /* 1 for '\0' */
-    char *ptr = enc;
-
-    const unsigned char k_len_ = k_len % 256;
-    ptr += int_to_hex_str(ptr, (const char*)&k_len_, sizeof(k_len_));
-
-    memcpy(ptr, key, k_len);
-    ptr += k_len;
+    buf[n++] = (unsigned char)v;
+    return n;
+}
 
-    *ptr = key_type;
-    ptr += key_type_len;
+/* ret: bytes read from buf, 0 - fail */
+static int varint_get(const unsigned char *buf, size_t len, uint64_t *v)
+{
+    uint64_t r = 0;
+    size_t n;
+    for (n = 0; n < len && n < 10; n++)
+    {
+        r |= (uint64_t)(buf[n] & 0x7f) << (7 * n);
+        if ((buf[n] & 0x80) == 0)
+        {
+            *v = r;
+            return n + 1;
+        }
+    }
+    return 0;
+}
 
-    *ptr = 0;
-    return enc;
+/* ret:
+ * 0 - succ
+ * 1 - fail
+ */
+static int hex_str_to_bytes(const char *hex, size_t hex_len, unsigned char *rslt)
+{
+    size_t i;
+    for (i = 0; i + 1 < hex_len; i += 2)
+    {
+        if (hex_str_to_byte(hex + i, 2, rslt + i / 2) != 0)
+        {
+            return 1;
+        }
+    }
+    return hex_len % 2;
 }
 
-char *encode_string_key(const char* key, size_t k_len, size_t *enc_len)
+/* sub: the sub key already in the format of ver */
+static char *build_dbe_key(int ver, const char* key, size_t k_len, char key_type, const char *sub, size_t s_len, size_t *enc_len)
 {
-    if (!key || !enc_len || k_len > 255 || k_len == 0)
+    if (!key || !enc_len || k_len == 0 || (ver != DBE_KEY_VER_2 && k_len > 255))
     {
         return NULL;
     }
-    log_debug("encode_string_key: key=%s", key);
-    /* key_len(2 bytes) + key(n bytes) + key_type(1 byte) */
-    *enc_len = 2 + k_len + 1;
-    char *enc = zmalloc(*enc_len + 1); /* 1 for '\0' */
+    const size_t key_type_len = key_type == 0 ? 0 : 1;
+    char *enc = zmalloc(1 + 10 + k_len + key_type_len + s_len + 1); /* 1 for '\0' */
     char *ptr = enc;
 
-    const unsigned char k_len_ = k_len % 256;
-    ptr += int_to_hex_str(ptr, (const char*)&k_len_, sizeof(k_len_));
+    if (ver == DBE_KEY_VER_2)
+    {
+        *(unsigned char *)ptr++ = DBE_KEY_V2_TAG;
+        ptr += varint_put((unsigned char *)ptr, k_len);
+    }
+    else
+    {
+        const unsigned char k_len_ = k_len % 256;
+        ptr += int_to_hex_str(ptr, (const char*)&k_len_, sizeof(k_len_));
+    }
 
     memcpy(ptr, key, k_len);
     ptr += k_len;
 
-    *ptr = KEY_TYPE_STRING;
-    ptr += 1;
+    *ptr = key_type;
+    ptr += key_type_len;
+
+    if (s_len)
+    {
+        memcpy(ptr, sub, s_len);
+        ptr += s_len;
+    }
 
     *ptr = 0;
+    *enc_len = ptr - enc;
     return enc;
 }
 
-char *encode_list_key(const char* key, size_t k_len, int64_t seq, size_t *enc_len)
+/* sub key of list, seq(16 bytes in hex) for v1, seq(8 bytes, big endian
+ * with the sign bit flipped to sort negative ones first) for v2 */
+static size_t make_list_sub(int ver, int64_t seq, char *sub)
 {
-    if (!key || !enc_len || k_len > 255 || k_len == 0)
+    if (ver == DBE_KEY_VER_2)
     {
-        return NULL;
+        const uint64_t seq_ = htonll((uint64_t)seq ^ 0x8000000000000000ULL);
+        memcpy(sub, &seq_, sizeof(seq_));
+        return sizeof(seq_);
     }
-    //log_prompt("encode_list_key: key=%s, seq=%"PRId64, key, seq);
-    /* key_len(2 bytes) + key(n bytes) + key_type(1 byte) + seq(16bytes) */
-    *enc_len = 2 + k_len + 1 + 16;
-    char *enc = zmalloc(*enc_len + 1); /* 1 for '\0' */
-    char *ptr = enc;
+    const int64_t seq_ = (int64_t)htonll(seq);
+    return int_to_hex_str(sub, (const char*)&seq_, sizeof(seq_));
+}
 
-    const unsigned char k_len_ = k_len % 256;
-    ptr += int_to_hex_str(ptr, (const char*)&k_len_, sizeof(k_len_));
+char *encode_prefix_key_ver(int ver, const char* key, size_t k_len, char key_type, size_t *enc_len)
+{
+    /* key_len + key(n bytes) + key_type(1 byte, optional) */
+    return build_dbe_key(ver, key, k_len, key_type, NULL, 0, enc_len);
+}
 
-    memcpy(ptr, key, k_len);
-    ptr += k_len;
+char *encode_prefix_key(const char* key, size_t k_len, char key_type, size_t *enc_len)
+{
+    //log_prompt("encode_prefix_key: key=%s, type=%c", key, key_type);
+    return encode_prefix_key_ver(server.dbe_key_ver, key, k_len, key_type, enc_len);
+}
 
-    *ptr = KEY_TYPE_LIST;
-    ptr += 1;
+char *encode_string_key_ver(int ver, const char* key, size_t k_len, size_t *enc_len)
+{
+    /* key_len + key(n bytes) + key_type(1 byte) */
+    return build_dbe_key(ver, key, k_len, KEY_TYPE_STRING, NULL, 0, enc_len);
+}
 
-    const int64_t seq_ = (int64_t)htonll(seq);
-    ptr += int_to_hex_str(ptr, (const char*)&seq_, sizeof(seq_));
+char *encode_string_key(const char* key, size_t k_len, size_t *enc_len)
+{
+    log_debug("encode_string_key: key=%s", key);
+    return encode_string_key_ver(server.dbe_key_ver, key, k_len, enc_len);
+}
 
-    *ptr = 0;
-    return enc;
+char *encode_list_key_ver(int ver, const char* key, size_t k_len, int64_t seq, size_t *enc_len)
+{
+    /* key_len + key(n bytes) + key_type(1 byte) + seq */
+    char sub[16];
+    const size_t s_len = make_list_sub(ver, seq, sub);
+    return build_dbe_key(ver, key, k_len, KEY_TYPE_LIST, sub, s_len, enc_len);
 }
 
-static char *encode_key_subkey(const char* key, size_t k_len, const char* subkey, size_t s_len, char key_type, size_t *enc_len)
+char *encode_list_key(const char* key, size_t k_len, int64_t seq, size_t *enc_len)
 {
-    if (!key || !enc_len || k_len > 255 || k_len == 0)
+    //log_prompt("encode_list_key: key=%s, seq=%"PRId64, key, seq);
+    return encode_list_key_ver(server.dbe_key_ver, key, k_len, seq, enc_len);
+}
+
+static char *encode_key_subkey(int ver, const char* key, size_t k_len, const char* subkey, size_t s_len, char key_type, size_t *enc_len)
+{
+    /* key_len + key(n bytes) + key_type(1 byte) + hash(16 bytes in hex for v1, 8 bytes for v2) */
+    char hash[17];
+    key_hash_str((const unsigned char*)subkey, s_len, hash);
+    if (ver == DBE_KEY_VER_2)
     {
-        return NULL;
+        unsigned char raw[8];
+        if (hex_str_to_bytes(hash, 16, raw) != 0)
+        {
+            log_error("key_hash_str() isn't in hex, key=%s", key);
+            return NULL;
+        }
+        return build_dbe_key(DBE_KEY_VER_2, key, k_len, key_type, (const char *)raw, sizeof(raw), enc_len);
     }
-    /* key_len(2 bytes) + key(n bytes) + key_type(1 byte) + hash(16bytes) */
-    *enc_len = 2 + k_len + 1 + 16;
-    char *enc = zmalloc(*enc_len + 1); /* 1 for '\0' */
-    char *ptr = enc;
-
-    const unsigned char k_len_ = k_len % 256;
-    ptr += int_to_hex_str(ptr, (const char*)&k_len_, sizeof(k_len_));
-
-    memcpy(ptr, key, k_len);
-    ptr += k_len;
+    return build_dbe_key(DBE_KEY_VER_1, key, k_len, key_type, hash, 16, enc_len);
+}
 
-    *ptr = key_type;
-    ptr += 1;
+/* the same row key in format ver, only the format changes */
+char *convert_dbe_key(const char* dbe_key, size_t dbe_k_len, int ver, size_t *enc_len)
+{
+    dbe_key_attr attr;
+    if (decode_dbe_key(dbe_key, dbe_k_len, &attr) != 0)
+    {
+        return NULL;
+    }
 
-    key_hash_str((const unsigned char*)subkey, s_len, ptr);
-    ptr += 16;
+    char sub[16];
+    size_t s_len = 0;
+    if (attr.sub_key_len > 0)
+    {
+        if (attr.type == KEY_TYPE_LIST)
+        {
+            s_len = make_list_sub(ver, attr.seq, sub);
+        }
+        else if (attr.ver == ver)
+        {
+            if (attr.sub_key_len > sizeof(sub))
+            {
+                return NULL;
+            }
+            s_len = attr.sub_key_len;
+            memcpy(sub, attr.sub_key, s_len);
+        }
+        else if (ver == DBE_KEY_VER_2)
+        {
+            /* hash in hex -> raw */
+            if (attr.sub_key_len != 16
+                || hex_str_to_bytes(attr.sub_key, 16, (unsigned char *)sub) != 0)
+            {
+                return NULL;
+            }
+            s_len = 8;
+        }
+        else
+        {
+            if (attr.sub_key_len != 8)
+            {
+                return NULL;
+            }
+            s_len = int_to_hex_str(sub, attr.sub_key, 8);
+        }
+    }
+    return build_dbe_key(ver, attr.key, attr.key_len, attr.type, sub, s_len, enc_len);
+}
 
-    *ptr = 0;
-    return enc;
+char *encode_set_key_ver(int ver, const char* key, size_t k_len, const char* member, size_t m_len, size_t *enc_len)
+{
+    return encode_key_subkey(ver, key, k_len, member, m_len, KEY_TYPE_SET, enc_len);
 }
 
 char *encode_set_key(const char* key, size_t k_len, const char* member, size_t m_len, size_t *enc_len)
 {
-    return encode_key_subkey(key, k_len, member, m_len, KEY_TYPE_SET, enc_len);
+    return encode_set_key_ver(server.dbe_key_ver, key, k_len, member, m_len, enc_len);
 }
 
 char *encode_zset_key(const char* key, size_t k_len, const char* member, size_t m_len, size_t *enc_len)
 {
     //log_prompt("encode_zset_key: key=%s, member=%s", key, member);
-    return encode_key_subkey(key, k_len, member, m_len, KEY_TYPE_ZSET, enc_len);
+    return encode_key_subkey(server.dbe_key_ver, key, k_len, member, m_len, KEY_TYPE_ZSET, enc_len);
 }
 
 char *encode_hash_key(const char* key, size_t k_len, const char* field, size_t f_len, size_t *enc_len)
 {
-    return encode_key_subkey(key, k_len, field, f_len, KEY_TYPE_HASH, enc_len);
+    return encode_key_subkey(server.dbe_key_ver, key, k_len, field, f_len, KEY_TYPE_HASH, enc_len);
 }
 
 
@@ -324,6 +427,52 @@ char *encode_hash_val(const char* field, size_t f_len, const char *val, uint64_t
     return enc;
 }
 
+static int decode_dbe_key_v2(const char* dbe_key, size_t dbe_k_len, dbe_key_attr *attr)
+{
+    const unsigned char *ptr = (const unsigned char *)dbe_key + 1;
+    const unsigned char *end = (const unsigned char *)dbe_key + dbe_k_len;
+    uint64_t key_len;
+    const int n = varint_get(ptr, end - ptr, &key_len);
+    if (n == 0 || key_len > (uint64_t)(end - ptr - n))
+    {
+        log_error("decode_dbe_key: v2 key_len illegal, dbe_key_len=%zu", dbe_k_len);
+        return 1;
+    }
+    if (key_len == 0)
+    {
+        /* DBE_KEY_V2_MARK, no user key */
+        return 1;
+    }
+    ptr += n;
+
+    attr->ver = DBE_KEY_VER_2;
+    attr->key = (char *)ptr;
+    attr->key_len = key_len;
+    ptr += key_len;
+
+    if (ptr < end)
+    {
+        attr->type = *ptr++;
+    }
+    if (ptr < end)
+    {
+        attr->sub_key = (char *)ptr;
+        attr->sub_key_len = end - ptr;
+        if (attr->sub_key_len != 8)
+        {
+            log_error("decode_dbe_key: v2 sub_key_len=%zu illegal", attr->sub_key_len);
+            return 1;
+        }
+        if (attr->type == KEY_TYPE_LIST)
+        {
+            uint64_t seq;
+            memcpy(&seq, ptr, sizeof(seq));
+            attr->seq = (int64_t)(ntohll(seq) ^ 0x8000000000000000ULL);
+        }
+    }
+    return 0;
+}
+
 /* ret:
  * 0 - succ
  * 1 - fail
@@ -341,15 +490,22 @@ int decode_dbe_key(const char* dbe_key, size_t dbe_k_len, dbe_key_attr *attr)
         attr->key = (char *)dbe_key;
         attr->key_len = dbe_k_len > 0 ? dbe_k_len - 1 : dbe_k_len;
         attr->type = KEY_TYPE_STRING;
+        attr->ver = DBE_KEY_VER_1;
         return 0;
     }
 
+    if (dbe_k_len > 0 && (unsigned char)dbe_key[0] == DBE_KEY_V2_TAG)
+    {
+        return decode_dbe_key_v2(dbe_key, dbe_k_len, attr);
+    }
+
     if (dbe_k_len <= 2)
     {
         log_error("decode_dbe_key paramter illegal, len=%zu", dbe_k_len);
         return 1;
     }
 
+    attr->ver = DBE_KEY_VER_1;
     const char *ptr = dbe_key;
     unsigned char key_len;
     int ret = hex_str_to_byte(ptr, 2, &key_len);
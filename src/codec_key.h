@@ -9,6 +9,15 @@
 #define KEY_TYPE_ZSET        'Z'
 #define KEY_TYPE_HASH        'H'
 
+#define DBE_KEY_VER_1        1
+#define DBE_KEY_VER_2        2
+
+/* first byte of a v2 key, never a hex digit of v1 */
+#define DBE_KEY_V2_TAG       0x02
+/* row of a dbe whose keys are all in v2, it has no user key */
+#define DBE_KEY_V2_MARK      "\x02\x00V"
+#define DBE_KEY_V2_MARK_LEN  3
+
 typedef struct dbe_key_attr_t
 {
     char *key;
@@ -17,6 +26,7 @@ typedef struct dbe_key_attr_t
     char *sub_key;
     size_t sub_key_len;
     int64_t seq;
+    int ver;
 } dbe_key_attr;
 
 typedef struct zset_val_attr_t
@@ -35,19 +45,29 @@ typedef struct hash_val_attr_t
 } hash_val_attr;
 
 /* format of key stored in dbe:
- * key_len(2 bytes) + key(n bytes) + key_type(1 byte) + sub_key(optional)
- * [key_len] string format in hex
- * [sub_key] null for string, seq for list, hash_val for hash/set/zset, 16 bytes
+ * v1: key_len(2 bytes) + key(n bytes) + key_type(1 byte) + sub_key(optional)
+ * [key_len] string format in hex, key is 255 bytes at most
+ * [sub_key] null for string, seq for list, hash_val for hash/set/zset, 16 bytes in hex
+ * v2: tag(1 byte) + key_len(varint) + key(n bytes) + key_type(1 byte) + sub_key(optional)
+ * [sub_key] null for string, seq for list, hash_val for hash/set/zset, 8 bytes
+ *           seq in big endian with the sign bit flipped
+ * encode_xxx() follow server.dbe_key_ver, decode_dbe_key() reads both
  */
 
 extern char *encode_prefix_key(const char* key, size_t k_len, char key_type, size_t *enc_len);
+extern char *encode_prefix_key_ver(int ver, const char* key, size_t k_len, char key_type, size_t *enc_len);
 extern char *encode_string_key(const char* key, size_t k_len, size_t *enc_len);
+extern char *encode_string_key_ver(int ver, const char* key, size_t k_len, size_t *enc_len);
 extern char *encode_list_key(const char* key, size_t k_len, int64_t seq, size_t *enc_len);
+extern char *encode_list_key_ver(int ver, const char* key, size_t k_len, int64_t seq, size_t *enc_len);
 extern char *encode_set_key(const char* key, size_t k_len, const char* member, size_t m_len, size_t *enc_len);
+extern char *encode_set_key_ver(int ver, const char* key, size_t k_len, const char* member, size_t m_len, size_t *enc_len);
 extern char *encode_zset_key(const char* key, size_t k_len, const char* member, size_t m_len, size_t *enc_len);
 extern char *encode_hash_key(const char* key, size_t k_len, const char* field, size_t f_len, size_t *enc_len);
 
 extern int decode_dbe_key(const char* dbe_key, size_t dbe_k_len, dbe_key_attr *attr);
+/* the same row key in format ver */
+extern char *convert_dbe_key(const char* dbe_key, size_t dbe_k_len, int ver, size_t *enc_len);
 
 /* format of the value stored in dbe:
  * 1) string:
@@ -120,6 +120,10 @@ void loadServerConfig(char *filename)
                 server.maxmemory_policy = REDIS_MAXMEMORY_ALLKEYS_RANDOM;
             } else if (!strcasecmp(argv[1],"noeviction")) {
                 server.maxmemory_policy = REDIS_MAXMEMORY_NO_EVICTION;
+            } else if (!strcasecmp(argv[1],"volatile-lfu")) {
+                server.maxmemory_policy = REDIS_MAXMEMORY_VOLATILE_LFU;
+            } else if (!strcasecmp(argv[1],"allkeys-lfu")) {
+                server.maxmemory_policy = REDIS_MAXMEMORY_ALLKEYS_LFU;
             } else {
                 err = "Invalid maxmemory policy";
                 goto loaderr;
@@ -288,6 +292,10 @@ void configSetCommand(redisClient *c)
             server.maxmemory_policy = REDIS_MAXMEMORY_ALLKEYS_RANDOM;
         } else if (!strcasecmp(o->ptr,"noeviction")) {
             server.maxmemory_policy = REDIS_MAXMEMORY_NO_EVICTION;
+        } else if (!strcasecmp(o->ptr,"volatile-lfu")) {
+            server.maxmemory_policy = REDIS_MAXMEMORY_VOLATILE_LFU;
+        } else if (!strcasecmp(o->ptr,"allkeys-lfu")) {
+            server.maxmemory_policy = REDIS_MAXMEMORY_ALLKEYS_LFU;
         } else {
             goto badfmt;
         }
@@ -434,9 +442,46 @@ void configSetCommand(redisClient *c)
     } else if (!strcasecmp(c->argv[2]->ptr,"dbe_get_que_size")) {
         if (getLongLongFromObject(o,&ll) == REDIS_ERR) goto badfmt;
         if (ll > 0) server.dbe_get_que_size = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"dbe_prefetch_depth")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
+        server.dbe_prefetch_depth = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"neg_cache_size")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
+        server.neg_cache_size = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"neg_cache_ttl")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
+        server.neg_cache_ttl = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"wr_dbe_coalesce_ms")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
+        server.wr_dbe_coalesce_ms = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"wr_dbe_coalesce_max")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
+        server.wr_dbe_coalesce_max = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"rebalance_budget_us")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
+        server.rebalance_budget_us = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"hk_budget_us")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
+        server.hk_budget_us = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"lfu_log_factor")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
+        server.lfu_log_factor = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"lfu_decay_time")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
+        server.lfu_decay_time = ll;
     } else if (!strcasecmp(c->argv[2]->ptr,"wr_bl_que_size")) {
         if (getLongLongFromObject(o,&ll) == REDIS_ERR) goto badfmt;
         if (ll > 0) server.wr_bl_que_size = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"binlog_fsync")) {
+        if (!strcasecmp(o->ptr,"no")) {
+            server.binlog_fsync = APPENDFSYNC_NO;
+        } else if (!strcasecmp(o->ptr,"everysec")) {
+            server.binlog_fsync = APPENDFSYNC_EVERYSEC;
+        } else if (!strcasecmp(o->ptr,"always")) {
+            server.binlog_fsync = APPENDFSYNC_ALWAYS;
+        } else {
+            goto badfmt;
+        }
     } else if (!strcasecmp(c->argv[2]->ptr,"loglevel")) {
         if (!strcasecmp(o->ptr,"warning")) {
             server.verbosity = REDIS_WARNING;
@@ -513,6 +558,8 @@ void configGetCommand(redisClient *c) {
         case REDIS_MAXMEMORY_ALLKEYS_LRU: s = "allkeys-lru"; break;
         case REDIS_MAXMEMORY_ALLKEYS_RANDOM: s = "allkeys-random"; break;
         case REDIS_MAXMEMORY_NO_EVICTION: s = "noeviction"; break;
+        case REDIS_MAXMEMORY_VOLATILE_LFU: s = "volatile-lfu"; break;
+        case REDIS_MAXMEMORY_ALLKEYS_LFU: s = "allkeys-lfu"; break;
         default: s = "unknown"; break; /* too harmless to panic */
         }
         addReplyBulkCString(c,"maxmemory-policy");
@@ -4,6 +4,9 @@
 #include "op_cmd.h"
 #include "ds_zmalloc.h"
 #include "ds_log.h"
+#include "hot_preload.h"
+#include "miss_filter.h"
+#include "serialize.h"
 
 #include <signal.h>
 
@@ -20,7 +23,7 @@ robj *lookupKey(redisDb *db, robj *key) {
          * Don't do it if we have a saving child, as this will trigger
          * a copy on write madness. */
         if (server.bgsavechildpid == -1 && server.bgrewritechildpid == -1)
-            val->lru = server.lruclock;
+            updateObjectAccess(val);
 
         if (server.vm_enabled) {
             if (val->storage == REDIS_VM_MEMORY ||
@@ -78,6 +81,7 @@ robj *lookupKeyWriteOrReply(redisClient *c, robj *key, robj *reply) {
  * The program is aborted if the key already exists. */
 void dbAdd(redisDb *db, robj *key, robj *val) {
     ds_update_mem_stat(get_obj_size(key) + get_obj_size(val));
+    mf_add_key(key);
     sds copy = sdsdup(key->ptr);
     int retval = dictAdd(db->dict, copy, val);
     redisAssert(retval == REDIS_OK);
@@ -198,6 +202,7 @@ int dbDelete(redisDb *db, robj *key) {
     {
         ds_update_mem_stat(-(get_obj_size(key) + get_obj_size((robj*)(de->val))));
     }
+    if (preload_running()) preload_key_deleted(key);
     if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
     return dictDelete(db->dict,key->ptr) == DICT_OK;
 }
@@ -207,6 +212,7 @@ long long emptyDb() {
     int j;
     long long removed = 0;
 
+    preload_cancel();
     for (j = 0; j < server.dbnum; j++) {
         removed += dictSize(server.db[j].dict);
         dictEmpty(server.db[j].dict);
@@ -242,6 +248,7 @@ void signalModifiedKey(redisDb *db, robj *key) {
 
 void signalFlushedDb(int dbid) {
     (void)dbid;
+    preload_cancel();
     //touchWatchedKeysOnFlush(dbid);
 }
 
@@ -290,30 +297,21 @@ void delCommand(redisClient *c)
     server.stat_del_cmd++;
 
     for (j = 1; j < c->argc; j++) {
-        if (server.has_cache == 0 && server.has_dbe == 1)
-        {
-            dbmng_wr_bl(c->tag, OP_DEL, c->argv[j], 0, 0, c->ds_id, c->db->id);
-            dbmng_del_key(c->tag, c->argv[j]);
+        if (dbDelete(c->db,c->argv[j])) {
+            if (server.has_dbe == 1)
+            {
+                log_prompt("del %s", c->argv[j]->ptr);
+            }
+            signalModifiedKey(c->db,c->argv[j]);
+            server.dirty++;
             deleted++;
+            server.stat_del_hits++;
         }
         else
         {
-            if (dbDelete(c->db,c->argv[j])) {
-                if (server.has_dbe == 1)
-                {
-                    log_prompt("del %s", c->argv[j]->ptr);
-                }
-                signalModifiedKey(c->db,c->argv[j]);
-                server.dirty++;
-                deleted++;
-                server.stat_del_hits++;
-            }
-            else
-            {
-                server.stat_del_misses++;
-            }
-            dbmng_save_op(c->tag, OP_DEL, c->argv[j], 0, 0, c->ds_id, c->db->id);
+            server.stat_del_misses++;
         }
+        dbmng_save_op(c->tag, OP_DEL, c->argv[j], 0, 0, c->ds_id, c->db->id);
     }
     //log_prompt("delCommand: %d deleted", deleted);
     addReplyLongLong(c,deleted);
@@ -321,17 +319,8 @@ void delCommand(redisClient *c)
 
 void existsCommand(redisClient *c)
 {
-    int exists = 0;
-    if (server.has_cache == 0 && server.has_dbe == 1)
-    {
-        exists = dbmng_key_exist(c->tag, c->argv[1], 0);
-    }
-    else
-    {
-        expireIfNeeded(c->db,c->argv[1]);
-        exists = dbExists(c->db,c->argv[1]);
-    }
-    if (exists) {
+    expireIfNeeded(c->db,c->argv[1]);
+    if (dbExists(c->db,c->argv[1])) {
         addReply(c, shared.cone);
     } else {
         addReply(c, shared.czero);
@@ -582,6 +571,39 @@ void moveCommand(redisClient *c)
     dbmng_save_op(c->tag, OP_MOVE, c->argv[1], c->argc - 2, &c->argv[2], c->ds_id, c->db->id);
 }
 
+/* RESTORE key value: value is serialized by serializeObjExp with its expire.
+ * it is sent by the rebalancer of the last owner of the key, a key written
+ * here since the topology changed is newer and is kept */
+void restoreCommand(redisClient *c)
+{
+    if (lookupKeyWrite(c->db,c->argv[1]) != NULL) {
+        addReply(c,shared.czero);
+        return;
+    }
+
+    robj *val = getDecodedObject(c->argv[2]);
+    time_t expire = 0;
+    robj *o = unserializeObj(val->ptr, sdslen(val->ptr), &expire);
+    decrRefCount(val);
+    if (o == NULL) {
+        addReplyError(c,"bad serialized value");
+        return;
+    }
+    if (expire > 0 && expire <= time(NULL)) {
+        decrRefCount(o);
+        addReply(c,shared.czero);
+        return;
+    }
+
+    dbAdd(c->db,c->argv[1],o);
+    if (expire > 0) setExpire(c->db,c->argv[1],expire);
+    signalModifiedKey(c->db,c->argv[1]);
+    server.dirty++;
+    addReply(c,shared.cone);
+
+    dbmng_save_op(c->tag, OP_RESTORE, c->argv[1], 1, &c->argv[2], c->ds_id, c->db->id);
+}
+
 /*-----------------------------------------------------------------------------
  * Expires API
  *----------------------------------------------------------------------------*/
@@ -3,10 +3,15 @@
 #include "checkpoint.h"
 #include "dbe_get.h"
 #include "bl_ctx.h"
+#include "hot_preload.h"
+#include "latency_hist.h"
 
 #include "ds_log.h"
+#include "ds_ctrl.h"
 
 #include <unistd.h>
+#include <sched.h>
+#include <sys/eventfd.h>
 
 /* [0]:dbe_get, [1]:dbe_set, [2]:write_bl */
 thread_pool_t *sc_pool[3];
@@ -19,6 +24,7 @@ typedef struct user_data_t
     thread_pool_t *pool;
     void *ctx;
     int cmd;
+    long long put_us;   /* when it is put into the queue */
 } user_data;
 
 static void readFromDbIo(aeEventLoop *el, int fd, void *privdata, int mask);
@@ -38,19 +44,52 @@ static pthread_t wr_dbe_tid;
 extern char gWrblRunning;
 #endif
 
-static sds rsp_buf;
+/* completion ring: io threads push finished tasks, main thread pops them.
+ * bounded mpsc queue, each cell carries a sequence number which tells
+ * whether the cell is free for the producer or ready for the consumer */
+#define CPL_RING_SIZE 16384 /* must be power of 2 and > queue size of DBE_GET */
+#define CPL_DRAIN_BATCH 128
+
+typedef struct cpl_cell_t
+{
+    volatile unsigned long seq;
+    int cmd;
+    void *ctx;
+} cpl_cell;
+
+typedef struct cpl_ring_t
+{
+    cpl_cell cells[CPL_RING_SIZE];
+    volatile unsigned long head;     /* next pos to push, shared by io threads */
+    char pad[64];
+    unsigned long tail;              /* next pos to pop, main thread only */
+    volatile int signaled;           /* 1 - eventfd has been written */
+    volatile unsigned int wrbl_wakeups;
+} cpl_ring;
+
+static cpl_ring *sc_ring = 0;
+
+static void push_completion(int cmd, void *ctx);
+static int pop_completion(int *cmd, void **ctx);
+static void signal_main_server();
 
 int db_io_init()
 {
-    int fds[2];
-    if (pipe(fds) == -1)
+    sc_ring = (cpl_ring *)zcalloc(sizeof(cpl_ring));
+    unsigned long i;
+    for (i = 0; i < CPL_RING_SIZE; i++)
+    {
+        sc_ring->cells[i].seq = i;
+    }
+
+    const int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd == -1)
     {
-        log_error("pipe() fail: %s", strerror(errno));
+        log_error("eventfd() fail: %s", strerror(errno));
         return -1;
     }
-    server.recv_fd = fds[0];
-    server.send_fd = fds[1];
-    rsp_buf = sdsempty();
+    server.recv_fd = efd;
+    server.send_fd = efd;
 
     if (aeCreateFileEvent(server.el, server.recv_fd, AE_READABLE, readFromDbIo, 0)
         == AE_ERR)
@@ -67,9 +106,9 @@ int db_io_init()
         log_error("create_thread_pool() fail for dbe_get, pool_size=%d", 10240);
         return -1;
     }
-    if (add_thread_pool_worker(sc_pool[0], "io_worker_get", 0, io_worker_action, 0, 2) < 0)
+    if (add_thread_pool_worker(sc_pool[0], "io_worker_get", 0, io_worker_action, 0, server.dbe_get_threads) < 0)
     {
-        log_error("add_thread_pool_worker() fail, thread_cnt=%d", 2);
+        log_error("add_thread_pool_worker() fail, thread_cnt=%d", server.dbe_get_threads);
         return -1;
     }
     }
@@ -134,8 +173,8 @@ int db_io_init()
     log_prompt("handle_bl=%lu, wr_bl=%lu, wr_dbe=%lu" , tid, wr_bl_tid, wr_dbe_tid);
 #endif
 
-    log_prompt("db_io_init() succ, pool_g=%p, pool_s=%p, pool_w=%p, recv_fd=%d, send_fd=%d"
-              , sc_pool[0], sc_pool[1], sc_pool[2], fds[0], fds[1]);
+    log_prompt("db_io_init() succ, pool_g=%p, pool_s=%p, pool_w=%p, event_fd=%d"
+              , sc_pool[0], sc_pool[1], sc_pool[2], efd);
 
     return 0;
 }
@@ -146,6 +185,9 @@ void db_io_uninit()
     log_prompt("db_io_uninit: handle_bl=%lu, wr_bl=%lu, wr_dbe=%lu"
             , tid, wr_bl_tid, wr_dbe_tid);
     gWrblRunning = 0;
+    signalBlWriteList();
+    signalWrblList();
+    signalWrDbeList();
     void *ret = 0;
     pthread_join(tid, &ret);
     pthread_join(wr_bl_tid, &ret);
@@ -231,77 +273,147 @@ static void db_do_io_result(aeEventLoop *el, int fd, void *privdata, int mask)
 static void db_do_io_result();
 static void readFromDbIo(aeEventLoop *el, int fd, void *privdata, int mask)
 {
-    char buf[REDIS_IOBUF_LEN];
-    int nread;
+    uint64_t cnt;
     REDIS_NOTUSED(el);
     REDIS_NOTUSED(mask);
     REDIS_NOTUSED(privdata);
 
-    nread = read(fd, buf, REDIS_IOBUF_LEN);
-    if (nread == -1)
+    if (read(fd, &cnt, sizeof(cnt)) == -1 && errno != EAGAIN)
     {
-        if (errno == EAGAIN) {
-            nread = 0;
-        } else {
-            log_error("read() fail from fd=%d: %s", fd, strerror(errno));
-            return;
-        }
-    } else if (nread == 0) {
-        log_info("fd=%d closed", fd);
-        return;
-    }
-    if (nread) {
-        rsp_buf = sdscatlen(rsp_buf, buf, nread);
-    } else {
+        log_error("read() fail from fd=%d: %s", fd, strerror(errno));
         return;
     }
+
+    /* clear the flag before draining, so a push after the last pop will
+     * write the eventfd again */
+    sc_ring->signaled = 0;
+    __sync_synchronize();
+
     db_do_io_result();
 }
 
 static void db_do_io_result()
 {
-    int buf_len = sdslen(rsp_buf);
-    char *ptr = rsp_buf;
-    while (buf_len > 0)
+    int cmd[CPL_DRAIN_BATCH];
+    void *ctx[CPL_DRAIN_BATCH];
+    int cnt, i;
+
+    unsigned int wakeups = __sync_lock_test_and_set(&sc_ring->wrbl_wakeups, 0);
+    for (; wakeups > 0; wakeups--)
+    {
+        after_write_bl(NULL);
+    }
+
+    do
     {
-        if (*ptr == '0')
+        for (cnt = 0; cnt < CPL_DRAIN_BATCH; cnt++)
         {
-            if (buf_len < 10)
+            if (pop_completion(&cmd[cnt], &ctx[cnt]) != 0)
             {
-                log_warn("invalid input_len=%d for cmd(%c)", buf_len, *ptr);
                 break;
             }
-            void *ctx = 0;
-            const int len = *(ptr + 1);
-            if (len > 8)
+        }
+
+        for (i = 0; i < cnt; i++)
+        {
+            if (cmd[i] == 0)
+            {
+                after_dbe_get(ctx[i]);
+            }
+            else if (cmd[i] == 3)
+            {
+                after_preload(ctx[i]);
+            }
+#ifndef _UPD_DBE_BY_PERIODIC_
+            else if (cmd[i] == 4)
+            {
+                after_unpin_values(ctx[i]);
+            }
+            else if (cmd[i] == 5)
+            {
+                after_dbe_written(ctx[i]);
+            }
+#endif
+#ifdef _UPD_DBE_BY_PERIODIC_
+            else if (cmd[i] == 1)
             {
-                log_warn("invalid arg_len=%d for cmd(%c), ignore this cmd", len, *ptr);
-                ptr += 10;
-                buf_len -= 10;
-                continue;
+                after_dbe_set((dbmng_ctx *)ctx[i]);
+            }
+            else if (cmd[i] == 2)
+            {
+                after_write_bl(ctx[i]);
+            }
+#endif
+            else
+            {
+                log_error("unknown cmd from thread-pool, cmd=%d", cmd[i]);
             }
-            memcpy(&ctx, ptr + 2, len);
-            //log_debug("ctx=%p, arg_len=%d", ctx, len);
-            ptr += 10;
-            buf_len -= 10;
-            after_dbe_get(ctx);
         }
-        else if (*rsp_buf == '3')
+    } while (cnt == CPL_DRAIN_BATCH);
+
+    return;
+}
+
+/* call by io threads */
+static void push_completion(int cmd, void *ctx)
+{
+    cpl_cell *cell;
+    unsigned long pos;
+    for (;;)
+    {
+        pos = sc_ring->head;
+        cell = &sc_ring->cells[pos & (CPL_RING_SIZE - 1)];
+        const long dif = (long)cell->seq - (long)pos;
+        if (dif == 0)
         {
-            ptr++;
-            buf_len--;
-            after_write_bl(NULL);
+            if (__sync_bool_compare_and_swap(&sc_ring->head, pos, pos + 1))
+            {
+                break;
+            }
         }
-        else
+        else if (dif < 0)
         {
-            log_error("invalid cmd=%c(%d)", *ptr, *(unsigned char*)ptr);
-            ptr++;
-            buf_len--;
+            /* full, wait for main thread */
+            signal_main_server();
+            sched_yield();
         }
     }
-    rsp_buf = sdsrange(rsp_buf, ptr - rsp_buf, -1);
+    cell->cmd = cmd;
+    cell->ctx = ctx;
+    __sync_synchronize();
+    cell->seq = pos + 1;
 
-    return;
+    signal_main_server();
+}
+
+/* call by main thread
+ * return: 0 - succ; 1 - empty */
+static int pop_completion(int *cmd, void **ctx)
+{
+    const unsigned long pos = sc_ring->tail;
+    cpl_cell *cell = &sc_ring->cells[pos & (CPL_RING_SIZE - 1)];
+    if ((long)cell->seq - (long)(pos + 1) < 0)
+    {
+        return 1;
+    }
+    __sync_synchronize();
+    *cmd = cell->cmd;
+    *ctx = cell->ctx;
+    __sync_synchronize();
+    cell->seq = pos + CPL_RING_SIZE;
+    sc_ring->tail = pos + 1;
+    return 0;
+}
+
+/* write eventfd only once until main thread begins to drain */
+static void signal_main_server()
+{
+    if (sc_ring->signaled == 0
+        && __sync_bool_compare_and_swap(&sc_ring->signaled, 0, 1))
+    {
+        const uint64_t one = 1;
+        notify_main_server(server.send_fd, &one, sizeof(one));
+    }
 }
 
 /* call by thread in thread_pool */
@@ -314,6 +426,7 @@ static int io_worker_action(void **private, queue_data_t *task)
 
     log_debug2(0, "io_worker_action()...task=%p, pool=%p, ctx=%p, cmd=%d",
                task, ud->pool, ud->ctx, ud->cmd);
+    lh_record(LH_QUEUE_WAIT, ustime() - ud->put_us);
 
     ud->rf(task);
 
@@ -338,6 +451,27 @@ int commit_write_bl_task(void *ctx)
     return commit_db_io_task(ctx, write_bl_task_routine, 2, sc_pool[2], QUEUE_BLOCKING);
 }
 
+/* call by preload threads, the batch is inserted into rdb by main thread */
+int commit_preload_batch(void *ctx)
+{
+    push_completion(3, ctx);
+    return 0;
+}
+
+/* call by write stage threads, the values are unpinned by main thread */
+int commit_unpin_values(void *ctx)
+{
+    push_completion(4, ctx);
+    return 0;
+}
+
+/* call by write stage threads, the keys are done with dbe for main thread */
+int commit_dbe_written(void *ctx)
+{
+    push_completion(5, ctx);
+    return 0;
+}
+
 // block: QUEUE_NONBLOCK, QUEUE_BLOCKING
 static int commit_db_io_task(void *ctx, routine_func rf, int cmd, thread_pool_t *pool, int block)
 {
@@ -379,6 +513,7 @@ static queue_data_t *gen_db_io_task(routine_func rf, thread_pool_t *pool, int fd
     ud->send_fd = fd;
     ud->ctx = ctx;
     ud->cmd = cmd;
+    ud->put_us = ustime();
 
     return task;
 }
@@ -389,13 +524,14 @@ static void dbe_set_task_routine(void *ptr)
     queue_data_t *task = (queue_data_t *)ptr;
     user_data *ud = (user_data *)task->data;
 
-    log_debug("dbe_set_task running...pool=%p, ctx=%p", ud->pool, ud->ctx);
-    do_dbe_set((dbmng_ctx *)ud->ctx);
+    void *ctx = ud->ctx;
+
+    log_debug("dbe_set_task running...pool=%p, ctx=%p", ud->pool, ctx);
+    do_dbe_set((dbmng_ctx *)ctx);
 
     /* finish action, return to notice main server */
-    const int fd = ud->send_fd;
-    //put_resp(ud->pool, task, QUEUE_BLOCKING);
-    notify_main_server(fd, "1", 1);
+    zfree(task);
+    push_completion(1, ctx);
 }
 
 static void dbe_get_task_routine(void *ptr)
@@ -408,14 +544,8 @@ static void dbe_get_task_routine(void *ptr)
     do_dbe_get(ctx);
 
     /* finish action, return to notice main server */
-    const int fd = ud->send_fd;
-    //put_resp(ud->pool, task, QUEUE_BLOCKING);
-    //notify_main_server(fd, "0", 1);
-    char buf[10];
-    buf[0] = '0';
-    buf[1] = sizeof(ctx);
-    memcpy(buf + 2, &ctx, buf[1]);
-    notify_main_server(fd, buf, sizeof(buf));
+    zfree(task);
+    push_completion(0, ctx);
 }
 
 static void write_bl_task_routine(void *ptr)
@@ -423,13 +553,14 @@ static void write_bl_task_routine(void *ptr)
     queue_data_t *task = (queue_data_t *)ptr;
     user_data *ud = (user_data *)task->data;
 
-    log_debug("write_bl_task running...pool=%p, ctx=%p", ud->pool, ud->ctx);
-    do_handle_write_bl(ud->ctx);
+    void *ctx = ud->ctx;
+
+    log_debug("write_bl_task running...pool=%p, ctx=%p", ud->pool, ctx);
+    do_handle_write_bl(ctx);
 
     /* finish action, return to notice main server */
-    const int fd = ud->send_fd;
-    //put_resp(ud->pool, task, QUEUE_BLOCKING);
-    notify_main_server(fd, "2", 1);
+    zfree(task);
+    push_completion(2, ctx);
 }
 
 int notify_main_server(int fd, const void *buf, size_t buf_size)
@@ -451,7 +582,8 @@ int notify_main_server(int fd, const void *buf, size_t buf_size)
 #ifndef _UPD_DBE_BY_PERIODIC_
 void wakeupWrbl()
 {
-    notify_main_server(server.send_fd, "3", 1);
+    __sync_fetch_and_add(&sc_ring->wrbl_wakeups, 1);
+    signal_main_server();
 }
 #endif
 
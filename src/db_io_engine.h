@@ -6,6 +6,9 @@ extern void db_io_uninit();
 extern int commit_dbe_set_task(void *ctx);
 extern int commit_dbe_get_task(void *ctx);
 extern int commit_write_bl_task(void *ctx);
+extern int commit_preload_batch(void *ctx);
+extern int commit_unpin_values(void *ctx);
+extern int commit_dbe_written(void *ctx);
 
 #endif /* _DB_IO_ENGINE_H_ */
 
@@ -10,25 +10,59 @@
 #include "ds_ctrl.h"
 #include "restore_key.h"
 #include "key_filter.h"
+#include "miss_filter.h"
 
 #include <sys/timeb.h>
 
 #include "dict.h"
 
+#define PREFETCH_MAX_ARGC 1024 /* longer cmd stops the prefetch scan */
+
+/* one cold key being read from dbe, shared by all clients waiting for it */
 typedef struct ItemKeyVal_t
 {
     robj *key;
     void *val;
     time_t expire;
     char cmd_type;
+    char committed; /* 1 - the task has been put into io thread pool */
+    char not_found; /* 1 - dbe has not the key */
+    void *ctx;
+    list *clients;  /* clients waiting for the key */
 } ItemKeyVal;
 
 static int check_block_key(redisClient *c, robj *key);
 static int check_multi_block_keys(redisClient *c, struct redisCommand *cmd, int argc, robj **argv);
-
+static void free_item(ItemKeyVal *item);
+static ItemKeyVal *create_item(redisClient *c, robj *key);
+static void prefetch_pipeline(redisClient *c);
+static void detach_client(redisClient *c);
+static void resume_client(redisClient *c);
+
+/* commit the keys of c which are not in io thread pool yet
+ * return: 0 - succ; 1 - fail, the client is queued again or terminated */
 static int notify_dbe_get(redisClient *c)
 {
-    const int ret = commit_dbe_get_task(c);
+    listNode *ln = 0;
+    listIter li;
+    int ret = 0;
+
+    listRewind(c->dbe_get_keys, &li);
+    while ((ln = listNext(&li)))
+    {
+        ItemKeyVal *item = listNodeValue(ln);
+        if (item->committed)
+        {
+            continue;
+        }
+        if ((ret = commit_dbe_get_task(item)) != 0)
+        {
+            break;
+        }
+        item->committed = 1;
+        server.stat_dbe_get_keys++;
+    }
+
     if (ret != 0)
     {
         /* notify io thread fail */
@@ -38,6 +72,9 @@ static int notify_dbe_get(redisClient *c)
         {
             /* terminal the request */
             log_error("terminal the request: c=%p, enque_cnt=%d", c, c->enque_cnt);
+            detach_client(c);
+            c->flags &= (~REDIS_DBE_GET_WAIT);
+            server.dbe_get_clients_cnt--;
             addReplyError(c, "can't notify io thread");
             resetClient(c);
         }
@@ -60,12 +97,14 @@ static int notify_dbe_get(redisClient *c)
 int block_client_on_dbe_get(redisClient *c)
 {
     //log_test("block_client_on_dbe_get()...");
-    if (server.has_dbe == 0 || server.read_dbe == 0)
+    if (server.has_dbe == 0 || (server.has_cache == 1 && server.read_dbe == 0))
     {
+        /* rdb of a pure dbe is a cache of dbe, always read through */
         return 0;
     }
 
     const unsigned int clients = server.dbe_get_clients_cnt;
+    c->ctx = get_entry_ctx(0);
     const int block = check_multi_block_keys(c, c->cmd, c->argc, c->argv);
     if (block == 0)
     {
@@ -75,6 +114,7 @@ int block_client_on_dbe_get(redisClient *c)
     if (clients > (unsigned int)server.dbe_get_que_size)
     {
         log_error("too many clients(%d) are queue at dbe_get", clients);
+        detach_client(c);
         return 2;
     }
 
@@ -87,7 +127,7 @@ int block_client_on_dbe_get(redisClient *c)
     server.dbe_get_clients_cnt++;
 
     c->enque_cnt = 0;
-    c->ctx = get_entry_ctx(0);
+    c->dbe_get_pending = listLength(c->dbe_get_keys);
 #ifdef _UPD_DBE_BY_PERIODIC_
     if (clients == 0)
     {
@@ -96,6 +136,10 @@ int block_client_on_dbe_get(redisClient *c)
     }
 #endif
     notify_dbe_get(c);
+    if (server.dbe_prefetch_depth > 0 && sdslen(c->querybuf) > 0)
+    {
+        prefetch_pipeline(c);
+    }
     return block;
 }
 
@@ -129,25 +173,235 @@ static int check_block_key(redisClient *c, robj *key)
     }
 
     server.stat_misses_in_cache++;
+
+    if (mf_key_absent(key))
     {
-        ItemKeyVal *item = (ItemKeyVal *)zcalloc(sizeof(ItemKeyVal));
-        item->key = key;
+        /* not in dbe, go on as a miss without io */
+        return 0;
+    }
 
-        if (server.enc_kv == 0)
+    ItemKeyVal *item = 0;
+    dictEntry *de = dictFind(server.dbe_get_inflight, key);
+    if (de)
+    {
+        /* the key is being read for other client, wait for it too */
+        item = dictGetEntryVal(de);
+        if (listSearchKey(item->clients, c))
         {
-            /* support string only */
-            item->cmd_type = 'K';
+            /* the same key appears more than once in the cmd */
+            return 1;
         }
-        else
+        server.stat_dbe_get_shared++;
+    }
+    else
+    {
+        item = create_item(c, key);
+    }
+
+    listAddNodeTail(item->clients, c);
+    listAddNodeTail(c->dbe_get_keys, item);
+    return 1;
+}
+
+static ItemKeyVal *create_item(redisClient *c, robj *key)
+{
+    ItemKeyVal *item = (ItemKeyVal *)zcalloc(sizeof(ItemKeyVal));
+    item->key = key;
+    item->ctx = c->ctx;
+    item->clients = listCreate();
+
+    if (server.enc_kv == 0)
+    {
+        /* support string only */
+        item->cmd_type = 'K';
+    }
+    else
+    {
+        /* can't set according to the cmd, it must search by prefix */
+        item->cmd_type = 'k';
+    }
+
+    incrRefCount(key);
+    dictAdd(server.dbe_get_inflight, key, item);
+    return item;
+}
+
+/* read a cold key of a pipelined cmd in advance, nobody waits for it,
+ * after_dbe_get() inserts it into rdb and later cmds hit it or join it
+ * return: 0 - go on; 1 - io thread pool is busy, stop prefetching */
+static int prefetch_key(redisClient *c, robj *key)
+{
+    if (cache_filter(key->ptr, sdslen(key->ptr)) == 1
+        || dictFind(server.dbe_get_inflight, key)
+        || dbmng_check_key_io(0, key) == 0
+        || mf_key_absent(key))
+    {
+        return 0;
+    }
+
+    ItemKeyVal *item = create_item(c, key);
+    if (commit_dbe_get_task(item) != 0)
+    {
+        dictDelete(server.dbe_get_inflight, item->key);
+        free_item(item);
+        return 1;
+    }
+    item->committed = 1;
+
+    server.stat_misses_in_cache++;
+    server.stat_dbe_get_keys++;
+    server.stat_dbe_prefetch_keys++;
+    return 0;
+}
+
+/* parse the multibulk cmd at buf[*pos] without consuming it
+ * return: argc; 0 - incomplete or not a multibulk cmd */
+static int peek_multibulk(char *buf, size_t len, size_t *pos, int max, char **argv, size_t *argvlen)
+{
+    size_t p = *pos;
+    char *nl;
+    long long ll;
+    int argc, j;
+
+    if (p >= len || buf[p] != '*')
+    {
+        return 0;
+    }
+    nl = memchr(buf + p, '\r', len - p);
+    if (nl == NULL || (size_t)(nl - buf) + 2 > len
+        || !string2ll(buf + p + 1, nl - (buf + p + 1), &ll) || ll <= 0 || ll > max)
+    {
+        return 0;
+    }
+    argc = ll;
+    p = nl - buf + 2;
+
+    for (j = 0; j < argc; j++)
+    {
+        if (p >= len || buf[p] != '$')
         {
-            /* can't set according to the cmd, it must search by prefix */
-            item->cmd_type = 'k';
+            return 0;
         }
+        nl = memchr(buf + p, '\r', len - p);
+        if (nl == NULL || (size_t)(nl - buf) + 2 > len
+            || !string2ll(buf + p + 1, nl - (buf + p + 1), &ll) || ll < 0)
+        {
+            return 0;
+        }
+        p = nl - buf + 2;
+        if (len - p < (size_t)ll + 2)
+        {
+            return 0;
+        }
+        argv[j] = buf + p;
+        argvlen[j] = ll;
+        p += ll + 2;
+    }
+
+    *pos = p;
+    return argc;
+}
 
-        incrRefCount(key);
-        listAddNodeTail(c->dbe_get_keys, item);
+/* c is blocked by a cold key, scan the cmds behind it in querybuf and
+ * commit all their cold keys at once, so the pipeline waits for dbe
+ * about once instead of once per cmd */
+static void prefetch_pipeline(redisClient *c)
+{
+    static char *argv[PREFETCH_MAX_ARGC];
+    static size_t argvlen[PREFETCH_MAX_ARGC];
+    static sds name = NULL;
+    const size_t len = sdslen(c->querybuf);
+    size_t pos = 0;
+    int depth, argc, j, last;
+
+    if (name == NULL)
+    {
+        name = sdsempty();
     }
-    return 1;
+
+    for (depth = 0; depth < server.dbe_prefetch_depth; depth++)
+    {
+        argc = peek_multibulk(c->querybuf, len, &pos, PREFETCH_MAX_ARGC, argv, argvlen);
+        if (argc == 0)
+        {
+            break;
+        }
+
+        name = sdscpylen(name, argv[0], argvlen[0]);
+        struct redisCommand *cmd = lookupCommand(name);
+        if (cmd == NULL || cmd->io_firstkey == 0
+            || (cmd->arity > 0 && cmd->arity != argc) || argc < -cmd->arity)
+        {
+            continue;
+        }
+
+        last = cmd->io_lastkey;
+        if (last < 0)
+        {
+            last = argc + last;
+        }
+        for (j = cmd->io_firstkey; j <= last && j < argc; j += cmd->io_keystep)
+        {
+            robj *key = createStringObject(argv[j], argvlen[j]);
+            const int busy = prefetch_key(c, key);
+            decrRefCount(key);
+            if (busy)
+            {
+                return;
+            }
+        }
+    }
+}
+
+static void free_item(ItemKeyVal *item)
+{
+    if (item->val)
+    {
+        decrRefCount(item->val);
+    }
+    decrRefCount(item->key);
+    listRelease(item->clients);
+    zfree(item);
+}
+
+/* remove c from all keys it is waiting for, the keys which are not
+ * committed to io thread and waited by nobody are released */
+static void detach_client(redisClient *c)
+{
+    listNode *ln = 0;
+    while ((ln = listFirst(c->dbe_get_keys)))
+    {
+        ItemKeyVal *item = listNodeValue(ln);
+        listNode *cn = listSearchKey(item->clients, c);
+        if (cn)
+        {
+            listDelNode(item->clients, cn);
+        }
+        if (listLength(item->clients) == 0 && item->committed == 0)
+        {
+            dictDelete(server.dbe_get_inflight, item->key);
+            free_item(item);
+        }
+        listDelNode(c->dbe_get_keys, ln);
+    }
+    c->dbe_get_pending = 0;
+}
+
+/* call when free the client */
+void unblock_client_on_dbe_get(redisClient *c)
+{
+    if (!(c->flags & REDIS_DBE_GET_WAIT))
+    {
+        return;
+    }
+    listNode *ln = listSearchKey(server.dbe_get_clients, c);
+    if (ln)
+    {
+        listDelNode(server.dbe_get_clients, ln);
+    }
+    detach_client(c);
+    c->flags &= (~REDIS_DBE_GET_WAIT);
+    server.dbe_get_clients_cnt--;
 }
 
 static int check_multi_block_keys(redisClient *c, struct redisCommand *cmd, int argc, robj **argv)
@@ -174,38 +428,32 @@ static int check_multi_block_keys(redisClient *c, struct redisCommand *cmd, int
     return ret;
 }
 
-/* call by thread in thread_pool */
+/* call by thread in thread_pool, one key per task */
 void do_dbe_get(void *t_ctx)
 {
 #if 1
-    redisClient *c = (redisClient *)t_ctx;
-    listNode *ln = 0;
-    ItemKeyVal *item;
-    listIter li;
+    ItemKeyVal *item = (ItemKeyVal *)t_ctx;
     val_attr rslt;
 
-    dbmng_ctx *ctx = (dbmng_ctx*)c->ctx;
-    listRewind(c->dbe_get_keys, &li);
-    while ((ln = listNext(&li)))
+    dbmng_ctx *ctx = (dbmng_ctx*)item->ctx;
+    const int ret = restore_key_from_dbe(ctx->db, (const char *)item->key->ptr, sdslen(item->key->ptr), item->cmd_type, &rslt);
+    if (ret == 0)
     {
-        item = listNodeValue(ln);
-
-        const int ret = restore_key_from_dbe(ctx->db, (const char *)item->key->ptr, sdslen(item->key->ptr), item->cmd_type, &rslt);
-        if (ret == 0)
-        {
-            item->val = rslt.val;
-            item->expire = rslt.expire_ms;
-        }
-        else if (ret != 1)
-        {
-            log_error("restore_key_from_dbe fail, ret=%d, key=%s"
-                    , ret, (const char *)item->key->ptr);
-        }
+        item->val = rslt.val;
+        item->expire = rslt.expire_ms;
+    }
+    else if (ret == 1)
+    {
+        item->not_found = 1;
+    }
+    else
+    {
+        log_error("restore_key_from_dbe fail, ret=%d, key=%s"
+                , ret, (const char *)item->key->ptr);
     }
 #endif
 #if 0
     struct timespec ts;
-    dbe_stat *tmp = &gDbeGetTop[0];
 
     listNode *ln = 0;
     redisClient *c = 0;
@@ -228,8 +476,7 @@ void do_dbe_get(void *t_ctx)
         /* get value from db engine */
         ts = pf_get_time_tick();
         rslt = dbe_get(ctx->db, (const char *)item->key->ptr, &ptr, &len, zmalloc);
-        tmp->io_dur = pf_get_time_diff_nsec(ts, pf_get_time_tick()) / 1000;
-        tmp->buf_len = len;
+        lh_record(LH_DBE_GET, pf_get_time_diff_nsec(ts, pf_get_time_tick()) / 1000);
         if (rslt == DBE_ERR_NOT_FOUND)
         {
             log_info2(ctx->tag, "dbe_get() return null, db=%p, key=%s",
@@ -243,43 +490,13 @@ void do_dbe_get(void *t_ctx)
         }
 
         /* unserialize */
-        ts = pf_get_time_tick();
         item->val = unserializeObj(ptr, len, &item->expire);
-        tmp->unserialize_dur = pf_get_time_diff_nsec(ts, pf_get_time_tick()) / 1000;
         dbe_free_ptr(ptr, zfree);
         if (item->val == 0)
         {
             /* fail */
             log_error2(ctx->tag, "unserializeObj() fail, len=%d", len);
         }
-
-        int min_idx = 0;
-        unsigned int k;
-        for (k = 1; k < sizeof(gDbeGetTop) / sizeof(gDbeGetTop[0]); k++)
-        {
-            if (gDbeGetTop[k].valid == 0)
-            {
-                min_idx = k;
-                break;
-            }
-            if (gDbeGetTop[k].io_dur < gDbeGetTop[min_idx].io_dur)
-            {
-                min_idx = k;
-            }
-        }
-        memcpy(&gDbeGetTop[min_idx], &gDbeGetTop[0], sizeof(gDbeGetTop[0]));
-        gDbeGetTop[min_idx].valid = 1;
-        gDbeGetTop[min_idx].time = time(NULL);
-        if (tmp->io_dur > gDbeGetMax)
-        {
-            gDbeGetMax = tmp->io_dur;
-        }
-        if (tmp->io_dur < gDbeGetMin || gDbeGetMin == 0)
-        {
-            gDbeGetMin = tmp->io_dur;
-        }
-        gDbeGetTotal += tmp->io_dur;
-        gDbeGetCnt++;
     }
 
     //log_prompt2(ctx->tag, "*** do_dbe_get: %lld(us)", ustime() - s);
@@ -287,62 +504,24 @@ void do_dbe_get(void *t_ctx)
 #endif
 }
 
-void after_dbe_get(void *t_ctx)
+/* the client has got all its keys, go on executing the cmd */
+static void resume_client(redisClient *c)
 {
-    log_test("continue after finishing dbe get...arg=%p", t_ctx);
-    unsigned int wait_c_cnt;
-
-    listNode *ln = 0;
-    ItemKeyVal *item;
-    listIter li;
+    server.dbe_get_clients_cnt--;
+    c->dbe_get_block_dur = server.ustime - c->block_start_time;
+    log_test("wait in dbe_get_que: %lld(us), cmd=%s, waiting_c=%d"
+              , c->dbe_get_block_dur, c->argv[0]->ptr, listLength(server.dbe_get_clients));
 
-    redisClient *c = (redisClient *)t_ctx;
-    dbmng_ctx *ctx = (dbmng_ctx*)c->ctx;
-    listRewind(c->dbe_get_keys, &li);
-    while ((ln = listNext(&li)))
+    if (c->enque_cnt > 0)
     {
-        item = listNodeValue(ln);
-
-        robj *const val = lookupKey(ctx->rdb, item->key);
-        if (val == 0)
+        /* the rest keys are committed by other clients */
+        listNode *ln = listSearchKey(server.dbe_get_clients, c);
+        if (ln)
         {
-            if (item->val)
-            {
-                /* get value succ */
-                dbAdd(ctx->rdb, item->key, (robj *)item->val);
-                if (item->expire > 0)
-                {
-                    setExpire(ctx->rdb, item->key, item->expire);
-                }
-                else
-                {
-                    removeExpire(ctx->rdb, item->key);
-                }
-            }
-            restore_a(ctx->rdb, (binlog_tab *)ctx->binlogtab, ctx->db, item->key, RESTORE_LVL_ACT, 0);
+            listDelNode(server.dbe_get_clients, ln);
         }
-        else
-        {
-            /* the key has existed in rdb, maybe insert by other cmd, release it */
-            if (item->val)
-            {
-                decrRefCount(item->val);
-            }
-        }
-
-        /* release resource */
-        decrRefCount(item->key);
-        listDelNode(c->dbe_get_keys, ln);
-        zfree(item);
     }
 
-handle_client:
-    server.dbe_get_clients_cnt--;
-    wait_c_cnt = listLength(server.dbe_get_clients);
-    c->dbe_get_block_dur = server.ustime - c->block_start_time;
-    log_test("wait in dbe_get_que: %lld(us), cmd=%s, waiting_c=%d"
-              , c->dbe_get_block_dur, c->argv[0]->ptr, wait_c_cnt);
-
     c->flags &= (~REDIS_DBE_GET_WAIT);
     //aeCreateFileEvent(server.el, c->fd, AE_READABLE, readQueryFromClient, c);
     struct redisCommand *cmd = lookupCommand(c->argv[0]->ptr);
@@ -367,7 +546,12 @@ handle_client:
     }
     if (ignore == 0)
     {
+        const unsigned long long bl_seq = server.bl_enq_seq;
         call(c);
+        if (cmd->wrbl_flag)
+        {
+            block_client_on_bl_sync(c, bl_seq);
+        }
         resetClient(c);
         if (c->querybuf && sdslen(c->querybuf) > 0)
         {
@@ -375,25 +559,70 @@ handle_client:
             processInputBuffer(c);
         }
     }
+}
+
+/* call by main thread after one key has been read from dbe */
+void after_dbe_get(void *t_ctx)
+{
+    log_test("continue after finishing dbe get...arg=%p", t_ctx);
+
+    listNode *ln = 0;
+    ItemKeyVal *item = (ItemKeyVal *)t_ctx;
+    dbmng_ctx *ctx = (dbmng_ctx*)item->ctx;
+
+    dictDelete(server.dbe_get_inflight, item->key);
 
-    if (wait_c_cnt)
+    robj *const val = lookupKey(ctx->rdb, item->key);
+    if (val == 0)
     {
-        /* go on startup next c */
-        ln = listFirst(server.dbe_get_clients);
-        c = listNodeValue(ln);
-        listDelNode(server.dbe_get_clients, ln);
-        const int block = check_multi_block_keys(c, c->cmd, c->argc, c->argv);
-        if (block)
+        if (item->val)
         {
-            notify_dbe_get(c);
-            return;
+            /* get value succ */
+            dbAdd(ctx->rdb, item->key, (robj *)item->val);
+            if (item->expire > 0)
+            {
+                setExpire(ctx->rdb, item->key, item->expire);
+            }
+            else
+            {
+                removeExpire(ctx->rdb, item->key);
+            }
+            item->val = 0;
         }
-        else
+        restore_a(ctx->rdb, (binlog_tab *)ctx->binlogtab, ctx->db, item->key, RESTORE_LVL_ACT, 0);
+        if (item->not_found && dictFind(ctx->rdb->dict, item->key->ptr) == NULL)
         {
-            /* do not need to block the client anymore */
-            goto handle_client;
+            mf_note_miss(item->key);
         }
     }
+    /* else: the key has existed in rdb, maybe insert by other cmd, release it */
+
+    /* the item has been removed from dbe_get_inflight, nobody joins it now */
+    while ((ln = listFirst(item->clients)))
+    {
+        redisClient *c = listNodeValue(ln);
+        listDelNode(item->clients, ln);
+
+        listNode *kn = listSearchKey(c->dbe_get_keys, item);
+        if (kn)
+        {
+            listDelNode(c->dbe_get_keys, kn);
+        }
+        if (--c->dbe_get_pending <= 0)
+        {
+            resume_client(c);
+        }
+    }
+    free_item(item);
+
+    if (listLength(server.dbe_get_clients) > 0)
+    {
+        /* go on startup next c */
+        ln = listFirst(server.dbe_get_clients);
+        redisClient *c = listNodeValue(ln);
+        listDelNode(server.dbe_get_clients, ln);
+        notify_dbe_get(c);
+    }
 
 #ifdef _UPD_DBE_BY_PERIODIC_
     if (server.dbe_get_clients_cnt <= 0)
@@ -403,4 +632,3 @@ handle_client:
     }
 #endif
 }
-
@@ -8,6 +8,7 @@ extern int block_client_on_dbe_get(redisClient *c);
 extern void do_dbe_get(void *);
 extern void after_dbe_get(void *);
 extern void check_dbe_get_timer();
+extern void unblock_client_on_dbe_get(redisClient *c);
 
 
 #endif /* _DBE_GET_H_ */
@@ -9,7 +9,7 @@
 
 #ifdef _DBE_LEVEL_DB_
 #include "leveldb/dbe_cif.h"
-#else
+#elif !defined(_DBE_LOG_DB_)
 #include "hidb/db/include/db.h"
 #include "hidb2/src/db/db.h"
 #endif
@@ -19,6 +19,12 @@
     if (Ctx == 0) return DBE_ERR_OTHER_FAIL;\
 }
 
+#ifdef _DBE_LOG_DB_
+/* ldb_set_filter() takes both */
+static dbeFilterFunc sc_key_filter = NULL;
+static dbeValFilterFunc sc_val_filter = NULL;
+#endif
+
 
 int dbe_init(const char *dbname, void **pdb, int read_only, int auto_purge, int dbe_fsize)
 {
@@ -31,6 +37,20 @@ int dbe_init(const char *dbname, void **pdb, int read_only, int auto_purge, int
     (void)dbe_fsize;
     server.dbe_ver = DBE_VER_HIDB;
     return leveldbInit(dbname, pdb);
+#elif defined(_DBE_LOG_DB_)
+    (void)auto_purge;
+    /* the size unit of dbe_fsize is of hidb, use LDB_SEG_SIZE */
+    (void)dbe_fsize;
+    server.dbe_ver = DBE_VER_HIDB2;
+    ldb_t *db = NULL;
+    const int ret = ldb_open(dbname, read_only, 0, &db);
+    if (ret != LDB_OK)
+    {
+        log_error("ldb_open fail, ret=%d, dbname=%s", ret, dbname);
+        return DBE_ERR_OTHER_FAIL;
+    }
+    *pdb = db;
+    return DBE_ERR_SUCC;
 #else
     const int dbe_ver = dbe_version((char*)dbname);
     if (dbe_ver == DBVER_V1)
@@ -97,6 +117,8 @@ void dbe_uninit(void *db_ctx)
 
 #ifdef _DBE_LEVEL_DB_
     leveldbUninit(db_ctx);
+#elif defined(_DBE_LOG_DB_)
+    ldb_close((ldb_t *)db_ctx);
 #else
     if (server.dbe_ver == DBE_VER_HIDB)
     {
@@ -120,6 +142,14 @@ int dbe_startup(void *db_ctx)
 #ifdef _DBE_LEVEL_DB_
     (void)db_ctx;
     return DBE_ERR_SUCC;
+#elif defined(_DBE_LOG_DB_)
+    const int ret = ldb_start((ldb_t *)db_ctx);
+    if (ret != LDB_OK)
+    {
+        log_error("ldb_start fail, ret=%d", ret);
+        return DBE_ERR_OTHER_FAIL;
+    }
+    return DBE_ERR_SUCC;
 #else
     int ret;
     if (server.dbe_ver == DBE_VER_HIDB)
@@ -161,6 +191,20 @@ int dbe_get(void *db_ctx, const char *key, size_t key_len, char **val, int *val_
     (void)key_len;
     *val = leveldbGet(db_ctx, key, val_len, f);
     const int32_t ret = *val != NULL ? 0 : 1;
+#elif defined(_DBE_LOG_DB_)
+    size_t len = 0;
+    const int32_t ret = ldb_get((ldb_t *)db_ctx, key, key_len, val, &len, f);
+    *val_len = (int)len;
+    if (ret != LDB_OK && *val)
+    {
+        /* allocated by f even on failure, freed here for zmalloc,
+         * the other allocators (restore_key.c) own their memory */
+        if (f == zmalloc)
+        {
+            zfree(*val);
+        }
+        *val = 0;
+    }
 #else
     int32_t ret;
     if (server.dbe_ver == DBE_VER_HIDB)
@@ -261,6 +305,20 @@ int dbe_put(void *db_ctx, char *key, int key_len, char *val, int val_len)
     zfree(key);
     zfree(val);
     return ret;
+#elif defined(_DBE_LOG_DB_)
+    int ret = ldb_put((ldb_t *)db_ctx, key, key_len, val, val_len);
+    if (ret != LDB_OK)
+    {
+        log_error("ldb_put fail, ret=%d, key=%s, val_len=%d", ret, key, val_len);
+        ret = DBE_ERR_OTHER_FAIL;
+    }
+    else
+    {
+        ret = DBE_ERR_SUCC;
+    }
+    zfree(key);
+    zfree(val);
+    return ret;
 #else
     int ret;
     if (server.dbe_ver == DBE_VER_HIDB)
@@ -329,6 +387,19 @@ int dbe_mput(void *db_ctx, kvec_t *data, size_t cnt)
     }
     zfree(data);
     return DBE_ERR_SUCC;
+#elif defined(_DBE_LOG_DB_)
+    const int ret = ldb_write((ldb_t *)db_ctx, data, cnt, NULL, 0);
+    if (ret != LDB_OK)
+    {
+        log_error("ldb_write fail, ret=%d, key_cnt=%zu", ret, cnt);
+    }
+    for (i = 0; i < cnt; i++)
+    {
+        zfree(data[i].k);
+        zfree(data[i].v);
+    }
+    zfree(data);
+    return ret == LDB_OK ? DBE_ERR_SUCC : DBE_ERR_OTHER_FAIL;
 #else
     if (server.dbe_ver == DBE_VER_HIDB)
     {
@@ -384,6 +455,19 @@ int dbe_mdelete(void *db_ctx, kvec_t *data, size_t cnt)
     }
     zfree(data);
     return DBE_ERR_SUCC;
+#elif defined(_DBE_LOG_DB_)
+    const int ret = ldb_write((ldb_t *)db_ctx, NULL, 0, data, cnt);
+    if (ret != LDB_OK)
+    {
+        log_error("ldb_write fail, ret=%d, key_cnt=%zu", ret, cnt);
+    }
+    for (i = 0; i < cnt; i++)
+    {
+        zfree(data[i].k);
+        zfree(data[i].v);
+    }
+    zfree(data);
+    return ret == LDB_OK ? DBE_ERR_SUCC : DBE_ERR_OTHER_FAIL;
 #else
     if (server.dbe_ver == DBE_VER_HIDB)
     {
@@ -418,6 +502,10 @@ int dbe_set_filter(void *db_ctx, dbeFilterFunc f)
 #ifdef _DBE_LEVEL_DB_
     (void)(f);
     return DBE_ERR_SUCC;
+#elif defined(_DBE_LOG_DB_)
+    sc_key_filter = f;
+    ldb_set_filter((ldb_t *)db_ctx, f, sc_val_filter);
+    return DBE_ERR_SUCC;
 #else
     int32_t ret;
     if (server.dbe_ver == DBE_VER_HIDB)
@@ -447,6 +535,10 @@ int dbe_set_val_filter(void *db_ctx, dbeValFilterFunc f)
 #ifdef _DBE_LEVEL_DB_
     (void)(f);
     return DBE_ERR_SUCC;
+#elif defined(_DBE_LOG_DB_)
+    sc_val_filter = f;
+    ldb_set_filter((ldb_t *)db_ctx, sc_key_filter, f);
+    return DBE_ERR_SUCC;
 #else
     int32_t ret;
     if (server.dbe_ver == DBE_VER_HIDB)
@@ -477,6 +569,14 @@ int dbe_clean(void *db_ctx)
     CHECK_DB_CTX(db_ctx);
 #ifdef _DBE_LEVEL_DB_
     return DBE_ERR_SUCC;
+#elif defined(_DBE_LOG_DB_)
+    const int ret = ldb_clear((ldb_t *)db_ctx);
+    if (ret != LDB_OK)
+    {
+        log_error("ldb_clear fail, ret=%d", ret);
+        return DBE_ERR_OTHER_FAIL;
+    }
+    return DBE_ERR_SUCC;
 #else
     int ret;
     if (server.dbe_ver == DBE_VER_HIDB)
@@ -505,7 +605,8 @@ int dbe_clean_file(void *db_ctx, const void *tm)
     log_prompt("dbe_clean_file: db_ctx=%p", db_ctx);
 
     CHECK_DB_CTX(db_ctx);
-#ifdef _DBE_LEVEL_DB_
+#if defined(_DBE_LEVEL_DB_) || defined(_DBE_LOG_DB_)
+    /* ldb: the segments are removed by compaction, not by time */
     (void)(tm);
     return DBE_ERR_SUCC;
 #else
@@ -538,6 +639,9 @@ int dbe_freeze(void *db_ctx)
     CHECK_DB_CTX(db_ctx);
 #ifdef _DBE_LEVEL_DB_
     return DBE_ERR_SUCC;
+#elif defined(_DBE_LOG_DB_)
+    ldb_freeze((ldb_t *)db_ctx, 1);
+    return DBE_ERR_SUCC;
 #else
     int32_t ret;
     if (server.dbe_ver == DBE_VER_HIDB)
@@ -568,6 +672,9 @@ int dbe_unfreeze(void *db_ctx)
     CHECK_DB_CTX(db_ctx);
 #ifdef _DBE_LEVEL_DB_
     return DBE_ERR_SUCC;
+#elif defined(_DBE_LOG_DB_)
+    ldb_freeze((ldb_t *)db_ctx, 0);
+    return DBE_ERR_SUCC;
 #else
     int32_t ret;
     if (server.dbe_ver == DBE_VER_HIDB)
@@ -600,6 +707,14 @@ int dbe_merge(void *db_ctx, const char *path)
     (void)db_ctx;
     (void)path;
     return DBE_ERR_SUCC;
+#elif defined(_DBE_LOG_DB_)
+    const int ret = ldb_merge((ldb_t *)db_ctx, path);
+    if (ret != LDB_OK)
+    {
+        log_error("ldb_merge fail, ret=%d, path=%s", ret, path);
+        return DBE_ERR_OTHER_FAIL;
+    }
+    return DBE_ERR_SUCC;
 #else
     int32_t ret;
     if (server.dbe_ver == DBE_VER_HIDB)
@@ -631,6 +746,13 @@ int dbe_purge(void *db_ctx)
 #ifdef _DBE_LEVEL_DB_
     (void)db_ctx;
     return DBE_ERR_SUCC;
+#elif defined(_DBE_LOG_DB_)
+    const int ret = ldb_compact((ldb_t *)db_ctx);
+    if (ret != LDB_OK)
+    {
+        log_error("ldb_compact fail, ret=%d", ret);
+    }
+    return DBE_ERR_SUCC;
 #else
     if (server.dbe_ver == DBE_VER_HIDB)
     {
@@ -660,6 +782,16 @@ void *dbe_pget(void *db_ctx, const char *key_prefix, size_t len)
     (void)key_prefix;
     (void)len;
     it = (void*)1;
+#elif defined(_DBE_LOG_DB_)
+    it = ldb_iter_prefix((ldb_t *)db_ctx, key_prefix, len);
+    if (it == NULL)
+    {
+        log_error("ldb_iter_prefix: return NULL, key_prefix=%s", key_prefix);
+    }
+    else
+    {
+        server.stat_dbeio_it++;
+    }
 #else
     if (server.dbe_ver == DBE_VER_HIDB)
     {
@@ -700,6 +832,14 @@ int dbe_pdelete(void *db_ctx, const char *key_prefix, size_t len)
     (void)key_prefix;
     (void)len;
     return DBE_ERR_SUCC;
+#elif defined(_DBE_LOG_DB_)
+    const int ret = ldb_pdel((ldb_t *)db_ctx, key_prefix, len);
+    if (ret != LDB_OK)
+    {
+        log_error("ldb_pdel: return %d, key=%s", ret, key_prefix);
+        return DBE_ERR_OTHER_FAIL;
+    }
+    return DBE_ERR_SUCC;
 #else
     int ret;
     if (server.dbe_ver == DBE_VER_HIDB)
@@ -740,6 +880,17 @@ void *dbe_create_it(void *db_ctx, int level)
     (void)db_ctx;
     (void)level;
     it = (void*)1;
+#elif defined(_DBE_LOG_DB_)
+    /* level: the newest segments for hot keys, MF_SCAN_LEVEL for all */
+    it = ldb_iter_recent((ldb_t *)db_ctx, level >= 15 ? 0 : level);
+    if (it == NULL)
+    {
+        log_error("ldb_iter_recent: return NULL, db_ctx=%p, level=%d", db_ctx, level);
+    }
+    else
+    {
+        server.stat_dbeio_it++;
+    }
 #else
     if (server.dbe_ver == DBE_VER_HIDB)
     {
@@ -833,6 +984,42 @@ int dbe_next_key(void *it, char **k, int *k_len, char **v, int *v_len, dbeMalloc
         sc_idx += 1;
         return DBE_ERR_SUCC;
     }
+#elif defined(_DBE_LOG_DB_)
+    struct timespec ts;
+    if (dur)
+    {
+        ts = pf_get_time_tick();
+    }
+    size_t ks = 0;
+    size_t vs = 0;
+    const int ret = ldb_iter_next((ldb_iter_t *)it, k, &ks, v, &vs, f);
+    if (dur)
+    {
+        *dur = pf_get_time_diff_nsec(ts, pf_get_time_tick()) / 1000;
+    }
+    if (ret != LDB_OK)
+    {
+        if (ret != LDB_NOT_FOUND)
+        {
+            log_error("ldb_iter_next() ret=%d, it=%p", ret, it);
+        }
+        /* allocated by f even on failure, freed here for zmalloc,
+         * the other allocators (restore_key.c) own their memory */
+        if (*k && f == zmalloc)
+        {
+            zfree(*k);
+        }
+        if (*v && f == zmalloc)
+        {
+            zfree(*v);
+        }
+        *k = 0;
+        *v = 0;
+        return DBE_ERR_OTHER_FAIL;
+    }
+    *k_len = (int)ks;
+    *v_len = (int)vs;
+    return DBE_ERR_SUCC;
 #else
     struct timespec ts;
     if (dur)
@@ -878,6 +1065,8 @@ void dbe_destroy_it(void *it)
     (void)it;
     sc_idx = 0;
     return;
+#elif defined(_DBE_LOG_DB_)
+    ldb_iter_free((ldb_iter_t *)it);
 #else
     if (server.dbe_ver == DBE_VER_HIDB)
     {
@@ -895,6 +1084,17 @@ void dbe_print_info(void *db_ctx)
 #ifdef _DBE_LEVEL_DB_
     (void)db_ctx;
     return;
+#elif defined(_DBE_LOG_DB_)
+    if (db_ctx)
+    {
+        ldb_stat_t st;
+        ldb_get_stat((ldb_t *)db_ctx, &st);
+        log_prompt("ldb: keys=%" PRIu64 ", segs=%u, active_seg=%u, disk_bytes=%" PRIu64
+                   ", dead_bytes=%" PRIu64 ", compactions=%" PRIu64 ", moved_bytes=%" PRIu64
+                   ", filtered_keys=%" PRIu64 ", corrupt_bytes=%" PRIu64
+                   , st.keys, st.segs, st.active_seg, st.disk_bytes, st.dead_bytes
+                   , st.compactions, st.moved_bytes, st.filtered_keys, st.corrupt_bytes);
+    }
 #else
     if (db_ctx)
     {
@@ -913,7 +1113,7 @@ void dbe_print_info(void *db_ctx)
 extern int dbe_tran_begin(void *db_ctx)
 {
     int ret = 0;
-#ifndef _DBE_LEVEL_DB_
+#if !defined(_DBE_LEVEL_DB_) && !defined(_DBE_LOG_DB_)
     if (server.dbe_ver == DBE_VER_HIDB)
     {
         return 0;
@@ -931,7 +1131,7 @@ extern int dbe_tran_begin(void *db_ctx)
 extern int dbe_tran_commit(void *db_ctx)
 {
     int ret = 0;
-#ifndef _DBE_LEVEL_DB_
+#if !defined(_DBE_LEVEL_DB_) && !defined(_DBE_LOG_DB_)
     if (server.dbe_ver == DBE_VER_HIDB)
     {
         return 0;
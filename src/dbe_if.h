@@ -10,7 +10,12 @@
 #define DBE_ERR_RE_INIT           6
 #define DBE_ERR_NEVER_INIT        7
 
+#ifdef _DBE_LOG_DB_
+#include "log_dbe.h"
+typedef ldb_kv_t kvec_t;
+#else
 #include "hidb2/src/db/db_com_def.h"
+#endif
 
 typedef void *(*dbeMallocFunc)(size_t size);
 typedef void (*dbeFreeFunc)(void *ptr);
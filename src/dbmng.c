@@ -14,6 +14,9 @@
 #include "ds_zmalloc.h"
 #include "pf_util.h"
 #include "codec_key.h"
+#include "hot_preload.h"
+#include "miss_filter.h"
+#include "key_migrate.h"
 
 #include <stdio.h>
 #include <pthread.h>
@@ -135,6 +138,8 @@ int dbmng_init(int tag, int slave)
 
     int ret;
     time_t start, end;
+    void *it = 0;
+    void *bloom_it = 0;
 
     /* init binlog */
     start = time(0);
@@ -169,126 +174,34 @@ int dbmng_init(int tag, int slave)
         log_prompt("dbe_init during=%ds, dbe=%p, path=%s"
                    , end - start, s->ctx->db, db_path);
 
-        void *it = 0;
+        mf_init();
+        if ((server.has_cache == 0 || server.read_dbe == 1) && server.dbe_bloom_mb > 0)
+        {
+            bloom_it = dbe_create_it(s->ctx->db, MF_SCAN_LEVEL);
+        }
         if (server.has_cache == 1 && server.dbe_hot_level > 0)
         {
+            /* create it before dbe_startup, the keys are loaded in background */
             const int lvl = server.dbe_hot_level;
             it = dbe_create_it(s->ctx->db, lvl);
         }
-        if (it)
-        {
-            // load hot keys from dbe
-            start = end;
-            long long cnt = 0;
-            size_t ignore_cnt = 0;
-            char *k = 0;
-            int k_len;
-            char *v = 0;
-            int v_len;
-            robj *key = 0;
-            robj *val = 0;
-            size_t val_total_len = 0;
-            time_t diff = 0;
-            long long uns_diff = 0;
-
-            while ((server.load_hot_key_max_num < 0 || server.load_hot_key_max_num > cnt)
-                   && dbe_next_key(it, &k, &k_len, &v, &v_len, zmalloc, NULL) == 0)
-            {
-                const size_t mem_size = ds_zmalloc_used_memory();
-                if (mem_size * 10 > (size_t)server.db_max_size * 9)
-                {
-                    log_prompt("stop loading, mem=%zd, db_max_size=%llu",
-                               mem_size, server.db_max_size);
-                    zfree(k);
-                    zfree(v);
-                    break;
-                }
-
-                dbe_key_attr attr;
-                if (decode_dbe_key(k, k_len, &attr) != 0)
-                {
-                    zfree(k);
-                    zfree(v);
-                    continue;
-                }
-                if (attr.type != KEY_TYPE_STRING)
-                {
-                    log_test("\'%c\' not string, ignore, dbe_key=%s", attr.type, k);
-                    zfree(k);
-                    zfree(v);
-                    continue;
-                }
-
-                struct timespec start1 = pf_get_time_tick();
-                key = createStringObject(attr.key, attr.key_len);
-                val = lookupKey(s->ctx->rdb, key);
-                if (!val)
-                {
-                    time_t expire;
-                    struct timespec start_t = pf_get_time_tick();
-                    val = unserializeObj(v, v_len, &expire);
-                    struct timespec end_t = pf_get_time_tick();
-                    uns_diff += pf_get_time_diff_nsec(start_t, end_t);
-
-                    const time_t now = time(0);
-                    if (val && expire > 0 && expire < now)
-                    {
-                        /* expire, ignore */
-                        log_error("\"%s\" expired, ignore it, expire=%d, now=%d",
-                                  key->ptr, expire, now);
-                        decrRefCount(val);
-                    }
-                    else if (val)
-                    {
-                        if (val->type == REDIS_STRING
-                            && val->encoding == REDIS_ENCODING_RAW)
-                        {
-                            val_total_len += sdslen(val->ptr);
-                        }
-                        cnt++;
-
-                        dbAdd(s->ctx->rdb, key, val);
-                        if (expire > 0)
-                        {
-                            setExpire(s->ctx->rdb, key, expire);
-                        }
-                    }
-                    else
-                    {
-                        log_error("load from dbe fail, key=%s", key->ptr);
-                    }
-                }
-                else
-                {
-                    /* the has exist, ignore it */
-                    log_info("\"%s\" existed, ignore", key->ptr);
-                    ignore_cnt++;
-                }
-
-                decrRefCount(key);
-                zfree(k);
-                zfree(v);
-
-                struct timespec end1 = pf_get_time_tick();
-                diff += pf_get_time_diff_nsec(start1, end1);
-            }
-
-            dbe_destroy_it(it);
-
-            end = time(0);
-            log_prompt("load k-v into rdb from dbe during=%ds(%lldms, %lldms)"
-                       ", cnt=%lld, ignore=%zd, val_total_len=%zd"
-                       , end - start, diff / 1000000, uns_diff / 1000000
-                       , cnt, ignore_cnt, val_total_len);
-        }
 
         ret = dbe_startup(s->ctx->db);
         if (ret != DBE_ERR_SUCC)
         {
             log_error("dbe_startup() fail, ret=%d", ret);
+            if (it)
+            {
+                dbe_destroy_it(it);
+            }
+            if (bloom_it)
+            {
+                dbe_destroy_it(bloom_it);
+            }
             dbmng_uninit(tag);
             return 1;
         }
+        km_init(s->ctx->db);
     }
 
     if (server.has_dbe == 1 && server.has_cache == 1)
@@ -317,6 +230,22 @@ int dbmng_init(int tag, int slave)
         redo_bl(s->ctx->rdb, s->ctx->binlog, server.load_bl_cnt);
     }
 
+    if (bloom_it)
+    {
+        mf_start_build(bloom_it);
+    }
+    else
+    {
+        /* the bloom can't know all keys in dbe */
+        mf_disable("no dbe iterator");
+    }
+
+    if (it)
+    {
+        /* load hot keys from dbe, rdb serves while loading */
+        preload_start(s->ctx, it);
+    }
+
     return 0;
 }
 
@@ -344,6 +273,9 @@ int dbmng_uninit(int tag)
 
 static void dbmng_destroy(dbmng_ctx_hash *s)
 {
+    preload_stop();
+    mf_stop();
+
     if (s->ctx->db)
     {
         dbe_uninit(s->ctx->db);
@@ -409,7 +341,13 @@ int dbmng_check_key_io(int tag, const robj *key)
 
     int ret = 0;
     robj *value = lookupKey(s->ctx->rdb, (robj *)key);
-    if (!value)
+    if (!value && bl_dbe_inflight(s->ctx->rdb->id, key->ptr))
+    {
+        /* a key with writes not in dbe yet is never evicted,
+         * so it has been deleted, dbe is stale */
+        server.stat_dbe_inflight_misses++;
+    }
+    else if (!value)
     {
         ret = restore_a(s->ctx->rdb, (binlog_tab *)s->ctx->binlogtab,
                 s->ctx->db, key, RESTORE_LVL_ACT, 1);
@@ -428,11 +366,10 @@ int dbmng_save_op(int tag, const char *cmd, const robj *key, int argc, robj **ar
     log_debug("dbmng_save_op...cmd=%s, key=%s", cmd, key->ptr);
 
     if (server.is_slave == 0
-        && ((server.has_cache == 1 && server.has_dbe == 0)
-         || (server.has_cache == 0 && server.has_dbe == 1))
+        && server.has_cache == 1 && server.has_dbe == 0
         && server.wr_bl == 0)
     {
-        /* pure cache & pure dbe may ignore binlog */
+        /* pure cache may ignore binlog, pure dbe writes dbe through it */
         return 0;
     }
 
@@ -530,7 +467,7 @@ void dbmng_start_cp(int tag)
         return;
     }
 
-    const unsigned int bl_writing_cnt = listLength(server.bl_writing);
+    const unsigned int bl_writing_cnt = server.handle_bl_depth;
     if (bl_writing_cnt > 0)
     {
         log_info("dbmng_start_cp, but bl is writing, bl_writing_cnt=%u", bl_writing_cnt);
@@ -755,124 +692,6 @@ int dbmng_unblock_upd_cp(int tag)
     return 0;
 }
 
-int dbmng_key_exist(int tag, const robj *key, uint64_t *ver)
-{
-    log_debug("dbmng_key_exist...key=%s", key->ptr);
-
-    dbmng_ctx *ctx = get_entry_ctx(tag);
-    if (ctx == 0)
-    {
-        /* fail */
-        log_error("%s", "get_entry_ctx() fail");
-        return 2;
-    }
-    (void)ver;
-
-    return 0;
-}
-
-robj *dbmng_lookup_key(int tag, const robj *key, time_t *exp)
-{
-    log_debug("dbmng_lookup_key...key=%s", key->ptr);
-
-    dbmng_ctx *ctx = get_entry_ctx(tag);
-    if (ctx == 0)
-    {
-        /* fail */
-        log_error("%s", "get_entry_ctx() fail");
-        return 0;
-    }
-    (void)exp;
-
-    return 0;
-}
-
-int dbmng_set_key(int tag, const robj *key, int argc, robj **argv)
-{
-    log_debug("dbmng_set_key...key=%s", key->ptr);
-
-    dbmng_ctx *ctx = get_entry_ctx(tag);
-    if (ctx == 0)
-    {
-        /* fail */
-        log_error("%s", "get_entry_ctx() fail");
-        return 1;
-    }
-
-    int expire = 0;
-    if (argc == 2)
-    {
-        long long exp;
-        if (getLongLongFromObject(argv[1], &exp) == REDIS_OK)
-        {
-            expire = (int)exp;
-        }
-    }
-
-    int len;
-    char *val = 0;
-    val = serializeObjExp(argv[0], &len, expire);
-    if (val)
-    {
-        zfree(val);
-        return 0;
-    }
-    else
-    {
-        return 1;
-    }
-}
-
-int dbmng_wr_bl(int tag, const char *cmd, const robj *key, int argc, robj **argv, unsigned long long ds_id, unsigned char db_id)
-{
-    log_debug("dbmng_wr_bl...cmd=%s, key=%s", cmd, key->ptr);
-
-    if (server.is_slave == 0
-        && ((server.has_cache == 1 && server.has_dbe == 0)
-         || (server.has_cache == 0 && server.has_dbe == 1))
-        && server.wr_bl == 0)
-    {
-        /* pure cache & pure dbe may ignore binlog */
-        return 0;
-    }
-
-    dbmng_ctx *ctx = get_entry_ctx(tag);
-    if (ctx == 0)
-    {
-        /* fail */
-        log_error("%s", "get_entry_ctx() fail");
-        return 1;
-    }
-
-    const int command = get_cmd(cmd);
-    if (command < 0)
-    {
-        /* illegal command */
-        log_error("illegal command, ret=%d, cmd=%s", command, cmd);
-        return 1;
-    }
-    log_debug("op: %s --> %d", cmd, command);
-
-    bl_write_op(ctx->binlog, command, key, argc, (const robj **)argv, ds_id, db_id, 1);
-
-    return 0;
-}
-
-int dbmng_del_key(int tag, const robj *key)
-{
-    log_debug("dbmng_del_key...key=%s", key->ptr);
-
-    dbmng_ctx *ctx = get_entry_ctx(tag);
-    if (ctx == 0)
-    {
-        /* fail */
-        log_error("%s", "get_entry_ctx() fail");
-        return 1;
-    }
-
-    return 0;
-}
-
 void dbmng_release_bl(int tag)
 {
     dbmng_ctx *ctx = get_entry_ctx(tag);
@@ -56,17 +56,6 @@ extern int dbmng_unblock_upd_cp(int tag);
 extern void dbmng_release_bl(int tag);
 extern void dbmng_reset_bl(int tag);
 
-/* return:
- * 0 - not existed
- * 1 - existed
- * 2 - system fail
- */
-extern int dbmng_key_exist(int tag, const robj *key, uint64_t *ver);
-extern robj *dbmng_lookup_key(int tag, const robj *key, time_t *expire);
-extern int dbmng_set_key(int tag, const robj *key, int argc, robj **argv);
-extern int dbmng_wr_bl(int tag, const char *cmd, const robj *key, int argc, robj **argv, unsigned long long ds_id, unsigned char db_id);
-extern int dbmng_del_key(int tag, const robj *key);
-
 extern struct dbmng_conf_st dbmng_conf;
 
 extern dbmng_ctx *get_entry_ctx(int tag);
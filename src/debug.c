@@ -1,5 +1,7 @@
 #include "redis.h"
 #include "sha1.h"   /* SHA1 is used for DEBUG DIGEST */
+#include "serialize.h"  /* DEBUG SERIALIZE */
+#include "codec_key.h"  /* DEBUG CODEC */
 
 #include <arpa/inet.h>
 
@@ -214,6 +216,143 @@ void computeDatasetDigest(unsigned char *final) {
     }
 }
 
+/* DEBUG SERIALIZE <count>: time serializeObjExp() over every encoding,
+ * each result is unserialized back and serialized again to compare */
+static robj *createSerializeBenchObject(int variant) {
+    robj *o = NULL, *ele, *val;
+    char buf[64];
+    int j;
+
+    if (variant == 0) {
+        return createStringObject(
+            "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+            "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghij",100);
+    } else if (variant == 1) {
+        return createStringObjectFromLongLong(123456789);
+    }
+    for (j = 0; j < 16; j++) {
+        if (variant == 4 || variant == 5)
+            snprintf(buf,sizeof(buf),"%d",j*1000);
+        else
+            snprintf(buf,sizeof(buf),"member:%d:abcdefghijabcdefghij",j);
+        ele = createStringObject(buf,strlen(buf));
+        switch(variant) {
+        case 2: case 3:
+            if (!o) o = createZiplistObject();
+            listTypePush(o,ele,REDIS_TAIL);
+            break;
+        case 4: case 5:
+            if (!o) o = createIntsetObject();
+            setTypeAdd(o,ele);
+            break;
+        case 6: case 7:
+            if (!o) o = createZsetZiplistObject();
+            o->ptr = zzlInsert(o->ptr,ele,(double)j/3);
+            break;
+        case 8: case 9:
+            if (!o) o = createHashObject();
+            val = createStringObjectFromLongLong(j);
+            hashTypeSet(o,ele,val);
+            decrRefCount(val);
+            break;
+        }
+        decrRefCount(ele);
+    }
+    if (variant == 3) listTypeConvert(o,REDIS_ENCODING_LINKEDLIST);
+    else if (variant == 5) setTypeConvert(o,REDIS_ENCODING_HT);
+    else if (variant == 7) zsetConvert(o,REDIS_ENCODING_SKIPLIST);
+    else if (variant == 9 && o->encoding == REDIS_ENCODING_ZIPMAP)
+        convertToRealHash(o);
+    return o;
+}
+
+static void debugSerializeBench(redisClient *c, long count) {
+    static const char *names[] = {
+        "string-raw", "string-int", "list-ziplist", "list-linkedlist",
+        "set-intset", "set-ht", "zset-ziplist", "zset-skiplist",
+        "hash-zipmap", "hash-ht"
+    };
+    int variant, nvariants = sizeof(names)/sizeof(names[0]);
+
+    addReplyMultiBulkLen(c,nvariants);
+    for (variant = 0; variant < nvariants; variant++) {
+        robj *o = createSerializeBenchObject(variant), *back;
+        char *ser = NULL, *ser2;
+        int len = 0, len2;
+        long long start, elapsed;
+        long j;
+        time_t expire;
+
+        start = ustime();
+        for (j = 0; j < count; j++) {
+            if (ser) zfree(ser);
+            ser = serializeObjExp(o,&len,0);
+        }
+        elapsed = ustime()-start;
+
+        back = ser ? unserializeObj(ser,len,&expire) : NULL;
+        ser2 = back ? serializeObjExp(back,&len2,0) : NULL;
+        addReplyStatusFormat(c,"%s: %.1f ns/op, %d bytes, roundtrip %s",
+            names[variant], count ? elapsed*1000.0/count : 0.0, len,
+            (ser2 && len2 == len && !memcmp(ser,ser2,len)) ? "ok" : "mismatch");
+        if (ser) zfree(ser);
+        if (ser2) zfree(ser2);
+        if (back) decrRefCount(back);
+        decrRefCount(o);
+    }
+}
+
+/* DEBUG CODEC <count>: time encode_xxx_key() and decode_dbe_key() of
+ * every dbe key format, for prefix/string/list/set keys */
+static char *encodeCodecBenchKey(int kind, int ver, long j, size_t *len) {
+    static const char key[] = "user:profile:1000042";
+    static const char member[] = "member:00000000000000000042";
+
+    switch(kind) {
+    case 0: return encode_prefix_key_ver(ver,key,sizeof(key)-1,KEY_TYPE_HASH,len);
+    case 1: return encode_string_key_ver(ver,key,sizeof(key)-1,len);
+    case 2: return encode_list_key_ver(ver,key,sizeof(key)-1,(int64_t)j-1000,len);
+    default: return encode_set_key_ver(ver,key,sizeof(key)-1,member,sizeof(member)-1,len);
+    }
+}
+
+static void debugCodecBench(redisClient *c, long count) {
+    static const char *names[] = { "prefix", "string", "list", "set" };
+    int kind, ver, nkinds = sizeof(names)/sizeof(names[0]);
+
+    addReplyMultiBulkLen(c,nkinds*2);
+    for (kind = 0; kind < nkinds; kind++) {
+        for (ver = DBE_KEY_VER_1; ver <= DBE_KEY_VER_2; ver++) {
+            char *enc = NULL;
+            size_t len = 0;
+            long long start, enc_us, dec_us;
+            long j;
+            dbe_key_attr attr;
+            int bad = 0;
+
+            start = ustime();
+            for (j = 0; j < count; j++) {
+                if (enc) zfree(enc);
+                enc = encodeCodecBenchKey(kind,ver,j,&len);
+            }
+            enc_us = ustime()-start;
+
+            start = ustime();
+            for (j = 0; enc && j < count; j++)
+                bad |= decode_dbe_key(enc,len,&attr);
+            dec_us = ustime()-start;
+
+            addReplyStatusFormat(c,
+                "%s v%d: encode %.1f ns/op, decode %.1f ns/op, %zu bytes, decode %s",
+                names[kind], ver,
+                count ? enc_us*1000.0/count : 0.0,
+                count ? dec_us*1000.0/count : 0.0,
+                len, (enc && !bad && attr.ver == ver) ? "ok" : "fail");
+            if (enc) zfree(enc);
+        }
+    }
+}
+
 void debugCommand(redisClient *c) {
     if (!strcasecmp(c->argv[1]->ptr,"segfault")) {
         *((char*)-1) = 'x';
@@ -330,9 +469,21 @@ void debugCommand(redisClient *c) {
 
         usleep(utime);
         addReply(c,shared.ok);
+    } else if (!strcasecmp(c->argv[1]->ptr,"serialize") && c->argc == 3) {
+        long count;
+
+        if (getLongFromObjectOrReply(c, c->argv[2], &count, NULL) != REDIS_OK)
+            return;
+        debugSerializeBench(c,count);
+    } else if (!strcasecmp(c->argv[1]->ptr,"codec") && c->argc == 3) {
+        long count;
+
+        if (getLongFromObjectOrReply(c, c->argv[2], &count, NULL) != REDIS_OK)
+            return;
+        debugCodecBench(c,count);
     } else {
         addReplyError(c,
-            "Syntax error, try DEBUG [SEGFAULT|OBJECT <key>|SWAPIN <key>|SWAPOUT <key>|RELOAD]");
+            "Syntax error, try DEBUG [SEGFAULT|OBJECT <key>|SWAPIN <key>|SWAPOUT <key>|RELOAD|SERIALIZE <count>|CODEC <count>]");
     }
 }
 
@@ -540,6 +540,69 @@ dictEntry *dictGetRandomKey(dict *d)
     return he;
 }
 
+/* Sample up to 'count' entries from a random place of the dict into 'des',
+ * walking adjacent buckets. It is much cheaper than calling
+ * dictGetRandomKey() 'count' times, but the entries are not independent,
+ * good enough to feed the eviction pool.
+ * Returns the number of entries stored. */
+unsigned int dictGetSomeKeys(dict *d, dictEntry **des, unsigned int count)
+{
+    unsigned int j;
+    unsigned int tables;
+    unsigned int stored = 0;
+    unsigned long maxsizemask;
+    unsigned long maxsteps;
+
+    if (dictSize(d) < count) count = dictSize(d);
+    maxsteps = count*10;
+
+    /* Do a rehashing work proportional to 'count'. */
+    for (j = 0; j < count; j++) {
+        if (dictIsRehashing(d))
+            _dictRehashStep(d);
+        else
+            break;
+    }
+
+    tables = dictIsRehashing(d) ? 2 : 1;
+    maxsizemask = d->ht[0].sizemask;
+    if (tables > 1 && maxsizemask < d->ht[1].sizemask)
+        maxsizemask = d->ht[1].sizemask;
+
+    unsigned long i = random() & maxsizemask;
+    unsigned long emptylen = 0; /* contiguous empty buckets so far */
+    while(stored < count && maxsteps--) {
+        for (j = 0; j < tables; j++) {
+            /* buckets of ht[0] below rehashidx are already moved */
+            if (tables == 2 && j == 0 && i < (unsigned long) d->rehashidx) {
+                if (i >= d->ht[1].size) i = d->rehashidx;
+                continue;
+            }
+            if (i >= d->ht[j].size) continue;
+            dictEntry *he = d->ht[j].table[i];
+
+            /* jump to another place after too many empty buckets */
+            if (he == NULL) {
+                emptylen++;
+                if (emptylen >= 5 && emptylen > count) {
+                    i = random() & maxsizemask;
+                    emptylen = 0;
+                }
+            } else {
+                emptylen = 0;
+                while (he) {
+                    *des++ = he;
+                    he = he->next;
+                    stored++;
+                    if (stored == count) return stored;
+                }
+            }
+        }
+        i = (i+1) & maxsizemask;
+    }
+    return stored;
+}
+
 /* ------------------------- private functions ------------------------------ */
 
 /* Expand the hash table if needed */
@@ -140,6 +140,7 @@ dictEntry *dictNext(dictIterator *iter);
 dictEntry *dictNextFY(dictIterator *iter, int *finish);
 void dictReleaseIterator(dictIterator *iter);
 dictEntry *dictGetRandomKey(dict *d);
+unsigned int dictGetSomeKeys(dict *d, dictEntry **des, unsigned int count);
 void dictPrintStats(dict *d);
 unsigned int dictGenHashFunction(const unsigned char *buf, int len);
 unsigned int dictGenCaseHashFunction(const unsigned char *buf, int len);
@@ -473,7 +473,6 @@ int upd_idx_file(const char *path, const char *prefix, int idx)
 char *serialize_op(unsigned char cmd, const robj *key, int argc, const robj **argv, int32_t ts, unsigned char db_id, unsigned char type, int *pLen)
 {
     int i;
-    char *buf = 0;
     const int key_len = sdslen(key->ptr);
     const unsigned char ver = server.prtcl_redis == 0 ? 128 : 129;
 
@@ -486,70 +485,58 @@ char *serialize_op(unsigned char cmd, const robj *key, int argc, const robj **ar
      * version(1) + cmd(1) + key_len(2) + key(n) + encode(1) + ts(4) + argc(4) 
      * (version: 129)
      */
-    if (ver == 128)
+    ser_buf *b = serializeBufGet();
+    unsigned char hdr[1 + 1 + sizeof(uint16_t) + 1 + sizeof(int32_t) + 4];
+    uint16_t n16;
+    uint32_t n32;
+    int idx = 0;
+
+    hdr[idx++] = ver;
+    hdr[idx++] = cmd;
+    n16 = htons(key_len);
+    memcpy(hdr + idx, &n16, sizeof(n16));
+    idx += sizeof(n16);
+    serializeBufAppend(b, hdr, idx);
+    serializeBufAppend(b, key->ptr, key_len);
+
+    idx = 0;
+    if (ver == 129)
     {
-        *pLen = 1 + 1 + sizeof(uint16_t) + key_len + sizeof(int32_t) + 1;
+        hdr[idx++] = (db_id & 0x7f) + ((type ? 1 : 0) << 7);
     }
-    else
+    n32 = htonl(ts);
+    memcpy(hdr + idx, &n32, sizeof(n32));
+    idx += sizeof(n32);
+    if (ver == 128)
     {
-        *pLen = 1 + 1 + sizeof(uint16_t) + key_len + 1 + sizeof(int32_t) + 4;
+        hdr[idx++] = (unsigned char)argc;
     }
-    for (i = 0; i < argc; i++)
+    else
     {
-        /* argv[i].len(4) + argv[i] */
-        *pLen += sizeof(uint32_t) + serializeObjLen(argv[i]);
+        n32 = htonl(argc);
+        memcpy(hdr + idx, &n32, sizeof(n32));
+        idx += sizeof(n32);
     }
+    serializeBufAppend(b, hdr, idx);
 
-    buf = (char *)zmalloc(*pLen);
-    if (buf)
+    for (i = 0; i < argc; i++)
     {
-        int idx = 0;
-
-        *(unsigned char *)(buf + idx++) = ver;
-
-        *(buf + idx++) = cmd;
-
-        *(uint16_t *)(buf + idx) = htons(key_len);
-        idx += sizeof(uint16_t);
-            
-        memcpy(buf + idx, key->ptr, key_len);
-        idx += key_len;
+        /* argv[i].len(4) + argv[i], the len is filled after argv[i] */
+        const size_t pos = b->len;
+        serializeBufAppend(b, &n32, sizeof(n32));
 
-        if (ver == 129)
+        const int len = serializeObjAppend(b, argv[i], 0);
+        if (len < 0)
         {
-            *(unsigned char *)(buf + idx++) = (db_id & 0x7f) + ((type ? 1 : 0) << 7);
-        }
-
-        *(uint32_t *)(buf + idx) = htonl(ts);
-        idx += sizeof(uint32_t);
-
-        if (ver == 128)
-        {
-            *(unsigned char *)(buf + idx++) = (unsigned char)argc;
-        }
-        else
-        {
-            *(uint32_t *)(buf + idx) = htonl(argc);
-            idx += sizeof(uint32_t);
-        }
-
-        for (i = 0; i < argc; i++)
-        {
-            const int len = serializeObjLen(argv[i]);
-
-            *(uint32_t *)(buf + idx) = htonl(len);
-            idx += sizeof(uint32_t);
-            
-            serializeObj2Buf(argv[i], buf + idx, len, 0);
-            idx += len;
+            log_error("serialize_op: serialize argv[%d] fail", i);
+            *pLen = -1;
+            return 0;
         }
-    }
-    else
-    {
-        log_error("serialize_op: zmalloc() fail for %d", *pLen);
+        n32 = htonl(len);
+        memcpy(b->p + pos, &n32, sizeof(n32));
     }
 
-    return buf;
+    return serializeBufTake(b, pLen);
 }
 
 char *serialize_digsig(const robj *key, int *pLen, unsigned char ds_id)
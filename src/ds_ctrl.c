@@ -15,18 +15,6 @@ repl_status_mngr gReplStatusMngr;
 
 unsigned int gWaitBlClntMax;
 
-wr_bl_stat gWrBlTop[11];
-long long gWrBlMax, gWrBlMin, gWrBlTotal;
-int gWrBlCnt;
-
-dbe_stat gDbeGetTop[11];
-long long gDbeGetMax, gDbeGetMin, gDbeGetTotal;
-int gDbeGetCnt;
-
-dbe_stat gDbeSetTop[11];
-long long gDbeSetMax, gDbeSetMin, gDbeSetTotal;
-int gDbeSetCnt;
-
 static pthread_rwlock_t g_rwlock;
 //static pthread_mutex_t sc_stat_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t sc_sync_status_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -39,6 +27,9 @@ static pthread_mutex_t sc_cache_filter_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t sc_bl_write_list_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t sc_wr_bl_list_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t sc_wr_dbe_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sc_bl_write_list_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t sc_wr_bl_list_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t sc_wr_dbe_list_cond = PTHREAD_COND_INITIALIZER;
 #endif
 static pthread_mutex_t sc_dbe_get_lock = PTHREAD_MUTEX_INITIALIZER;
 
@@ -355,6 +346,56 @@ int unlockWrDbeList()
     }
     return ret;
 }
+
+/* must be called with the lock held, return after signaled or timeout */
+static int wait_list_cond(pthread_cond_t *cond, pthread_mutex_t *lock, int ms)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (long)(ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    const int ret = pthread_cond_timedwait(cond, lock, &ts);
+    if (ret != 0 && ret != ETIMEDOUT)
+    {
+        log_fatal("pthread_cond_timedwait() fail: %d", ret);
+    }
+    return ret;
+}
+
+int waitBlWriteList(int ms)
+{
+    return wait_list_cond(&sc_bl_write_list_cond, &sc_bl_write_list_lock, ms);
+}
+
+int signalBlWriteList()
+{
+    return pthread_cond_signal(&sc_bl_write_list_cond);
+}
+
+int waitWrblList(int ms)
+{
+    return wait_list_cond(&sc_wr_bl_list_cond, &sc_wr_bl_list_lock, ms);
+}
+
+int signalWrblList()
+{
+    return pthread_cond_signal(&sc_wr_bl_list_cond);
+}
+
+int waitWrDbeList(int ms)
+{
+    return wait_list_cond(&sc_wr_dbe_list_cond, &sc_wr_dbe_list_lock, ms);
+}
+
+int signalWrDbeList()
+{
+    return pthread_cond_signal(&sc_wr_dbe_list_cond);
+}
 #endif
 
 int lockDbeGet()
@@ -189,26 +189,6 @@ typedef struct transfer_cmd_tag
     int status[2];
 } transfer_cmd;
 
-typedef struct wr_bl_stat_tag
-{
-    unsigned char valid;
-    unsigned char cmd;
-    int buf_len;
-    time_t time;
-    char key[256];
-    int64_t serialize_dur;
-    int64_t io_dur;
-} wr_bl_stat;
-
-typedef struct dbe_stat_tag
-{
-    unsigned char valid;
-    int buf_len;
-    time_t time;
-    int64_t unserialize_dur;
-    int64_t io_dur;
-} dbe_stat;
-
 extern ds_ctrl_info gDsCtrl; /* for ds ctrl */
 extern transfer_cmd gTran; /* for transfer command */
 extern ds_stat_info gDsStat; /* for ds stat */
@@ -218,18 +198,6 @@ extern repl_status_mngr gReplStatusMngr;
 
 extern unsigned int gWaitBlClntMax;
 
-extern wr_bl_stat gWrBlTop[11];
-extern long long gWrBlMax, gWrBlMin, gWrBlTotal;
-extern int gWrBlCnt;
-
-extern dbe_stat gDbeGetTop[11];
-extern long long gDbeGetMax, gDbeGetMin, gDbeGetTotal;
-extern int gDbeGetCnt;
-
-extern dbe_stat gDbeSetTop[11];
-extern long long gDbeSetMax, gDbeSetMin, gDbeSetTotal;
-extern int gDbeSetCnt;
-
 extern void init_ctrl_info();
 extern int lock_ctrl_info_rd();
 extern int lock_ctrl_info_wr();
@@ -258,6 +226,12 @@ extern int lockWrblList();
 extern int unlockWrblList();
 extern int lockWrDbeList();
 extern int unlockWrDbeList();
+extern int waitBlWriteList(int ms);
+extern int signalBlWriteList();
+extern int waitWrblList(int ms);
+extern int signalWrblList();
+extern int waitWrDbeList(int ms);
+extern int signalWrDbeList();
 #endif
 
 extern int lockDbeGet();
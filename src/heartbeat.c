@@ -9,6 +9,8 @@
 #include "ds_zmalloc.h"
 #include "ds_binlog.h"
 #include "key_filter.h"
+#include "latency_hist.h"
+#include "codec_key.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -1071,6 +1073,14 @@ try_local_config:
             {
                 server.maxmemory_policy = REDIS_MAXMEMORY_NO_EVICTION;
             }
+            else if (!strcasecmp(t, "volatile-lfu"))
+            {
+                server.maxmemory_policy = REDIS_MAXMEMORY_VOLATILE_LFU;
+            }
+            else if (!strcasecmp(t, "allkeys-lfu"))
+            {
+                server.maxmemory_policy = REDIS_MAXMEMORY_ALLKEYS_LFU;
+            }
         }
     }
 
@@ -1388,6 +1398,238 @@ try_local_config:
         }
     }
 
+    /* dbe_get_threads */
+    item = pf_json_get_sub_obj(config, "dbe_get_threads");
+    if (item)
+    {
+        if (pf_json_get_obj_type(item) == PF_JSON_TYPE_INT)
+        {
+            const int threads = pf_json_get_int(item);
+            if (threads > 0 && threads <= 64)
+            {
+                server.dbe_get_threads = threads;
+            }
+        }
+    }
+
+    /* dbe_prefetch_depth */
+    item = pf_json_get_sub_obj(config, "dbe_prefetch_depth");
+    if (item)
+    {
+        if (pf_json_get_obj_type(item) == PF_JSON_TYPE_INT)
+        {
+            const int depth = pf_json_get_int(item);
+            if (depth >= 0)
+            {
+                server.dbe_prefetch_depth = depth;
+            }
+        }
+    }
+
+    /* dbe_bloom_mb */
+    item = pf_json_get_sub_obj(config, "dbe_bloom_mb");
+    if (item)
+    {
+        if (pf_json_get_obj_type(item) == PF_JSON_TYPE_INT)
+        {
+            const int mb = pf_json_get_int(item);
+            if (mb >= 0 && mb <= 4096)
+            {
+                server.dbe_bloom_mb = mb;
+            }
+        }
+    }
+
+    /* neg_cache_size */
+    item = pf_json_get_sub_obj(config, "neg_cache_size");
+    if (item)
+    {
+        if (pf_json_get_obj_type(item) == PF_JSON_TYPE_INT)
+        {
+            const int size = pf_json_get_int(item);
+            if (size >= 0)
+            {
+                server.neg_cache_size = size;
+            }
+        }
+    }
+
+    /* neg_cache_ttl */
+    item = pf_json_get_sub_obj(config, "neg_cache_ttl");
+    if (item)
+    {
+        if (pf_json_get_obj_type(item) == PF_JSON_TYPE_INT)
+        {
+            const int ttl = pf_json_get_int(item);
+            if (ttl >= 0)
+            {
+                server.neg_cache_ttl = ttl;
+            }
+        }
+    }
+
+    /* wr_dbe_coalesce_ms */
+    item = pf_json_get_sub_obj(config, "wr_dbe_coalesce_ms");
+    if (item)
+    {
+        if (pf_json_get_obj_type(item) == PF_JSON_TYPE_INT)
+        {
+            const int ms = pf_json_get_int(item);
+            if (ms >= 0)
+            {
+                server.wr_dbe_coalesce_ms = ms;
+            }
+        }
+    }
+
+    /* wr_dbe_coalesce_max */
+    item = pf_json_get_sub_obj(config, "wr_dbe_coalesce_max");
+    if (item)
+    {
+        if (pf_json_get_obj_type(item) == PF_JSON_TYPE_INT)
+        {
+            const int max = pf_json_get_int(item);
+            if (max >= 0)
+            {
+                server.wr_dbe_coalesce_max = max;
+            }
+        }
+    }
+
+    /* dbe_key_ver */
+    item = pf_json_get_sub_obj(config, "dbe_key_ver");
+    if (item)
+    {
+        if (pf_json_get_obj_type(item) == PF_JSON_TYPE_INT)
+        {
+            const int ver = pf_json_get_int(item);
+            if (ver == DBE_KEY_VER_1 || ver == DBE_KEY_VER_2)
+            {
+                server.dbe_key_ver = ver;
+            }
+        }
+    }
+
+    /* rebalance_budget_us */
+    item = pf_json_get_sub_obj(config, "rebalance_budget_us");
+    if (item)
+    {
+        if (pf_json_get_obj_type(item) == PF_JSON_TYPE_INT)
+        {
+            const int us = pf_json_get_int(item);
+            if (us >= 0)
+            {
+                server.rebalance_budget_us = us;
+            }
+        }
+    }
+
+    /* hk_budget_us */
+    item = pf_json_get_sub_obj(config, "hk_budget_us");
+    if (item)
+    {
+        if (pf_json_get_obj_type(item) == PF_JSON_TYPE_INT)
+        {
+            const int us = pf_json_get_int(item);
+            if (us >= 0)
+            {
+                server.hk_budget_us = us;
+            }
+        }
+    }
+
+    /* lfu_log_factor */
+    item = pf_json_get_sub_obj(config, "lfu_log_factor");
+    if (item)
+    {
+        if (pf_json_get_obj_type(item) == PF_JSON_TYPE_INT)
+        {
+            const int factor = pf_json_get_int(item);
+            if (factor >= 0)
+            {
+                server.lfu_log_factor = factor;
+            }
+        }
+    }
+
+    /* lfu_decay_time */
+    item = pf_json_get_sub_obj(config, "lfu_decay_time");
+    if (item)
+    {
+        if (pf_json_get_obj_type(item) == PF_JSON_TYPE_INT)
+        {
+            const int minutes = pf_json_get_int(item);
+            if (minutes >= 0)
+            {
+                server.lfu_decay_time = minutes;
+            }
+        }
+    }
+
+    /* net_io_threads */
+    item = pf_json_get_sub_obj(config, "net_io_threads");
+    if (item)
+    {
+        if (pf_json_get_obj_type(item) == PF_JSON_TYPE_INT)
+        {
+            const int threads = pf_json_get_int(item);
+            if (threads > 0 && threads <= 64)
+            {
+                server.net_io_threads = threads;
+            }
+        }
+    }
+
+    /* preload_threads */
+    item = pf_json_get_sub_obj(config, "preload_threads");
+    if (item)
+    {
+        if (pf_json_get_obj_type(item) == PF_JSON_TYPE_INT)
+        {
+            const int threads = pf_json_get_int(item);
+            if (threads > 0 && threads <= 64)
+            {
+                server.preload_threads = threads;
+            }
+        }
+    }
+
+    /* preload_mem_pct */
+    item = pf_json_get_sub_obj(config, "preload_mem_pct");
+    if (item)
+    {
+        if (pf_json_get_obj_type(item) == PF_JSON_TYPE_INT)
+        {
+            const int pct = pf_json_get_int(item);
+            if (pct > 0 && pct <= 100)
+            {
+                server.preload_mem_pct = pct;
+            }
+        }
+    }
+
+    /* binlog_fsync: no|everysec|always */
+    item = pf_json_get_sub_obj(config, "binlog_fsync");
+    if (item)
+    {
+        if (pf_json_get_obj_type(item) == PF_JSON_TYPE_STRING)
+        {
+            const char *const policy = pf_json_get_str(item);
+            if (strcasecmp(policy, "no") == 0)
+            {
+                server.binlog_fsync = APPENDFSYNC_NO;
+            }
+            else if (strcasecmp(policy, "always") == 0)
+            {
+                server.binlog_fsync = APPENDFSYNC_ALWAYS;
+            }
+            else if (strcasecmp(policy, "everysec") == 0)
+            {
+                server.binlog_fsync = APPENDFSYNC_EVERYSEC;
+            }
+        }
+    }
+
     /* dbnum */
     item = pf_json_get_sub_obj(config, "dbnum");
     if (item)
@@ -1769,6 +2011,26 @@ static void hb_with_mngr()
     pf_json_add_sub_obj(stat_info, "accepting_conns", pf_json_create_int_obj(stat.accepting_conns));
     pf_json_add_sub_obj(app_info, "stat_info", stat_info);
 
+    /* latency since startup, the mngr gets the interval by the counts */
+    pf_json_object_t *latency_info = pf_json_create_obj();
+    int i;
+    for (i = 0; i < LH_KIND_NUM; i++)
+    {
+        lh_hist h;
+        lh_summary ls;
+        lh_merge(i, &h);
+        lh_summarize(&h, &ls);
+        pf_json_object_t *one = pf_json_create_obj();
+        pf_json_add_sub_obj(one, "calls", pf_json_create_int64_obj(ls.cnt));
+        pf_json_add_sub_obj(one, "avg", pf_json_create_int64_obj(ls.avg));
+        pf_json_add_sub_obj(one, "p50", pf_json_create_int64_obj(ls.p50));
+        pf_json_add_sub_obj(one, "p99", pf_json_create_int64_obj(ls.p99));
+        pf_json_add_sub_obj(one, "p999", pf_json_create_int64_obj(ls.p999));
+        pf_json_add_sub_obj(one, "max", pf_json_create_int64_obj(ls.max));
+        pf_json_add_sub_obj(latency_info, lh_kind_str(i), one);
+    }
+    pf_json_add_sub_obj(app_info, "latency_info", latency_info);
+
 
     pf_json_object_t *app_info_list = pf_json_create_array_obj();
     pf_json_array_obj_add_item(app_info_list, app_info);
@@ -0,0 +1,606 @@
+#include "hot_preload.h"
+#include "db_io_engine.h"
+#include "binlogtab.h"
+#include "codec_key.h"
+#include "restore_key.h"
+#include "serialize.h"
+#include "dbe_if.h"
+#include "ds_zmalloc.h"
+#include "rds_util.h"
+#include "ds_log.h"
+
+#include <pthread.h>
+
+#define PRELOAD_BATCH 256           /* keys per batch handed over between threads */
+#define PRELOAD_MAX_THREADS 64
+#define PRELOAD_PROGRESS_MS 5000    /* interval of progress log */
+
+typedef struct preload_item_t
+{
+    char *k;          /* raw dbe record, released by worker */
+    int k_len;
+    char *v;          /* null for collections, read by prefix in worker */
+    int v_len;
+    const char *key;  /* user key inside k */
+    size_t key_len;
+    char type;
+
+    robj *kobj;       /* built by worker */
+    robj *val;
+    time_t expire;
+} preload_item;
+
+typedef struct preload_batch_t
+{
+    struct preload_batch_t *next;
+    int cnt;
+    int eof;          /* 1 - the last one, iterator has been released */
+    int skipped;      /* expired or deleted in dbe */
+    int failed;
+    preload_item items[PRELOAD_BATCH];
+} preload_batch;
+
+static pthread_mutex_t sc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sc_work = PTHREAD_COND_INITIALIZER;  /* raw batch queued */
+static pthread_cond_t sc_room = PTHREAD_COND_INITIALIZER;  /* inflight decreased */
+static preload_batch *sc_head = 0;
+static preload_batch *sc_tail = 0;
+static int sc_inflight = 0;       /* batches not yet consumed by main thread */
+static int sc_inflight_max = 0;
+static int sc_iter_done = 0;
+static volatile int sc_stop = 0;
+
+static dbmng_ctx *sc_ctx = 0;
+static void *sc_it = 0;
+static pthread_t sc_iter_tid;
+static pthread_t sc_worker_tid[PRELOAD_MAX_THREADS];
+static int sc_workers = 0;
+static int sc_started = 0;
+static int sc_eof = 0;
+
+/* keys deleted from rdb while loading, stale copies from dbe are dropped */
+static dict *sc_deleted = 0;
+
+static preload_stat sc_stat;
+static long long sc_start_ms = 0;
+static long long sc_last_log_ms = 0;
+
+static void *preload_iterate(void *arg);
+static void *preload_work(void *arg);
+static void build_batch(preload_batch *b);
+static void release_item(preload_item *item);
+static void finish_preload();
+
+int preload_start(dbmng_ctx *ctx, void *it)
+{
+    int i;
+
+    memset(&sc_stat, 0, sizeof(sc_stat));
+    sc_ctx = ctx;
+    sc_it = it;
+    sc_stop = 0;
+    sc_iter_done = 0;
+    sc_eof = 0;
+    sc_head = sc_tail = 0;
+    sc_inflight = 0;
+
+    sc_workers = server.preload_threads;
+    if (sc_workers <= 0)
+    {
+        sc_workers = 1;
+    }
+    else if (sc_workers > PRELOAD_MAX_THREADS)
+    {
+        sc_workers = PRELOAD_MAX_THREADS;
+    }
+    /* bound the keys between dbe and rdb, which are not seen by the budget */
+    sc_inflight_max = sc_workers * 2;
+
+    sc_stat.threads = sc_workers;
+    sc_stat.mem_budget = (size_t)(server.db_max_size / 100 * server.preload_mem_pct);
+    sc_stat.state = PRELOAD_STATE_LOADING;
+    sc_deleted = dictCreate(&sdsSetDictType, NULL);
+    sc_start_ms = sc_last_log_ms = ustime() / 1000;
+
+    if (pthread_create(&sc_iter_tid, 0, preload_iterate, 0) != 0)
+    {
+        log_error("%s", "pthread_create() fail for preload iterator");
+        dbe_destroy_it(it);
+        sc_it = 0;
+        sc_stat.state = PRELOAD_STATE_ABORT;
+        dictRelease(sc_deleted);
+        sc_deleted = 0;
+        return 1;
+    }
+
+    for (i = 0; i < sc_workers; i++)
+    {
+        if (pthread_create(&sc_worker_tid[i], 0, preload_work, 0) != 0)
+        {
+            log_error("pthread_create() fail for preload worker, idx=%d", i);
+            break;
+        }
+    }
+    if (i == 0)
+    {
+        /* no worker, the iterator must not wait for ever */
+        sc_stop = 1;
+        pthread_mutex_lock(&sc_lock);
+        pthread_cond_broadcast(&sc_room);
+        pthread_mutex_unlock(&sc_lock);
+        pthread_join(sc_iter_tid, 0);
+        sc_stat.state = PRELOAD_STATE_ABORT;
+        dictRelease(sc_deleted);
+        sc_deleted = 0;
+        return 1;
+    }
+    sc_workers = i;
+    sc_stat.threads = i;
+    sc_started = 1;
+
+    log_prompt("preload start: level=%d, threads=%d, mem_budget=%zu, max_num=%lld"
+               , server.dbe_hot_level, sc_workers, sc_stat.mem_budget
+               , server.load_hot_key_max_num);
+
+    return 0;
+}
+
+/* call by main thread at shutdown */
+void preload_stop()
+{
+    int i;
+
+    if (sc_started == 0)
+    {
+        return;
+    }
+
+    sc_stop = 1;
+    pthread_mutex_lock(&sc_lock);
+    pthread_cond_broadcast(&sc_room);
+    pthread_cond_broadcast(&sc_work);
+    pthread_mutex_unlock(&sc_lock);
+
+    pthread_join(sc_iter_tid, 0);
+    for (i = 0; i < sc_workers; i++)
+    {
+        pthread_join(sc_worker_tid[i], 0);
+    }
+    sc_started = 0;
+
+    if (sc_stat.state == PRELOAD_STATE_LOADING)
+    {
+        sc_stat.state = PRELOAD_STATE_ABORT;
+    }
+    log_prompt("preload stopped, loaded=%llu", sc_stat.loaded);
+}
+
+/* the keyspace is flushed, nothing from dbe is valid any more */
+void preload_cancel()
+{
+    if (sc_stat.state != PRELOAD_STATE_LOADING)
+    {
+        return;
+    }
+
+    log_prompt("preload cancelled, loaded=%llu", sc_stat.loaded);
+    sc_stat.state = PRELOAD_STATE_ABORT;
+    sc_stop = 1;
+    pthread_mutex_lock(&sc_lock);
+    pthread_cond_broadcast(&sc_room);
+    pthread_mutex_unlock(&sc_lock);
+}
+
+int preload_running()
+{
+    return sc_stat.state == PRELOAD_STATE_LOADING;
+}
+
+void preload_key_deleted(const robj *key)
+{
+    if (sc_deleted == 0)
+    {
+        return;
+    }
+
+    sds copy = sdsdup(key->ptr);
+    if (dictAdd(sc_deleted, copy, NULL) != DICT_OK)
+    {
+        sdsfree(copy);
+    }
+}
+
+void preload_get_stat(preload_stat *st)
+{
+    *st = sc_stat;
+    if (sc_stat.state == PRELOAD_STATE_LOADING)
+    {
+        st->elapsed_ms = server.mstime - sc_start_ms;
+        st->keys_ps = st->elapsed_ms > 0 ? st->loaded * 1000 / st->elapsed_ms : 0;
+    }
+}
+
+const char *preload_state_str(int state)
+{
+    switch (state)
+    {
+    case PRELOAD_STATE_LOADING:
+        return "loading";
+    case PRELOAD_STATE_DONE:
+        return "done";
+    case PRELOAD_STATE_FULL:
+        return "full";
+    case PRELOAD_STATE_ABORT:
+        return "aborted";
+    default:
+        return "none";
+    }
+}
+
+/* call by iterator thread, wait until main thread consumes some batches
+ * return: 0 - stop loading */
+static preload_batch *alloc_batch(int wait)
+{
+    pthread_mutex_lock(&sc_lock);
+    while (wait && sc_stop == 0 && sc_inflight >= sc_inflight_max)
+    {
+        pthread_cond_wait(&sc_room, &sc_lock);
+    }
+    if (wait && sc_stop)
+    {
+        pthread_mutex_unlock(&sc_lock);
+        return 0;
+    }
+    sc_inflight++;
+    pthread_mutex_unlock(&sc_lock);
+
+    preload_batch *b = (preload_batch *)zmalloc(sizeof(preload_batch));
+    b->next = 0;
+    b->cnt = 0;
+    b->eof = 0;
+    b->skipped = 0;
+    b->failed = 0;
+    return b;
+}
+
+static void queue_batch(preload_batch *b)
+{
+    pthread_mutex_lock(&sc_lock);
+    if (sc_tail)
+    {
+        sc_tail->next = b;
+    }
+    else
+    {
+        sc_head = b;
+    }
+    sc_tail = b;
+    pthread_cond_signal(&sc_work);
+    pthread_mutex_unlock(&sc_lock);
+}
+
+/* iterator thread: only reads records from dbe, decode and dispatch them */
+static void *preload_iterate(void *arg)
+{
+    (void)arg;
+
+    char *k = 0;
+    int k_len;
+    char *v = 0;
+    int v_len;
+    long long cnt = 0;
+    sds last = sdsempty();
+    char last_type = 0;
+    preload_batch *b = 0;
+
+    while (sc_stop == 0
+           && (server.load_hot_key_max_num < 0 || server.load_hot_key_max_num > cnt)
+           && dbe_next_key(sc_it, &k, &k_len, &v, &v_len, zmalloc, NULL) == 0)
+    {
+        sc_stat.scanned++;
+
+        dbe_key_attr attr;
+        if (decode_dbe_key(k, k_len, &attr) != 0)
+        {
+            zfree(k);
+            zfree(v);
+            continue;
+        }
+        if (attr.type != KEY_TYPE_STRING)
+        {
+            /* members of one key are adjacent, the whole key is read by prefix once */
+            if (attr.type == last_type && sdslen(last) == attr.key_len
+                && memcmp(last, attr.key, attr.key_len) == 0)
+            {
+                zfree(k);
+                zfree(v);
+                continue;
+            }
+            last = sdscpylen(last, attr.key, attr.key_len);
+            last_type = attr.type;
+            zfree(v);
+            v = 0;
+            v_len = 0;
+        }
+
+        if (b == 0)
+        {
+            if (ds_zmalloc_used_memory() >= sc_stat.mem_budget
+                || (b = alloc_batch(1)) == 0)
+            {
+                zfree(k);
+                zfree(v);
+                break;
+            }
+        }
+
+        preload_item *item = &b->items[b->cnt++];
+        item->k = k;
+        item->k_len = k_len;
+        item->v = v;
+        item->v_len = v_len;
+        item->key = attr.key;
+        item->key_len = attr.key_len;
+        item->type = attr.type;
+        cnt++;
+
+        if (b->cnt == PRELOAD_BATCH)
+        {
+            queue_batch(b);
+            b = 0;
+        }
+    }
+
+    if (b)
+    {
+        queue_batch(b);
+    }
+    sdsfree(last);
+
+    dbe_destroy_it(sc_it);
+    sc_it = 0;
+
+    pthread_mutex_lock(&sc_lock);
+    sc_iter_done = 1;
+    pthread_cond_broadcast(&sc_work);
+    pthread_mutex_unlock(&sc_lock);
+
+    log_prompt("preload iterator finish, scanned=%llu, dispatched=%lld"
+               , sc_stat.scanned, cnt);
+
+    /* tell main thread nothing more will be produced */
+    b = alloc_batch(0);
+    b->eof = 1;
+    commit_preload_batch(b);
+
+    return 0;
+}
+
+/* worker thread: build robj from raw records, the same as dbe_get */
+static void *preload_work(void *arg)
+{
+    (void)arg;
+
+    preload_batch *b;
+    for (;;)
+    {
+        pthread_mutex_lock(&sc_lock);
+        while (sc_head == 0 && sc_iter_done == 0)
+        {
+            pthread_cond_wait(&sc_work, &sc_lock);
+        }
+        b = sc_head;
+        if (b)
+        {
+            sc_head = b->next;
+            if (sc_head == 0)
+            {
+                sc_tail = 0;
+            }
+        }
+        pthread_mutex_unlock(&sc_lock);
+
+        if (b == 0)
+        {
+            break;
+        }
+
+        build_batch(b);
+        commit_preload_batch(b);
+    }
+
+    return 0;
+}
+
+static void build_batch(preload_batch *b)
+{
+    const time_t now = time(0);
+    int i;
+
+    for (i = 0; i < b->cnt; i++)
+    {
+        preload_item *item = &b->items[i];
+        item->kobj = 0;
+        item->val = 0;
+        item->expire = 0;
+
+        if (sc_stop)
+        {
+            zfree(item->k);
+            zfree(item->v);
+            continue;
+        }
+
+        item->kobj = createStringObject((char *)item->key, item->key_len);
+        if (item->type == KEY_TYPE_STRING)
+        {
+            item->val = unserializeObj(item->v, item->v_len, &item->expire);
+            if (item->val == 0)
+            {
+                log_error("unserializeObj fail, key=%s", (char *)item->kobj->ptr);
+                b->failed++;
+            }
+            else if (item->expire > 0 && item->expire < now)
+            {
+                decrRefCount(item->val);
+                item->val = 0;
+                b->skipped++;
+            }
+        }
+        else
+        {
+            /* list/set/zset/hash, read all members by the key prefix */
+            val_attr rslt;
+            const int ret = restore_key_from_dbe(sc_ctx->db, item->kobj->ptr
+                    , sdslen(item->kobj->ptr), 'k', &rslt);
+            if (ret == 0)
+            {
+                item->val = rslt.val;
+            }
+            else if (ret == 1)
+            {
+                b->skipped++;
+            }
+            else
+            {
+                log_error("restore_key_from_dbe fail, ret=%d, type=%c, key=%s"
+                          , ret, item->type, (char *)item->kobj->ptr);
+                b->failed++;
+            }
+        }
+
+        zfree(item->k);
+        zfree(item->v);
+    }
+}
+
+static void release_item(preload_item *item)
+{
+    if (item->val)
+    {
+        decrRefCount(item->val);
+        item->val = 0;
+    }
+    if (item->kobj)
+    {
+        decrRefCount(item->kobj);
+        item->kobj = 0;
+    }
+}
+
+/* call by main thread, insert one ready batch into rdb */
+void after_preload(void *ptr)
+{
+    preload_batch *b = (preload_batch *)ptr;
+    redisDb *rdb = sc_ctx->rdb;
+    int i;
+
+    sc_stat.skipped += b->skipped;
+    sc_stat.failed += b->failed;
+
+    if (sc_stat.state == PRELOAD_STATE_LOADING && b->cnt > 0
+        && ds_zmalloc_used_memory() >= sc_stat.mem_budget)
+    {
+        log_prompt("stop preload, mem=%zu, budget=%zu, loaded=%llu"
+                   , ds_zmalloc_used_memory(), sc_stat.mem_budget, sc_stat.loaded);
+        sc_stat.state = PRELOAD_STATE_FULL;
+        sc_stop = 1;
+        pthread_mutex_lock(&sc_lock);
+        pthread_cond_broadcast(&sc_room);
+        pthread_mutex_unlock(&sc_lock);
+    }
+
+    for (i = 0; i < b->cnt; i++)
+    {
+        preload_item *item = &b->items[i];
+        if (item->val == 0 || sc_stat.state != PRELOAD_STATE_LOADING)
+        {
+            release_item(item);
+            continue;
+        }
+
+        /* newer value has been in rdb, is being read by dbe_get
+         * or has been deleted since loading, the dbe copy is stale */
+        if (dictFind(rdb->dict, item->kobj->ptr)
+            || dictFind(server.dbe_get_inflight, item->kobj)
+            || dictFind(sc_deleted, item->kobj->ptr))
+        {
+            sc_stat.skipped++;
+            release_item(item);
+            continue;
+        }
+
+        dbAdd(rdb, item->kobj, item->val);
+        if (item->expire > 0)
+        {
+            setExpire(rdb, item->kobj, item->expire);
+        }
+        item->val = 0;
+        restore_a(rdb, (binlog_tab *)sc_ctx->binlogtab, sc_ctx->db, item->kobj, RESTORE_LVL_ACT, 0);
+        sc_stat.loaded++;
+        release_item(item);
+    }
+
+    if (b->eof)
+    {
+        sc_eof = 1;
+    }
+    zfree(b);
+
+    pthread_mutex_lock(&sc_lock);
+    const int inflight = --sc_inflight;
+    pthread_cond_signal(&sc_room);
+    pthread_mutex_unlock(&sc_lock);
+
+    if (sc_stat.state == PRELOAD_STATE_LOADING
+        && server.mstime - sc_last_log_ms >= PRELOAD_PROGRESS_MS)
+    {
+        preload_stat st;
+        preload_get_stat(&st);
+        sc_last_log_ms = server.mstime;
+        log_prompt("preload progress: scanned=%llu, loaded=%llu, skipped=%llu"
+                   ", failed=%llu, keys_ps=%llu, mem=%zu"
+                   , st.scanned, st.loaded, st.skipped, st.failed, st.keys_ps
+                   , ds_zmalloc_used_memory());
+    }
+
+    if (sc_eof && inflight == 0)
+    {
+        finish_preload();
+    }
+}
+
+static void finish_preload()
+{
+    int i;
+
+    if (sc_started)
+    {
+        /* all batches are consumed, the threads are exiting */
+        pthread_join(sc_iter_tid, 0);
+        for (i = 0; i < sc_workers; i++)
+        {
+            pthread_join(sc_worker_tid[i], 0);
+        }
+        sc_started = 0;
+    }
+
+    if (sc_stat.state == PRELOAD_STATE_LOADING)
+    {
+        sc_stat.state = PRELOAD_STATE_DONE;
+    }
+    sc_stat.elapsed_ms = ustime() / 1000 - sc_start_ms;
+    sc_stat.keys_ps = sc_stat.elapsed_ms > 0 ? sc_stat.loaded * 1000 / sc_stat.elapsed_ms : 0;
+
+    if (sc_deleted)
+    {
+        dictRelease(sc_deleted);
+        sc_deleted = 0;
+    }
+
+    log_prompt("preload %s: during=%lldms, scanned=%llu, loaded=%llu, skipped=%llu"
+               ", failed=%llu, keys_ps=%llu, mem=%zu"
+               , preload_state_str(sc_stat.state), sc_stat.elapsed_ms
+               , sc_stat.scanned, sc_stat.loaded, sc_stat.skipped, sc_stat.failed
+               , sc_stat.keys_ps, ds_zmalloc_used_memory());
+}
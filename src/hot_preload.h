@@ -0,0 +1,40 @@
+#ifndef _HOT_PRELOAD_H_
+#define _HOT_PRELOAD_H_
+
+#include "redis.h"
+#include "dbmng.h"
+
+#define PRELOAD_STATE_NONE      0
+#define PRELOAD_STATE_LOADING   1
+#define PRELOAD_STATE_DONE      2
+#define PRELOAD_STATE_FULL      3  /* stopped by memory budget */
+#define PRELOAD_STATE_ABORT     4  /* stopped by flush or shutdown */
+
+typedef struct preload_stat_t
+{
+    int state;
+    int threads;
+    unsigned long long scanned;  /* records read from dbe iterator */
+    unsigned long long loaded;   /* keys inserted into rdb */
+    unsigned long long skipped;  /* existed, deleted, expired or in dbe_get */
+    unsigned long long failed;
+    unsigned long long keys_ps;  /* loaded keys per second */
+    long long elapsed_ms;
+    size_t mem_budget;
+} preload_stat;
+
+/* load hot keys from the dbe iterator in background:
+ * one thread drains the iterator, preload_threads workers deserialize
+ * and the main thread inserts the ready keys into rdb by after_preload()
+ * it: created by dbe_create_it(), released by the preload threads */
+extern int preload_start(dbmng_ctx *ctx, void *it);
+extern void preload_stop();
+extern void preload_cancel();
+extern void after_preload(void *batch);
+
+extern int preload_running();
+extern void preload_key_deleted(const robj *key);
+extern void preload_get_stat(preload_stat *st);
+extern const char *preload_state_str(int state);
+
+#endif /* _HOT_PRELOAD_H_ */
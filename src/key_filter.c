@@ -6,30 +6,120 @@
 #include "ds_util.h"
 #include "codec_key.h"
 
+#include "prefix_trie.h"
+
 #include <pthread.h>
+#include <sched.h>
+#include <time.h>
 
-typedef struct filter_list_tag
+/* readers of an object published by an atomic pointer swap,
+ * a reader is counted in cnt[epoch & 1] for one lookup, the writer
+ * flips the epoch and frees the replaced object when the old side is 0 */
+typedef struct filter_readers_tag
+{
+    volatile unsigned int epoch;
+    volatile int cnt[2];
+} filter_readers;
+
+/* log a writer waiting longer than it for readers to quiesce */
+#define FILTER_QUIESCE_WARN_MS   100
+
+/* compiled prefix list, immutable after published */
+typedef struct filter_rule_tag
 {
     int permission;
-    int list_cnt;
-    char **list;
-} filter_list;
+    prefix_trie_t *trie;
+} filter_rule;
+
+typedef struct filter_slot_tag
+{
+    const char *name;
+    filter_rule *volatile rule; /* 0: disable */
+    filter_readers readers;
+    int permission;             /* current config, only by writer */
+    int list_len;
+    char *list;
+} filter_slot;
+
+static filter_slot sc_bl_slot = { "bl_filter", 0, {0, {0, 0}}, -1, 0, 0};
+static filter_slot sc_sync_slot = { "sync_filter", 0, {0, {0, 0}}, -1, 0, 0};
+static filter_slot sc_cache_slot = { "cache_filter", 0, {0, {0, 0}}, -1, 0, 0};
+
+/* owner of keys, immutable after published */
+typedef struct filter_route_tag
+{
+    ch_route_t *ch;
+    const char *self_key; /* server.ds_key when built */
+    int self;             /* point of self_key */
+} filter_route;
+
+static filter_route *volatile sc_route = 0; /* 0: no server, allow all */
+static filter_readers sc_route_readers = {0, {0, 0}};
+static pthread_mutex_t sc_route_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* return: the epoch to pass to reader_leave() */
+static unsigned int reader_enter(filter_readers *rd)
+{
+    for (;;)
+    {
+        const unsigned int epoch = rd->epoch;
+        __sync_add_and_fetch(&rd->cnt[epoch & 1], 1);
+        if (rd->epoch == epoch)
+        {
+            return epoch;
+        }
+        /* the writer has flipped, it may not wait for this side */
+        __sync_sub_and_fetch(&rd->cnt[epoch & 1], 1);
+    }
+}
+
+static void reader_leave(filter_readers *rd, unsigned int epoch)
+{
+    __sync_sub_and_fetch(&rd->cnt[epoch & 1], 1);
+}
 
-static filter_list sc_bl_list = { -1, 0, 0};
-static filter_list sc_sync_list = { -1, 0, 0};
-static filter_list sc_cache_list = { -1, 0, 0};
+static long long monotonic_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-static pthread_rwlock_t g_rwlock;
-static serv_node_info_t *g_cont = 0;
-static serv_node_info_t *g_cont2 = 0;
+/* call by writer under its lock after the pointer swap,
+ * readers entered from now on see the new object */
+static void retire_obj(filter_readers *rd, void *obj, void (*free_func)(void *))
+{
+    if (obj == 0)
+    {
+        return;
+    }
 
+    const unsigned int epoch = __sync_fetch_and_add(&rd->epoch, 1);
+    const long long start = monotonic_ms();
+    while (rd->cnt[epoch & 1] != 0)
+    {
+        sched_yield();
+    }
+    const long long waited = monotonic_ms() - start;
+    if (waited >= FILTER_QUIESCE_WARN_MS)
+    {
+        log_prompt("filter readers quiesced after %lldms", waited);
+    }
+    free_func(obj);
+}
 
 int init_filter()
 {
-    pthread_rwlock_init(&g_rwlock, 0);
     return 0;
 }
 
+static void free_route(void *p)
+{
+    filter_route *route = (filter_route *)p;
+    ch_route_destroy(route->ch);
+    zfree(route);
+}
+
 int gen_filter_server()
 {
     int rslt = 0;
@@ -38,7 +128,7 @@ int gen_filter_server()
     int i;
 
     lock_ctrl_info_rd();
-    log_prompt("gen_server: ip_cnt=%d, g_cont=%p", gDsCtrl.ip_cnt, g_cont);
+    log_prompt("gen_server: ip_cnt=%d, route=%p", gDsCtrl.ip_cnt, sc_route);
     if (gDsCtrl.ip_cnt > 0)
     {
         server_keys = (char **)zmalloc(gDsCtrl.ip_cnt * sizeof(char *));
@@ -54,40 +144,39 @@ int gen_filter_server()
     }
     unlock_ctrl_info();
 
-    if (g_cont)
-    {
-        /* destroy it at first */
-        consistent_hash_destory(g_cont);
-        g_cont = 0;
-    }
+    filter_route *route = 0;
     if (server_keys)
     {
-        g_cont = consistent_hash_init((const char *const*)server_keys, sk_count);
-        if (g_cont == 0)
+        serv_node_info_t *cont = consistent_hash_init((const char *const*)server_keys, sk_count);
+        ch_route_t *ch = cont ? ch_route_create(cont) : 0;
+        if (ch == 0)
         {
-            /* log error */
-            log_error("consistent_hash_init() fail");
+            log_error("consistent_hash_init() or ch_route_create() fail, cont=%p", cont);
+            consistent_hash_destory(cont);
+            rslt = 1;
         }
-    }
-
-    pthread_rwlock_wrlock(&g_rwlock);
-    if (g_cont2)
-    {
-        /* destroy it at first */
-        consistent_hash_destory(g_cont2);
-        g_cont2 = 0;
-    }
-    if (server_keys)
-    {
-        g_cont2 = consistent_hash_init((const char *const*)server_keys, sk_count);
-        if (g_cont2 == 0)
+        else
         {
-            /* log error */
-            log_error("consistent_hash_init() fail for g_cont2");
+            route = (filter_route *)zmalloc(sizeof(filter_route));
+            route->ch = ch;
+            route->self_key = server.ds_key;
+            route->self = ch_route_point(ch, server.ds_key);
+
+            int direct = 0;
+            for (i = 0; i < CH_SLOT_CNT; i++)
+            {
+                direct += ch->owner[i] >= 0 ? 1 : 0;
+            }
+            log_prompt("gen_server: servers=%d, slots=%d, direct_slots=%d, self=%d"
+                    , sk_count, CH_SLOT_CNT, direct, route->self);
         }
     }
-    log_prompt("gen_server: g_cont=%p, g_cont2=%p", g_cont, g_cont2);
-    pthread_rwlock_unlock(&g_rwlock);
+
+    /* publish, readers see the old route or the new one */
+    pthread_mutex_lock(&sc_route_lock);
+    filter_route *old = __sync_lock_test_and_set(&sc_route, route);
+    retire_obj(&sc_route_readers, old, free_route);
+    pthread_mutex_unlock(&sc_route_lock);
 
     /* release source */
     if (server_keys)
@@ -102,31 +191,12 @@ int gen_filter_server()
     return rslt;
 }
 
-static int get_server(serv_node_info_t *cont, const char *key, int key_len, serv_node_t *s)
+static int route_point(const filter_route *route, const char *ds_key)
 {
-    int rslt = 0;
-    if (cont)
-    {
-        serv_node_t *serv = ch_get_server(cont, key, key_len);
-        if (serv)
-        {
-            s->point = serv->point;
-            strcpy(s->server_key, serv->server_key);
-        }
-        else
-        {
-            /* it maybe impossible */
-            rslt = 1;
-        }
-    }
-    else
-    {
-        rslt = 1;
-    }
-    return rslt;
+    return ds_key == route->self_key ? route->self : ch_route_point(route->ch, ds_key);
 }
 
-/*
+/* lock free
  * return: 0 - allow; 1 - forbidden
  */
 static int ds_filter(const char *key, int key_len, const char *ds_key)
@@ -136,70 +206,18 @@ static int ds_filter(const char *key, int key_len, const char *ds_key)
         return 0;
     }
 
-    serv_node_t serv;
-    int ret;
-
-    ret = get_server(g_cont, key, key_len, &serv);
-    if (ret == 0)
+    int ret = 0;
+    const unsigned int epoch = reader_enter(&sc_route_readers);
+    const filter_route *route = sc_route;
+    /* no server, regard as valid key */
+    if (route)
     {
-        //log_debug("\"%s\" on %s, ds_key=%s", key, serv.server_key, server.ds_key);
-        if (strcmp(serv.server_key, ds_key) == 0)
-        {
-            /* the key belong to this node */
-            //log_debug("master_filter() : valid key=%s", key);
-            return 0;
-        }
-        else
-        {
-            //log_debug("master_filter() : invalid key=%s", key);
-            return 1;
-        }
-    }
-    else
-    {
-        /* fail, but regard as valid key */
-        //log_error("master_filter() : get_server() fail for \"%s\"", key);
-        return 0;
-    }
-}
-
-/*
- * return: 0 - allow; 1 - forbidden
- */
-static int ds_filter2(const char *key, int key_len, const char *ds_key)
-{
-    if (key == 0 || key_len == 0 || ds_key == 0)
-    {
-        return 0;
-    }
-
-    serv_node_t serv;
-    int ret;
-
-    pthread_rwlock_rdlock(&g_rwlock);
-    ret = get_server(g_cont2, key, key_len, &serv);
-    pthread_rwlock_unlock(&g_rwlock);
-    if (ret == 0)
-    {
-        //log_debug("\"%s\" on %s, ds_key=%s", key, serv.server_key, server.ds_key);
-        if (strcmp(serv.server_key, ds_key) == 0)
-        {
-            /* the key belong to this node */
-            //log_debug("master_filter() : valid key=%s", key);
-            return 0;
-        }
-        else
-        {
-            //log_debug("master_filter() : invalid key=%s", key);
-            return 1;
-        }
-    }
-    else
-    {
-        /* fail, but regard as valid key */
-        //log_error("master_filter() : get_server() fail for \"%s\"", key);
-        return 0;
+        const int owner = ch_route_get(route->ch, key, key_len);
+        /* fail, but regard as valid key; 0: the key belong to this node */
+        ret = owner < 0 || owner == route_point(route, ds_key) ? 0 : 1;
     }
+    reader_leave(&sc_route_readers, epoch);
+    return ret;
 }
 
 int master_filter_keylen(const char *key, int key_len)
@@ -230,7 +248,7 @@ int master_filter_4_dbe(const char *dbe_key, size_t dbe_key_len)
     ret = decode_dbe_key(dbe_key, dbe_key_len, &attr);
     if (ret == 0)
     {
-        ret = ds_filter2(attr.key, attr.key_len, server.ds_key);
+        ret = ds_filter(attr.key, attr.key_len, server.ds_key);
 #ifdef _DBE_IF_DEBUG_
         log_prompt("filter_4_dbe: len=%zd, dbe_key=%s, key_len=%zd, key_type=%c, ret=%d"
                 , dbe_key_len, dbe_key, attr.key_len, attr.type, ret);
@@ -248,6 +266,37 @@ int master_filter_4_dbe(const char *dbe_key, size_t dbe_key_len)
     return ret;
 }
 
+/* master_filter_4_dbe() for cnt dbe keys with one route,
+ * drop[i] is set to 1 if dbe_keys[i] is forbidden */
+void master_filter_4_dbe_bulk(const char **dbe_keys, const size_t *dbe_key_lens, int cnt, char *drop)
+{
+    if (server.is_slave == 1 || dbe_keys == 0 || server.ds_key == 0)
+    {
+        return;
+    }
+
+    const unsigned int epoch = reader_enter(&sc_route_readers);
+    const filter_route *route = sc_route;
+    const int self = route ? route_point(route, server.ds_key) : 0;
+    int i;
+    for (i = 0; route && i < cnt; i++)
+    {
+        dbe_key_attr attr;
+        if (drop[i] || dbe_keys[i] == 0
+            || decode_dbe_key(dbe_keys[i], dbe_key_lens[i], &attr) != 0
+            || attr.key_len == 0)
+        {
+            continue;
+        }
+        const int owner = ch_route_get(route->ch, attr.key, attr.key_len);
+        if (owner >= 0 && owner != self)
+        {
+            drop[i] = 1;
+        }
+    }
+    reader_leave(&sc_route_readers, epoch);
+}
+
 /* for sync, ds_key belong to slave_sync
  * return: 0 - permissible; 1 - forbidden
  */
@@ -257,120 +306,152 @@ int filter_gen(const char *key, int key_len, const char *ds_key)
     {
         return 0;
     }
-    const int ret = ds_filter2(key, key_len, ds_key);
+    const int ret = ds_filter(key, key_len, ds_key);
     return ret;
 }
 
-/*
- * permission: -1 - disable; 0 - forbidden_write_bl prefix; 1 - write_bl prefix
- */
-void set_bl_filter_list(const char *list, int list_len, int permission)
+/* filter_gen() for cnt keys with one route,
+ * drop[i] is set to 1 if keys[i] is forbidden, keys[i] == 0 is skipped */
+void filter_gen_bulk(const char **keys, const int *key_lens, int cnt, const char *ds_key, char *drop)
 {
-    static int sc_permission = -1;
-    static int sc_list_len = 0;
-    static char *sc_list = 0;
+    if (keys == 0 || ds_key == 0)
+    {
+        return;
+    }
 
-    if (sc_permission != permission
-        || sc_list_len != list_len
-        || (sc_list && list && strcmp(sc_list, list) != 0)
-       )
+    const unsigned int epoch = reader_enter(&sc_route_readers);
+    const filter_route *route = sc_route;
+    const int point = route ? route_point(route, ds_key) : 0;
+    int i;
+    for (i = 0; route && i < cnt; i++)
     {
-        /* need to change current config */
-        int cnt = 0;
-        char **list_ar = 0;
-        if (sc_list)
-        {
-            zfree(sc_list);
-            sc_list = 0;
-            sc_list_len = 0;
-        }
-        if (permission != -1)
+        if (drop[i] || keys[i] == 0 || key_lens[i] <= 0)
         {
-            if (list && list_len > 0)
-            {
-                sc_list = zstrdup(list);
-                sc_list_len = list_len;
-                list_ar = parse_list_str(sc_list, &cnt, "\r \n,");
-            }
+            continue;
         }
-        sc_permission = permission;
-        log_prompt("bl_filter change: perm=%d, book_cnt=%d, book_list=%s"
-                , permission, cnt, list ? list : "");
-
-        lock_bl_filter();
-
-        if (sc_bl_list.list)
+        const int owner = ch_route_get(route->ch, keys[i], key_lens[i]);
+        if (owner >= 0 && owner != point)
         {
-            int i = 0;
-            for (; i < sc_bl_list.list_cnt; i++)
-            {
-                zfree(sc_bl_list.list[i]);
-            }
-            zfree(sc_bl_list.list);
-            sc_bl_list.list = 0;
-            sc_bl_list.list_cnt = 0;
+            /* the key doesn't belong to the node */
+            drop[i] = 1;
         }
-        sc_bl_list.permission = permission;
-        sc_bl_list.list_cnt = cnt;
-        sc_bl_list.list = list_ar;
-
-        unlock_bl_filter();
     }
+    reader_leave(&sc_route_readers, epoch);
 }
 
-/*
- * return: 0 - write bl, 1 - forbidden write bl
- */
-int bl_filter(const char *key, int key_len)
+static void free_rule(void *p)
 {
-    int rslt;
+    filter_rule *rule = (filter_rule *)p;
+    pt_destroy(rule->trie);
+    zfree(rule);
+}
 
-    lock_bl_filter();
+/* call by writer with the lock of the slot held
+ * permission: -1 - disable */
+static void set_filter_list(filter_slot *slot, const char *list, int list_len, int permission)
+{
+    if (slot->permission == permission
+        && slot->list_len == list_len
+        && !(slot->list && list && strcmp(slot->list, list) != 0)
+       )
+    {
+        return;
+    }
 
-    if (sc_bl_list.permission != -1)
+    /* need to change current config */
+    int cnt = 0;
+    char **list_ar = 0;
+    if (slot->list)
     {
-        int find = 0;
-        if (sc_bl_list.list)
+        zfree(slot->list);
+        slot->list = 0;
+        slot->list_len = 0;
+    }
+    if (permission != -1)
+    {
+        if (list && list_len > 0)
         {
-            find = 0;
-            int i;
-            for (i= 0; i < sc_bl_list.list_cnt; i++)
-            {
-                const int prefix_len = strlen(sc_bl_list.list[i]);
-                if (key_len >= prefix_len
-                    && strncmp(sc_bl_list.list[i], key, prefix_len) == 0)
-                {
-                    find = 1;
-                    break;
-                }
-            }
+            slot->list = zstrdup(list);
+            slot->list_len = list_len;
+            list_ar = parse_list_str(slot->list, &cnt, "\r \n,");
         }
-        else
+    }
+    slot->permission = permission;
+
+    filter_rule *rule = 0;
+    if (permission != -1)
+    {
+        rule = (filter_rule *)zcalloc(sizeof(filter_rule));
+        rule->permission = permission;
+        rule->trie = pt_create((const char *const *)list_ar, cnt);
+        if (rule->trie == 0)
+        {
+            log_error("%s: pt_create() fail, book_cnt=%d", slot->name, cnt);
+        }
+    }
+    if (list_ar)
+    {
+        int i = 0;
+        for (; i < cnt; i++)
         {
-            find = 0;
+            zfree(list_ar[i]);
         }
+        zfree(list_ar);
+    }
 
-        if (sc_bl_list.permission == 0)
-        { 
+    log_prompt("%s change: perm=%d, book_cnt=%d, trie_prefixes=%d, trie_nodes=%u, book_list=%s"
+            , slot->name, permission, cnt
+            , rule && rule->trie ? rule->trie->prefix_cnt : 0
+            , rule && rule->trie ? rule->trie->node_cnt : 0
+            , list ? list : "");
+
+    /* publish, readers see the old rule or the new one */
+    filter_rule *old = __sync_lock_test_and_set(&slot->rule, rule);
+    retire_obj(&slot->readers, old, free_rule);
+}
+
+/* lock free
+ * return: 0 - allow, 1 - forbidden */
+static int filter_key(filter_slot *slot, const char *key, int key_len)
+{
+    int ret = 0;
+    const unsigned int epoch = reader_enter(&slot->readers);
+    const filter_rule *rule = slot->rule;
+    /* 0: disable list */
+    if (rule)
+    {
+        const int find = pt_match(rule->trie, key, key_len);
+        if (rule->permission == 0)
+        {
             /* black list */
-            rslt = find == 0 ? 0 : 1;
+            ret = find == 0 ? 0 : 1;
         }
         else
         {
             /* white list */
-            rslt = find == 0 ? 1 : 0;
+            ret = find == 0 ? 1 : 0;
         }
     }
-    else
-    {
-        /* disable list */
-        rslt = 0;
-    }
+    reader_leave(&slot->readers, epoch);
+    return ret;
+}
 
+/*
+ * permission: -1 - disable; 0 - forbidden_write_bl prefix; 1 - write_bl prefix
+ */
+void set_bl_filter_list(const char *list, int list_len, int permission)
+{
+    lock_bl_filter();
+    set_filter_list(&sc_bl_slot, list, list_len, permission);
     unlock_bl_filter();
+}
 
-    //log_prompt("bl_filter: key_len=%d, result=%d", key_len, rslt);
-    return rslt;
+/*
+ * return: 0 - write bl, 1 - forbidden write bl
+ */
+int bl_filter(const char *key, int key_len)
+{
+    return filter_key(&sc_bl_slot, key, key_len);
 }
 
 /*
@@ -378,56 +459,9 @@ int bl_filter(const char *key, int key_len)
  */
 void set_sync_filter_list(const char *list, int list_len, int permission)
 {
-    static int sc_permission = -1;
-    static int sc_list_len = 0;
-    static char *sc_list = 0;
-
-    if (sc_permission != permission
-        || sc_list_len != list_len
-        || (sc_list && list && strcmp(sc_list, list) != 0)
-       )
-    {
-        /* need to change current config */
-        int cnt = 0;
-        char **list_ar = 0;
-        if (sc_list)
-        {
-            zfree(sc_list);
-            sc_list = 0;
-            sc_list_len = 0;
-        }
-        if (permission != -1)
-        {
-            if (list && list_len > 0)
-            {
-                sc_list = zstrdup(list);
-                sc_list_len = list_len;
-                list_ar = parse_list_str(sc_list, &cnt, "\r \n,");
-            }
-        }
-        sc_permission = permission;
-        log_prompt("sync_filter change: perm=%d, book_cnt=%d, book_list=%s"
-                , permission, cnt, list ? list : "");
-
-        lock_sync_filter();
-
-        if (sc_sync_list.list)
-        {
-            int i = 0;
-            for (; i < sc_sync_list.list_cnt; i++)
-            {
-                zfree(sc_sync_list.list[i]);
-            }
-            zfree(sc_sync_list.list);
-            sc_sync_list.list = 0;
-            sc_sync_list.list_cnt = 0;
-        }
-        sc_sync_list.permission = permission;
-        sc_sync_list.list_cnt = cnt;
-        sc_sync_list.list = list_ar;
-
-        unlock_sync_filter();
-    }
+    lock_sync_filter();
+    set_filter_list(&sc_sync_slot, list, list_len, permission);
+    unlock_sync_filter();
 }
 
 /*
@@ -435,54 +469,7 @@ void set_sync_filter_list(const char *list, int list_len, int permission)
  */
 int sync_filter(const char *key, int key_len)
 {
-    int rslt;
-
-    lock_sync_filter();
-
-    if (sc_sync_list.permission != -1)
-    {
-        int find = 0;
-        if (sc_sync_list.list)
-        {
-            find = 0;
-            int i;
-            for (i= 0; i < sc_sync_list.list_cnt; i++)
-            {
-                const int prefix_len = strlen(sc_sync_list.list[i]);
-                if (key_len >= prefix_len
-                    && strncmp(sc_sync_list.list[i], key, prefix_len) == 0)
-                {
-                    find = 1;
-                    break;
-                }
-            }
-        }
-        else
-        {
-            find = 0;
-        }
-
-        if (sc_sync_list.permission == 0)
-        { 
-            /* black list */
-            rslt = find == 0 ? 0 : 1;
-        }
-        else
-        {
-            /* white list */
-            rslt = find == 0 ? 1 : 0;
-        }
-    }
-    else
-    {
-        /* disable list */
-        rslt = 0;
-    }
-
-    unlock_sync_filter();
-
-    //log_prompt("sync_filter: key_len=%d, result=%d", key_len, rslt);
-    return rslt;
+    return filter_key(&sc_sync_slot, key, key_len);
 }
 
 /*
@@ -490,56 +477,9 @@ int sync_filter(const char *key, int key_len)
  */
 void set_cache_filter_list(const char *list, int list_len, int permission)
 {
-    static int sc_permission = -1;
-    static int sc_list_len = 0;
-    static char *sc_list = 0;
-
-    if (sc_permission != permission
-        || sc_list_len != list_len
-        || (sc_list && list && strcmp(sc_list, list) != 0)
-       )
-    {
-        /* need to change current config */
-        int cnt = 0;
-        char **list_ar = 0;
-        if (sc_list)
-        {
-            zfree(sc_list);
-            sc_list = 0;
-            sc_list_len = 0;
-        }
-        if (permission != -1)
-        {
-            if (list && list_len > 0)
-            {
-                sc_list = zstrdup(list);
-                sc_list_len = list_len;
-                list_ar = parse_list_str(sc_list, &cnt, "\r \n,");
-            }
-        }
-        sc_permission = permission;
-        log_prompt("cache_filter change: perm=%d, book_cnt=%d, book_list=%s"
-                , permission, cnt, list ? list : "");
-
-        lock_cache_filter();
-
-        if (sc_cache_list.list)
-        {
-            int i = 0;
-            for (; i < sc_cache_list.list_cnt; i++)
-            {
-                zfree(sc_cache_list.list[i]);
-            }
-            zfree(sc_cache_list.list);
-            sc_cache_list.list = 0;
-            sc_cache_list.list_cnt = 0;
-        }
-        sc_cache_list.permission = permission;
-        sc_cache_list.list_cnt = cnt;
-        sc_cache_list.list = list_ar;
-
-        unlock_cache_filter();
-    }
+    lock_cache_filter();
+    set_filter_list(&sc_cache_slot, list, list_len, permission);
+    unlock_cache_filter();
 }
 
 /*
@@ -547,53 +487,5 @@ void set_cache_filter_list(const char *list, int list_len, int permission)
  */
 int cache_filter(const char *key, int key_len)
 {
-    int rslt;
-
-    lock_cache_filter();
-
-    if (sc_cache_list.permission != -1)
-    {
-        int find = 0;
-        if (sc_cache_list.list)
-        {
-            find = 0;
-            int i;
-            for (i= 0; i < sc_cache_list.list_cnt; i++)
-            {
-                const int prefix_len = strlen(sc_cache_list.list[i]);
-                if (key_len >= prefix_len
-                    && strncmp(sc_cache_list.list[i], key, prefix_len) == 0)
-                {
-                    find = 1;
-                    break;
-                }
-            }
-        }
-        else
-        {
-            find = 0;
-        }
-
-        if (sc_cache_list.permission == 0)
-        { 
-            /* black list */
-            rslt = find == 0 ? 0 : 1;
-        }
-        else
-        {
-            /* white list */
-            rslt = find == 0 ? 1 : 0;
-        }
-    }
-    else
-    {
-        /* disable list */
-        rslt = 0;
-    }
-
-    unlock_cache_filter();
-
-    //log_prompt("cache_filter: key_len=%d, result=%d", key_len, rslt);
-    return rslt;
+    return filter_key(&sc_cache_slot, key, key_len);
 }
-
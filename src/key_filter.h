@@ -10,9 +10,11 @@ extern int init_filter();
 extern int gen_filter_server();
 extern int master_filter(const char *key);
 extern int master_filter_4_dbe(const char *key, size_t);
+extern void master_filter_4_dbe_bulk(const char **dbe_keys, const size_t *dbe_key_lens, int cnt, char *drop);
 extern int master_filter_keylen(const char *key, int key_len);
 
 extern int filter_gen(const char *key, int key_len, const char *ds_key);
+extern void filter_gen_bulk(const char **keys, const int *key_lens, int cnt, const char *ds_key, char *drop);
 
 extern void set_bl_filter_list(const char *list, int list_len, int permission);
 extern int bl_filter(const char *key, int key_len);
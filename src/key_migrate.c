@@ -0,0 +1,347 @@
+#include "key_migrate.h"
+#include "codec_key.h"
+#include "dbe_if.h"
+#include "rds_util.h"
+#include "ds_log.h"
+
+#define KM_BATCH            256     /* records per km_step() */
+#define KM_SCAN_LEVEL       15      /* the highest dbe level, all keys */
+
+static volatile int sc_state = KM_STATE_NONE;
+static void *sc_dbe = 0;
+static void *sc_it = 0;
+static sds sc_last = 0;             /* the last key moved by the scan */
+static long long sc_start_ms = 0;
+static int sc_scan_fail = 0;        /* a key of the scan has not been moved */
+
+static km_stat sc_stat;
+
+static void finish_migrate();
+
+/* ret: 1 - the dbe has no record */
+static int dbe_is_empty(void *dbe)
+{
+    void *it = dbe_create_it(dbe, KM_SCAN_LEVEL);
+    if (it == 0)
+    {
+        return 0;
+    }
+    char *k = 0;
+    char *v = 0;
+    int k_len;
+    int v_len;
+    const int empty = dbe_next_key(it, &k, &k_len, &v, &v_len, zmalloc, NULL) != 0;
+    if (k)
+    {
+        zfree(k);
+    }
+    if (v)
+    {
+        zfree(v);
+    }
+    dbe_destroy_it(it);
+    return empty;
+}
+
+static void put_mark(void *dbe)
+{
+    char *k = zmalloc(DBE_KEY_V2_MARK_LEN + 1);
+    memcpy(k, DBE_KEY_V2_MARK, DBE_KEY_V2_MARK_LEN + 1);
+    /* type(128) as collections, never taken as an expired value */
+    char *v = zmalloc(2);
+    v[0] = (char)128;
+    v[1] = '2';
+    /* k & v are released by dbe */
+    if (dbe_put(dbe, k, DBE_KEY_V2_MARK_LEN, v, 2) != DBE_ERR_SUCC)
+    {
+        log_error("put v2 mark into dbe fail, dbe=%p", dbe);
+    }
+}
+
+void km_init(void *dbe)
+{
+    server.dbe_key_mixed = 0;
+    if (server.enc_kv == 0 || server.dbe_key_ver != DBE_KEY_VER_2 || dbe == 0)
+    {
+        return;
+    }
+
+    char *v = 0;
+    int v_len;
+    const int ret = dbe_get(dbe, DBE_KEY_V2_MARK, DBE_KEY_V2_MARK_LEN, &v, &v_len, zmalloc, NULL);
+    if (ret == DBE_ERR_SUCC)
+    {
+        dbe_free_ptr(v, zfree);
+        sc_state = KM_STATE_DONE;
+    }
+    else if (dbe_is_empty(dbe))
+    {
+        put_mark(dbe);
+        sc_state = KM_STATE_DONE;
+    }
+    else if (server.dbe_ver == DBE_VER_HIDB)
+    {
+        /* hidb don't support dbe_pget, v1 keys can't be moved or shadowed */
+        log_error("dbe key: hidb has v1 keys, keep dbe_key_ver=%d", DBE_KEY_VER_1);
+        server.dbe_key_ver = DBE_KEY_VER_1;
+    }
+    else
+    {
+        server.dbe_key_mixed = 1;
+    }
+    log_prompt("dbe key: ver=%d, mixed=%d", server.dbe_key_ver, server.dbe_key_mixed);
+}
+
+int km_start(void *dbe)
+{
+    if (sc_state == KM_STATE_RUNNING)
+    {
+        return 0;
+    }
+    if (server.dbe_key_mixed == 0)
+    {
+        return 1;
+    }
+    if (dbe == 0 || server.dbe_ver == DBE_VER_HIDB)
+    {
+        /* hidb don't support dbe_pget */
+        return 2;
+    }
+
+    memset(&sc_stat, 0, sizeof(sc_stat));
+    sc_scan_fail = 0;
+    sc_dbe = dbe;
+    sc_start_ms = ustime() / 1000;
+    log_prompt("migrate dbe keys to v2: start, dbe=%p", dbe);
+    sc_state = KM_STATE_RUNNING;
+    return 0;
+}
+
+int km_running()
+{
+    return sc_state == KM_STATE_RUNNING;
+}
+
+/* *moved: records moved
+ * ret: 0 - succ, no v1 row of the key is left; 1 - fail */
+static int migrate_key(void *dbe, const char *key, size_t key_len, size_t *moved)
+{
+    *moved = 0;
+    if (key_len > 255)
+    {
+        /* v1 keys are 255 bytes at most */
+        return 0;
+    }
+
+    size_t pre_len;
+    char *pre = encode_prefix_key_ver(DBE_KEY_VER_1, key, key_len, 0, &pre_len);
+    if (pre == 0)
+    {
+        log_error("encode v1 prefix fail for migrating, key=%s", key);
+        return 1;
+    }
+    void *it = dbe_pget(dbe, pre, pre_len);
+    if (it == 0)
+    {
+        log_error("dbe_pget fail for migrating, key=%s", key);
+        zfree(pre);
+        return 1;
+    }
+
+    int ret = 0;
+    size_t cnt = 0;
+    size_t cap = 0;
+    kvec_t *kv = 0;
+    char *k = 0;
+    char *v = 0;
+    int k_len;
+    int v_len;
+    while (dbe_next_key(it, &k, &k_len, &v, &v_len, zmalloc, NULL) == 0)
+    {
+        size_t nk_len;
+        char *nk = convert_dbe_key(k, k_len, DBE_KEY_VER_2, &nk_len);
+        zfree(k);
+        if (nk == 0)
+        {
+            log_error("convert dbe key fail, key=%s", key);
+            zfree(v);
+            ret = 1;
+            continue;
+        }
+        if (cnt == cap)
+        {
+            cap = cap ? cap * 2 : 16;
+            kv = zrealloc(kv, sizeof(kvec_t) * cap);
+        }
+        kv[cnt].k = nk;
+        kv[cnt].ks = nk_len;
+        kv[cnt].v = v;
+        kv[cnt].vs = v_len;
+        cnt++;
+    }
+    dbe_destroy_it(it);
+
+    if (ret != 0)
+    {
+        /* not all rows can be moved, keep the v1 ones */
+        size_t i;
+        for (i = 0; i < cnt; i++)
+        {
+            zfree(kv[i].k);
+            zfree(kv[i].v);
+        }
+        cnt = 0;
+    }
+    if (cnt > 0)
+    {
+        /* the v2 rows are in before the v1 ones go, a reader sees one of them */
+        const int put_ret = dbe_mput(dbe, kv, cnt);
+        if (put_ret != DBE_ERR_SUCC)
+        {
+            log_error("dbe_mput fail for migrating, ret=%d, key=%s", put_ret, key);
+            ret = 1;
+        }
+        else
+        {
+            /* a v1 row left would come back after a DEL of the v2 ones,
+             * the caller retries, putting the v2 rows again is harmless */
+            const int del_ret = dbe_pdelete(dbe, pre, pre_len);
+            if (del_ret != DBE_ERR_SUCC)
+            {
+                log_error("dbe_pdelete fail for migrating, ret=%d, key=%s", del_ret, key);
+                ret = 1;
+            }
+            else
+            {
+                sc_stat.rows += cnt;
+                *moved = cnt;
+            }
+        }
+    }
+    else if (kv)
+    {
+        zfree(kv);
+    }
+    zfree(pre);
+    return ret;
+}
+
+int km_migrate_key(void *dbe, const char *key, size_t key_len)
+{
+    size_t moved = 0;
+    if (server.dbe_key_mixed == 0)
+    {
+        return 0;
+    }
+    const int ret = migrate_key(dbe, key, key_len, &moved);
+    if (moved > 0)
+    {
+        sc_stat.on_write++;
+    }
+    return ret;
+}
+
+void km_step()
+{
+    if (sc_state != KM_STATE_RUNNING)
+    {
+        return;
+    }
+    if (sc_it == 0)
+    {
+        sc_it = dbe_create_it(sc_dbe, KM_SCAN_LEVEL);
+        if (sc_it == 0)
+        {
+            log_error("migrate dbe keys: dbe_create_it fail, dbe=%p", sc_dbe);
+            sc_state = KM_STATE_FAIL;
+            return;
+        }
+        sc_last = sdsempty();
+    }
+
+    char *k = 0;
+    char *v = 0;
+    int k_len;
+    int v_len;
+    int n;
+    for (n = 0; n < KM_BATCH; n++)
+    {
+        if (dbe_next_key(sc_it, &k, &k_len, &v, &v_len, zmalloc, NULL) != 0)
+        {
+            finish_migrate();
+            return;
+        }
+        sc_stat.scanned++;
+
+        dbe_key_attr attr;
+        if (decode_dbe_key(k, k_len, &attr) == 0 && attr.ver == DBE_KEY_VER_1
+            && (sdslen(sc_last) != attr.key_len
+                || memcmp(sc_last, attr.key, attr.key_len) != 0))
+        {
+            sc_last = sdscpylen(sc_last, attr.key, attr.key_len);
+            size_t moved = 0;
+            if (migrate_key(sc_dbe, attr.key, attr.key_len, &moved) != 0)
+            {
+                sc_scan_fail = 1;
+            }
+            else if (moved > 0)
+            {
+                sc_stat.keys++;
+            }
+        }
+        zfree(k);
+        zfree(v);
+    }
+}
+
+static void finish_migrate()
+{
+    dbe_destroy_it(sc_it);
+    sc_it = 0;
+    sdsfree(sc_last);
+    sc_last = 0;
+
+    if (sc_scan_fail)
+    {
+        /* v1 rows are left, stay mixed, km_start() scans again */
+        sc_stat.elapsed_ms = ustime() / 1000 - sc_start_ms;
+        sc_state = KM_STATE_FAIL;
+        log_error("migrate dbe keys to v2: some keys fail, during=%lldms, scanned=%llu, keys=%llu"
+                  , sc_stat.elapsed_ms, sc_stat.scanned, sc_stat.keys);
+        return;
+    }
+
+    put_mark(sc_dbe);
+    server.dbe_key_mixed = 0;
+    sc_stat.elapsed_ms = ustime() / 1000 - sc_start_ms;
+    sc_state = KM_STATE_DONE;
+    log_prompt("migrate dbe keys to v2: done, during=%lldms, scanned=%llu, keys=%llu, rows=%llu, on_write=%llu"
+               , sc_stat.elapsed_ms, sc_stat.scanned, sc_stat.keys, sc_stat.rows, sc_stat.on_write);
+}
+
+void km_get_stat(km_stat *st)
+{
+    *st = sc_stat;
+    st->state = sc_state;
+    if (sc_state == KM_STATE_RUNNING)
+    {
+        st->elapsed_ms = ustime() / 1000 - sc_start_ms;
+    }
+}
+
+const char *km_state_str(int state)
+{
+    switch (state)
+    {
+    case KM_STATE_NONE:
+        return "none";
+    case KM_STATE_RUNNING:
+        return "running";
+    case KM_STATE_DONE:
+        return "done";
+    case KM_STATE_FAIL:
+        return "fail";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef _KEY_MIGRATE_H_
+#define _KEY_MIGRATE_H_
+
+#include "redis.h"
+
+/* move the dbe rows with keys in v1 format to v2 while serving:
+ * 1) with dbe_key_ver 2, server.dbe_key_mixed is set until the dbe has the
+ *    v2 mark, reads of a key look for v2 then v1 meanwhile. hidb with v1
+ *    keys stays on dbe_key_ver 1, it can't move them
+ * 2) the write_dbe thread moves every v1 key it is going to change, and
+ *    scans the dbe in background after km_start(), a batch at a time
+ * 3) the mark is written at the end of the scan, dbe_key_mixed is cleared */
+
+#define KM_STATE_NONE       0
+#define KM_STATE_RUNNING    1
+#define KM_STATE_DONE       2
+#define KM_STATE_FAIL       3
+
+typedef struct km_stat_t
+{
+    int state;
+    unsigned long long scanned;   /* records read from dbe iterator */
+    unsigned long long keys;      /* keys moved by the scan */
+    unsigned long long rows;      /* records moved */
+    unsigned long long on_write;  /* keys moved before being written */
+    long long elapsed_ms;
+} km_stat;
+
+/* after dbe_startup() */
+extern void km_init(void *dbe);
+/* by main thread, 0 - started or running, 1 - nothing to migrate, 2 - fail */
+extern int km_start(void *dbe);
+extern int km_running();
+
+/* by write_dbe thread only */
+extern void km_step();
+/* ret: 0 - no v1 row of the key left; 1 - fail, the key must not be written */
+extern int km_migrate_key(void *dbe, const char *key, size_t key_len);
+
+extern void km_get_stat(km_stat *st);
+extern const char *km_state_str(int state);
+
+#endif /* _KEY_MIGRATE_H_ */
@@ -0,0 +1,306 @@
+#include "latency_hist.h"
+#include "ds_log.h"
+
+/* threads beyond it share one slot with atomic add */
+#define LH_MAX_THREADS  64
+
+typedef struct lh_slot_t
+{
+    volatile unsigned long long sum[LH_KIND_NUM];
+    volatile unsigned long long buckets[LH_KIND_NUM][LH_BUCKETS];
+} lh_slot;
+
+static lh_slot *volatile sc_slots[LH_MAX_THREADS];
+static volatile int sc_slot_num = 0;
+static lh_slot sc_shared;
+
+static __thread lh_slot *sc_mine = 0;
+
+/* the counts taken by LATENCY RESET, main thread only */
+static lh_hist sc_base[LH_KIND_NUM];
+
+static const char *sc_kind_names[LH_KIND_NUM] =
+{
+    "dbe_get",
+    "dbe_set",
+    "bl_serialize",
+    "bl_write",
+    "queue_wait",
+    "call",
+};
+
+static inline int bucket_of(unsigned long long v)
+{
+    if (v < LH_SUB_CNT)
+    {
+        return (int)v;
+    }
+    const int msb = 63 - __builtin_clzll(v);
+    if (msb >= LH_MAX_BITS)
+    {
+        return LH_BUCKETS - 1;
+    }
+    const int shift = msb - LH_SUB_BITS;
+    return ((shift + 1) << LH_SUB_BITS) + (int)((v >> shift) & (LH_SUB_CNT - 1));
+}
+
+/* the highest value kept by the bucket */
+static unsigned long long bucket_high(int idx)
+{
+    if (idx < LH_SUB_CNT)
+    {
+        return idx;
+    }
+    const int shift = (idx >> LH_SUB_BITS) - 1;
+    const unsigned long long sub = (idx & (LH_SUB_CNT - 1)) | LH_SUB_CNT;
+    return ((sub + 1) << shift) - 1;
+}
+
+static lh_slot *register_slot()
+{
+    const int idx = __sync_fetch_and_add(&sc_slot_num, 1);
+    lh_slot *slot = 0;
+    if (idx < LH_MAX_THREADS)
+    {
+        slot = zcalloc(sizeof(lh_slot));
+    }
+    if (slot == 0)
+    {
+        log_prompt("latency histogram: no own slot for thread No.%d, use the shared one", idx);
+        slot = &sc_shared;
+    }
+    else
+    {
+        /* the slot is zeroed before readers can see it */
+        __sync_synchronize();
+        sc_slots[idx] = slot;
+    }
+    sc_mine = slot;
+    return slot;
+}
+
+void lh_record(int kind, long long us)
+{
+    if (kind < 0 || kind >= LH_KIND_NUM)
+    {
+        return;
+    }
+    const unsigned long long v = us > 0 ? (unsigned long long)us : 0;
+    lh_slot *slot = sc_mine ? sc_mine : register_slot();
+    const int b = bucket_of(v);
+    if (slot == &sc_shared)
+    {
+        __sync_fetch_and_add(&slot->buckets[kind][b], 1);
+        __sync_fetch_and_add(&slot->sum[kind], v);
+    }
+    else
+    {
+        /* single writer */
+        slot->buckets[kind][b]++;
+        slot->sum[kind] += v;
+    }
+}
+
+static void add_slot(const lh_slot *slot, int kind, lh_hist *h)
+{
+    int i;
+    h->sum += slot->sum[kind];
+    for (i = 0; i < LH_BUCKETS; i++)
+    {
+        h->buckets[i] += slot->buckets[kind][i];
+    }
+}
+
+void lh_merge(int kind, lh_hist *h)
+{
+    int i;
+    memset(h, 0, sizeof(*h));
+    if (kind < 0 || kind >= LH_KIND_NUM)
+    {
+        return;
+    }
+
+    int num = sc_slot_num;
+    if (num > LH_MAX_THREADS)
+    {
+        num = LH_MAX_THREADS;
+    }
+    for (i = 0; i < num; i++)
+    {
+        /* null if the owner has not published it yet */
+        const lh_slot *slot = sc_slots[i];
+        if (slot)
+        {
+            add_slot(slot, kind, h);
+        }
+    }
+    add_slot(&sc_shared, kind, h);
+
+    /* counted from the buckets, the sum may be a little ahead or behind */
+    for (i = 0; i < LH_BUCKETS; i++)
+    {
+        h->cnt += h->buckets[i];
+    }
+}
+
+void lh_get(int kind, lh_hist *h)
+{
+    lh_merge(kind, h);
+    if (kind >= 0 && kind < LH_KIND_NUM)
+    {
+        lh_sub(h, &sc_base[kind]);
+    }
+}
+
+void lh_reset()
+{
+    int i;
+    for (i = 0; i < LH_KIND_NUM; i++)
+    {
+        lh_merge(i, &sc_base[i]);
+    }
+}
+
+void lh_sub(lh_hist *h, const lh_hist *base)
+{
+    int i;
+    h->cnt = h->cnt > base->cnt ? h->cnt - base->cnt : 0;
+    h->sum = h->sum > base->sum ? h->sum - base->sum : 0;
+    for (i = 0; i < LH_BUCKETS; i++)
+    {
+        h->buckets[i] = h->buckets[i] > base->buckets[i] ? h->buckets[i] - base->buckets[i] : 0;
+    }
+}
+
+unsigned long long lh_percentile(const lh_hist *h, double q)
+{
+    if (h->cnt == 0)
+    {
+        return 0;
+    }
+    if (q < 0)
+    {
+        q = 0;
+    }
+    else if (q > 1.0)
+    {
+        q = 1.0;
+    }
+
+    unsigned long long rank = (unsigned long long)(q * h->cnt + 0.5);
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+    unsigned long long acc = 0;
+    int i;
+    for (i = 0; i < LH_BUCKETS; i++)
+    {
+        acc += h->buckets[i];
+        if (acc >= rank)
+        {
+            return bucket_high(i);
+        }
+    }
+    return bucket_high(LH_BUCKETS - 1);
+}
+
+void lh_summarize(const lh_hist *h, lh_summary *s)
+{
+    s->cnt = h->cnt;
+    s->avg = h->cnt ? h->sum / h->cnt : 0;
+    s->p50 = lh_percentile(h, 0.5);
+    s->p99 = lh_percentile(h, 0.99);
+    s->p999 = lh_percentile(h, 0.999);
+    s->max = lh_percentile(h, 1.0);
+}
+
+const char *lh_kind_str(int kind)
+{
+    if (kind < 0 || kind >= LH_KIND_NUM)
+    {
+        return "unknown";
+    }
+    return sc_kind_names[kind];
+}
+
+int lh_kind_of(const char *name)
+{
+    int i;
+    for (i = 0; i < LH_KIND_NUM; i++)
+    {
+        if (!strcasecmp(name, sc_kind_names[i]))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void reply_kind(redisClient *c, int kind)
+{
+    lh_hist h;
+    lh_summary s;
+    lh_get(kind, &h);
+    lh_summarize(&h, &s);
+
+    addReplyMultiBulkLen(c, 13);
+    addReplyBulkCString(c, (char *)lh_kind_str(kind));
+    addReplyBulkCString(c, "calls");
+    addReplyLongLong_u(c, s.cnt);
+    addReplyBulkCString(c, "avg_us");
+    addReplyLongLong_u(c, s.avg);
+    addReplyBulkCString(c, "p50_us");
+    addReplyLongLong_u(c, s.p50);
+    addReplyBulkCString(c, "p99_us");
+    addReplyLongLong_u(c, s.p99);
+    addReplyBulkCString(c, "p999_us");
+    addReplyLongLong_u(c, s.p999);
+    addReplyBulkCString(c, "max_us");
+    addReplyLongLong_u(c, s.max);
+}
+
+/* LATENCY HISTOGRAM [kind ...]
+ * LATENCY RESET */
+void latencyCommand(redisClient *c)
+{
+    int i;
+    if (c->argc == 2 && !strcasecmp(c->argv[1]->ptr, "reset"))
+    {
+        lh_reset();
+        addReply(c, shared.ok);
+    }
+    else if (!strcasecmp(c->argv[1]->ptr, "histogram"))
+    {
+        for (i = 2; i < c->argc; i++)
+        {
+            if (lh_kind_of(c->argv[i]->ptr) == -1)
+            {
+                addReplyErrorFormat(c, "unknown latency kind '%s'", (char *)c->argv[i]->ptr);
+                return;
+            }
+        }
+
+        if (c->argc == 2)
+        {
+            addReplyMultiBulkLen(c, LH_KIND_NUM);
+            for (i = 0; i < LH_KIND_NUM; i++)
+            {
+                reply_kind(c, i);
+            }
+        }
+        else
+        {
+            addReplyMultiBulkLen(c, c->argc - 2);
+            for (i = 2; i < c->argc; i++)
+            {
+                reply_kind(c, lh_kind_of(c->argv[i]->ptr));
+            }
+        }
+    }
+    else
+    {
+        addReplyError(c,
+            "Unknown LATENCY subcommand or wrong # of args. Try HISTOGRAM, RESET.");
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef _LATENCY_HIST_H_
+#define _LATENCY_HIST_H_
+
+#include "redis.h"
+
+/* latency histograms of the io paths, recorded by any thread without lock:
+ * a thread gets its own slot at the first record and only it writes the
+ * slot, readers sum all slots on demand (INFO, LATENCY HISTOGRAM and the
+ * heart-beat), so the io workers never share a cache line for the stat.
+ * buckets are log-linear (HDR like): 2^LH_SUB_BITS linear sub-buckets per
+ * power of 2, a value is kept within 1/2^LH_SUB_BITS of relative error */
+
+#define LH_DBE_GET          0   /* dbe_get / dbe_next_key of a key */
+#define LH_DBE_SET          1   /* one dbe_put / dbe_mput op */
+#define LH_BL_SERIALIZE     2   /* serialize a binlog record */
+#define LH_BL_WRITE         3   /* write a binlog record into file */
+#define LH_QUEUE_WAIT       4   /* io task waits in the queue of thread pool */
+#define LH_CALL             5   /* cmd proc in call() */
+#define LH_KIND_NUM         6
+
+#define LH_SUB_BITS         4
+#define LH_SUB_CNT          (1 << LH_SUB_BITS)
+/* values (us) above 2^LH_MAX_BITS are put into the last bucket */
+#define LH_MAX_BITS         40
+#define LH_BUCKETS          ((LH_MAX_BITS - LH_SUB_BITS + 1) << LH_SUB_BITS)
+
+typedef struct lh_hist_t
+{
+    unsigned long long cnt;
+    unsigned long long sum;     /* us */
+    unsigned long long buckets[LH_BUCKETS];
+} lh_hist;
+
+typedef struct lh_summary_t
+{
+    unsigned long long cnt;
+    unsigned long long avg;
+    unsigned long long p50;
+    unsigned long long p99;
+    unsigned long long p999;
+    unsigned long long max;
+} lh_summary;
+
+/* call by any thread, us: duration in microsecond */
+extern void lh_record(int kind, long long us);
+
+/* sum of all threads since startup, safe for any thread */
+extern void lh_merge(int kind, lh_hist *h);
+/* since startup or the last lh_reset(), call by main thread */
+extern void lh_get(int kind, lh_hist *h);
+extern void lh_reset();
+
+/* h -= base, for the stat of an interval */
+extern void lh_sub(lh_hist *h, const lh_hist *base);
+/* q: 0 ~ 1.0, return the highest value of the bucket holding the quantile */
+extern unsigned long long lh_percentile(const lh_hist *h, double q);
+extern void lh_summarize(const lh_hist *h, lh_summary *s);
+
+extern const char *lh_kind_str(int kind);
+/* return: -1 - unknown name */
+extern int lh_kind_of(const char *name);
+
+extern void latencyCommand(redisClient *c);
+
+#endif /* _LATENCY_HIST_H_ */
@@ -0,0 +1,325 @@
+#include "miss_filter.h"
+#include "codec_key.h"
+#include "dbe_if.h"
+#include "dbmng.h"
+#include "bl_ctx.h"
+#include "rds_util.h"
+#include "ds_log.h"
+
+#include <pthread.h>
+
+/* one block is a cache line, all probes of a key hit the same block */
+#define MF_BLOCK_WORDS 8
+#define MF_BLOCK_BITS (MF_BLOCK_WORDS * 64)
+#define MF_PROBES 6
+
+static uint64_t *sc_bits = 0;
+static uint64_t sc_nblocks = 0;
+static volatile int sc_state = MF_STATE_OFF;
+static int sc_building = 0;
+static pthread_t sc_build_tid;
+
+/* sds key -> expire time in ms */
+static dict *sc_neg = 0;
+
+static mf_stat sc_stat;
+
+static void *mf_build(void *arg);
+
+/* MurmurHash64A */
+static uint64_t mf_hash(const void *key, size_t len)
+{
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    const unsigned char *data = (const unsigned char *)key;
+    const unsigned char *end = data + (len & ~(size_t)7);
+    uint64_t h = 0x9747b28cULL ^ (len * m);
+    uint64_t k;
+
+    while (data != end)
+    {
+        memcpy(&k, data, sizeof(k));
+        data += 8;
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    switch (len & 7)
+    {
+    case 7: h ^= (uint64_t)data[6] << 48;
+    case 6: h ^= (uint64_t)data[5] << 40;
+    case 5: h ^= (uint64_t)data[4] << 32;
+    case 4: h ^= (uint64_t)data[3] << 24;
+    case 3: h ^= (uint64_t)data[2] << 16;
+    case 2: h ^= (uint64_t)data[1] << 8;
+    case 1: h ^= (uint64_t)data[0];
+            h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+/* the block is chosen by h, the bits in it by a remix of h, 9 bits each */
+static uint64_t *mf_block(const char *key, size_t len, uint64_t *probe)
+{
+    const uint64_t h = mf_hash(key, len);
+    uint64_t g = h ^ (h >> 29);
+    g *= 0xbf58476d1ce4e5b9ULL;
+    g ^= g >> 32;
+    *probe = g;
+    return sc_bits + (h % sc_nblocks) * MF_BLOCK_WORDS;
+}
+
+/* call by main thread and build thread */
+static void bloom_add(const char *key, size_t len)
+{
+    uint64_t probe;
+    uint64_t *blk = mf_block(key, len, &probe);
+    int i;
+
+    for (i = 0; i < MF_PROBES; i++)
+    {
+        const unsigned int bit = probe & (MF_BLOCK_BITS - 1);
+        __sync_fetch_and_or(&blk[bit >> 6], 1ULL << (bit & 63));
+        probe >>= 9;
+    }
+    __sync_fetch_and_add(&sc_stat.bloom_keys, 1);
+}
+
+static int bloom_maybe(const char *key, size_t len)
+{
+    uint64_t probe;
+    const uint64_t *blk = mf_block(key, len, &probe);
+    int i;
+
+    for (i = 0; i < MF_PROBES; i++)
+    {
+        const unsigned int bit = probe & (MF_BLOCK_BITS - 1);
+        if ((blk[bit >> 6] & (1ULL << (bit & 63))) == 0)
+        {
+            return 0;
+        }
+        probe >>= 9;
+    }
+    return 1;
+}
+
+int mf_init()
+{
+    memset(&sc_stat, 0, sizeof(sc_stat));
+    if (server.has_dbe == 0 || (server.has_cache == 1 && server.read_dbe == 0))
+    {
+        return 0;
+    }
+
+    if (server.neg_cache_size > 0)
+    {
+        sc_neg = dictCreate(&sdsSetDictType, NULL);
+    }
+
+    if (server.dbe_bloom_mb > 0)
+    {
+        const size_t bytes = (size_t)server.dbe_bloom_mb * 1024 * 1024;
+        sc_nblocks = bytes / (MF_BLOCK_WORDS * sizeof(uint64_t));
+        sc_bits = (uint64_t *)zcalloc(sc_nblocks * MF_BLOCK_WORDS * sizeof(uint64_t));
+        sc_stat.bloom_bytes = sc_nblocks * MF_BLOCK_WORDS * sizeof(uint64_t);
+        /* keys inserted into rdb from now on are added, but it can't
+         * answer until all keys in dbe have been added */
+        sc_state = MF_STATE_BUILDING;
+    }
+
+    log_prompt("mf_init: bloom=%zuB, neg_cache_size=%d, neg_cache_ttl=%ds"
+               , sc_stat.bloom_bytes, server.neg_cache_size, server.neg_cache_ttl);
+    return 0;
+}
+
+/* it: created by dbe_create_it(MF_SCAN_LEVEL), released by build thread */
+int mf_start_build(void *it)
+{
+    if (sc_state != MF_STATE_BUILDING)
+    {
+        dbe_destroy_it(it);
+        return 0;
+    }
+
+    if (pthread_create(&sc_build_tid, 0, mf_build, it) != 0)
+    {
+        log_error("%s", "pthread_create() fail for bloom build");
+        dbe_destroy_it(it);
+        sc_state = MF_STATE_OFF;
+        return 1;
+    }
+    sc_building = 1;
+    return 0;
+}
+
+static void *mf_build(void *arg)
+{
+    void *it = arg;
+    char *k = 0;
+    int k_len;
+    char *v = 0;
+    int v_len;
+    unsigned long long cnt = 0;
+    const long long start = ustime();
+
+    while (sc_state == MF_STATE_BUILDING
+           && dbe_next_key(it, &k, &k_len, &v, &v_len, zmalloc, NULL) == 0)
+    {
+        dbe_key_attr attr;
+        if (decode_dbe_key(k, k_len, &attr) == 0)
+        {
+            bloom_add(attr.key, attr.key_len);
+        }
+        zfree(k);
+        zfree(v);
+        cnt++;
+    }
+    dbe_destroy_it(it);
+
+    if (__sync_bool_compare_and_swap(&sc_state, MF_STATE_BUILDING, MF_STATE_READY))
+    {
+        log_prompt("bloom is ready: during=%lldms, dbe_recs=%llu, keys=%llu, bytes=%zu"
+                   , (ustime() - start) / 1000, cnt, sc_stat.bloom_keys, sc_stat.bloom_bytes);
+    }
+    return 0;
+}
+
+/* call by main thread at shutdown */
+void mf_stop()
+{
+    if (sc_building)
+    {
+        sc_state = MF_STATE_OFF;
+        pthread_join(sc_build_tid, 0);
+        sc_building = 0;
+    }
+}
+
+/* keys are written into dbe bypassing rdb, nothing is known */
+void mf_disable(const char *reason)
+{
+    if (sc_state != MF_STATE_OFF)
+    {
+        log_prompt("bloom disabled: %s", reason);
+        sc_state = MF_STATE_OFF;
+    }
+    if (sc_neg)
+    {
+        dictEmpty(sc_neg);
+    }
+}
+
+/* the key has writes queued for dbe, a miss of dbe says nothing about it */
+static int key_inflight(const robj *key)
+{
+    dbmng_ctx *ctx = get_entry_ctx(0);
+    return ctx && ctx->rdb && bl_dbe_inflight(ctx->rdb->id, key->ptr);
+}
+
+int mf_key_absent(const robj *key)
+{
+    if (sc_neg && dictSize(sc_neg) > 0 && !key_inflight(key))
+    {
+        dictEntry *de = dictFind(sc_neg, key->ptr);
+        if (de)
+        {
+            if ((long long)(intptr_t)dictGetEntryVal(de) > server.mstime)
+            {
+                sc_stat.neg_hits++;
+                return 1;
+            }
+            dictDelete(sc_neg, key->ptr);
+        }
+    }
+
+    if (sc_state == MF_STATE_READY && bloom_maybe(key->ptr, sdslen(key->ptr)) == 0)
+    {
+        sc_stat.bloom_negatives++;
+        return 1;
+    }
+    return 0;
+}
+
+/* call by dbAdd, the key will be written into dbe */
+void mf_add_key(const robj *key)
+{
+    if (sc_state != MF_STATE_OFF)
+    {
+        bloom_add(key->ptr, sdslen(key->ptr));
+    }
+    if (sc_neg && dictSize(sc_neg) > 0)
+    {
+        dictDelete(sc_neg, key->ptr);
+    }
+}
+
+/* call by main thread, the key is queued for a dbe write */
+void mf_drop_neg(const robj *key)
+{
+    if (sc_neg && dictSize(sc_neg) > 0)
+    {
+        dictDelete(sc_neg, key->ptr);
+    }
+}
+
+/* call by main thread, dbe_get has not found the key */
+void mf_note_miss(const robj *key)
+{
+    if (key_inflight(key))
+    {
+        /* dbe_get raced with a write, dbe will have the key soon */
+        return;
+    }
+
+    if (sc_state == MF_STATE_READY)
+    {
+        /* it has passed the bloom */
+        sc_stat.bloom_fp++;
+    }
+
+    if (sc_neg == 0 || server.neg_cache_size <= 0)
+    {
+        return;
+    }
+
+    const long long expire = server.mstime + (long long)server.neg_cache_ttl * 1000;
+    dictEntry *de = dictFind(sc_neg, key->ptr);
+    if (de)
+    {
+        dictGetEntryVal(de) = (void *)(intptr_t)expire;
+        return;
+    }
+    while (dictSize(sc_neg) >= (unsigned long)server.neg_cache_size)
+    {
+        de = dictGetRandomKey(sc_neg);
+        dictDelete(sc_neg, dictGetEntryKey(de));
+    }
+    dictAdd(sc_neg, sdsdup(key->ptr), (void *)(intptr_t)expire);
+}
+
+void mf_get_stat(mf_stat *st)
+{
+    *st = sc_stat;
+    st->state = sc_state;
+    st->neg_size = sc_neg ? dictSize(sc_neg) : 0;
+}
+
+const char *mf_state_str(int state)
+{
+    switch (state)
+    {
+    case MF_STATE_BUILDING:
+        return "building";
+    case MF_STATE_READY:
+        return "ready";
+    default:
+        return "off";
+    }
+}
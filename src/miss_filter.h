@@ -0,0 +1,43 @@
+#ifndef _MISS_FILTER_H_
+#define _MISS_FILTER_H_
+
+#include "redis.h"
+
+/* answer "not found" for cold keys without reading dbe:
+ * 1) a blocked bloom filter of all keys in dbe, built from the dbe
+ *    iterator in background and fed by every key inserted into rdb,
+ *    deletes are not applied, they only raise the false positive rate
+ * 2) a small negative cache of keys dbe_get has just missed, with ttl */
+
+#define MF_STATE_OFF        0
+#define MF_STATE_BUILDING   1  /* not complete, never answers */
+#define MF_STATE_READY      2
+
+#define MF_SCAN_LEVEL       15 /* the highest dbe level, all keys */
+
+typedef struct mf_stat_t
+{
+    int state;
+    size_t bloom_bytes;
+    unsigned long long bloom_keys;       /* keys added */
+    unsigned long long bloom_negatives;  /* cold keys answered by bloom */
+    unsigned long long bloom_fp;         /* bloom said maybe, dbe said not found */
+    unsigned long long neg_hits;         /* cold keys answered by negative cache */
+    unsigned long neg_size;
+} mf_stat;
+
+extern int mf_init();
+extern int mf_start_build(void *it);
+extern void mf_stop();
+extern void mf_disable(const char *reason);
+
+/* return: 1 - the key is surely absent in dbe */
+extern int mf_key_absent(const robj *key);
+extern void mf_add_key(const robj *key);
+extern void mf_note_miss(const robj *key);
+extern void mf_drop_neg(const robj *key);
+
+extern void mf_get_stat(mf_stat *st);
+extern const char *mf_state_str(int state);
+
+#endif /* _MISS_FILTER_H_ */
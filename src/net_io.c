@@ -0,0 +1,220 @@
+#include "net_io.h"
+#include "ds_log.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+/* fewer clients are done by the main thread alone, waking threads up
+ * costs more than the syscalls saved */
+#define NIO_MIN_CLIENTS_PER_THREAD  2
+/* spins of the main thread waiting for a batch before it yields the cpu */
+#define NIO_SPINS_BEFORE_YIELD      1024
+
+typedef struct nio_thread_t
+{
+    pthread_t tid;
+    redisClient **clients;
+    int cnt;
+    int cap;
+    unsigned long long bytes;    /* read or written by the batch */
+    unsigned long long calls;    /* writev() of the batch */
+    nio_thread_stat stat;
+} nio_thread;
+
+__thread int nio_worker = 0;
+
+static nio_thread sc_threads[NIO_MAX_THREADS];
+static int sc_threads_cnt = 1;
+static long long sc_start_us = 0;
+
+static pthread_mutex_t sc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sc_work = PTHREAD_COND_INITIALIZER;
+static unsigned long sc_seq = 0;        /* batch number, under sc_lock */
+static int sc_op = NIO_OP_READ;         /* op of the batch, under sc_lock */
+static volatile int sc_left = 0;        /* threads not done with the batch */
+
+static void run_batch(nio_thread *t, int op)
+{
+    if (t->cnt == 0)
+    {
+        return;
+    }
+
+    const long long start = ustime();
+    int i;
+    for (i = 0; i < t->cnt; i++)
+    {
+        redisClient *c = t->clients[i];
+        if (op == NIO_OP_READ)
+        {
+            const int nread = ioReadQuery(c);
+            if (nread > 0)
+            {
+                t->bytes += nread;
+                ioParseQuery(c);
+            }
+        }
+        else
+        {
+            t->bytes += ioWriteClient(c, &t->calls);
+        }
+    }
+    t->stat.busy_us += ustime() - start;
+    t->stat.clients += t->cnt;
+    t->stat.runs++;
+}
+
+static void *nio_work(void *arg)
+{
+    nio_thread *t = arg;
+    unsigned long seen = 0;
+
+    nio_worker = 1;
+    for (;;)
+    {
+        pthread_mutex_lock(&sc_lock);
+        while (sc_seq == seen)
+        {
+            pthread_cond_wait(&sc_work, &sc_lock);
+        }
+        seen = sc_seq;
+        const int op = sc_op;
+        pthread_mutex_unlock(&sc_lock);
+
+        run_batch(t, op);
+        __sync_sub_and_fetch(&sc_left, 1);
+    }
+    return 0;
+}
+
+int nio_init()
+{
+    sc_start_us = ustime();
+    sc_threads_cnt = server.net_io_threads;
+    if (sc_threads_cnt < 1)
+    {
+        sc_threads_cnt = 1;
+    }
+    else if (sc_threads_cnt > NIO_MAX_THREADS)
+    {
+        sc_threads_cnt = NIO_MAX_THREADS;
+    }
+
+    int i;
+    for (i = 1; i < sc_threads_cnt; i++)
+    {
+        if (pthread_create(&sc_threads[i].tid, 0, nio_work, &sc_threads[i]) != 0)
+        {
+            log_error("pthread_create() fail for net io thread, idx=%d", i);
+            sc_threads_cnt = i;
+            break;
+        }
+    }
+    log_prompt("net io threads: %d", sc_threads_cnt);
+    return 0;
+}
+
+int nio_active()
+{
+    return sc_threads_cnt > 1;
+}
+
+static void add_client(nio_thread *t, redisClient *c)
+{
+    if (t->cnt == t->cap)
+    {
+        t->cap = t->cap ? t->cap * 2 : 64;
+        t->clients = zrealloc(t->clients, sizeof(redisClient *) * t->cap);
+    }
+    t->clients[t->cnt++] = c;
+}
+
+void nio_run(list *clients, int op)
+{
+    const int cnt = listLength(clients);
+    if (cnt == 0)
+    {
+        return;
+    }
+
+    const int n = cnt < sc_threads_cnt * NIO_MIN_CLIENTS_PER_THREAD ? 1 : sc_threads_cnt;
+    int i;
+    for (i = 0; i < sc_threads_cnt; i++)
+    {
+        sc_threads[i].cnt = 0;
+        sc_threads[i].bytes = 0;
+        sc_threads[i].calls = 0;
+    }
+
+    listIter li;
+    listNode *ln;
+    i = 0;
+    listRewind(clients, &li);
+    while ((ln = listNext(&li)))
+    {
+        add_client(&sc_threads[i], listNodeValue(ln));
+        i = (i + 1) % n;
+    }
+
+    if (n > 1)
+    {
+        /* every thread takes the batch, ones without clients are done at once */
+        sc_left = sc_threads_cnt - 1;
+        pthread_mutex_lock(&sc_lock);
+        sc_op = op;
+        sc_seq++;
+        pthread_cond_broadcast(&sc_work);
+        pthread_mutex_unlock(&sc_lock);
+    }
+
+    run_batch(&sc_threads[0], op);
+
+    if (n > 1)
+    {
+        /* the batch is short, it's waited for without sleeping,
+         * but a descheduled worker gets the cpu back */
+        int spins = 0;
+        while (sc_left > 0)
+        {
+            if (++spins < NIO_SPINS_BEFORE_YIELD)
+            {
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+            }
+            else
+            {
+                sched_yield();
+            }
+        }
+        __sync_synchronize();
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (op == NIO_OP_READ)
+        {
+            server.bytes_read += sc_threads[i].bytes;
+        }
+        else
+        {
+            server.bytes_written += sc_threads[i].bytes;
+            server.stat_reply_writev += sc_threads[i].calls;
+        }
+    }
+}
+
+int nio_get_stat(nio_thread_stat *st, int max)
+{
+    int i;
+    for (i = 0; i < sc_threads_cnt && i < max; i++)
+    {
+        st[i] = sc_threads[i].stat;
+    }
+    return sc_threads_cnt;
+}
+
+long long nio_uptime_us()
+{
+    return ustime() - sc_start_us;
+}
@@ -0,0 +1,34 @@
+#ifndef _NET_IO_H_
+#define _NET_IO_H_
+
+#include "redis.h"
+
+#define NIO_MAX_THREADS     64
+
+#define NIO_OP_READ         0   /* read the socket and parse a query */
+#define NIO_OP_WRITE        1   /* write the replies */
+
+typedef struct nio_thread_stat_t
+{
+    unsigned long long clients;  /* clients read or written */
+    unsigned long long runs;     /* batches with any client */
+    unsigned long long busy_us;
+} nio_thread_stat;
+
+/* client sockets are read, queries parsed and replies written by
+ * net_io_threads in parallel from beforeSleep, the main thread taking
+ * the first share; commands are still executed by the main thread only,
+ * which waits for the batch to finish before going on */
+extern int nio_init();
+extern int nio_active();
+/* by main thread, op on every client of the list */
+extern void nio_run(list *clients, int op);
+
+/* 1 in the net io threads except the main one */
+extern __thread int nio_worker;
+
+/* ret: threads, at most max stats filled */
+extern int nio_get_stat(nio_thread_stat *st, int max);
+extern long long nio_uptime_us();
+
+#endif /* _NET_IO_H_ */
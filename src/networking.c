@@ -1,8 +1,18 @@
 #include "redis.h"
 #include <sys/uio.h>
+#include <limits.h>
 
 #include "ds_log.h"
 #include "ds_ctrl.h"
+#include "dbe_get.h"
+#include "net_io.h"
+
+/* vectors gathered for one writev() of replies */
+#if defined(IOV_MAX) && IOV_MAX < 1024
+#define REDIS_WRITEV_IOV IOV_MAX
+#else
+#define REDIS_WRITEV_IOV 1024
+#endif
 
 int g_max_fd = 0;
 
@@ -78,32 +88,47 @@ redisClient *createClient(int fd) {
     c->read_only = server.read_only ? 1 : 0;
     c->ds_id = server.ds_key_num;
     c->dbe_get_keys = listCreate();
+    c->dbe_get_pending = 0;
+    c->io_err = 0;
+    c->io_sent = 0;
     c->stat = 0;
     c->recv_dur = 0;
     c->call_dur = 0;
     c->dbe_get_block_dur = 0;
     c->wr_bl_block_dur = 0;
     c->wr_bl_dur = 0;
+    c->bl_wait_seq = 0;
 
     return c;
 }
 
-/* Set the event loop to listen for write events on the client's socket.
- * Typically gets called every time a reply is built. */
+/* Queue the client to have its replies written in beforeSleep, without
+ * a round trip through the event loop. AE_WRITABLE is installed there
+ * only when the socket doesn't take all of them. */
+void queueClientPendingWrite(redisClient *c) {
+    if (!(c->flags & REDIS_PENDING_WRITE)) {
+        c->flags |= REDIS_PENDING_WRITE;
+        listAddNodeHead(server.clients_pending_write,c);
+    }
+}
+
+/* Typically gets called every time a reply is built. */
 int _installWriteEvent(redisClient *c) {
     if (c->fd <= 0)
     {
         log_error("_installWriteEvent() fail because of c->fd=%d", c->fd);
         return REDIS_ERR;
     }
+    if (nio_worker)
+    {
+        /* queued by the main thread after the batch */
+        return REDIS_OK;
+    }
     if (c->bufpos == 0 && listLength(c->reply) == 0 &&
         (c->replstate == REDIS_REPL_NONE ||
-         c->replstate == REDIS_REPL_ONLINE) &&
-        aeCreateFileEvent(server.el, c->fd, AE_WRITABLE,
-        sendReplyToClient, c) == AE_ERR)
+         c->replstate == REDIS_REPL_ONLINE))
     {
-        log_error("_installWriteEvent() fail because of aeCreateFileEvent() fail");
-        return REDIS_ERR;
+        queueClientPendingWrite(c);
     }
     return REDIS_OK;
 }
@@ -752,6 +777,20 @@ void freeClient(redisClient *c)
     redisAssert(ln != NULL);
     listDelNode(server.clients,ln);
 
+    /* Remove from the list of clients to be read by net io threads */
+    if (c->flags & REDIS_PENDING_READ) {
+        ln = listSearchKey(server.clients_pending_read,c);
+        redisAssert(ln != NULL);
+        listDelNode(server.clients_pending_read,ln);
+    }
+
+    /* Remove from the list of clients with replies to flush */
+    if (c->flags & REDIS_PENDING_WRITE) {
+        ln = listSearchKey(server.clients_pending_write,c);
+        redisAssert(ln != NULL);
+        listDelNode(server.clients_pending_write,ln);
+    }
+
     /* Remove from the list of write_bl_clients */
     ln = listSearchKey(server.write_bl_clients,c);
     if (ln)
@@ -786,6 +825,7 @@ void freeClient(redisClient *c)
         server.vm_blocked_clients--;
     }
     listRelease(c->io_keys);
+    unblock_client_on_dbe_get(c);
     listRelease(c->dbe_get_keys);
     /* Master/slave cleanup.
      * Case 1: we lost the connection with a slave. */
@@ -825,58 +865,90 @@ void freeClient(redisClient *c)
     zfree(c);
 }
 
-void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
-    redisClient *c = privdata;
-    int nwritten = 0, totwritten = 0, objlen;
-    robj *o;
-    REDIS_NOTUSED(el);
-    REDIS_NOTUSED(mask);
-
-    while(c->bufpos > 0 || listLength(c->reply)) {
+/* Write as much of the replies of c as the socket takes, gathering c->buf
+ * and the nodes of c->reply into one writev() of up to REDIS_WRITEV_IOV
+ * vectors. Nothing but c is touched, so that it can run in a net io
+ * thread: the nodes sent are counted in *sent and dropped by the main
+ * thread, they may be shared objects.
+ * ret: 0, or errno of a failed write */
+static int writeReplies(redisClient *c, int *sent, unsigned long long *calls,
+                        unsigned long long *bytes) {
+    struct iovec iov[REDIS_WRITEV_IOV];
+    ssize_t nwritten = 0;
+    size_t batch = 0;
+    int totwritten = 0;
+    listNode *head = listFirst(c->reply); /* the first node not sent entirely */
+
+    *sent = 0;
+    while(c->bufpos > 0 || head) {
+        int iovcnt = 0;
+        int sentlen = c->sentlen;
+        listNode *ln;
+
+        batch = 0;
         if (c->bufpos > 0) {
-            if (c->flags & REDIS_MASTER) {
-                /* Don't reply to a master */
-                nwritten = c->bufpos - c->sentlen;
-            } else {
-                nwritten = write(fd,c->buf+c->sentlen,c->bufpos-c->sentlen);
-                if (nwritten <= 0) break;
-                server.bytes_written += nwritten;
+            iov[iovcnt].iov_base = c->buf+sentlen;
+            iov[iovcnt].iov_len = c->bufpos-sentlen;
+            batch += iov[iovcnt++].iov_len;
+            sentlen = 0;
+        }
+        for (ln = head;
+             ln && iovcnt < REDIS_WRITEV_IOV && batch < REDIS_MAX_WRITE_PER_EVENT;
+             ln = listNextNode(ln))
+        {
+            robj *o = listNodeValue(ln);
+            size_t objlen = sdslen(o->ptr);
+
+            /* c->sentlen counts for the head only, when c->buf is empty */
+            if (objlen > (size_t)sentlen) {
+                iov[iovcnt].iov_base = ((char*)o->ptr)+sentlen;
+                iov[iovcnt].iov_len = objlen-sentlen;
+                batch += iov[iovcnt++].iov_len;
             }
-            c->sentlen += nwritten;
-            totwritten += nwritten;
+            sentlen = 0;
+        }
 
-            /* If the buffer was sent, set bufpos to zero to continue with
-             * the remainder of the reply. */
-            if (c->sentlen == c->bufpos) {
-                c->bufpos = 0;
-                c->sentlen = 0;
-            }
+        if (c->flags & REDIS_MASTER) {
+            /* Don't reply to a master */
+            nwritten = batch;
+        } else if (iovcnt > 0) {
+            nwritten = writev(c->fd,iov,iovcnt);
+            (*calls)++;
+            if (nwritten <= 0) break;
+            *bytes += nwritten;
         } else {
-            o = listNodeValue(listFirst(c->reply));
-            objlen = sdslen(o->ptr);
-
-            if (objlen == 0) {
-                listDelNode(c->reply,listFirst(c->reply));
-                continue;
-            }
+            nwritten = 0;
+        }
+        totwritten += nwritten;
 
-            if (c->flags & REDIS_MASTER) {
-                /* Don't reply to a master */
-                nwritten = objlen - c->sentlen;
+        /* Skip what was sent, the rest is sent from c->sentlen of head */
+        size_t left = nwritten;
+        if (c->bufpos > 0) {
+            if (left < (size_t)(c->bufpos-c->sentlen)) {
+                c->sentlen += left;
+                left = 0;
             } else {
-                nwritten = write(fd, ((char*)o->ptr)+c->sentlen,objlen-c->sentlen);
-                if (nwritten <= 0) break;
-                server.bytes_written += nwritten;
+                left -= c->bufpos-c->sentlen;
+                c->bufpos = 0;
+                c->sentlen = 0;
             }
-            c->sentlen += nwritten;
-            totwritten += nwritten;
+        }
+        while(c->bufpos == 0 && head) {
+            robj *o = listNodeValue(head);
+            size_t rest = sdslen(o->ptr)-c->sentlen;
 
-            /* If we fully sent the object on head go to the next one */
-            if (c->sentlen == objlen) {
-                listDelNode(c->reply,listFirst(c->reply));
-                c->sentlen = 0;
+            if (left < rest) {
+                c->sentlen += left;
+                break;
             }
+            left -= rest;
+            c->sentlen = 0;
+            head = listNextNode(head);
+            (*sent)++;
         }
+
+        /* The socket buffer is full, wait for it to drain. */
+        if ((size_t)nwritten < batch) break;
         /* Note that we avoid to send more thank REDIS_MAX_WRITE_PER_EVENT
          * bytes, in a single threaded server it's a good idea to serve
          * other clients as well, even if a very large request comes from
@@ -884,24 +956,101 @@ void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
          * scenario think about 'KEYS *' against the loopback interfae) */
         if (totwritten > REDIS_MAX_WRITE_PER_EVENT) break;
     }
-    if (nwritten == -1) {
-        if (errno == EAGAIN) {
-            nwritten = 0;
-        } else {
-            redisLog(REDIS_VERBOSE,
-                "Error writing to client: %s", strerror(errno));
-            freeClient(c);
-            return;
-        }
-    }
     if (totwritten > 0) c->lastinteraction = time(NULL);
+    if (nwritten == -1 && errno != EAGAIN) return errno;
+    return 0;
+}
+
+/* The part of writeToClient() after the writes, by the main thread.
+ * ret: REDIS_ERR if the client was freed */
+static int afterWrite(redisClient *c, int err, int sent, int handler_installed) {
+    while (sent--) listDelNode(c->reply,listFirst(c->reply));
+
+    if (err) {
+        redisLog(REDIS_VERBOSE,
+            "Error writing to client: %s", strerror(err));
+        freeClient(c);
+        return REDIS_ERR;
+    }
     if (c->bufpos == 0 && listLength(c->reply) == 0) {
         c->sentlen = 0;
-        aeDeleteFileEvent(server.el,c->fd,AE_WRITABLE);
+        if (handler_installed) aeDeleteFileEvent(server.el,c->fd,AE_WRITABLE);
 
         /* Close connection after entire reply has been sent. */
-        if (c->flags & REDIS_CLOSE_AFTER_REPLY) freeClient(c);
+        if (c->flags & REDIS_CLOSE_AFTER_REPLY) {
+            freeClient(c);
+            return REDIS_ERR;
+        }
     }
+    return REDIS_OK;
+}
+
+void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
+    redisClient *c = privdata;
+    int sent, err;
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(fd);
+    REDIS_NOTUSED(mask);
+
+    err = writeReplies(c,&sent,&server.stat_reply_writev,&server.bytes_written);
+    afterWrite(c,err,sent,1);
+}
+
+/* NIO_OP_WRITE of a net io thread, the result is left in c->io_err and
+ * c->io_sent for the main thread. ret: bytes written */
+int ioWriteClient(redisClient *c, unsigned long long *calls) {
+    unsigned long long bytes = 0;
+
+    c->io_err = writeReplies(c,&c->io_sent,calls,&bytes);
+    return (int)bytes;
+}
+
+/* Called from beforeSleep: write the replies of the clients queued by
+ * _installWriteEvent() directly, by the net io threads when enabled.
+ * AE_WRITABLE is installed only for the clients the socket didn't take
+ * entirely. ret: clients processed */
+int handleClientsWithPendingWrites(void) {
+    listIter li;
+    listNode *ln;
+    int processed = listLength(server.clients_pending_write);
+
+    if (processed == 0) return 0;
+
+    /* Held until its binlog is synced, unblock_client_on_bl_sync()
+     * queues it again. */
+    listRewind(server.clients_pending_write,&li);
+    while((ln = listNext(&li))) {
+        redisClient *c = listNodeValue(ln);
+        if (c->flags & REDIS_WR_BL_WAIT) {
+            c->flags &= ~REDIS_PENDING_WRITE;
+            listDelNode(server.clients_pending_write,ln);
+        }
+    }
+
+    nio_run(server.clients_pending_write,NIO_OP_WRITE);
+
+    /* freeClient() may free others in the list, take the head each time */
+    while(listLength(server.clients_pending_write)) {
+        ln = listFirst(server.clients_pending_write);
+        redisClient *c = listNodeValue(ln);
+        c->flags &= ~REDIS_PENDING_WRITE;
+        listDelNode(server.clients_pending_write,ln);
+
+        if (afterWrite(c,c->io_err,c->io_sent,0) == REDIS_ERR) continue;
+
+        if (c->bufpos == 0 && listLength(c->reply) == 0) {
+            server.stat_reply_direct++;
+        } else {
+            server.stat_reply_handlers++;
+            if (aeCreateFileEvent(server.el,c->fd,AE_WRITABLE,
+                sendReplyToClient,c) == AE_ERR)
+            {
+                log_error("handleClientsWithPendingWrites() fail because of aeCreateFileEvent() fail, fd=%d", c->fd);
+                freeClient(c);
+            }
+        }
+    }
+    return processed;
 }
 
 /* resetClient prepare the client to process the next command */
@@ -1144,7 +1293,7 @@ int processMultibulkBuffer(redisClient *c)
 
 void processInputBuffer(redisClient *c) {
     /* Keep processing while there is something in the input buffer */
-    while(sdslen(c->querybuf)) {
+    while(sdslen(c->querybuf) || (c->flags & REDIS_PENDING_COMMAND)) {
         /* Immediately abort if the client is in the middle of something. */
         if (c->flags & REDIS_BLOCKED || c->flags & REDIS_IO_WAIT) return;
         if (c->flags & REDIS_DBE_GET_WAIT || c->flags & REDIS_WR_BL_WAIT) return;
@@ -1154,24 +1303,35 @@ void processInputBuffer(redisClient *c) {
          * this flag has been set (i.e. don't process more commands). */
         if (c->flags & REDIS_CLOSE_AFTER_REPLY) return;
 
-        /* Determine request type when unknown. */
-        if (!c->reqtype) {
-            g_tid = c->tid = alloc_new_tid();
-            redisLog(REDIS_DEBUG, "tid=%d, fd=%d", c->tid, c->fd);
-            c->req_len = 0;
-            if (c->querybuf[0] == '*') {
-                c->reqtype = REDIS_REQ_MULTIBULK;
+        if (c->flags & REDIS_PENDING_COMMAND) {
+            /* Parsed by a net io thread already. */
+            c->flags &= ~REDIS_PENDING_COMMAND;
+        } else {
+            /* Determine request type when unknown. */
+            if (!c->reqtype) {
+                c->tid = -1;
+                c->req_len = 0;
+                if (c->querybuf[0] == '*') {
+                    c->reqtype = REDIS_REQ_MULTIBULK;
+                } else {
+                    c->reqtype = REDIS_REQ_INLINE;
+                }
+            }
+
+            if (c->reqtype == REDIS_REQ_INLINE) {
+                if (processInlineBuffer(c) != REDIS_OK) break;
+            } else if (c->reqtype == REDIS_REQ_MULTIBULK) {
+                if (processMultibulkBuffer(c) != REDIS_OK) break;
             } else {
-                c->reqtype = REDIS_REQ_INLINE;
+                redisPanic("Unknown request type");
             }
         }
 
-        if (c->reqtype == REDIS_REQ_INLINE) {
-            if (processInlineBuffer(c) != REDIS_OK) break;
-        } else if (c->reqtype == REDIS_REQ_MULTIBULK) {
-            if (processMultibulkBuffer(c) != REDIS_OK) break;
-        } else {
-            redisPanic("Unknown request type");
+        /* The request type may have been determined by a net io thread,
+         * tids are allocated by the main thread only. */
+        if (c->tid == -1) {
+            g_tid = c->tid = alloc_new_tid();
+            redisLog(REDIS_DEBUG, "tid=%d, fd=%d", c->tid, c->fd);
         }
 
         /* Multibulk processing could see a <= 0 length. */
@@ -1188,41 +1348,78 @@ void processInputBuffer(redisClient *c) {
     }
 }
 
-void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
-    redisClient *c = (redisClient*) privdata;
+/* Read the socket of c into c->querybuf, it can run in a net io thread:
+ * a failure is left in c->io_err for the main thread.
+ * ret: bytes read */
+int ioReadQuery(redisClient *c) {
     char buf[REDIS_IOBUF_LEN];
     int nread;
-    REDIS_NOTUSED(el);
-    REDIS_NOTUSED(mask);
 
-    if (c->flags & REDIS_DBE_GET_WAIT) return;
+    c->io_err = 0;
     if (c->stat != 2)
     {
         c->start_time = server.ustime;
     }
 
-    nread = read(fd, buf, REDIS_IOBUF_LEN);
+    nread = read(c->fd, buf, REDIS_IOBUF_LEN);
     if (nread == -1) {
-        if (errno == EAGAIN) {
-            nread = 0;
-        } else {
-            redisLog(REDIS_VERBOSE, "Reading from client: %s",strerror(errno));
-            freeClient(c);
-            return;
-        }
+        if (errno != EAGAIN) c->io_err = errno;
+        return 0;
     } else if (nread == 0) {
-        redisLog(REDIS_VERBOSE, "Client closed connection, fd=%d", fd);
-        freeClient(c);
+        c->io_err = -1;
+        return 0;
+    }
+    //const size_t querybuf_len = sdslen(c->querybuf);
+    c->querybuf = sdscatlen(c->querybuf,buf,nread);
+    //redisLog(REDIS_DEBUG, "read() %d from %d, %d -> %d", nread, fd, querybuf_len, sdslen(c->querybuf));
+    c->lastinteraction = time(NULL);
+    return nread;
+}
+
+/* Parse the first request of c->querybuf in a net io thread, argv is
+ * executed by processInputBuffer() later with REDIS_PENDING_COMMAND. */
+void ioParseQuery(redisClient *c) {
+    if (c->flags & (REDIS_BLOCKED|REDIS_IO_WAIT|REDIS_DBE_GET_WAIT|
+                    REDIS_WR_BL_WAIT|REDIS_CLOSE_AFTER_REPLY|REDIS_PENDING_COMMAND))
         return;
+    if (sdslen(c->querybuf) == 0 ||
+        sdslen(c->querybuf) > server.client_max_querybuf_len) return;
+    /* A protocol error is replied by the parser, only into an empty c->buf
+     * here: a reply list may hold shared objects. */
+    if (c->bufpos || listLength(c->reply)) return;
+
+    if (!c->reqtype) {
+        c->tid = -1;
+        c->req_len = 0;
+        c->reqtype = c->querybuf[0] == '*' ? REDIS_REQ_MULTIBULK : REDIS_REQ_INLINE;
     }
-    if (nread) {
-        //const size_t querybuf_len = sdslen(c->querybuf);
-        c->querybuf = sdscatlen(c->querybuf,buf,nread);
-        server.bytes_read += nread;
-        //redisLog(REDIS_DEBUG, "read() %d from %d, %d -> %d", nread, fd, querybuf_len, sdslen(c->querybuf));
-        c->lastinteraction = time(NULL);
+    if (c->reqtype == REDIS_REQ_INLINE) {
+        if (processInlineBuffer(c) != REDIS_OK) return;
     } else {
-        return;
+        if (processMultibulkBuffer(c) != REDIS_OK) return;
+    }
+
+    if (c->argc > 0) {
+        c->flags |= REDIS_PENDING_COMMAND;
+    } else {
+        /* Multibulk processing could see a <= 0 length. */
+        c->reqtype = 0;
+        c->multibulklen = 0;
+        c->bulklen = -1;
+    }
+}
+
+/* The part of readQueryFromClient() after the read, by the main thread.
+ * ret: REDIS_ERR if the client was freed */
+static int afterRead(redisClient *c) {
+    if (c->io_err == -1) {
+        redisLog(REDIS_VERBOSE, "Client closed connection, fd=%d", c->fd);
+        freeClient(c);
+        return REDIS_ERR;
+    } else if (c->io_err) {
+        redisLog(REDIS_VERBOSE, "Reading from client: %s",strerror(c->io_err));
+        freeClient(c);
+        return REDIS_ERR;
     }
     if (sdslen(c->querybuf) > server.client_max_querybuf_len) {
         sds ci = getClientInfoString(c), bytes = sdsempty();
@@ -1232,8 +1429,33 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
         sdsfree(ci);
         sdsfree(bytes);
         freeClient(c);
+        return REDIS_ERR;
+    }
+    return REDIS_OK;
+}
+
+void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
+    redisClient *c = (redisClient*) privdata;
+    int nread;
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(fd);
+    REDIS_NOTUSED(mask);
+
+    if (c->flags & REDIS_DBE_GET_WAIT) return;
+
+    /* With net io threads, the socket is read in beforeSleep. */
+    if (nio_active() && !(c->flags & (REDIS_MASTER|REDIS_SLAVE))) {
+        if (!(c->flags & REDIS_PENDING_READ)) {
+            c->flags |= REDIS_PENDING_READ;
+            listAddNodeTail(server.clients_pending_read,c);
+        }
         return;
     }
+
+    nread = ioReadQuery(c);
+    server.bytes_read += nread;
+    if (afterRead(c) == REDIS_ERR || nread == 0) return;
+
     g_tid = c->tid;
     g_tag = c->master;
     processInputBuffer(c);
@@ -1241,6 +1463,39 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
     g_tag = -1;
 }
 
+/* Called from beforeSleep: read the sockets of the clients queued by
+ * readQueryFromClient() and parse their first request by the net io
+ * threads, then execute the commands. ret: clients processed */
+int handleClientsWithPendingReads(void) {
+    listNode *ln;
+    int processed = listLength(server.clients_pending_read);
+
+    if (processed == 0) return 0;
+
+    nio_run(server.clients_pending_read,NIO_OP_READ);
+
+    /* A command may free others in the list, take the head each time */
+    while(listLength(server.clients_pending_read)) {
+        ln = listFirst(server.clients_pending_read);
+        redisClient *c = listNodeValue(ln);
+        c->flags &= ~REDIS_PENDING_READ;
+        listDelNode(server.clients_pending_read,ln);
+
+        if (afterRead(c) == REDIS_ERR) continue;
+
+        /* A protocol error replied by a net io thread isn't queued. */
+        if ((c->bufpos || listLength(c->reply)) &&
+            !(c->flags & REDIS_PENDING_WRITE)) queueClientPendingWrite(c);
+
+        g_tid = c->tid;
+        g_tag = c->master;
+        processInputBuffer(c);
+        g_tid = -1;
+        g_tag = -1;
+    }
+    return processed;
+}
+
 void getClientsMaxBuffers(unsigned long *longest_output_list,
                           unsigned long *biggest_input,
                           unsigned long *biggest_input_buffer)
@@ -50,7 +50,7 @@ void initObject(robj *o, int type, void *ptr)
      * and accessing server.lruclock in theory is an error
      * (no locks). But in practice this is safe, and even if we read
      * garbage Redis will not fail. */
-    o->lru = server.lruclock;
+    o->lru = objectInitLRU();
     /* The following is only needed if VM is active, but since the conditional
      * is probably more costly than initializing the field it's better to
      * have every field properly initialized anyway. */
@@ -755,6 +755,61 @@ unsigned long estimateObjectIdleTime(robj *o) {
     }
 }
 
+/* ---------------------------- LFU ------------------------------------- */
+
+static unsigned long LFUGetTimeInMinutes(void) {
+    return (server.unixtime/60) & REDIS_LFU_TIME_MAX;
+}
+
+/* minutes since ldt, with a single wrap around */
+static unsigned long LFUTimeElapsed(unsigned long ldt) {
+    unsigned long now = LFUGetTimeInMinutes();
+    if (now >= ldt) return now-ldt;
+    return REDIS_LFU_TIME_MAX-ldt+now+1;
+}
+
+/* The counter grows with a probability of 1/((counter-init)*factor+1),
+ * it saturates at 255 after about a million hits with factor 10. */
+static uint8_t LFULogIncr(uint8_t counter) {
+    if (counter == 255) return 255;
+    double r = (double)rand()/RAND_MAX;
+    double baseval = counter - REDIS_LFU_INIT_VAL;
+    if (baseval < 0) baseval = 0;
+    double p = 1.0/(baseval*server.lfu_log_factor+1);
+    if (r < p) counter++;
+    return counter;
+}
+
+/* The counter decreased by the periods of lfu_decay_time elapsed since
+ * the last decrement. The object is not updated. */
+unsigned long LFUDecrAndReturn(robj *o) {
+    unsigned long ldt = o->lru >> 8;
+    unsigned long counter = o->lru & 255;
+    unsigned long num_periods = server.lfu_decay_time ?
+        LFUTimeElapsed(ldt) / server.lfu_decay_time : 0;
+    if (num_periods)
+        counter = (num_periods > counter) ? 0 : counter - num_periods;
+    return counter;
+}
+
+/* obj->lru of a new object for the current maxmemory policy */
+unsigned int objectInitLRU(void) {
+    if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy))
+        return (LFUGetTimeInMinutes()<<8) | REDIS_LFU_INIT_VAL;
+    return server.lruclock;
+}
+
+/* Call on every access of a value */
+void updateObjectAccess(robj *o) {
+    if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+        unsigned long counter = LFUDecrAndReturn(o);
+        counter = LFULogIncr(counter);
+        o->lru = (LFUGetTimeInMinutes()<<8) | counter;
+    } else {
+        o->lru = server.lruclock;
+    }
+}
+
 /* This is an helper function for the DEBUG command. We need to lookup keys
  * without any modification of LRU or other parameters. */
 robj *objectCommandLookup(redisClient *c, robj *key) {
@@ -788,9 +843,21 @@ void objectCommand(redisClient *c) {
     } else if (!strcasecmp(c->argv[1]->ptr,"idletime") && c->argc == 3) {
         if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.nullbulk))
                 == NULL) return;
+        if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+            addReplyError(c,"An LFU maxmemory policy is selected, idle time not tracked.");
+            return;
+        }
         addReplyLongLong(c,estimateObjectIdleTime(o));
+    } else if (!strcasecmp(c->argv[1]->ptr,"freq") && c->argc == 3) {
+        if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.nullbulk))
+                == NULL) return;
+        if (!REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+            addReplyError(c,"An LFU maxmemory policy is not selected, access frequency not tracked.");
+            return;
+        }
+        addReplyLongLong(c,LFUDecrAndReturn(o));
     } else {
-        addReplyError(c,"Syntax error. Try OBJECT (refcount|encoding|idletime)");
+        addReplyError(c,"Syntax error. Try OBJECT (refcount|encoding|idletime|freq)");
     }
 }
 
@@ -4,6 +4,7 @@
 #include "ds_log.h"
 
 #include "codec_key.h"
+#include "serialize.h"
 
 #include <string.h>
 #include <ctype.h>
@@ -172,6 +173,28 @@ static void op_moveCommand(redisClient *c)
     server.dirty++;
 }
 
+static void op_restoreCommand(redisClient *c)
+{
+    time_t expire = 0;
+    robj *o = unserializeObj(c->argv[2]->ptr, sdslen(c->argv[2]->ptr), &expire);
+    if (o == NULL)
+    {
+        log_error("unserializeObj() fail, key=%s", (char *)c->argv[1]->ptr);
+        return;
+    }
+
+    if (lookupKeyWrite(c->db, c->argv[1]) != NULL)
+    {
+        dbDelete(c->db, c->argv[1]);
+    }
+    dbAdd(c->db, c->argv[1], o);
+    if (expire > 0)
+    {
+        setExpire(c->db, c->argv[1], expire);
+    }
+    server.dirty++;
+}
+
 
 typedef void opCommandProc(redisClient *c);
 typedef struct opCommand_st
@@ -225,7 +248,8 @@ static opCommandMap cmdmap_tab[] =
     , {OP_LSET, op_lsetCommand, KEY_TYPE_LIST}                   // 28
     , {OP_LTRIM, op_ltrimCommand, KEY_TYPE_LIST}                 // 29
     , {OP_MOVE, op_moveCommand, 'k'}                             // 30
-//    , {OP_PSETEX, op_psetexCommand, '-'}                         // 31
+    , {OP_RESTORE, op_restoreCommand, 'k'}                       // 31
+//    , {OP_PSETEX, op_psetexCommand, '-'}                         // 32
 };
 
 const int ci_num = sizeof(cmdmap_tab) / sizeof(cmdmap_tab[0]);
@@ -332,7 +356,8 @@ int redo_op(redisDb *rdb, const robj *key, unsigned char cmd, int argc, robj **a
 
 int is_entirety_cmd(int cmd)
 {
-    if (cmd == OP_CMD_SET || cmd == OP_CMD_SETEX || cmd == OP_CMD_CAS || cmd == OP_CMD_DEL)
+    if (cmd == OP_CMD_SET || cmd == OP_CMD_SETEX || cmd == OP_CMD_CAS || cmd == OP_CMD_DEL
+        || cmd == OP_CMD_RESTORE)
     {
         return 1;
     }
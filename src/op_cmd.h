@@ -8,6 +8,7 @@
 #define OP_CMD_SETEX             2
 #define OP_CMD_DEL               8
 #define OP_CMD_CAS               9
+#define OP_CMD_RESTORE          31
 
 /* expire_time field in binlog is expressed to timestamp form */
 
@@ -30,6 +31,8 @@
 #define OP_FLUSHDB           "flushdb"
 #define OP_RENAME            "rename"
 #define OP_MOVE              "move"
+/* restore: cmd + key + serialized value with expire */
+#define OP_RESTORE           "restore"
 
 /* hash category */
 #define OP_HDEL              "hdel"
@@ -0,0 +1,288 @@
+#include "rebalance.h"
+#include "dbmng.h"
+#include "op_cmd.h"
+#include "key_filter.h"
+#include "serialize.h"
+#include "ds_log.h"
+
+/* the dicts may be rehashed while the walk is paused, keys moved to a
+ * bucket already passed are found by one more pass */
+#define RB_MAX_PASSES   3
+/* ustime() is checked once every so many buckets */
+#define RB_CHECK_BUCKETS    16
+
+static dictIterator *sc_it = 0;
+static int sc_db_id = 0;
+static int sc_pass = 0;
+static unsigned long long sc_pass_moved = 0;
+/* keys failed to be queued in this pass */
+static unsigned long long sc_pass_failed = 0;
+static long long sc_start_ms = 0;
+
+/* keys of the bucket being handled, the chain changes when keys are deleted */
+static sds *sc_keys = 0;
+static int sc_keys_size = 0;
+
+static rb_stat sc_stat;
+
+/* no binlog file of a pure cache or pure dbe master without wr_bl,
+ * see dbmng_save_op() and write_binlog_file() */
+static int binlog_on()
+{
+    return !(server.is_slave == 0
+             && ((server.has_cache == 1 && server.has_dbe == 0)
+                 || (server.has_cache == 0 && server.has_dbe == 1))
+             && server.wr_bl == 0);
+}
+
+static void round_start()
+{
+    if (sc_it)
+    {
+        /* doing, cancel and redo it with the new ip list */
+        dictReleaseIterator(sc_it);
+        sc_it = 0;
+    }
+
+    unsigned long total_slot = 0;
+    const unsigned long long rounds = sc_stat.rounds;
+    int i;
+    memset(&sc_stat, 0, sizeof(sc_stat));
+    sc_stat.rounds = rounds + 1;
+    for (i = 0; i < server.dbnum; i++)
+    {
+        total_slot += dictSlots(server.db[i].dict);
+        sc_stat.total_keys += dictSize(server.db[i].dict);
+    }
+    sc_stat.state = RB_STATE_RUNNING;
+    sc_db_id = 0;
+    sc_pass = 0;
+    sc_pass_moved = 0;
+    sc_pass_failed = 0;
+    sc_start_ms = server.mstime;
+
+    redisLog(REDIS_PROMPT, "start rebalance: round=%llu, db_num=%d, slots=%lu, keys=%llu, binlog=%d"
+            , sc_stat.rounds, server.dbnum, total_slot, sc_stat.total_keys, binlog_on());
+}
+
+static void round_over()
+{
+    sc_stat.state = RB_STATE_DONE;
+    sc_stat.elapsed_ms = server.mstime - sc_start_ms;
+    sc_stat.keys_ps = sc_stat.elapsed_ms > 0 ? sc_stat.scanned * 1000 / sc_stat.elapsed_ms : 0;
+
+    redisLog(REDIS_PROMPT
+            , "finish rebalance: passes=%d, scanned=%llu, migrated=%llu, spilled=%llu"
+              ", kept=%llu, evicted=%llu, dropped=%llu, dur=%lldms"
+            , sc_pass, sc_stat.scanned, sc_stat.migrated, sc_stat.spilled
+            , sc_stat.kept, sc_stat.evicted, sc_stat.dropped, sc_stat.elapsed_ms);
+}
+
+/* write the key into binlog as a RESTORE record, then evict it
+ * return: 1 - evicted, 0 - kept in rdb */
+static int move_key(redisDb *db, robj *key, robj *val)
+{
+    const time_t expire = getExpire(db, key);
+    if (expire != -1 && expire <= server.unixtime)
+    {
+        /* expired, nothing to move */
+    }
+    else if (binlog_on())
+    {
+        if (server.has_dbe && val->type != REDIS_STRING)
+        {
+            /* a RESTORE of a collection isn't put into dbe, see
+             * write_binlog_file(), it stays here */
+            sc_stat.kept++;
+            log_debug("rebalance: keep collection, type=%d, key=%s"
+                    , val->type, (char *)key->ptr);
+            return 0;
+        }
+        int len = 0;
+        char *buf = serializeObjExp(val, &len, expire == -1 ? 0 : expire);
+        robj *arg = buf ? createStringObject(buf, len) : 0;
+        zfree(buf);
+        const int ret = arg ? dbmng_save_op(0, OP_RESTORE, key, 1, &arg, server.ds_key_num, db->id) : -1;
+        if (arg)
+        {
+            decrRefCount(arg);
+        }
+        if (ret == 0)
+        {
+            sc_stat.migrated++;
+        }
+        else if (server.has_dbe)
+        {
+            /* not queued, dbe doesn't have it yet, retried by next pass */
+            sc_stat.kept++;
+            sc_pass_failed++;
+            log_error("rebalance: fail to migrate, keep it, key=%s", (char *)key->ptr);
+            return 0;
+        }
+        else
+        {
+            sc_stat.dropped++;
+            log_error("rebalance: fail to migrate, key=%s", (char *)key->ptr);
+        }
+    }
+    else if (server.has_dbe)
+    {
+        /* a pure dbe master, dbe has all of it */
+        sc_stat.spilled++;
+    }
+    else
+    {
+        sc_stat.dropped++;
+    }
+
+    dbDelete(db, key);
+    sc_stat.evicted++;
+    return 1;
+}
+
+/* handle a whole hash link */
+static void handle_bucket(redisDb *db, dictEntry *de)
+{
+    int cnt = 0;
+    int i;
+    for (; de; de = de->next)
+    {
+        if (cnt == sc_keys_size)
+        {
+            sc_keys_size = sc_keys_size ? sc_keys_size * 2 : 16;
+            sc_keys = zrealloc(sc_keys, sc_keys_size * sizeof(sds));
+        }
+        sc_keys[cnt++] = dictGetEntryKey(de);
+    }
+
+    if (cnt > 10)
+    {
+        redisLog(REDIS_NOTICE, "link_size=%d", cnt);
+    }
+
+    /* keys are checked before any of them is deleted */
+    int moving = 0;
+    for (i = 0; i < cnt; i++)
+    {
+        sc_stat.scanned++;
+        if (master_filter(sc_keys[i]) != 0)
+        {
+            sc_keys[moving++] = sc_keys[i];
+        }
+    }
+
+    for (i = 0; i < moving; i++)
+    {
+        robj k;
+        initObject(&k, REDIS_STRING, sc_keys[i]);
+        de = dictFind(db->dict, k.ptr);
+        if (de && move_key(db, &k, dictGetEntryVal(de)))
+        {
+            sc_pass_moved++;
+        }
+    }
+}
+
+/* return: 1 - all db are walked */
+static int walk(long long deadline)
+{
+    int cnt = 0;
+    for (;;)
+    {
+        redisDb *db = &server.db[sc_db_id];
+        if (sc_it == 0)
+        {
+            sc_it = dictGetIterator(db->dict);
+            if (sc_it == 0)
+            {
+                redisLog(REDIS_WARNING, "dictGetIterator() fail for db_id=%d", sc_db_id);
+                return 0;
+            }
+        }
+
+        int finish;
+        dictEntry *de = dictNextFY(sc_it, &finish);
+        if (de)
+        {
+            handle_bucket(db, de);
+        }
+        else if (finish)
+        {
+            /* db over */
+            dictReleaseIterator(sc_it);
+            sc_it = 0;
+            sc_db_id = (sc_db_id + 1) % server.dbnum;
+            if (sc_db_id == 0)
+            {
+                return 1;
+            }
+        }
+
+        if (++cnt % RB_CHECK_BUCKETS == 0 && ustime() >= deadline)
+        {
+            return 0;
+        }
+    }
+}
+
+int rb_cron(long long deadline)
+{
+    if (server.ip_list_changed == 1)
+    {
+        server.ip_list_changed = 0;
+        round_start();
+    }
+
+    if (sc_stat.state != RB_STATE_RUNNING || server.rebalance_budget_us <= 0)
+    {
+        return 0;
+    }
+
+    const long long own = ustime() + server.rebalance_budget_us;
+    if (own < deadline)
+    {
+        deadline = own;
+    }
+    while (walk(deadline))
+    {
+        sc_pass++;
+        if ((sc_pass_moved == 0 && sc_pass_failed == 0) || sc_pass >= RB_MAX_PASSES)
+        {
+            round_over();
+            return 1;
+        }
+        sc_pass_moved = 0;
+        sc_pass_failed = 0;
+        if (ustime() >= deadline)
+        {
+            break;
+        }
+    }
+
+    sc_stat.elapsed_ms = server.mstime - sc_start_ms;
+    sc_stat.keys_ps = sc_stat.elapsed_ms > 0 ? sc_stat.scanned * 1000 / sc_stat.elapsed_ms : 0;
+    return 1;
+}
+
+int rb_running()
+{
+    return sc_stat.state == RB_STATE_RUNNING;
+}
+
+void rb_get_stat(rb_stat *st)
+{
+    *st = sc_stat;
+}
+
+const char *rb_state_str(int state)
+{
+    switch (state)
+    {
+    case RB_STATE_RUNNING:
+        return "running";
+    case RB_STATE_DONE:
+        return "done";
+    default:
+        return "idle";
+    }
+}
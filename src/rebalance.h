@@ -0,0 +1,43 @@
+#ifndef _REBALANCE_H_
+#define _REBALANCE_H_
+
+#include "redis.h"
+
+/* move the keys which no longer belong here after the ip list changed:
+ * rb_cron() walks the dicts bucket by bucket within rebalance_budget_us
+ * per serverCron, a departing key is written into binlog as a RESTORE
+ * record carrying its serialized value, the peers syncing from here get it
+ * by the ds_key filter of the sync, and a string is put into the local dbe
+ * again with it, then the key is evicted from rdb without DEL record;
+ * with dbe a key is evicted only after its RESTORE is queued, and a
+ * collection isn't moved as dbe takes a RESTORE of a string only */
+
+#define RB_STATE_IDLE       0
+#define RB_STATE_RUNNING    1
+#define RB_STATE_DONE       2
+
+typedef struct rb_stat_t
+{
+    int state;
+    unsigned long long rounds;     /* walks started by ip list changes */
+    unsigned long long scanned;    /* keys checked in this round */
+    unsigned long long migrated;   /* RESTORE records written */
+    unsigned long long spilled;    /* kept only in local dbe */
+    unsigned long long kept;       /* not moved, left in rdb */
+    unsigned long long evicted;    /* keys removed from rdb */
+    unsigned long long dropped;    /* evicted without any copy */
+    unsigned long long keys_ps;    /* scanned keys per second */
+    unsigned long long total_keys; /* keys in rdb when the round started */
+    long long elapsed_ms;
+} rb_stat;
+
+/* call by the housekeeping of serverCron, it stops at deadline (us) or
+ * after rebalance_budget_us
+ * return: 1 - it has run */
+extern int rb_cron(long long deadline);
+extern int rb_running();
+
+extern void rb_get_stat(rb_stat *st);
+extern const char *rb_state_str(int state);
+
+#endif /* _REBALANCE_H_ */
@@ -74,6 +74,12 @@
 #include "ds_binlog.h"
 #include "serialize.h"
 #include "dbe_get.h"
+#include "hot_preload.h"
+#include "miss_filter.h"
+#include "key_migrate.h"
+#include "net_io.h"
+#include "rebalance.h"
+#include "latency_hist.h"
 #include "write_bl.h"
 #include "restore_key.h"
 #include "codec_key.h"
@@ -88,8 +94,10 @@
 #define CONVERT_THREAD_CNT             6
 #define PERSIST_THREAD_CNT             4
 
-static void freeMemoryIfNeededBySelf(void);
-static void clean_more(void);
+static int freeMemoryIfNeededBySelf(long long deadline);
+static int clean_more(long long deadline);
+static void housekeeping(int from_cron);
+static evictionPoolEntry *evictionPoolAlloc(void);
 static int upd_cp_cron(struct aeEventLoop *eventLoop, long long id, void *clientData);
 static int print_dbeinfo_cron(struct aeEventLoop *eventLoop, long long id, void *clientData);
 static int print_info_cron(struct aeEventLoop *eventLoop, long long id, void *clientData);
@@ -115,6 +123,35 @@ static time_t cln_start = 0;
 static pthread_mutex_t sc_clean_lock = PTHREAD_MUTEX_INITIALIZER;
 static unsigned char sc_clean_c = 0;
 
+/* housekeeping run by serverCron and beforeSleep within hk_budget_us,
+ * a command only checks the memory and evicts one key if it is over */
+#define HK_EVICT                       0
+#define HK_CLEAN                       1
+#define HK_REBALANCE                   2
+#define HK_TASK_NUM                    3
+/* the budget is doubled from 1% over db_max_size, up to x8 */
+#define HK_BUDGET_MAX_MULT             8
+/* part of the budget for beforeSleep, only when memory is to be freed */
+#define HK_SLEEP_DIV                   4
+
+typedef struct hk_task_t
+{
+    const char *name;
+    unsigned long long runs; /* calls having done something */
+    unsigned long long us;
+} hk_task;
+
+static hk_task sc_hk_tasks[HK_TASK_NUM] =
+{
+    {"evict", 0, 0}
+    , {"clean", 0, 0}
+    , {"rebalance", 0, 0}
+};
+static unsigned long long sc_hk_ticks = 0;
+static unsigned long long sc_hk_overruns = 0;  /* ticks ending with work left */
+static unsigned long long sc_hk_fg_evicts = 0; /* keys evicted by commands */
+static long long sc_hk_last_budget = 0;
+
 static void do_keydump(const char *dbe_path, int fmt);
 static void do_getkey(const char *dbe_path, const char *key);
 static void do_testkey(const char *dbe_path, const char *key, int max_key, int sample_cnt, int test_type);
@@ -222,6 +259,7 @@ struct redisCommand readonlyCommandTable[] =
     {"select",selectCommand,2,0,NULL,0,0,0,0,0,0,0,0,0,0, 0, 'c'},
     {"move",moveCommand,3,0,NULL,1,1,1,1,1,1,1,1,1,1, 0, 'k'},
     {"rename",renameCommand,3,0,NULL,1,1,1,1,1,1,1,1,1,1, 0, 'k'},
+    {"restore",restoreCommand,3,REDIS_CMD_DENYOOM,NULL,1,1,1,1,1,1,1,1,1,1, 0, 'k'},
     {"renamenx",renamenxCommand,3,0,NULL,1,1,1,1,1,1,1,1,1,1, 0, 'k'},
     {"expire",expireCommand,3,0,NULL,0,0,0,0,0,0,1,1,1,1, 0, 'k'},
     {"expireat",expireatCommand,3,0,NULL,0,0,0,0,0,0,1,1,1,1, 0, 'k'},
@@ -255,6 +293,7 @@ struct redisCommand readonlyCommandTable[] =
     {"clean_cache",cleancacheCommand,2,0,NULL,0,0,0,0,0,0,0,0,0,0, 0, '-'},
     {"clean_dbe",cleandbeCommand,2,0,NULL,0,0,0,0,0,0,0,0,0,0, 0, '-'},
     {"purge_dbe",purgedbeCommand,1,0,NULL,0,0,0,0,0,0,0,0,0,0, 0, '-'},
+    {"migrate_dbe_key",migratedbekeyCommand,1,0,NULL,0,0,0,0,0,0,0,0,0,0, 0, '-'},
     {"decode_bl",decodeblCommand,2,0,NULL,0,0,0,0,0,0,0,0,0,0, 0, '-'},
     {"flushcp",flushcpCommand,1,0,NULL,0,0,0,0,0,0,0,0,0,0, 0, '-'},
 
@@ -277,7 +316,8 @@ struct redisCommand readonlyCommandTable[] =
     {"unwatch",unwatchCommand,1,0,NULL,0,0,0,0,0,0,0,0,0,0, 0, 'c'},
     {"object",objectCommand,-2,0,NULL,0,0,0,0,0,0,0,0,0,0, 0, 'c'},
     {"client",clientCommand,-2,0,NULL,0,0,0,0,0,0,0,0,0,0, 0, 'c'},
-    {"slowlog",slowlogCommand,-2,0,NULL,0,0,0,0,0,0,0,0,0,0, 0, 'c'}
+    {"slowlog",slowlogCommand,-2,0,NULL,0,0,0,0,0,0,0,0,0,0, 0, 'c'},
+    {"latency",latencyCommand,-2,0,NULL,0,0,0,0,0,0,0,0,0,0, 0, 'c'}
 };
 
 /*============================ Utility functions ============================ */
@@ -565,6 +605,26 @@ dictType keylistDictType = {
     dictListDestructor          /* val destructor */
 };
 
+/* Sets of sds strings without vals */
+dictType sdsSetDictType = {
+    dictSdsHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictSdsKeyCompare,          /* key compare */
+    dictSdsDestructor,          /* key destructor */
+    NULL                        /* val destructor */
+};
+
+/* Keys being read from dbe, the val owns the key object */
+dictType dbeGetDictType = {
+    dictObjHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictObjKeyCompare,          /* key compare */
+    NULL,                       /* key destructor */
+    NULL                        /* val destructor */
+};
+
 int htNeedsResize(dict *dict) {
     long long size, used;
 
@@ -617,6 +677,23 @@ void updateDictResizePolicy(void) {
 
 /* ======================= Cron: called every 100 ms ======================== */
 
+/* throughput of replication master threads */
+static void sample_repl_stat(void)
+{
+    repl_master_stat_t rs;
+    repl_get_master_stat(&rs);
+
+    const long long dur = server.mstime - server.repl_sample_ms;
+    if (server.repl_sample_ms > 0 && dur > 0)
+    {
+        server.repl_bytes_ps = (rs.sent_bytes - server.repl_sent_bytes_last) * 1000 / dur;
+        server.repl_recs_ps = (rs.sent_recs - server.repl_sent_recs_last) * 1000 / dur;
+    }
+    server.repl_sent_bytes_last = rs.sent_bytes;
+    server.repl_sent_recs_last = rs.sent_recs;
+    server.repl_sample_ms = server.mstime;
+}
+
 void save_stat_info(int init_flg)
 {
     if (0 != lock_stat_info())
@@ -697,130 +774,6 @@ void save_stat_info(int init_flg)
     unlock_stat_info();
 }
 
-void check_key_validity()
-{
-#if 1
-    static int db_id = 0;
-    static dictIterator *it = 0;
-    static int fin = 1;
-    static int total = 0;
-    static int total_del = 0;
-    static int total_db = 0;
-    static int total_db_del = 0;
-    static time_t start = 0;
-    static time_t start_db = 0;
-
-    if (server.ip_list_changed == 1)
-    {
-        if (it)
-        {
-            // doing, cancel at first and redo it 
-            dictReleaseIterator(it);
-            it = 0;
-        }
-
-        server.ip_list_changed = 0;
-
-        fin = 0;
-        start = server.unixtime;
-        int i = 0;
-        unsigned long total_slot = 0;
-        unsigned long total_key = 0;
-        for (i = 0; i < server.dbnum; i++)
-        {
-            total_slot += dictSlots(server.db[i].dict);
-            total_key += dictSize(server.db[i].dict);
-        }
-        redisLog(REDIS_PROMPT, "start key_checking, db_num=%d, slots=%lu, keys=%lu"
-                , server.dbnum, total_slot, total_key);
-    }
-    else
-    {
-        if (fin == 1)
-        {
-            return;
-        }
-    }
-
-    if (it == 0)
-    {
-        it = dictGetIterator(server.db[db_id].dict);
-        if (it == 0)
-        {
-            redisLog(REDIS_WARNING, "dictGetIterator() fail for db_id=%d", db_id);
-            return;
-        }
-        start_db = server.unixtime;
-        total_db = total_db_del = 0;
-    }
-
-    dictEntry *de = 0;
-    int finish;
-    de = dictNextFY(it, &finish);
-    if (de != NULL)
-    {
-        /* handle the whole hash_link */
-        int link_size = 0;
-        do
-        {
-            dictEntry *next_de = de->next;
-            link_size++;
-            total_db++;
-            sds key = 0;
-            key = (sds)de->key;
-            //redisLog(REDIS_PROMPT, "check db_id=%d, key:%s, de=%p", db_id, key, de);
-            if (0 != master_filter(key))
-            {
-                /* the key not belong to here */
-                robj k;
-                initObject(&k, REDIS_STRING, key);
-                dbDelete(&server.db[db_id], &k);
-
-                total_db_del++;
-
-                redisLog(REDIS_DEBUG
-                     , "key_checking: db_id=%d, index=%ld, "
-                       "table=%d, total=%d, total_del=%d"
-                     , db_id, it->index, it->table, total_db, total_db_del);
-            }
-            de = next_de;
-        } while (de);
-        if (link_size > 10)
-        {
-            redisLog(REDIS_NOTICE, "link_size=%d", link_size);
-        }
-    }
-    else if (finish)
-    {
-        /* db over */
-        dictReleaseIterator(it);
-        it = 0;
-
-        if (total_db)
-        {
-            redisLog(REDIS_NOTICE
-                , "key_checking over: db_id=%d, total=%d, total_del=%d, dur=%lds"
-                , db_id, total_db, total_db_del, server.unixtime - start_db);
-        }
-        total += total_db;
-        total_del += total_db_del;
-
-        db_id = (db_id + 1) % server.dbnum;
-        if (db_id == 0)
-        {
-            /* finish all db */
-            redisLog(REDIS_PROMPT
-                , "finish key_checking: keys=%d, del=%d, dur=%lds"
-                , total, total_del, server.unixtime - start);
-
-            fin = 1;
-            total = 0;
-            total_del = 0;
-        }
-    }
-#endif
-}
-
 void watch_hb_thread()
 {
     int status;
@@ -939,20 +892,12 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
      */
     updateLRUClock();
 
-    check_key_validity();
-    clean_more();
+    housekeeping(1);
     
-    if (loops % 5 == 0)
-    {
-        check_key_validity();
-        clean_more();
-        freeMemoryIfNeededBySelf();
-    }
     if (loops % 10 == 0)
     {
         save_stat_info(0);
-        check_key_validity();
-        clean_more();
+        sample_repl_stat();
         check_dbe_get_timer();
     }
 
@@ -1146,6 +1091,11 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
     listNode *ln;
     redisClient *c;
 
+    /* Read and run the queries of the sockets left to net io threads */
+    handleClientsWithPendingReads();
+
+    housekeeping(0);
+
     /* Awake clients that got all the swapped keys they requested */
     if (server.vm_enabled && listLength(server.io_ready_clients)) {
         listIter li;
@@ -1197,6 +1147,9 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
         }
     }
 
+    /* Write the replies built in this loop before waiting for events */
+    handleClientsWithPendingWrites();
+
 #if 0
     // disable in FooYun
     /* Write the AOF buffer on disk */
@@ -1400,6 +1353,21 @@ void initServerConfig()
     server.auto_purge = 1;
     server.ip_list_changed = 0;
     server.dbe_fsize = 4;
+    server.dbe_get_threads = 2;
+    server.net_io_threads = 1;
+    server.dbe_prefetch_depth = 64;
+    server.dbe_bloom_mb = 64;
+    server.neg_cache_size = 65536;
+    server.neg_cache_ttl = 30;
+    server.preload_threads = 4;
+    server.preload_mem_pct = 90;
+    server.wr_dbe_coalesce_ms = 5;
+    server.wr_dbe_coalesce_max = 4096;
+    server.rebalance_budget_us = 2000;
+    server.hk_budget_us = 3000;
+    server.lfu_log_factor = 10;
+    server.lfu_decay_time = 1;
+    server.binlog_fsync = APPENDFSYNC_EVERYSEC;
 
     server.querybuf_reuse = 1;
     server.mngr_list = 0;
@@ -1410,6 +1378,8 @@ void initServerConfig()
     server.prtcl_redis = 0; // mc
     server.dbe_ver = DBE_VER_HIDB2;
     server.enc_kv = 0; // mc: raw; redis: encode kv
+    server.dbe_key_ver = DBE_KEY_VER_1;
+    server.dbe_key_mixed = 0;
 }
 
 void initServer() 
@@ -1430,13 +1400,23 @@ void initServer()
     server.slaves = listCreate();
     server.monitors = listCreate();
     server.unblocked_clients = listCreate();
+    server.clients_pending_write = listCreate();
+    server.clients_pending_read = listCreate();
     server.repl_slaves = listCreate();
     server.cleans = listCreate();
     server.dbe_get_clients = listCreate();
+    server.dbe_get_inflight = dictCreate(&dbeGetDictType,NULL);
     server.write_bl_clients = listCreate();
     server.bl_writing = listCreate();
     server.wr_bl_list = listCreate();
     server.wr_dbe_list = listCreate();
+    server.handle_bl_depth = server.wr_bl_depth = server.wr_dbe_depth = 0;
+    server.handle_bl_peak = server.wr_bl_peak = server.wr_dbe_peak = 0;
+    server.repl_sent_bytes_last = server.repl_sent_recs_last = 0;
+    server.repl_sample_ms = 0;
+    server.repl_bytes_ps = server.repl_recs_ps = 0;
+    server.bl_enq_seq = 0;
+    server.bl_synced_seq = 0;
     server.dbe_get_clients_cnt = 0;
     server.op_bl_cnt = 0;
     createSharedObjects();
@@ -1496,6 +1476,7 @@ void initServer()
         server.db[j].expires = dictCreate(&keyptrDictType,NULL);
         server.db[j].blocking_keys = dictCreate(&keylistDictType,NULL);
         server.db[j].watched_keys = dictCreate(&keylistDictType,NULL);
+        server.db[j].eviction_pool = evictionPoolAlloc();
         if (server.vm_enabled)
             server.db[j].io_keys = dictCreate(&keylistDictType,NULL);
         server.db[j].id = j;
@@ -1523,6 +1504,18 @@ void initServer()
     server.stat_fork_time = 0;
     server.stat_misses_in_cache = 0;
     server.stat_notify_dbe_get_fail = 0;
+    server.stat_dbe_get_keys = 0;
+    server.stat_dbe_get_shared = 0;
+    server.stat_dbe_prefetch_keys = 0;
+    server.stat_bl_fsyncs = 0;
+    server.stat_bl_groups = 0;
+    server.stat_bl_group_recs = 0;
+    server.stat_wr_dbe_coalesced = 0;
+    server.stat_wr_dbe_issued = 0;
+    server.stat_wr_dbe_skipped = 0;
+    server.stat_evict_pool_stale = 0;
+    server.stat_evict_inflight = 0;
+    server.stat_dbe_inflight_misses = 0;
 
     server.stat_get_cmd = 0;
     server.stat_set_cmd = 0;
@@ -1560,6 +1553,9 @@ void initServer()
 
     server.bytes_read = 0;
     server.bytes_written = 0;
+    server.stat_reply_writev = 0;
+    server.stat_reply_direct = 0;
+    server.stat_reply_handlers = 0;
     server.rejected_conns = 0;
     server.accepting_conns = 1;
 
@@ -1643,11 +1639,12 @@ void call(redisClient *c) {
     redisLog(REDIS_DEBUG,
              "#%d#%d [%s %s ...] argc=%d",
              g_tag, g_tid, c->cmd->name, c->argc > 1 ? c->argv[1]->ptr : "", c->argc);
-    const long long start = server.ustime;
+    /* the cached server.ustime is not updated in the event loop */
+    const long long start = ustime();
     c->cmd->proc(c);
-    //updateCachedTime();
-    c->call_dur = server.ustime - start;
+    c->call_dur = ustime() - start;
     duration = (long long)c->call_dur;
+    lh_record(LH_CALL, duration);
     dirty = server.dirty-dirty;
     slowlogPushEntryIfNeeded(c->argv,c->argc,duration);
 
@@ -1727,9 +1724,10 @@ int processCommand(redisClient *c)
      * keys in the dataset). If there are not the only thing we can do
      * is returning an error. */
 
-    check_key_validity();
-    clean_more();
-    freeMemoryIfNeededBySelf();
+    if (ds_zmalloc_used_memory() > (size_t)server.db_max_size)
+    {
+        sc_hk_fg_evicts += freeMemoryIfNeededBySelf(0);
+    }
 
     if (server.maxmemory) freeMemoryIfNeeded();
     if (server.maxmemory && (c->cmd->flags & REDIS_CMD_DENYOOM) &&
@@ -1812,7 +1810,13 @@ int processCommand(redisClient *c)
             }
         }
 
+        const unsigned long long bl_seq = server.bl_enq_seq;
         call(c);
+        if (cmd->wrbl_flag)
+        {
+            /* hold the reply until the binlog is synced */
+            block_client_on_bl_sync(c, bl_seq);
+        }
     }
     return REDIS_OK;
 }
@@ -1962,6 +1966,18 @@ sds genMCStatInfoString(void)
         "dbeio_del=%llu\n"
         "dbeio_it=%llu\n"
         "notify_dbe_get_fail=%llu\n"
+        "dbe_get_keys=%llu\n"
+        "dbe_get_shared=%llu\n"
+        "dbe_prefetch_keys=%llu\n"
+        "bl_fsyncs=%llu\n"
+        "bl_groups=%llu\n"
+        "bl_group_recs=%llu\n"
+        "wr_dbe_coalesced=%llu\n"
+        "wr_dbe_issued=%llu\n"
+        "wr_dbe_skipped=%llu\n"
+        "evict_pool_stale=%llu\n"
+        "evict_inflight=%llu\n"
+        "dbe_inflight_misses=%llu\n"
         "bl_sync_delay_max=%d\n"
         , server.host
         , server.port
@@ -1995,6 +2011,18 @@ sds genMCStatInfoString(void)
         , server.stat_dbeio_del
         , server.stat_dbeio_it
         , server.stat_notify_dbe_get_fail
+        , server.stat_dbe_get_keys
+        , server.stat_dbe_get_shared
+        , server.stat_dbe_prefetch_keys
+        , server.stat_bl_fsyncs
+        , server.stat_bl_groups
+        , server.stat_bl_group_recs
+        , server.stat_wr_dbe_coalesced
+        , server.stat_wr_dbe_issued
+        , server.stat_wr_dbe_skipped
+        , server.stat_evict_pool_stale
+        , server.stat_evict_inflight
+        , server.stat_dbe_inflight_misses
         , server.bl_sync_delay_max
         );
 
@@ -2101,6 +2129,9 @@ sds genRedisInfoString(void)
         "handle_bl_list_len: %d\r\n"
         "wr_bl_list_len: %d\r\n"
         "wr_dbe_list_len: %d\r\n"
+        "handle_bl_depth: %d(%d)\r\n"
+        "wr_bl_depth: %d(%d)\r\n"
+        "wr_dbe_depth: %d(%d)\r\n"
         "vm_enabled: %d\r\n"
         , server.host
         , server.port
@@ -2154,9 +2185,179 @@ sds genRedisInfoString(void)
         listLength(server.bl_writing),
         listLength(server.wr_bl_list),
         listLength(server.wr_dbe_list),
+        server.handle_bl_depth, server.handle_bl_peak,
+        server.wr_bl_depth, server.wr_bl_peak,
+        server.wr_dbe_depth, server.wr_dbe_peak,
         server.vm_enabled != 0
     );
 
+    mf_stat ms;
+    mf_get_stat(&ms);
+    info = sdscatprintf(info,
+        "miss_filter: %s\r\n"
+        "bloom_bytes: %zu\r\n"
+        "bloom_keys: %llu\r\n"
+        "bloom_negatives: %llu\r\n"
+        "bloom_false_positives: %llu\r\n"
+        "bloom_fp_rate: %.4f\r\n"
+        "neg_cache_keys: %lu\r\n"
+        "neg_cache_hits: %llu\r\n"
+        "dbe_get_short_circuits: %llu\r\n",
+        mf_state_str(ms.state),
+        ms.bloom_bytes,
+        ms.bloom_keys,
+        ms.bloom_negatives,
+        ms.bloom_fp,
+        ms.bloom_fp + ms.bloom_negatives > 0
+            ? (double)ms.bloom_fp / (ms.bloom_fp + ms.bloom_negatives) : 0.0,
+        ms.neg_size,
+        ms.neg_hits,
+        ms.neg_hits + ms.bloom_negatives);
+
+    preload_stat ps;
+    preload_get_stat(&ps);
+    info = sdscatprintf(info,
+        "preload_status: %s\r\n"
+        "preload_threads: %d\r\n"
+        "preload_scanned_recs: %llu\r\n"
+        "preload_loaded_keys: %llu\r\n"
+        "preload_skipped_keys: %llu\r\n"
+        "preload_failed_keys: %llu\r\n"
+        "preload_keys_per_sec: %llu\r\n"
+        "preload_elapsed_ms: %lld\r\n"
+        "preload_mem_budget: %zu\r\n",
+        preload_state_str(ps.state),
+        ps.threads,
+        ps.scanned,
+        ps.loaded,
+        ps.skipped,
+        ps.failed,
+        ps.keys_ps,
+        ps.elapsed_ms,
+        ps.mem_budget);
+
+    rb_stat bs;
+    rb_get_stat(&bs);
+    info = sdscatprintf(info,
+        "rebalance_status: %s\r\n"
+        "rebalance_rounds: %llu\r\n"
+        "rebalance_total_keys: %llu\r\n"
+        "rebalance_scanned_keys: %llu\r\n"
+        "rebalance_migrated_keys: %llu\r\n"
+        "rebalance_spilled_keys: %llu\r\n"
+        "rebalance_kept_keys: %llu\r\n"
+        "rebalance_evicted_keys: %llu\r\n"
+        "rebalance_dropped_keys: %llu\r\n"
+        "rebalance_keys_per_sec: %llu\r\n"
+        "rebalance_elapsed_ms: %lld\r\n",
+        rb_state_str(bs.state),
+        bs.rounds,
+        bs.total_keys,
+        bs.scanned,
+        bs.migrated,
+        bs.spilled,
+        bs.kept,
+        bs.evicted,
+        bs.dropped,
+        bs.keys_ps,
+        bs.elapsed_ms);
+
+    km_stat ks;
+    km_get_stat(&ks);
+    info = sdscatprintf(info,
+        "dbe_key_ver: %d\r\n"
+        "dbe_key_mixed: %d\r\n"
+        "key_migrate_status: %s\r\n"
+        "key_migrate_scanned_recs: %llu\r\n"
+        "key_migrate_keys: %llu\r\n"
+        "key_migrate_rows: %llu\r\n"
+        "key_migrate_on_write_keys: %llu\r\n"
+        "key_migrate_elapsed_ms: %lld\r\n",
+        server.dbe_key_ver,
+        server.dbe_key_mixed,
+        km_state_str(ks.state),
+        ks.scanned,
+        ks.keys,
+        ks.rows,
+        ks.on_write,
+        ks.elapsed_ms);
+
+    info = sdscatprintf(info,
+        "reply_writev_calls: %llu\r\n"
+        "reply_writev_per_cmd: %.3f\r\n"
+        "reply_direct_flushes: %llu\r\n"
+        "reply_write_handlers: %llu\r\n"
+        "clients_pending_write: %u\r\n",
+        server.stat_reply_writev,
+        server.stat_numcommands > 0
+            ? (double)server.stat_reply_writev / server.stat_numcommands : 0.0,
+        server.stat_reply_direct,
+        server.stat_reply_handlers,
+        listLength(server.clients_pending_write));
+
+    nio_thread_stat ns[NIO_MAX_THREADS];
+    const int nio_cnt = nio_get_stat(ns, NIO_MAX_THREADS);
+    const long long nio_up = nio_uptime_us();
+    info = sdscatprintf(info,
+        "net_io_threads: %d\r\n"
+        "clients_pending_read: %u\r\n",
+        nio_cnt,
+        listLength(server.clients_pending_read));
+    for (j = 0; j < nio_cnt; j++)
+    {
+        info = sdscatprintf(info,
+            "net_io_thread_%d: clients=%llu,runs=%llu,busy_us=%llu,util=%.2f%%\r\n",
+            j, ns[j].clients, ns[j].runs, ns[j].busy_us,
+            nio_up > 0 ? (double)ns[j].busy_us * 100 / nio_up : 0.0);
+    }
+
+    info = sdscatprintf(info,
+        "hk_ticks: %llu\r\n"
+        "hk_overruns: %llu\r\n"
+        "hk_last_budget_us: %lld\r\n"
+        "hk_cmd_evicted_keys: %llu\r\n",
+        sc_hk_ticks,
+        sc_hk_overruns,
+        sc_hk_last_budget,
+        sc_hk_fg_evicts);
+    for (j = 0; j < HK_TASK_NUM; j++)
+    {
+        info = sdscatprintf(info,
+            "hk_%s_runs: %llu\r\n"
+            "hk_%s_us: %llu\r\n",
+            sc_hk_tasks[j].name, sc_hk_tasks[j].runs,
+            sc_hk_tasks[j].name, sc_hk_tasks[j].us);
+    }
+
+    for (j = 0; j < LH_KIND_NUM; j++)
+    {
+        lh_hist lh;
+        lh_summary ls;
+        lh_get(j, &lh);
+        lh_summarize(&lh, &ls);
+        info = sdscatprintf(info,
+            "latency_%s: calls=%llu,avg=%llu,p50=%llu,p99=%llu,p999=%llu,max=%llu\r\n",
+            lh_kind_str(j), ls.cnt, ls.avg, ls.p50, ls.p99, ls.p999, ls.max);
+    }
+
+    repl_master_stat_t rs;
+    repl_get_master_stat(&rs);
+    info = sdscatprintf(info,
+        "repl_masters: %d\r\n"
+        "repl_sent_bytes: %llu\r\n"
+        "repl_sent_recs: %llu\r\n"
+        "repl_filtered_recs: %llu\r\n"
+        "repl_bytes_per_sec: %llu\r\n"
+        "repl_recs_per_sec: %llu\r\n"
+        "repl_max_lag_ms: %llu\r\n",
+        rs.masters,
+        (unsigned long long)rs.sent_bytes,
+        (unsigned long long)rs.sent_recs,
+        (unsigned long long)rs.filtered_recs,
+        server.repl_bytes_ps,
+        server.repl_recs_ps,
+        (unsigned long long)(rs.max_lag_us / 1000));
+
 #if 0
     // disable in FooYun
     if (server.appendonly) {
@@ -2303,8 +2504,12 @@ void infoCommand(redisClient *c) {
         {
             /* info config */
             info = get_conf_info_str();
+#ifdef _DBE_LOG_DB_
+            info = sdscatprintf(info, "dbe=logdb\n");
+#else
             info = sdscatprintf(info, "dbe=%s\n"
                     , server.dbe_ver == DBE_VER_HIDB ? "hidb" : "hidb2");
+#endif
         }
         else
         {
@@ -2328,6 +2533,120 @@ void monitorCommand(redisClient *c) {
 
 /* ============================ Maxmemory directive  ======================== */
 
+/* ----------------------------------------------------------------------------
+ * Eviction pool: the best candidates of the past samples are kept sorted by
+ * score (idle time, or 255 - frequency with a LFU policy), so a pass only
+ * samples a few adjacent keys and evicts the best one seen so far
+ * --------------------------------------------------------------------------*/
+
+#define EVICTION_SAMPLES_ARRAY_SIZE 16
+
+static evictionPoolEntry *evictionPoolAlloc(void)
+{
+    evictionPoolEntry *ep = zcalloc(sizeof(evictionPoolEntry) * REDIS_EVICTION_POOL_SIZE);
+    return ep;
+}
+
+/* the higher the better candidate */
+static unsigned long long evictionScore(robj *o)
+{
+    if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy))
+    {
+        return 255 - LFUDecrAndReturn(o);
+    }
+    return estimateObjectIdleTime(o);
+}
+
+/* sample keys of sampledict, values are looked up in keydict when they
+ * differ (sampledict is db->expires) */
+static void evictionPoolPopulate(dict *sampledict, dict *keydict, evictionPoolEntry *pool)
+{
+    dictEntry *_samples[EVICTION_SAMPLES_ARRAY_SIZE];
+    dictEntry **samples = _samples;
+    int j, k, count;
+
+    if (server.maxmemory_samples > EVICTION_SAMPLES_ARRAY_SIZE)
+    {
+        samples = zmalloc(sizeof(samples[0]) * server.maxmemory_samples);
+    }
+    count = dictGetSomeKeys(sampledict, samples, server.maxmemory_samples);
+    for (j = 0; j < count; j++)
+    {
+        dictEntry *de = samples[j];
+        sds key = dictGetEntryKey(de);
+        if (sampledict != keydict)
+        {
+            de = dictFind(keydict, key);
+            if (de == NULL)
+            {
+                continue;
+            }
+        }
+        const unsigned long long idle = evictionScore(dictGetEntryVal(de));
+
+        /* the first slot whose key is empty or better than this one */
+        k = 0;
+        while (k < REDIS_EVICTION_POOL_SIZE && pool[k].key && pool[k].idle < idle)
+        {
+            k++;
+        }
+        if (k == 0 && pool[REDIS_EVICTION_POOL_SIZE - 1].key != NULL)
+        {
+            /* worse than all and no empty slot */
+            continue;
+        }
+        else if (k < REDIS_EVICTION_POOL_SIZE && pool[k].key == NULL)
+        {
+            /* an empty slot */
+        }
+        else if (pool[REDIS_EVICTION_POOL_SIZE - 1].key == NULL)
+        {
+            /* shift to the right from k */
+            memmove(pool + k + 1, pool + k, sizeof(pool[0]) * (REDIS_EVICTION_POOL_SIZE - k - 1));
+        }
+        else
+        {
+            /* full, drop the worst one at the left */
+            k--;
+            sdsfree(pool[0].key);
+            memmove(pool, pool + 1, sizeof(pool[0]) * k);
+        }
+        pool[k].key = sdsdup(key);
+        pool[k].idle = idle;
+    }
+
+    if (samples != _samples)
+    {
+        zfree(samples);
+    }
+}
+
+/* take the best candidate still in dict out of the pool
+ * return: the key in dict, or NULL */
+static sds evictionPoolPop(evictionPoolEntry *pool, dict *dict)
+{
+    int k;
+    for (k = REDIS_EVICTION_POOL_SIZE - 1; k >= 0; k--)
+    {
+        if (pool[k].key == NULL)
+        {
+            continue;
+        }
+        dictEntry *de = dictFind(dict, pool[k].key);
+        sdsfree(pool[k].key);
+        memmove(pool + k, pool + k + 1, sizeof(pool[0]) * (REDIS_EVICTION_POOL_SIZE - k - 1));
+        pool[REDIS_EVICTION_POOL_SIZE - 1].key = NULL;
+        pool[REDIS_EVICTION_POOL_SIZE - 1].idle = 0;
+        if (de)
+        {
+            return dictGetEntryKey(de);
+        }
+        /* deleted since it was sampled */
+        server.stat_evict_pool_stale++;
+    }
+    return NULL;
+}
+
 /* This function gets called when 'maxmemory' is set on the config file to limit
  * the max memory used by the server, and we are out of memory.
  * This function will try to, in order:
@@ -2356,6 +2675,7 @@ void freeMemoryIfNeeded(void)
             dict *dict;
 
             if (server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LRU ||
+                server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LFU ||
                 server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_RANDOM)
             {
                 dict = server.db[j].dict;
@@ -2372,30 +2692,13 @@ void freeMemoryIfNeeded(void)
                 bestkey = dictGetEntryKey(de);
             }
 
-            /* volatile-lru and allkeys-lru policy */
+            /* volatile-lru, allkeys-lru, volatile-lfu and allkeys-lfu policy */
             else if (server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LRU ||
-                server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_LRU)
+                server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_LRU ||
+                REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy))
             {
-                for (k = 0; k < server.maxmemory_samples; k++) {
-                    sds thiskey;
-                    long thisval;
-                    robj *o;
-
-                    de = dictGetRandomKey(dict);
-                    thiskey = dictGetEntryKey(de);
-                    /* When policy is volatile-lru we need an additonal lookup
-                     * to locate the real key, as dict is set to db->expires. */
-                    if (server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_LRU)
-                        de = dictFind(db->dict, thiskey);
-                    o = dictGetEntryVal(de);
-                    thisval = estimateObjectIdleTime(o);
-
-                    /* Higher idle time is better candidate for deletion */
-                    if (bestkey == NULL || thisval > bestval) {
-                        bestkey = thiskey;
-                        bestval = thisval;
-                    }
-                }
+                evictionPoolPopulate(dict, db->dict, db->eviction_pool);
+                bestkey = evictionPoolPop(db->eviction_pool, dict);
             }
 
             /* volatile-ttl */
@@ -2417,6 +2720,12 @@ void freeMemoryIfNeeded(void)
                 }
             }
 
+            if (bestkey && bl_dbe_inflight(db->id, bestkey))
+            {
+                server.stat_evict_inflight++;
+                bestkey = NULL;
+            }
+
             /* Finally remove the selected key. */
             if (bestkey) {
                 robj keyobj;
@@ -2443,41 +2752,31 @@ void freeMemoryIfNeeded(void)
 static int removeKeyFromMem(redisDb *db)
 {
     dict *dict = db->dict;
-    long bestval = 0; /* just to prevent warning */
     sds bestkey = NULL;
     robj *bestvalobj = NULL;
-    struct dictEntry *de;
 
     if (dictSize(dict) == 0)
     {
         return 1;
     }
 
+    /* once more if all keys in the pool have gone,
+     * a key with writes not in dbe yet is kept, dbe has an old value */
     int k;
-    for (k = 0; k < server.maxmemory_samples; k++)
+    for (k = 0; k < 4 && bestkey == NULL; k++)
     {
-        sds thiskey;
-        long thisval;
-        robj *o;
-
-        de = dictGetRandomKey(dict);
-        if (de == 0)
+        evictionPoolPopulate(dict, dict, db->eviction_pool);
+        bestkey = evictionPoolPop(db->eviction_pool, dict);
+        if (bestkey && bl_dbe_inflight(db->id, bestkey))
         {
-            break;
-        }
-        thiskey = dictGetEntryKey(de);
-        /* When policy is volatile-lru we need an additonal lookup
-         * to locate the real key, as dict is set to db->expires. */
-        o = dictGetEntryVal(de);
-        thisval = estimateObjectIdleTime(o);
-
-        /* Higher idle time is better candidate for deletion */
-        if (bestkey == NULL || thisval > bestval) {
-            bestkey = thiskey;
-            bestval = thisval;
-            bestvalobj = o;
+            server.stat_evict_inflight++;
+            bestkey = NULL;
         }
     }
+    if (bestkey)
+    {
+        bestvalobj = dictFetchValue(dict, bestkey);
+    }
 
     /* Finally remove the selected key. */
     if (bestkey)
@@ -2503,46 +2802,53 @@ static int removeKeyFromMem(redisDb *db)
     }
 }
 
-static void freeMemoryIfNeededBySelf(void)
+/* evict until memory is under db_max_size or the deadline is reached,
+ * at least one key is evicted if over
+ * return: number of evicted keys */
+static int freeMemoryIfNeededBySelf(long long deadline)
 {
     /* Remove keys accordingly to the active policy as long as we are
      * over the memory limit. */
-    const long long start = server.ustime;
+    const long long start = ustime();
     size_t um = ds_zmalloc_used_memory();
     const size_t um_old = um;
 
     int j = 0;
     int cnt = 0;
     int loop = 0;
-    while (um > (size_t)server.db_max_size && cnt <= 5 && loop < server.dbnum)
+    while (um > (size_t)server.db_max_size && loop < server.dbnum)
     {
         //redisLog(REDIS_PROMPT, "db.%d: um=%ld, db_max_size=%ld, db_min_size=%ld",
         //        j, um, server.db_max_size, server.db_min_size);
         redisDb *db = server.db + j;
+        j = (j + 1) % server.dbnum;
         if (removeKeyFromMem(db) == 0)
         {
             server.stat_evictedkeys++;
             cnt++;
             um = ds_zmalloc_used_memory();
             loop = 0;
+            if (ustime() >= deadline)
+            {
+                break;
+            }
         }
         else
         {
             loop++;
         }
-        j = (j + 1) % server.dbnum;
     }
 
     if (cnt && server.verbosity <= REDIS_VERBOSE)
     {
-        updateCachedTime();
-        const long long dur = server.ustime - start;
+        const long long dur = ustime() - start;
         redisLog(REDIS_VERBOSE,
                  "evicted=%d, %zd -> %zd, diff=%zd, dur=%lld(us), "
                  "db_max_size=%"PRId64", db_min_size=%"PRId64,
                  cnt, um_old, um, um_old - um, dur,
                  server.db_max_size, server.db_min_size);
     }
+    return cnt;
 }
 
 static void cache_clean(int percent)
@@ -2680,36 +2986,104 @@ void rsp_hb(aeEventLoop *el, int fd, void *privdata, int mask)
     }
 }
 
-static void clean_more(void)
+/* continue clean_cache until the deadline
+ * return: number of removed keys */
+static int clean_more(long long deadline)
 {
-    if (maxMem > 0)
+    if (maxMem == 0)
     {
-        /* continue to clean_cache */
-        size_t um = ds_zmalloc_used_memory();
-        int j = 0;
-        while (um > maxMem  && j < server.dbnum)
+        return 0;
+    }
+
+    size_t um = ds_zmalloc_used_memory();
+    int cnt = 0;
+    int j = 0;
+    while (um > maxMem && j < server.dbnum)
+    {
+        //redisLog(REDIS_PROMPT, "db.%d: um=%ld, maxMem=%ld", j, um, maxMem);
+        redisDb *db = server.db + db_idx;
+        db_idx = (db_idx + 1) % server.dbnum;
+        if (removeKeyFromMem(db) == 0)
         {
-            //redisLog(REDIS_PROMPT, "db.%d: um=%ld, maxMem=%ld", j, um, maxMem);
-            redisDb *db = server.db + db_idx;
-            db_idx = (db_idx + 1) % server.dbnum;
-            if (removeKeyFromMem(db) == 0)
+            um = ds_zmalloc_used_memory();
+            cnt++;
+            j = 0;
+            if (ustime() >= deadline)
             {
-                um = ds_zmalloc_used_memory();
-                break;
+                return cnt;
             }
-            j++;
         }
-        /* there was no item to remove in all db or reach the condition */
-        if (j >= server.dbnum || maxMem >= um)
+        else
         {
-            /* finished, stop it */
-            redisLog(REDIS_PROMPT
-                     , "clean over: loop=%d, to %zd, now %zd, dur=%lds"
-                     , j, maxMem, um, server.unixtime - cln_start);
-            maxMem = 0;
-            db_idx = 0;
+            j++;
         }
     }
+
+    /* there was no item to remove in all db or reach the condition */
+    redisLog(REDIS_PROMPT
+             , "clean over: loop=%d, to %zd, now %zd, dur=%lds"
+             , j, maxMem, um, server.unixtime - cln_start);
+    maxMem = 0;
+    db_idx = 0;
+    return cnt;
+}
+
+static long long hk_budget(long long base)
+{
+    const size_t um = ds_zmalloc_used_memory();
+    if (server.db_max_size <= 0 || um <= (size_t)server.db_max_size)
+    {
+        return base;
+    }
+    const long long over_pct = (long long)((um - server.db_max_size) * 100 / server.db_max_size);
+    const long long mult = 2 + 2 * over_pct;
+    return base * (mult < HK_BUDGET_MAX_MULT ? mult : HK_BUDGET_MAX_MULT);
+}
+
+static void hk_account(int task, int done, long long *t)
+{
+    const long long now = ustime();
+    if (done)
+    {
+        sc_hk_tasks[task].runs++;
+        sc_hk_tasks[task].us += now - *t;
+    }
+    *t = now;
+}
+
+/* from_cron: 1 - serverCron, all tasks; 0 - beforeSleep, only to free memory */
+static void housekeeping(int from_cron)
+{
+    if (from_cron == 0
+        && maxMem == 0
+        && ds_zmalloc_used_memory() <= (size_t)server.db_max_size)
+    {
+        return;
+    }
+
+    long long t = ustime();
+    const long long budget = hk_budget(server.hk_budget_us) / (from_cron ? 1 : HK_SLEEP_DIV);
+    const long long deadline = t + budget;
+    sc_hk_last_budget = budget;
+    sc_hk_ticks++;
+
+    hk_account(HK_EVICT, freeMemoryIfNeededBySelf(deadline), &t);
+    if (t < deadline)
+    {
+        hk_account(HK_CLEAN, clean_more(deadline), &t);
+    }
+    if (from_cron && t < deadline)
+    {
+        hk_account(HK_REBALANCE, rb_cron(deadline), &t);
+    }
+
+    if (t >= deadline
+        && (maxMem > 0
+            || ds_zmalloc_used_memory() > (size_t)server.db_max_size
+            || rb_running()))
+    {
+        sc_hk_overruns++;
+    }
 }
 
 /* =================================== Main! ================================ */
@@ -2821,7 +3195,17 @@ void usage(const char *name)
     fprintf(stderr, "config set compress <0|1>\n");
     fprintf(stderr, "config set log_get_miss <0|1>\n");
     fprintf(stderr, "config set dbe_get_que_size <xxx>\n");
+    fprintf(stderr, "config set dbe_prefetch_depth <xxx>\n");
+    fprintf(stderr, "config set neg_cache_size <xxx>\n");
+    fprintf(stderr, "config set neg_cache_ttl <xxx>\n");
+    fprintf(stderr, "config set wr_dbe_coalesce_ms <xxx>\n");
+    fprintf(stderr, "config set wr_dbe_coalesce_max <xxx>\n");
+    fprintf(stderr, "config set rebalance_budget_us <xxx>\n");
+    fprintf(stderr, "config set hk_budget_us <xxx>\n");
+    fprintf(stderr, "config set lfu_log_factor <xxx>\n");
+    fprintf(stderr, "config set lfu_decay_time <xxx>\n");
     fprintf(stderr, "config set wr_bl_que_size <xxx>\n");
+    fprintf(stderr, "config set binlog_fsync <no|everysec|always>\n");
     fprintf(stderr, "config set loglevel <warning|notice|verbose|debug>\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "how to get parameters:\n");
@@ -2930,6 +3314,14 @@ static const char *get_max_memory_policy_str(int policy)
     {
         return "noeviction";
     }
+    if (policy == REDIS_MAXMEMORY_VOLATILE_LFU)
+    {
+        return "volatile-lfu";
+    }
+    if (policy == REDIS_MAXMEMORY_ALLKEYS_LFU)
+    {
+        return "allkeys-lfu";
+    }
     else
     {
         return "unknown";
@@ -2968,6 +3360,22 @@ sds get_conf_info_str()
                         "dbe_hot_level=%d\n"
                         "read_dbe=%d\n"
                         "auto_purge=%d\n"
+                        "dbe_get_threads=%d\n"
+                        "net_io_threads=%d\n"
+                        "dbe_prefetch_depth=%d\n"
+                        "dbe_bloom_mb=%d\n"
+                        "neg_cache_size=%d\n"
+                        "neg_cache_ttl=%d\n"
+                        "preload_threads=%d\n"
+                        "preload_mem_pct=%d\n"
+                        "wr_dbe_coalesce_ms=%d\n"
+                        "wr_dbe_coalesce_max=%d\n"
+                        "dbe_key_ver=%d\n"
+                        "rebalance_budget_us=%d\n"
+                        "hk_budget_us=%d\n"
+                        "lfu_log_factor=%d\n"
+                        "lfu_decay_time=%d\n"
+                        "binlog_fsync=%s\n"
                         "db_max_size=%"PRId64"\n"
                         "db_min_size=%"PRId64"\n"
                         "app_path=%s\n"
@@ -3022,6 +3430,23 @@ sds get_conf_info_str()
                         , server.dbe_hot_level
                         , server.read_dbe
                         , server.auto_purge
+                        , server.dbe_get_threads
+                        , server.net_io_threads
+                        , server.dbe_prefetch_depth
+                        , server.dbe_bloom_mb
+                        , server.neg_cache_size
+                        , server.neg_cache_ttl
+                        , server.preload_threads
+                        , server.preload_mem_pct
+                        , server.wr_dbe_coalesce_ms
+                        , server.wr_dbe_coalesce_max
+                        , server.dbe_key_ver
+                        , server.rebalance_budget_us
+                        , server.hk_budget_us
+                        , server.lfu_log_factor
+                        , server.lfu_decay_time
+                        , server.binlog_fsync == APPENDFSYNC_ALWAYS ? "always"
+                          : (server.binlog_fsync == APPENDFSYNC_NO ? "no" : "everysec")
                         , server.db_max_size
                         , server.db_min_size
                         , server.app_path ? server.app_path : ""
@@ -3767,6 +4192,7 @@ cmd_fail:
     if (server.sofd > 0)
         redisLog(REDIS_PROMPT,"ready at unixsocket: %s", server.unixsocket);
 
+    nio_init();
     aeSetBeforeSleepProc(server.el,beforeSleep);
     aeMain(server.el);
     aeDeleteEventLoop(server.el);
@@ -3928,80 +4354,29 @@ static int print_info_cron(struct aeEventLoop *eventLoop, long long id, void *cl
     REDIS_NOTUSED(id);
     REDIS_NOTUSED(clientData);
 
-    int out = 0;
-    unsigned int i;
-
-    for (i = 1; i < sizeof(gWrBlTop) / sizeof(gWrBlTop[0]); i++)
-    {
-        if (gWrBlTop[i].valid == 0)
-        {
-            break;
-        }
-        if (out == 0)
-        {
-            redisLog(REDIS_PROMPT
-                    , "WrBl(us): cnt[%d] max[%lld] min[%lld] avg[%lld] max_wait[%d]"
-                      " (io, s, len, time, cmd, key)"
-                    , gWrBlCnt, gWrBlMax, gWrBlMin
-                    , gWrBlCnt ? (gWrBlTotal / gWrBlCnt) : 0, gWaitBlClntMax
-                    );
-            out = 1;
-            gWrBlTotal = gWrBlCnt = gWrBlMax = gWrBlMin = 0;
-            gWaitBlClntMax = 0;
-        }
-        redisLog(REDIS_PROMPT, "No.%d: %"PRId64", %"PRId64", %d, %ld, %d, %s"
-                , i, gWrBlTop[i].io_dur, gWrBlTop[i].serialize_dur
-                , gWrBlTop[i].buf_len, gWrBlTop[i].time
-                , gWrBlTop[i].cmd, gWrBlTop[i].key
-                );
-        gWrBlTop[i].valid = 0;
-    }
-
-    out = 0;
-    for (i = 1; i < sizeof(gDbeGetTop) / sizeof(gDbeGetTop[0]); i++)
-    {
-        if (gDbeGetTop[i].valid == 0)
-        {
-            break;
-        }
-        if (out == 0)
-        {
-            redisLog(REDIS_PROMPT
-                    , "dbe_get(us): cnt[%d] max[%lld] min[%lld] avg[%lld]"
-                    , gDbeGetCnt, gDbeGetMax, gDbeGetMin, gDbeGetCnt ? (gDbeGetTotal / gDbeGetCnt) : 0
-                    );
-            out = 1;
-            gDbeGetTotal = gDbeGetCnt = gDbeGetMax = gDbeGetMin = 0;
-        }
-        redisLog(REDIS_PROMPT, "No.%d: %"PRId64", %"PRId64", %d, %ld"
-                , i, gDbeGetTop[i].io_dur, gDbeGetTop[i].unserialize_dur
-                , gDbeGetTop[i].buf_len, gDbeGetTop[i].time
-                );
-        gDbeGetTop[i].valid = 0;
-    }
+    /* the counts of the last print */
+    static lh_hist last[LH_KIND_NUM];
+    int i;
 
-    out = 0;
-    for (i = 1; i < sizeof(gDbeSetTop) / sizeof(gDbeSetTop[0]); i++)
+    for (i = 0; i < LH_KIND_NUM; i++)
     {
-        if (gDbeSetTop[i].valid == 0)
+        lh_hist h;
+        lh_summary s;
+        lh_merge(i, &h);
+        const lh_hist cur = h;
+        lh_sub(&h, &last[i]);
+        last[i] = cur;
+        if (h.cnt == 0)
         {
-            break;
-        }
-        if (out == 0)
-        {
-            redisLog(REDIS_PROMPT
-                    , "dbe_set(us): cnt[%d] max[%lld] min[%lld] avg[%lld]"
-                    , gDbeSetCnt, gDbeSetMax, gDbeSetMin, gDbeSetCnt ? (gDbeSetTotal / gDbeSetCnt) : 0
-                    );
-            out = 1;
-            gDbeSetTotal = gDbeSetCnt = gDbeSetMax = gDbeSetMin = 0;
+            continue;
         }
-        redisLog(REDIS_PROMPT, "No.%d: %"PRId64", %d, %ld"
-                , i, gDbeSetTop[i].io_dur
-                , gDbeSetTop[i].buf_len, gDbeSetTop[i].time
-                );
-        gDbeSetTop[i].valid = 0;
+        lh_summarize(&h, &s);
+        redisLog(REDIS_PROMPT
+                , "%s(us): cnt[%llu] avg[%llu] p50[%llu] p99[%llu] p999[%llu] max[%llu]"
+                , lh_kind_str(i), s.cnt, s.avg, s.p50, s.p99, s.p999, s.max);
     }
+    redisLog(REDIS_PROMPT, "WrBl: max_wait[%d]", gWaitBlClntMax);
+    gWaitBlClntMax = 0;
 
     return 600000;
 }
@@ -4727,6 +5102,8 @@ void mergedbeCommand(redisClient *c)
         return;
     }
 
+    /* the merged keys are not in the bloom */
+    mf_disable("dbe_merge");
     const int ret = dbe_merge(dbmng_get_db(c->tag, 0), c->argv[1]->ptr);
     if (ret != DBE_ERR_SUCC)
     {
@@ -4817,6 +5194,35 @@ void purgedbeCommand(redisClient *c)
     }
 }
 
+/*
+ * cmd format: migrate_dbe_key
+ */
+void migratedbekeyCommand(redisClient *c)
+{
+    redisLog(REDIS_PROMPT, "migrate_dbe_key");
+
+    if (server.has_dbe == 0)
+    {
+        redisLog(REDIS_WARNING, "not allow to migrate dbe key in only cache mode");
+        addReplyErrorFormat(c, "not allow to migrate dbe key in only cache mode");
+        return;
+    }
+
+    const int ret = km_start(dbmng_get_db(c->tag, 0));
+    if (ret == 1)
+    {
+        addReplyErrorFormat(c, "nothing to migrate, dbe_key_ver=%d", server.dbe_key_ver);
+    }
+    else if (ret != 0)
+    {
+        addReplyErrorFormat(c, "km_start() fail, ret=%d", ret);
+    }
+    else
+    {
+        addReply(c, shared.ok);
+    }
+}
+
 void push_back_to_clean_list(redisClient *c)
 {
     const int ret = pthread_mutex_lock(&sc_clean_lock);
@@ -163,6 +163,12 @@
                                server.unblocked_clients */
 #define REDIS_DBE_GET_WAIT 512 /* This client is waiting for dbe get */ 
 #define REDIS_WR_BL_WAIT 1024 /* This client is waiting for write binlog */ 
+#define REDIS_PENDING_WRITE 2048 /* This client has replies to flush in
+                                    beforeSleep, in server.clients_pending_write */
+#define REDIS_PENDING_READ 4096 /* This client is to be read by net io threads,
+                                   in server.clients_pending_read */
+#define REDIS_PENDING_COMMAND 8192 /* argv was parsed by a net io thread and
+                                      is to be executed */
 
 /* Client request types */
 #define REDIS_REQ_INLINE 1
@@ -236,6 +242,13 @@
 #define REDIS_MAXMEMORY_ALLKEYS_LRU 3
 #define REDIS_MAXMEMORY_ALLKEYS_RANDOM 4
 #define REDIS_MAXMEMORY_NO_EVICTION 5
+#define REDIS_MAXMEMORY_VOLATILE_LFU 6
+#define REDIS_MAXMEMORY_ALLKEYS_LFU 7
+#define REDIS_MAXMEMORY_IS_LFU(p) \
+    ((p) == REDIS_MAXMEMORY_VOLATILE_LFU || (p) == REDIS_MAXMEMORY_ALLKEYS_LFU)
+
+/* candidates of eviction kept between passes, best one at the end */
+#define REDIS_EVICTION_POOL_SIZE 16
 
 /* We can print the stacktrace, so our assert is defined this way: */
 #define redisAssert(_e) ((_e)?(void)0 : (_redisAssert(#_e,__FILE__,__LINE__),_exit(1)))
@@ -253,6 +266,10 @@ void bugReportStart(void);
 /* The actual Redis Object */
 #define REDIS_LRU_CLOCK_MAX ((1<<21)-1) /* Max value of obj->lru */
 #define REDIS_LRU_CLOCK_RESOLUTION 10 /* LRU clock resolution in seconds */
+/* with a LFU policy obj->lru is split into the time of the last decrement
+ * in minutes (14 bits, wraps in 11 days) and a logarithmic counter (8 bits) */
+#define REDIS_LFU_TIME_MAX ((1<<14)-1)
+#define REDIS_LFU_INIT_VAL 5
 typedef struct redisObject {
     unsigned type:4;
     unsigned storage:2;     /* REDIS_VM_MEMORY or REDIS_VM_SWAPPING */
@@ -314,9 +331,15 @@ typedef struct redisDb {
     dict *blocking_keys;        /* Keys with clients waiting for data (BLPOP) */
     dict *io_keys;              /* Keys with clients waiting for VM I/O */
     dict *watched_keys;         /* WATCHED keys for MULTI/EXEC CAS */
+    struct evictionPoolEntry *eviction_pool; /* Eviction pool of keys */
     int id;
 } redisDb;
 
+typedef struct evictionPoolEntry {
+    unsigned long long idle;    /* Object idle time, or 255-freq with LFU */
+    sds key;                    /* Key name, a copy */
+} evictionPoolEntry;
+
 /* Client MULTI/EXEC state */
 typedef struct multiCmd {
     robj **argv;
@@ -391,10 +414,14 @@ typedef struct redisClient
     long long call_dur;
     long long dbe_get_block_dur;
     long long wr_bl_block_dur;
+    unsigned long long bl_wait_seq; /* reply is held until binlog synced up to this seq */
     int64_t wr_bl_dur;
     int req_len;
     void *ctx;
     int enque_cnt;
+    int dbe_get_pending;    /* keys in dbe_get_keys not finished yet */
+    int io_err;             /* errno of a net io thread, -1: closed by peer */
+    int io_sent;            /* reply nodes sent by a net io thread */
 } redisClient;
 
 struct saveparam {
@@ -431,8 +458,8 @@ struct redisServer
     int ipfd;
     int slave_ipfd;
     int sofd;
-    int recv_fd; /* pipe[0] */
-    int send_fd; /* pipe[1] */
+    int recv_fd; /* eventfd of io completion */
+    int send_fd; /* same as recv_fd */
     int hb_recv_fd; /* pipe[0] for hb */
     int hb_send_fd; /* pipe[1] for hb */
     redisDb *db;
@@ -497,6 +524,9 @@ struct redisServer
 
     unsigned long long bytes_read;
     unsigned long long bytes_written;
+    unsigned long long stat_reply_writev;      /* writev() calls for replies */
+    unsigned long long stat_reply_direct;      /* replies flushed from beforeSleep entirely */
+    unsigned long long stat_reply_handlers;    /* AE_WRITABLE installed after a short write */
     unsigned long long rejected_conns;
 
     list *slowlog;
@@ -565,6 +595,8 @@ struct redisServer
     unsigned int bpop_blocked_clients;
     unsigned int vm_blocked_clients;
     list *unblocked_clients;
+    list *clients_pending_write; /* replies written in beforeSleep, no AE_WRITABLE */
+    list *clients_pending_read;  /* sockets read by net io threads in beforeSleep */
     /* Sort parameters - qsort_r() is only available under BSD so we
      * have to take this state global, in order to pass it to sortCompare() */
     int sort_desc;
@@ -666,11 +698,38 @@ struct redisServer
     long long load_hot_key_max_num; /* -1: unlimit, >0: max mumber */
     int load_bl_cnt; /* for cache */
     int dbe_fsize;
+    int dbe_get_threads; /* io threads for reading cold keys from dbe */
+    int net_io_threads; /* threads reading/writing client sockets, 1: main thread only */
+    int dbe_prefetch_depth; /* pipelined cmds scanned for cold keys, 0: disable */
+    int dbe_bloom_mb; /* bloom of keys in dbe, 0: disable */
+    int neg_cache_size; /* keys just missed in dbe, 0: disable */
+    int neg_cache_ttl; /* in seconds */
+    int preload_threads; /* threads for building hot keys loaded from dbe */
+    int preload_mem_pct; /* stop loading hot keys at db_max_size * pct / 100 */
+    int wr_dbe_coalesce_ms; /* max delay of a string write in write_dbe stage */
+    int wr_dbe_coalesce_max; /* max keys pending in write_dbe stage, 0: disable */
+    int rebalance_budget_us; /* time of the rebalancer per serverCron, 0: pause */
+    int hk_budget_us; /* time of housekeeping per serverCron, x8 at most under memory pressure */
+    int lfu_log_factor; /* hits for the LFU counter to grow, logarithmic */
+    int lfu_decay_time; /* minutes for the LFU counter to decrease by 1 */
+    int binlog_fsync; /* APPENDFSYNC_NO/EVERYSEC/ALWAYS for binlog files */
 
     /* static */
     unsigned long long stat_lru_del_keys;     /* number of keys deleted by lru */
     unsigned long long stat_misses_in_cache;  /* for persistence */
     unsigned long long stat_notify_dbe_get_fail;   /* notify dbe get fail */
+    unsigned long long stat_dbe_get_keys;   /* keys committed to dbe_get io thread */
+    unsigned long long stat_dbe_get_shared; /* keys shared with other waiting clients */
+    unsigned long long stat_dbe_prefetch_keys; /* keys read ahead for pipelined cmds */
+    unsigned long long stat_bl_fsyncs;      /* fdatasync() on binlog files */
+    unsigned long long stat_bl_groups;      /* group commits of binlog */
+    unsigned long long stat_bl_group_recs;  /* binlog records in group commits */
+    unsigned long long stat_wr_dbe_coalesced; /* dbe writes superseded by a later one */
+    unsigned long long stat_wr_dbe_issued;    /* dbe writes issued by write_dbe stage */
+    unsigned long long stat_wr_dbe_skipped;   /* dbe writes of keys failed to be migrated */
+    unsigned long long stat_evict_pool_stale; /* pool candidates deleted before eviction */
+    unsigned long long stat_evict_inflight;   /* eviction skipped, writes not in dbe yet */
+    unsigned long long stat_dbe_inflight_misses; /* misses of deleted keys not in dbe yet */
 
     unsigned long long ds_key_num;
 
@@ -686,10 +745,24 @@ struct redisServer
     list *repl_slaves;
     list *cleans;
     list *dbe_get_clients;
+    dict *dbe_get_inflight; /* key -> key being read from dbe */
     list *write_bl_clients;
     list *bl_writing;
     list *wr_bl_list;
     list *wr_dbe_list;
+    volatile int handle_bl_depth; /* depth gauges of the write pipeline stages */
+    volatile int wr_bl_depth;
+    volatile int wr_dbe_depth;
+    int handle_bl_peak;
+    int wr_bl_peak;
+    int wr_dbe_peak;
+    unsigned long long repl_sent_bytes_last; /* repl master stream, sampled every second */
+    unsigned long long repl_sent_recs_last;
+    long long repl_sample_ms;
+    unsigned long long repl_bytes_ps;
+    unsigned long long repl_recs_ps;
+    unsigned long long bl_enq_seq; /* seq of last binlog record queued by main thread */
+    volatile unsigned long long bl_synced_seq; /* seq of last binlog record written(synced) */
     int dbe_get_clients_cnt;
     int dbe_get_que_size;
     int wr_bl_que_size;
@@ -699,6 +772,8 @@ struct redisServer
     int prtcl_redis;
     int dbe_ver;
     int enc_kv;
+    int dbe_key_ver;            /* format of dbe keys written, DBE_KEY_VER_x */
+    volatile int dbe_key_mixed; /* dbe may still have keys of v1 */
 };
 
 typedef struct pubsubPattern {
@@ -842,7 +917,9 @@ typedef struct {
 extern struct redisServer server;
 extern struct sharedObjectsStruct shared;
 extern dictType setDictType;
+extern dictType sdsSetDictType;
 extern dictType zsetDictType;
+extern dictType dbeGetDictType;
 extern double R_Zero, R_PosInf, R_NegInf, R_Nan;
 dictType hashDictType;
 
@@ -857,6 +934,12 @@ void freeClient(redisClient *c);
 void freeClientOutLoop(redisClient *c);
 void resetClient(redisClient *c);
 void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask);
+int handleClientsWithPendingWrites(void);
+int handleClientsWithPendingReads(void);
+int ioReadQuery(redisClient *c);
+void ioParseQuery(redisClient *c);
+int ioWriteClient(redisClient *c, unsigned long long *calls);
+void queueClientPendingWrite(redisClient *c);
 void addReply_unsigned(redisClient *c, robj *obj);
 void *addDeferredMultiBulkLength(redisClient *c);
 void setDeferredMultiBulkLength(redisClient *c, void *node, long length);
@@ -970,6 +1053,9 @@ char *strEncoding(int encoding);
 int compareStringObjects(robj *a, robj *b);
 int equalStringObjects(robj *a, robj *b);
 unsigned long estimateObjectIdleTime(robj *o);
+unsigned long LFUDecrAndReturn(robj *o);
+unsigned int objectInitLRU(void);
+void updateObjectAccess(robj *o);
 
 /* Synchronous I/O with timeout */
 int syncWrite(int fd, char *ptr, ssize_t size, int timeout);
@@ -1174,6 +1260,7 @@ void bgrewriteaofCommand(redisClient *c);
 void shutdownCommand(redisClient *c);
 void moveCommand(redisClient *c);
 void renameCommand(redisClient *c);
+void restoreCommand(redisClient *c);
 void renamenxCommand(redisClient *c);
 void lpushCommand(redisClient *c);
 void rpushCommand(redisClient *c);
@@ -1214,6 +1301,7 @@ void mergedbeCommand(redisClient *c);
 void cleancacheCommand(redisClient *c);
 void cleandbeCommand(redisClient *c);
 void purgedbeCommand(redisClient *c);
+void migratedbekeyCommand(redisClient *c);
 void decodeblCommand(redisClient *c);
 void flushcpCommand(redisClient *c);
 void flushdbCommand(redisClient *c);
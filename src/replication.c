@@ -252,6 +252,63 @@ static int bl_filter_gen(const char *bl_ptr, int bl_len, const char *ds_key)
     return rslt;
 }
 
+/* bl_filter_gen() for a batch of records, see filter_bulk_func */
+static void bl_filter_gen_bulk(const char **bl_ptrs, const int *bl_lens, int cnt, const char *ds_key, char *drop)
+{
+    const int ds_key_len = ds_key ? strlen(ds_key) : 0;
+    const char **keys = (const char **)zcalloc(sizeof(char *) * cnt);
+    int *key_lens = (int *)zcalloc(sizeof(int) * cnt);
+    op_rec rec;
+    int i;
+
+    for (i = 0; i < cnt; i++)
+    {
+        if (bl_ptrs[i] == 0 || bl_lens[i] <= 0)
+        {
+            continue;
+        }
+
+        if (parse_op_rec_key(bl_ptrs[i], bl_lens[i], &rec) != 0)
+        {
+            continue;
+        }
+
+        if (rec.cmd == 0)
+        {
+            drop[i] = 1;
+        }
+        else
+        {
+            keys[i] = rec.key.ptr;
+            key_lens[i] = rec.key.len;
+        }
+
+        if (rec.argc != 0)
+        {
+            /* free memory malloc in parse_op_rec() */
+            zfree(rec.argv);
+        }
+    }
+
+    if (ds_key_len > 0)
+    {
+        filter_gen_bulk(keys, key_lens, cnt, ds_key, drop);
+    }
+    else if (server.is_slave)
+    {
+        for (i = 0; i < cnt; i++)
+        {
+            if (drop[i] == 0 && keys[i])
+            {
+                drop[i] = sync_filter(keys[i], key_lens[i]) ? 1 : 0;
+            }
+        }
+    }
+
+    zfree(keys);
+    zfree(key_lens);
+}
+
 //static void *do_sync_master(void *arg);
 /* 
  * cmd format: sync bl_tag ds_id [ds_key]
@@ -280,7 +337,7 @@ void syncCommand(redisClient *c)
 
     aeDeleteFileEvent(server.el, c->fd, AE_READABLE);
 
-    const int ret = sync_master_start(bl_path, dbmng_conf.log_prefix, dbmng_conf.binlog_max_size, BL_MAX_IDX, c, freeClientOutLoop, server.ds_key_num, ds_id_s, ds_key_s, bl_filter_gen);
+    const int ret = sync_master_start(bl_path, dbmng_conf.log_prefix, dbmng_conf.binlog_max_size, BL_MAX_IDX, c, freeClientOutLoop, server.ds_key_num, ds_id_s, ds_key_s, bl_filter_gen, bl_filter_gen_bulk);
     if (ret != 0)
     {
         redisLog(REDIS_WARNING, "sync_master_start fail, ret=%d, slave=%s:%d",
@@ -5,19 +5,64 @@
 #include "dbe_if.h"
 #include "serialize.h"
 #include "t_zset.h"
+#include "latency_hist.h"
 
-static void stat_dbe_get_op();
-static int make_string(const char *val, int v_len, val_attr *rslt, dbe_stat *tmp);
-static int make_list(robj *subject, char *key, int k_len, char *val, int v_len);
-static int make_set(robj *set, char *key, int k_len, char *val, int v_len, robj *vobj);
-static int make_zset(robj *zobj, char *key, int k_len, char *val, int v_len);
-static int make_hash(robj *set, char *key, int k_len, char *val, int v_len);
+/* members of a list/set/zset/hash restored from dbe are gathered in a
+ * pool growing by doubling, then the value is built at once in its final
+ * encoding: ziplist/intset/zipmap while the thresholds allow, else a
+ * dict/skiplist sized for all members */
+typedef struct rk_elem_st
+{
+    size_t off;         /* in pool while rows are read */
+    const char *ptr;    /* set from off once all rows are read */
+    uint32_t len;       /* list value, set/zset member, hash field */
+    uint32_t len2;      /* zset score text, hash value, behind ptr + len */
+    double score;
+    int64_t n;          /* list seq, set member as integer */
+} rk_elem;
+
+typedef struct rk_stream_st
+{
+    char type;
+    rk_elem *elems;
+    size_t cnt;
+    size_t cap;
+    char *pool;
+    size_t used;
+    size_t pool_cap;
+    size_t max_len;     /* the longest len/len2 */
+    int all_int;        /* every set member fits in an intset */
+} rk_stream;
+
+/* rows of dbe iterator are allocated here and dropped all by next row */
+typedef struct rk_chunk_st
+{
+    struct rk_chunk_st *next;
+    size_t cap;
+    size_t used;
+    char data[];
+} rk_chunk;
+
+#define RK_CHUNK_MIN    (16 * 1024)
+/* a thread keeps its row chunk up to this size */
+#define RK_CHUNK_KEEP   (1024 * 1024)
+
+static __thread rk_chunk *sc_row;
+
+static int make_string(const char *val, int v_len, val_attr *rslt);
+static int next_key(void *it, char **k, int *k_len, char **v, int *v_len);
+static void row_release();
+static void stream_init(rk_stream *s, char type);
+static void stream_free(rk_stream *s);
+static int stream_row(rk_stream *s, const char *key, int k_len, const char *val, int v_len);
+static robj *stream_build(rk_stream *s);
 static int restore_key_fuzzy(void *db, const char *k, size_t k_len, val_attr *rslt);
 static int restore_string_key(void *db, const char *k, size_t k_len, val_attr *rslt);
-static int restore_list_key(void *db, const char *k, size_t k_len, val_attr *rslt);
-static int restore_set_key(void *db, const char *k, size_t k_len, val_attr *rslt);
-static int restore_zset_key(void *db, const char *k, size_t k_len, val_attr *rslt);
-static int restore_hash_key(void *db, const char *k, size_t k_len, val_attr *rslt);
+static int restore_multi_key(void *db, const char *k, size_t k_len, char type, val_attr *rslt);
+static int get_string_key(void *db, const char *k, size_t k_len, int ver, val_attr *rslt);
+static int key_vers(int vers[2]);
+static int first_row(void *db, const char *k, size_t k_len, char type
+                     , void **it, char **key, int *key_len, char **val, int *val_len);
 
 /*
  * key_type: 'k" mean key_prefix
@@ -48,21 +93,10 @@ int restore_key_from_dbe(void *db, const char *key, size_t key_len, char key_typ
     {
         ret = restore_string_key(db, key, key_len, rslt);
     }
-    else if (key_type == 'L')
-    {
-        ret = restore_list_key(db, key, key_len, rslt);
-    }
-    else if (key_type == 'S')
+    else if (key_type == KEY_TYPE_LIST || key_type == KEY_TYPE_SET
+             || key_type == KEY_TYPE_ZSET || key_type == KEY_TYPE_HASH)
     {
-        ret = restore_set_key(db, key, key_len, rslt);
-    }
-    else if (key_type == 'Z')
-    {
-        ret = restore_zset_key(db, key, key_len, rslt);
-    }
-    else if (key_type == 'H')
-    {
-        ret = restore_hash_key(db, key, key_len, rslt);
+        ret = restore_multi_key(db, key, key_len, key_type, rslt);
     }
     else if (key_type == 'k')
     {
@@ -72,62 +106,73 @@ int restore_key_from_dbe(void *db, const char *key, size_t key_len, char key_typ
     {
         log_error("unknown key_type=\'%c\'", key_type);
     }
+    row_release();
     return ret;
 #endif
 }
 
-static int restore_key_fuzzy(void *db, const char *k, size_t k_len, val_attr *rslt)
+/* continue the rows of it after the first one (key, val) into a value of type */
+static int restore_rows(void *it, char type, const char *k, char *key, int key_len, char *val, int val_len, val_attr *rslt)
 {
-    dbe_stat *tmp = &gDbeGetTop[0];
-    int ret = 3;
-    char *key = 0;
-    size_t key_len;
+    rk_stream s;
+    int ret = 0;
+    int m_cnt = 0;
 
-    key = encode_prefix_key(k, k_len, 0, &key_len);
-    if (key == 0)
+    stream_init(&s, type);
+    while (key)
     {
-        return 3;
+        if (stream_row(&s, key, key_len, val, val_len) != 0)
+        {
+            log_error("restore '%c' fail for a row, key=%s", type, k);
+            ret = 3;
+            break;
+        }
+        m_cnt++;
+        if (next_key(it, &key, &key_len, &val, &val_len) != 0)
+        {
+            key = 0;
+        }
     }
+    dbe_destroy_it(it);
 
-    void *it = dbe_pget(db, key, key_len);
-    if (it == 0)
+    log_test("get %d member from dbe for '%c', key=%s", m_cnt, type, k);
+    if (ret == 0)
     {
-        log_error("dbe_pget fail, dbe_key_prefix=%s", key);
-        zfree(key);
-        return 3;
+        if (m_cnt == 0)
+        {
+            ret = 1;
+        }
+        else if ((rslt->val = stream_build(&s)) == NULL)
+        {
+            log_error("build '%c' fail, key=%s", type, k);
+            ret = 3;
+        }
     }
-    zfree(key);
-    key = 0;
+    stream_free(&s);
+    return ret;
+}
 
-    /* get one and parse type from it */
+static int restore_key_fuzzy(void *db, const char *k, size_t k_len, val_attr *rslt)
+{
+    void *it;
+    char *key = 0;
     char *val = 0;
-    size_t val_len;
     int key_len_;
     int val_len_;
     int tmp_ret;
-    tmp_ret = dbe_next_key(it, &key, &key_len_, &val, &val_len_, zmalloc, &tmp->io_dur);
+
+    /* get one and parse type from it */
+    tmp_ret = first_row(db, k, k_len, 0, &it, &key, &key_len_, &val, &val_len_);
     if (tmp_ret != 0)
     {
-        log_info("restore_key_fuzzy: dbe_next_key fail, ret=%d, key=%s"
-                , tmp_ret, k);
-        dbe_destroy_it(it);
-        return 1;
+        return tmp_ret;
     }
-    key_len = key_len_;
-    val_len = val_len_;
 
     dbe_key_attr attr;
-    tmp_ret = decode_dbe_key(key, key_len, &attr);
+    tmp_ret = decode_dbe_key(key, key_len_, &attr);
     if (tmp_ret != 0)
     {
         log_error("restore_key_fuzzy: decode_key fail, dbe_key=%s", key);
-#ifdef _DBE_LEVEL_DB_
-        zfree(key);
-        zfree(val);
-#else
-        dbe_free_ptr(key, zfree);
-        dbe_free_ptr(val, zfree);
-#endif
         dbe_destroy_it(it);
         return 3;
     }
@@ -135,150 +180,23 @@ static int restore_key_fuzzy(void *db, const char *k, size_t k_len, val_attr *rs
     if (attr.type == KEY_TYPE_STRING)
     {
         dbe_destroy_it(it);
-
-        ret = make_string(val, val_len, rslt, tmp) == 0 ? 0 : 3;
-
-#ifdef _DBE_LEVEL_DB_
-        zfree(key);
-        zfree(val);
-#else
-        dbe_free_ptr(key, zfree);
-        dbe_free_ptr(val, zfree);
-#endif
-    }
-    else if (attr.type == KEY_TYPE_LIST)
-    {
-        robj *subject = createListObject();
-        ret = make_list(subject, key, key_len_, val, val_len_);
-        if (ret == 0)
-        {
-            while (dbe_next_key(it, &key, &key_len_, &val, &val_len_, zmalloc, &tmp->io_dur) == 0)
-            {
-                ret = make_list(subject, key, key_len_, val, val_len_);
-                if (ret == 1)
-                {
-                    break;
-                }
-            }
-        }
-        dbe_destroy_it(it);
-        if (ret == 0)
-        {
-            rslt->val = subject;
-        }
-        else
-        {
-            decrRefCount(subject);
-            log_error("make_list fail, key=%s", k);
-            ret = 3;
-        }
-    }
-    else if (attr.type == KEY_TYPE_ZSET)
-    {
-        robj *zobj = createZsetZiplistObject();
-        ret = make_zset(zobj, key, key_len_, val, val_len_);
-        if (ret == 0)
-        {
-            while (dbe_next_key(it, &key, &key_len_, &val, &val_len_, zmalloc, &tmp->io_dur) == 0)
-            {
-                ret = make_zset(zobj, key, key_len_, val, val_len_);
-                if (ret == 1)
-                {
-                    break;
-                }
-            }
-        }
-        dbe_destroy_it(it);
-        if (ret == 0)
-        {
-            rslt->val = zobj;
-        }
-        else
-        {
-            decrRefCount(zobj);
-            log_error("make_zset fail, key=%s", k);
-            ret = 3;
-        }
-    }
-    else if (attr.type == KEY_TYPE_SET)
-    {
-        robj *member = createStringObject(val + 1, val_len - 1);
-        robj *set = setTypeCreate(member);
-        ret = make_set(set, key, key_len_, val, val_len_, member);
-        if (ret == 0)
-        {
-            while (dbe_next_key(it, &key, &key_len_, &val, &val_len_, zmalloc, &tmp->io_dur) == 0)
-            {
-                ret = make_set(set, key, key_len_, val, val_len_, NULL);
-                if (ret == 1)
-                {
-                    break;
-                }
-            }
-        }
-        dbe_destroy_it(it);
-        if (ret == 0)
-        {
-            rslt->val = set;
-        }
-        else
-        {
-            decrRefCount(set);
-            log_error("make_set fail, key=%s", k);
-            ret = 3;
-        }
+        return make_string(val, val_len_, rslt) == 0 ? 0 : 3;
     }
-    else if (attr.type == KEY_TYPE_HASH)
+    else if (attr.type == KEY_TYPE_LIST || attr.type == KEY_TYPE_SET
+             || attr.type == KEY_TYPE_ZSET || attr.type == KEY_TYPE_HASH)
     {
-        robj *hash = createHashObject();
-        ret = make_hash(hash, key, key_len_, val, val_len_);
-        if (ret == 0)
-        {
-            while (dbe_next_key(it, &key, &key_len_, &val, &val_len_, zmalloc, &tmp->io_dur) == 0)
-            {
-                ret = make_hash(hash, key, key_len_, val, val_len_);
-                if (ret == 1)
-                {
-                    break;
-                }
-            }
-        }
-        dbe_destroy_it(it);
-        if (ret == 0)
-        {
-            rslt->val = hash;
-        }
-        else
-        {
-            decrRefCount(hash);
-            log_error("make_hash fail, key=%s", k);
-            ret = 3;
-        }
+        return restore_rows(it, attr.type, k, key, key_len_, val, val_len_, rslt);
     }
     else
     {
         dbe_destroy_it(it);
-
-#ifdef _DBE_LEVEL_DB_
-        zfree(key);
-        zfree(val);
-#else
-        dbe_free_ptr(key, zfree);
-        dbe_free_ptr(val, zfree);
-#endif
-        ret = restore_key_from_dbe(db, k, k_len, attr.type, rslt);
+        return restore_key_from_dbe(db, k, k_len, attr.type, rslt);
     }
-
-    return ret;
 }
 
-static int make_string(const char *val, int v_len, val_attr *rslt, dbe_stat *tmp)
+static int make_string(const char *val, int v_len, val_attr *rslt)
 {
-    struct timespec ts;
-    ts = pf_get_time_tick();
     rslt->val = unserializeObj(val, v_len, (time_t*)&rslt->expire_ms);
-    tmp->unserialize_dur = pf_get_time_diff_nsec(ts, pf_get_time_tick()) / 1000;
-    stat_dbe_get_op();
     int ret = 0;
     if (rslt->val == NULL)
     {
@@ -296,7 +214,24 @@ static int make_string(const char *val, int v_len, val_attr *rslt, dbe_stat *tmp
  */
 static int restore_string_key(void *db, const char *k, size_t k_len, val_attr *rslt)
 {
-    dbe_stat *tmp = &gDbeGetTop[0];
+    if (server.enc_kv && server.dbe_key_mixed)
+    {
+        int vers[2];
+        const int n = key_vers(vers);
+        int ret = 1;
+        int i;
+        for (i = 0; i < n && ret == 1; i++)
+        {
+            ret = get_string_key(db, k, k_len, vers[i], rslt);
+        }
+        return ret;
+    }
+    return get_string_key(db, k, k_len, server.dbe_key_ver, rslt);
+}
+
+/* ret: as restore_string_key(), ver is ignored without enc_kv */
+static int get_string_key(void *db, const char *k, size_t k_len, int ver, val_attr *rslt)
+{
     char *key = 0;
     size_t key_len;
 
@@ -307,9 +242,14 @@ static int restore_string_key(void *db, const char *k, size_t k_len, val_attr *r
     }
     else
     {
-        key = encode_string_key(k, k_len, &key_len);
+        key = encode_string_key_ver(ver, k, k_len, &key_len);
         if (key == 0)
         {
+            if (ver == DBE_KEY_VER_1 && server.dbe_key_mixed)
+            {
+                /* too long for v1, never written in it */
+                return 1;
+            }
             log_error("encode fail, key=%s", k);
             return 3;
         }
@@ -318,7 +258,9 @@ static int restore_string_key(void *db, const char *k, size_t k_len, val_attr *r
     /* get value from db engine */
     int len;
     char *ptr = 0;
-    const int dbe_ret = dbe_get(db, key, key_len, &ptr, &len, zmalloc, &tmp->io_dur);
+    int64_t io_dur = 0;
+    const int dbe_ret = dbe_get(db, key, key_len, &ptr, &len, zmalloc, &io_dur);
+    lh_record(LH_DBE_GET, io_dur);
     if (dbe_ret == DBE_ERR_NOT_FOUND)
     {
         log_info("dbe_get() return null, db=%p, dbe_key=%s", db, key);
@@ -337,10 +279,9 @@ static int restore_string_key(void *db, const char *k, size_t k_len, val_attr *r
         }
         return 2;
     }
-    tmp->buf_len = len;
 
     int ret = 0;
-    if (make_string(ptr, len, rslt, tmp) != 0)
+    if (make_string(ptr, len, rslt) != 0)
     {
         /* fail */
         log_error("make_string() fail, val_len=%d, dbe_key=%s", len, key);
@@ -356,284 +297,443 @@ static int restore_string_key(void *db, const char *k, size_t k_len, val_attr *r
     return ret;
 }
 
-static int restore_list_key(void *db, const char *k, size_t k_len, val_attr *rslt)
+/* ret:
+ * 0 - succ
+ * 1 - not found
+ * 3 - process fail
+ */
+static int restore_multi_key(void *db, const char *k, size_t k_len, char type, val_attr *rslt)
 {
-    (void)db;
-    (void)k;
-    (void)k_len;
-    (void)rslt;
-    return 3;
+    void *it;
+    char *key = 0;
+    char *val = 0;
+    int key_len_;
+    int val_len_;
+    const int ret = first_row(db, k, k_len, type, &it, &key, &key_len_, &val, &val_len_);
+    if (ret != 0)
+    {
+        return ret;
+    }
+    return restore_rows(it, type, k, key, key_len_, val, val_len_, rslt);
 }
 
-static int make_list(robj *subject, char *key, int k_len, char *val, int v_len)
+/* the dbe key versions to look up in order while keys are migrated:
+ * a key is written as v2 only after its v1 rows are moved,
+ * so a v2 row is always newer than a v1 one left behind */
+static int key_vers(int vers[2])
 {
-    size_t key_len = k_len;
-    size_t val_len = v_len;
-
-    dbe_key_attr key_attr;
-    decode_dbe_key(key, key_len, &key_attr);
-    uint32_t seq = key_attr.seq;
-#ifdef _DBE_LEVEL_DB_
-    zfree(key);
-#else
-    dbe_free_ptr(key, zfree);
-#endif
+    if (server.dbe_key_mixed)
+    {
+        vers[0] = server.dbe_key_ver;
+        vers[1] = DBE_KEY_VER_1;
+        return 2;
+    }
+    vers[0] = server.dbe_key_ver;
+    return 1;
+}
 
-    robj *val_obj = createStringObject(val + 1, val_len - 1);
-    val_obj->reserved = seq;
+/* open the rows of k with prefix type(0 for any type) and read the first one
+ * ret:
+ * 0 - succ, *it is to be destroyed by caller
+ * 1 - not found
+ * 3 - process fail
+ */
+static int first_row(void *db, const char *k, size_t k_len, char type
+                     , void **it, char **key, int *key_len, char **val, int *val_len)
+{
+    int vers[2];
+    const int n = key_vers(vers);
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        size_t pre_len;
+        char *pre = encode_prefix_key_ver(vers[i], k, k_len, type, &pre_len);
+        if (pre == 0)
+        {
+            if (vers[i] == DBE_KEY_VER_1 && n > 1)
+            {
+                /* too long for v1 */
+                continue;
+            }
+            return 3;
+        }
 
-#ifdef _DBE_LEVEL_DB_
-    zfree(val);
-#else
-    dbe_free_ptr(val, zfree);
-#endif
+        *it = dbe_pget(db, pre, pre_len);
+        if (*it == 0)
+        {
+            log_error("dbe_pget fail, dbe_key_prefix=%s", pre);
+            zfree(pre);
+            return 3;
+        }
+        zfree(pre);
 
-    listIter *iter = NULL;
-    listNode *node = NULL;
-    int cnt = 0;
-    iter = listGetIterator(subject->ptr, AL_START_HEAD);
-    while (iter && (node = listNext(iter)) != NULL)
-    {
-        cnt++;
-        robj *cur = (robj*)listNodeValue(node);
-        if (seq <= cur->reserved)
+        const int ret = next_key(*it, key, key_len, val, val_len);
+        if (ret == 0)
         {
-            log_test("No.%d: seq(%d) <= Node(%d)", cnt, seq, cur->reserved);
-            break;
+            return 0;
         }
+        log_info("first_row: dbe_next_key fail, ret=%d, ver=%d, key=%s", ret, vers[i], k);
+        dbe_destroy_it(*it);
+        *it = 0;
     }
-    listReleaseIterator(iter);
-    if (node)
+    return 1;
+}
+
+static void *row_alloc(size_t size)
+{
+    size = (size + 7) & ~(size_t)7;
+    if (sc_row == NULL || sc_row->used + size > sc_row->cap)
     {
-        log_test("listInsertNode: seq=%u", seq);
-        subject->ptr = listInsertNode(subject->ptr, node, val_obj, AL_START_HEAD);
-    }
-    else if (cnt > 0)
+        size_t cap = sc_row ? sc_row->cap * 2 : RK_CHUNK_MIN;
+        while (cap < size)
+        {
+            cap *= 2;
+        }
+        rk_chunk *c = zmalloc(sizeof(*c) + cap);
+        c->next = sc_row;
+        c->cap = cap;
+        c->used = 0;
+        sc_row = c;
+    }
+    void *ptr = sc_row->data + sc_row->used;
+    sc_row->used += size;
+    return ptr;
+}
+
+/* drop the last row, only the newest(largest) chunk is kept */
+static void row_reset()
+{
+    if (sc_row)
     {
-        log_test("listAddNodeTail: seq=%u", seq);
-        subject->ptr = listAddNodeTail(subject->ptr, val_obj);
+        rk_chunk *c = sc_row->next;
+        while (c)
+        {
+            rk_chunk *next = c->next;
+            zfree(c);
+            c = next;
+        }
+        sc_row->next = NULL;
+        sc_row->used = 0;
     }
-    else
+}
+
+static void row_release()
+{
+    row_reset();
+    if (sc_row && sc_row->cap > RK_CHUNK_KEEP)
     {
-        log_test("listAddNodeHead: seq=%u", seq);
-        subject->ptr = listAddNodeHead(subject->ptr, val_obj);
+        zfree(sc_row);
+        sc_row = NULL;
     }
-
-    stat_dbe_get_op();
-
-    return 0;
 }
 
-static int make_set(robj *set, char *key, int k_len, char *val, int v_len, robj *vobj)
+static void stream_init(rk_stream *s, char type)
 {
-    (void)k_len;
+    memset(s, 0, sizeof(*s));
+    s->type = type;
+    s->all_int = 1;
+}
 
-    /* the key is dbe_key include md5 of member, useless */
-#ifdef _DBE_LEVEL_DB_
-    zfree(key);
-#else
-    dbe_free_ptr(key, zfree);
-#endif
+static void stream_free(rk_stream *s)
+{
+    if (s->elems)
+    {
+        zfree(s->elems);
+    }
+    if (s->pool)
+    {
+        zfree(s->pool);
+    }
+    memset(s, 0, sizeof(*s));
+}
 
-    int ret = 1;
-    robj *member = vobj ? vobj : createStringObject(val + 1, v_len - 1);
-    if (member)
+/* add a member of len + len2 bytes, return it with off set */
+static rk_elem *stream_add(rk_stream *s, const char *p, size_t len, const char *p2, size_t len2)
+{
+    if (s->cnt == s->cap)
     {
-        if (setTypeAdd(set, member) == 0)
-        {
-            /* fail */
-            decrRefCount(member);
-            ret = 1;
-        }
-        else
+        s->cap = s->cap ? s->cap * 2 : 16;
+        s->elems = zrealloc(s->elems, s->cap * sizeof(rk_elem));
+    }
+    if (s->used + len + len2 > s->pool_cap)
+    {
+        size_t cap = s->pool_cap ? s->pool_cap : 1024;
+        while (cap < s->used + len + len2)
         {
-            ret = 0;
+            cap *= 2;
         }
+        s->pool = zrealloc(s->pool, cap);
+        s->pool_cap = cap;
     }
 
-#ifdef _DBE_LEVEL_DB_
-    zfree(val);
-#else
-    dbe_free_ptr(val, zfree);
-#endif
-
-    stat_dbe_get_op();
+    rk_elem *e = &s->elems[s->cnt++];
+    memset(e, 0, sizeof(*e));
+    e->off = s->used;
+    e->len = len;
+    e->len2 = len2;
+    memcpy(s->pool + s->used, p, len);
+    if (len2)
+    {
+        memcpy(s->pool + s->used + len, p2, len2);
+    }
+    s->used += len + len2;
 
-    return ret;
+    if (len > s->max_len)
+    {
+        s->max_len = len;
+    }
+    if (len2 > s->max_len)
+    {
+        s->max_len = len2;
+    }
+    return e;
 }
 
-static int make_hash(robj *set, char *key, int k_len, char *val, int v_len)
+/* ret: 0 - succ, 1 - fail */
+static int stream_row(rk_stream *s, const char *key, int k_len, const char *val, int v_len)
 {
-    (void)k_len;
-    size_t val_len = v_len;
-
-    /* the key is dbe_key include md5 of member, useless */
-#ifdef _DBE_LEVEL_DB_
-    zfree(key);
-#else
-    dbe_free_ptr(key, zfree);
-#endif
-
-    hash_val_attr attr;
-    const int ret = decode_hash_val(val, val_len, &attr);
-    if (ret == 0)
+    if (v_len < 1)
     {
-        robj *f_obj = createStringObject(attr.field, attr.f_len);
-        robj *v_obj = createStringObject(attr.val, attr.v_len);
-        hashTypeSet(set, f_obj, v_obj);
+        log_error("illegal dbe value, len=%d", v_len);
+        return 1;
     }
 
-#ifdef _DBE_LEVEL_DB_
-    zfree(val);
-#else
-    dbe_free_ptr(val, zfree);
-#endif
-
-    stat_dbe_get_op();
-
-    return ret;
+    if (s->type == KEY_TYPE_LIST)
+    {
+        dbe_key_attr key_attr;
+        decode_dbe_key(key, k_len, &key_attr);
+        rk_elem *e = stream_add(s, val + 1, v_len - 1, NULL, 0);
+        e->n = key_attr.seq;
+    }
+    else if (s->type == KEY_TYPE_SET)
+    {
+        /* the key is dbe_key include md5 of member, useless */
+        long long ll;
+        rk_elem *e = stream_add(s, val + 1, v_len - 1, NULL, 0);
+        if (s->all_int && string2ll((char *)val + 1, v_len - 1, &ll))
+        {
+            e->n = ll;
+        }
+        else
+        {
+            s->all_int = 0;
+        }
+    }
+    else if (s->type == KEY_TYPE_ZSET)
+    {
+        zset_val_attr attr;
+        if (decode_zset_val(val, v_len, &attr) != 0)
+        {
+            return 1;
+        }
+        /* keep the score text, it is what zzlInsert() would write */
+        const char *score = attr.member + attr.m_len;
+        rk_elem *e = stream_add(s, attr.member, attr.m_len, score, val + v_len - score);
+        e->score = attr.score;
+    }
+    else if (s->type == KEY_TYPE_HASH)
+    {
+        hash_val_attr attr;
+        if (decode_hash_val(val, v_len, &attr) != 0)
+        {
+            return 1;
+        }
+        stream_add(s, attr.field, attr.f_len, attr.val, attr.v_len);
+    }
+    else
+    {
+        return 1;
+    }
+    return 0;
 }
 
-static int restore_set_key(void *db, const char *k, size_t k_len, val_attr *rslt)
+static int cmp_elem_seq(const void *a, const void *b)
 {
-    (void)db;
-    (void)k;
-    (void)k_len;
-    (void)rslt;
-    return 3;
+    const rk_elem *x = a;
+    const rk_elem *y = b;
+    return x->n < y->n ? -1 : (x->n > y->n ? 1 : 0);
 }
 
-static int make_zset(robj *zobj, char *key, int k_len, char *val, int v_len)
+/* the order of zzlInsert() and zslInsert() */
+static int cmp_elem_score(const void *a, const void *b)
 {
-    (void)k_len;
-    size_t val_len = v_len;
-
-    /* the key is dbe_key include md5 of member, useless */
-#ifdef _DBE_LEVEL_DB_
-    zfree(key);
-#else
-    dbe_free_ptr(key, zfree);
-#endif
-
-    zset_val_attr attr;
-    const int ret = decode_zset_val(val, val_len, &attr);
-    if (ret == 0)
+    const rk_elem *x = a;
+    const rk_elem *y = b;
+    if (x->score != y->score)
     {
-        zaddMember(zobj, attr.member, attr.m_len, attr.score);
+        return x->score < y->score ? -1 : 1;
     }
-
-#ifdef _DBE_LEVEL_DB_
-    zfree(val);
-#else
-    dbe_free_ptr(val, zfree);
-#endif
-
-    stat_dbe_get_op();
-
-    return ret ? 1 : 0;
+    const int ret = memcmp(x->ptr, y->ptr, x->len < y->len ? x->len : y->len);
+    return ret ? ret : (int)x->len - (int)y->len;
 }
 
-static int restore_zset_key(void *db, const char *k, size_t k_len, val_attr *rslt)
+static robj *build_list(rk_stream *s)
 {
-    dbe_stat *tmp = &gDbeGetTop[0];
-    char *key = 0;
-    size_t key_len;
+    size_t i;
+    robj *o;
 
-    key = encode_prefix_key(k, k_len, 'Z', &key_len);
-    if (key == 0)
+    qsort(s->elems, s->cnt, sizeof(rk_elem), cmp_elem_seq);
+    if (s->cnt <= server.list_max_ziplist_entries
+        && s->max_len <= server.list_max_ziplist_value)
     {
-        return 3;
+        o = createZiplistObject();
+        for (i = 0; i < s->cnt; i++)
+        {
+            o->ptr = ziplistPush(o->ptr, (unsigned char *)s->elems[i].ptr
+                                 , s->elems[i].len, ZIPLIST_TAIL);
+        }
     }
-
-    void *it = dbe_pget(db, key, key_len);
-    if (it == 0)
+    else
     {
-        log_error("dbe_pget fail, dbe_key_prefix=%s", key);
-        zfree(key);
-        return 3;
+        o = createListObject();
+        for (i = 0; i < s->cnt; i++)
+        {
+            listAddNodeTail(o->ptr, createStringObject((char *)s->elems[i].ptr, s->elems[i].len));
+        }
     }
-    zfree(key);
-    key = 0;
+    return o;
+}
 
-    char *val = 0;
-    int key_len_;
-    int val_len_;
-    int m_cnt = 0;
-    robj *zobj = createZsetZiplistObject();
-    while (dbe_next_key(it, &key, &key_len_, &val, &val_len_, zmalloc, &tmp->io_dur) == 0)
+static robj *build_set(rk_stream *s)
+{
+    size_t i;
+    robj *o;
+
+    if (s->all_int && s->cnt <= server.set_max_intset_entries)
     {
-        const int ret = make_zset(zobj, key, key_len_, val, val_len_);
-        if (ret == 1)
+        /* in order, every intsetAdd() appends */
+        qsort(s->elems, s->cnt, sizeof(rk_elem), cmp_elem_seq);
+        o = createIntsetObject();
+        for (i = 0; i < s->cnt; i++)
         {
-            decrRefCount(zobj);
-            dbe_destroy_it(it);
-            log_error("make_zset fail, key=%s", k);
-            return 3;
+            o->ptr = intsetAdd(o->ptr, s->elems[i].n, NULL);
         }
-
-        m_cnt++;
     }
+    else
+    {
+        o = createSetObject();
+        dictExpand(o->ptr, s->cnt);
+        for (i = 0; i < s->cnt; i++)
+        {
+            robj *member = createStringObject((char *)s->elems[i].ptr, s->elems[i].len);
+            if (dictAdd(o->ptr, member, NULL) != DICT_OK)
+            {
+                decrRefCount(member);
+            }
+        }
+    }
+    return o;
+}
 
-    dbe_destroy_it(it);
+static robj *build_zset(rk_stream *s)
+{
+    size_t i;
+    robj *o;
 
-    log_test("get %d member from dbe for zset, key=%s", m_cnt, k);
-    if (m_cnt)
+    qsort(s->elems, s->cnt, sizeof(rk_elem), cmp_elem_score);
+    if (s->cnt <= server.zset_max_ziplist_entries
+        && s->max_len <= server.zset_max_ziplist_value)
     {
-        rslt->val = zobj;
-        return 0;
+        o = createZsetZiplistObject();
+        for (i = 0; i < s->cnt; i++)
+        {
+            const rk_elem *e = &s->elems[i];
+            o->ptr = ziplistPush(o->ptr, (unsigned char *)e->ptr, e->len, ZIPLIST_TAIL);
+            o->ptr = ziplistPush(o->ptr, (unsigned char *)e->ptr + e->len, e->len2, ZIPLIST_TAIL);
+        }
     }
     else
     {
-        /* no fount */
-        decrRefCount(zobj);
-        return 1;
+        o = createZsetObject();
+        zset *zs = o->ptr;
+        dictExpand(zs->dict, s->cnt);
+        for (i = 0; i < s->cnt; i++)
+        {
+            const rk_elem *e = &s->elems[i];
+            robj *ele = createStringObject((char *)e->ptr, e->len);
+            if (dictFind(zs->dict, ele) != NULL)
+            {
+                decrRefCount(ele);
+                continue;
+            }
+            zskiplistNode *znode = zslInsert(zs->zsl, e->score, ele);
+            incrRefCount(ele);
+            dictAdd(zs->dict, ele, &znode->score);
+        }
     }
+    return o;
 }
 
-static int restore_hash_key(void *db, const char *k, size_t k_len, val_attr *rslt)
+static robj *build_hash(rk_stream *s)
 {
-    (void)db;
-    (void)k;
-    (void)k_len;
-    (void)rslt;
-    int ret = 3;
-    return ret;
-}
+    size_t i;
+    robj *o;
 
-static void stat_dbe_get_op()
-{
-    /* sort according to io_dur */
-    int min_idx = 0;
-    unsigned int k;
-    for (k = 1; k < sizeof(gDbeGetTop) / sizeof(gDbeGetTop[0]); k++)
+    if (s->cnt <= server.hash_max_zipmap_entries
+        && s->max_len <= server.hash_max_zipmap_value)
     {
-        if (gDbeGetTop[k].valid == 0)
+        o = createHashObject();
+        for (i = 0; i < s->cnt; i++)
         {
-            min_idx = k;
-            break;
+            const rk_elem *e = &s->elems[i];
+            o->ptr = zipmapSet(o->ptr, (unsigned char *)e->ptr, e->len
+                               , (unsigned char *)e->ptr + e->len, e->len2, NULL);
         }
-        if (gDbeGetTop[k].io_dur < gDbeGetTop[min_idx].io_dur)
+    }
+    else
+    {
+        o = createObject(REDIS_HASH, dictCreate(&hashDictType, NULL));
+        o->encoding = REDIS_ENCODING_HT;
+        dictExpand(o->ptr, s->cnt);
+        for (i = 0; i < s->cnt; i++)
         {
-            min_idx = k;
+            const rk_elem *e = &s->elems[i];
+            robj *f_obj = createStringObject((char *)e->ptr, e->len);
+            robj *v_obj = createStringObject((char *)e->ptr + e->len, e->len2);
+            if (dictReplace(o->ptr, f_obj, v_obj) == 0)
+            {
+                /* the old field is kept */
+                decrRefCount(f_obj);
+            }
         }
     }
-    if (min_idx != 0)
+    return o;
+}
+
+static robj *stream_build(rk_stream *s)
+{
+    size_t i;
+    for (i = 0; i < s->cnt; i++)
     {
-        memcpy(&gDbeGetTop[min_idx], &gDbeGetTop[0], sizeof(gDbeGetTop[0]));
-        gDbeGetTop[min_idx].valid = 1;
-        gDbeGetTop[min_idx].time = time(NULL);
+        s->elems[i].ptr = s->pool + s->elems[i].off;
     }
 
-    if (gDbeGetTop[0].io_dur > gDbeGetMax)
+    if (s->type == KEY_TYPE_LIST)
     {
-        gDbeGetMax = gDbeGetTop[0].io_dur;
+        return build_list(s);
     }
-    if (gDbeGetTop[0].io_dur < gDbeGetMin || gDbeGetMin == 0)
+    else if (s->type == KEY_TYPE_SET)
     {
-        gDbeGetMin = gDbeGetTop[0].io_dur;
+        return build_set(s);
     }
-    gDbeGetTotal += gDbeGetTop[0].io_dur;
-    gDbeGetCnt++;
-    memset(&gDbeGetTop[0], 0, sizeof(gDbeGetTop[0]));
+    else if (s->type == KEY_TYPE_ZSET)
+    {
+        return build_zset(s);
+    }
+    else if (s->type == KEY_TYPE_HASH)
+    {
+        return build_hash(s);
+    }
+    return NULL;
 }
 
+/* dbe_next_key() with its duration recorded, the row lives in the row
+ * chunk of this thread until the next call */
+static int next_key(void *it, char **k, int *k_len, char **v, int *v_len)
+{
+    int64_t io_dur = 0;
+    row_reset();
+    const int ret = dbe_next_key(it, k, k_len, v, v_len, row_alloc, &io_dur);
+    lh_record(LH_DBE_GET, io_dur);
+    return ret;
+}
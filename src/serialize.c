@@ -1,5 +1,6 @@
 #include "redis.h"
 #include "lzf.h"    /* LZF compression library */
+#include "serialize.h"
 
 #include "ds_log.h"
 #include "zmalloc.h"
@@ -14,91 +15,126 @@
 #include <arpa/inet.h>
 #include <sys/stat.h>
 
-#define MOVE_BUF_PTR(PTR, OFFSET) \
-{\
-    if (PTR)\
-    {\
-        PTR += OFFSET;\
-    }\
+/* the object is written in one pass into a buffer growing on demand,
+ * instead of a pass to measure it (compressing every string once more)
+ * and a pass to write it. each thread keeps its buffer for next calls */
+#define SER_BUF_INIT    256
+/* a thread keeps its buffer up to this size */
+#define SER_BUF_KEEP    (1024 * 1024)
+/* type(1) + compressed len(5) + len(5) */
+#define SER_LZF_HDR_MAX 11
+
+static __thread ser_buf sc_buf;
+
+ser_buf *serializeBufGet()
+{
+    sc_buf.len = 0;
+    return &sc_buf;
+}
+
+void serializeBufReserve(ser_buf *b, size_t n)
+{
+    if (b->len + n <= b->cap)
+    {
+        return;
+    }
+    size_t cap = b->cap ? b->cap : SER_BUF_INIT;
+    while (cap < b->len + n)
+    {
+        cap *= 2;
+    }
+    b->p = b->p ? zrealloc(b->p, cap) : zmalloc(cap);
+    b->cap = cap;
 }
 
-/* Convenience wrapper around fwrite, that returns the number of bytes written
- * to the file instead of the number of objects (see fwrite(3)) and -1 in the
- * case of an error. It also supports a NULL *fp to skip writing altogether
- * instead of writing to /dev/null. */
-static int rdbWriteRaw(char *fp, const void *p, size_t len) 
+void serializeBufAppend(ser_buf *b, const void *p, size_t len)
 {
-    if (fp != NULL)
+    serializeBufReserve(b, len);
+    memcpy(b->p + b->len, p, len);
+    b->len += len;
+}
+
+/* return the content in a buffer of its size, to be released by zfree(),
+ * a big buffer is handed over instead of copied */
+char *serializeBufTake(ser_buf *b, int *pLen)
+{
+    char *buf;
+    *pLen = (int)b->len;
+    if (b->cap > SER_BUF_KEEP)
+    {
+        buf = zrealloc(b->p, b->len ? b->len : 1);
+        b->p = 0;
+        b->cap = 0;
+    }
+    else
     {
-        memcpy(fp, p, len);
+        buf = (char *)zmalloc(b->len ? b->len : 1);
+        memcpy(buf, b->p, b->len);
     }
+    b->len = 0;
+    return buf;
+}
+
+static int rdbWriteRaw(ser_buf *b, const void *p, size_t len)
+{
+    serializeBufAppend(b, p, len);
     return len;
 }
 
-static int rdbSaveType(char *fp, unsigned char type) 
+static int rdbSaveType(ser_buf *b, unsigned char type)
 {
-    return rdbWriteRaw(fp, &type, sizeof(type));
+    return rdbWriteRaw(b, &type, sizeof(type));
 }
 
-static int rdbSaveVersion(char *fp, uint64_t version) 
+static int rdbSaveVersion(ser_buf *b, uint64_t version)
 {
     uint64_t v = htonll(version);
-    return rdbWriteRaw(fp, &v, sizeof(version));
+    return rdbWriteRaw(b, &v, sizeof(version));
 }
 
-static int rdbSaveRsvd(char *fp, uint32_t reserved) 
+static int rdbSaveRsvd(ser_buf *b, uint32_t reserved)
 {
     uint32_t v = htonl(reserved);
-    return rdbWriteRaw(fp, &v, sizeof(reserved));
+    return rdbWriteRaw(b, &v, sizeof(reserved));
 }
 
-static int rdbSaveExpire(char *fp, uint32_t expire) 
+static int rdbSaveExpire(ser_buf *b, uint32_t expire)
 {
     uint32_t v = htonl(expire);
-    return rdbWriteRaw(fp, &v, sizeof(expire));
+    return rdbWriteRaw(b, &v, sizeof(expire));
 }
 
-static int rdbSaveTimestamp(char *fp, uint64_t ts) 
+static int rdbSaveTimestamp(ser_buf *b, uint64_t ts)
 {
     uint64_t v = htonll(ts);
-    return rdbWriteRaw(fp, &v, sizeof(ts));
-}
-
-#if 0
-static int rdbSaveTime(char *fp, time_t t) 
-{
-    int32_t t32 = (int32_t) t;
-    return rdbWriteRaw(fp, &t32, 4);
+    return rdbWriteRaw(b, &v, sizeof(ts));
 }
-#endif
 
-static int rdbSaveLen(char *str, uint32_t len) 
+/* return: bytes of the encoded len in buf (1, 2 or 5) */
+static int rdbEncodeLen(unsigned char *buf, uint32_t len)
 {
-    char *fp = str;
-    unsigned char buf[2];
-    int nwritten;
-
     if (len < (1<<6)) {
         /* Save a 6 bit len */
         buf[0] = (len&0xFF)|(REDIS_RDB_6BITLEN<<6);
-        if (rdbWriteRaw(fp,buf,1) == -1) return -1;
-        nwritten = 1;
+        return 1;
     } else if (len < (1<<14)) {
         /* Save a 14 bit len */
         buf[0] = ((len>>8)&0xFF)|(REDIS_RDB_14BITLEN<<6);
         buf[1] = len&0xFF;
-        if (rdbWriteRaw(fp,buf,2) == -1) return -1;
-        nwritten = 2;
+        return 2;
     } else {
         /* Save a 32 bit len */
         buf[0] = (REDIS_RDB_32BITLEN<<6);
-        if (rdbWriteRaw(fp,buf,1) == -1) return -1;
-        MOVE_BUF_PTR(fp, 1);
         len = htonl(len);
-        if (rdbWriteRaw(fp,&len,4) == -1) return -1;
-        nwritten = 1+4;
+        memcpy(buf + 1, &len, 4);
+        return 1+4;
     }
-    return nwritten;
+}
+
+static int rdbSaveLen(ser_buf *b, uint32_t len)
+{
+    unsigned char buf[5];
+    return rdbWriteRaw(b, buf, rdbEncodeLen(buf, len));
 }
 
 /* Encode 'value' as an integer if possible (if integer will fit the
@@ -132,140 +168,119 @@ static int rdbEncodeInteger(long long value, unsigned char *enc)
 
 /* String objects in the form "2391" "-100" without any space and with a
  * range of values that can fit in an 8, 16 or 32 bit signed value can be
- * encoded as integers to save space */
-static int rdbTryIntegerEncoding(char *s, size_t len, unsigned char *enc)
+ * encoded as integers to save space. len <= 11, s needn't end with '\0' */
+static int rdbTryIntegerEncoding(const char *s, size_t len, unsigned char *enc)
 {
     long long value;
-    char *endptr, buf[32];
+    char *endptr, str[32], buf[32];
+
+    memcpy(str, s, len);
+    str[len] = '\0';
 
     /* Check if it's possible to encode this value as a number */
-    value = strtoll(s, &endptr, 10);
+    value = strtoll(str, &endptr, 10);
     if (endptr[0] != '\0') return 0;
     ll2string(buf,32,value);
 
     /* If the number converted back into a string is not identical
      * then it's not possible to encode the string as integer */
-    if (strlen(buf) != len || memcmp(buf,s,len)) return 0;
+    if (strlen(buf) != len || memcmp(buf,str,len)) return 0;
 
     return rdbEncodeInteger(value,enc);
 }
 
-static int rdbSaveLzfStringObject(char *str, const unsigned char *s, size_t len) 
+/* compress into the buffer behind room for the largest header,
+ * then move it to the real header, no scratch allocation */
+static int rdbSaveLzfStringObject(ser_buf *b, const unsigned char *s, size_t len)
 {
     size_t comprlen, outlen;
-    unsigned char byte;
-    int n, nwritten = 0;
-    void *out;
-    char *fp = str;
+    unsigned char hdr[SER_LZF_HDR_MAX];
+    int n = 0;
 
     /* We require at least four bytes compression for this to be worth it */
     if (len <= 4) return 0;
     outlen = len-4;
-    if ((out = zmalloc(outlen+1)) == NULL) return 0;
+    serializeBufReserve(b, SER_LZF_HDR_MAX + outlen + 1);
+    unsigned char *out = (unsigned char *)b->p + b->len + SER_LZF_HDR_MAX;
     comprlen = lzf_compress(s, len, out, outlen);
     if (comprlen == 0) {
-        zfree(out);
         return 0;
     }
-    /* Data compressed! Let's save it on disk */
-    byte = (REDIS_RDB_ENCVAL<<6)|REDIS_RDB_ENC_LZF;
-    if ((n = rdbWriteRaw(fp,&byte,1)) == -1) goto writeerr;
-    nwritten += n;
-    MOVE_BUF_PTR(fp, n);
-
-    if ((n = rdbSaveLen(fp,comprlen)) == -1) goto writeerr;
-    nwritten += n;
-    MOVE_BUF_PTR(fp, n);
-
-    if ((n = rdbSaveLen(fp,len)) == -1) goto writeerr;
-    nwritten += n;
-    MOVE_BUF_PTR(fp, n);
-
-    if ((n = rdbWriteRaw(fp,out,comprlen)) == -1) goto writeerr;
-    nwritten += n;
-    MOVE_BUF_PTR(fp, n);
-
-    zfree(out);
-    return nwritten;
-
-writeerr:
-    zfree(out);
-    return -1;
+    /* Data compressed! Let's save it */
+    hdr[n++] = (REDIS_RDB_ENCVAL<<6)|REDIS_RDB_ENC_LZF;
+    n += rdbEncodeLen(hdr + n, comprlen);
+    n += rdbEncodeLen(hdr + n, len);
+    memcpy(b->p + b->len, hdr, n);
+    if (n < SER_LZF_HDR_MAX) {
+        memmove(b->p + b->len + n, out, comprlen);
+    }
+    b->len += n + comprlen;
+    return n + comprlen;
 }
 
-/* Save a string objet as [len][data] on disk. If the object is a string
+/* Save a string objet as [len][data]. If the object is a string
  * representation of an integer value we try to save it in a special form */
-static int rdbSaveRawString(char *str, const unsigned char *s, size_t len) 
+static int rdbSaveRawString(ser_buf *b, const unsigned char *s, size_t len)
 {
-    char *fp = str;
     int enclen;
     int n, nwritten = 0;
 
     /* Try integer encoding */
     if (len <= 11) {
         unsigned char buf[5];
-        if ((enclen = rdbTryIntegerEncoding((char*)s,len,buf)) > 0) {
-            if (rdbWriteRaw(fp,buf,enclen) == -1) return -1;
-            return enclen;
+        if ((enclen = rdbTryIntegerEncoding((const char*)s,len,buf)) > 0) {
+            return rdbWriteRaw(b,buf,enclen);
         }
     }
 
     /* Try LZF compression - under 20 bytes it's unable to compress even
      * aaaaaaaaaaaaaaaaaa so skip it */
     if (server.rdbcompression && len > 20) {
-        n = rdbSaveLzfStringObject(fp,s,len);
-        if (n == -1) return -1;
+        n = rdbSaveLzfStringObject(b,s,len);
         if (n > 0) return n;
         /* Return value of 0 means data can't be compressed, save the old way */
     }
 
     /* Store verbatim */
-    if ((n = rdbSaveLen(fp,len)) == -1) return -1;
-    nwritten += n;
-    MOVE_BUF_PTR(fp, n);
+    nwritten += rdbSaveLen(b,len);
     if (len > 0) {
-        if (rdbWriteRaw(fp,s,len) == -1) return -1;
-        nwritten += len;
+        nwritten += rdbWriteRaw(b,s,len);
     }
     return nwritten;
 }
 
 /* Save a long long value as either an encoded string or a string. */
-static int rdbSaveLongLongAsStringObject(char *str, long long value)
+static int rdbSaveLongLongAsStringObject(ser_buf *b, long long value)
 {
-    char *fp = str;
     unsigned char buf[32];
-    int n, nwritten = 0;
+    int nwritten = 0;
     int enclen = rdbEncodeInteger(value,buf);
     if (enclen > 0) {
-        return rdbWriteRaw(fp,buf,enclen);
+        return rdbWriteRaw(b,buf,enclen);
     } else {
         /* Encode as string */
         enclen = ll2string((char*)buf,32,value);
         redisAssert(enclen < 32);
-        if ((n = rdbSaveLen(fp,enclen)) == -1) return -1;
-        nwritten += n;
-        MOVE_BUF_PTR(fp, n);
-        if ((n = rdbWriteRaw(fp,buf,enclen)) == -1) return -1;
-        nwritten += n;
+        nwritten += rdbSaveLen(b,enclen);
+        nwritten += rdbWriteRaw(b,buf,enclen);
     }
     return nwritten;
 }
 
 /* Like rdbSaveStringObjectRaw() but handle encoded objects */
-static int rdbSaveStringObject(char *fp, const robj *obj)
+static int rdbSaveStringObject(ser_buf *b, const robj *obj)
 {
     /* Avoid to decode the object, then encode it again, if the
      * object is alrady integer encoded. */
     if (obj->encoding == REDIS_ENCODING_INT) {
-        return rdbSaveLongLongAsStringObject(fp,(long)obj->ptr);
+        return rdbSaveLongLongAsStringObject(b,(long)obj->ptr);
     } else {
         if (obj->encoding != REDIS_ENCODING_RAW)
         {
             log_error("obj->encoding=%d, type=%d", obj->encoding, obj->type);
         }
         redisAssert(obj->encoding == REDIS_ENCODING_RAW);
-        return rdbSaveRawString(fp,obj->ptr,sdslen(obj->ptr));
+        return rdbSaveRawString(b,obj->ptr,sdslen(obj->ptr));
     }
 }
 
@@ -277,7 +292,7 @@ static int rdbSaveStringObject(char *fp, const robj *obj)
  * 254: + inf
  * 255: - inf
  */
-static int rdbSaveDoubleValue(char *fp, double val) 
+static int rdbSaveDoubleValue(ser_buf *b, double val)
 {
     unsigned char buf[128];
     int len;
@@ -309,43 +324,34 @@ static int rdbSaveDoubleValue(char *fp, double val)
         buf[0] = strlen((char*)buf+1);
         len = buf[0]+1;
     }
-    return rdbWriteRaw(fp,buf,len);
+    return rdbWriteRaw(b,buf,len);
 }
 
 /* Save a Redis object. */
-static int SaveObject(char *str, const robj *o)
+static int SaveObject(ser_buf *b, const robj *o)
 {
-    char *fp = str;
-    int n, nwritten = 0;
+    int nwritten = 0;
 
     if (o->type == REDIS_STRING) {
         /* Save a string value */
-        if ((n = rdbSaveStringObject(fp,o)) == -1) return -1;
-        nwritten += n;
-        MOVE_BUF_PTR(fp, n);
+        nwritten += rdbSaveStringObject(b,o);
     } else if (o->type == REDIS_LIST) {
         /* Save a list value */
         if (o->encoding == REDIS_ENCODING_ZIPLIST) {
             size_t l = ziplistBlobLen((unsigned char*)o->ptr);
 
-            if ((n = rdbSaveRawString(fp,o->ptr,l)) == -1) return -1;
-            nwritten += n;
-            MOVE_BUF_PTR(fp, n);
+            nwritten += rdbSaveRawString(b,o->ptr,l);
         } else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
             list *list = o->ptr;
             listIter li;
             listNode *ln;
 
-            if ((n = rdbSaveLen(fp,listLength(list))) == -1) return -1;
-            nwritten += n;
-            MOVE_BUF_PTR(fp, n);
+            nwritten += rdbSaveLen(b,listLength(list));
 
             listRewind(list,&li);
             while((ln = listNext(&li))) {
                 robj *eleobj = listNodeValue(ln);
-                if ((n = rdbSaveStringObject(fp,eleobj)) == -1) return -1;
-                nwritten += n;
-                MOVE_BUF_PTR(fp, n);
+                nwritten += rdbSaveStringObject(b,eleobj);
             }
         } else {
             log_fatal("Unknown list encoding");
@@ -358,23 +364,17 @@ static int SaveObject(char *str, const robj *o)
             dictIterator *di = dictGetIterator(set);
             dictEntry *de;
 
-            if ((n = rdbSaveLen(fp,dictSize(set))) == -1) return -1;
-            nwritten += n;
-            MOVE_BUF_PTR(fp, n);
+            nwritten += rdbSaveLen(b,dictSize(set));
 
             while((de = dictNext(di)) != NULL) {
                 robj *eleobj = dictGetEntryKey(de);
-                if ((n = rdbSaveStringObject(fp,eleobj)) == -1) return -1;
-                nwritten += n;
-                MOVE_BUF_PTR(fp, n);
+                nwritten += rdbSaveStringObject(b,eleobj);
             }
             dictReleaseIterator(di);
         } else if (o->encoding == REDIS_ENCODING_INTSET) {
             size_t l = intsetBlobLen((intset*)o->ptr);
 
-            if ((n = rdbSaveRawString(fp,o->ptr,l)) == -1) return -1;
-            nwritten += n;
-            MOVE_BUF_PTR(fp, n);
+            nwritten += rdbSaveRawString(b,o->ptr,l);
         } else {
             log_fatal("Unknown set encoding");
             return -1;
@@ -384,28 +384,20 @@ static int SaveObject(char *str, const robj *o)
         if (o->encoding == REDIS_ENCODING_ZIPLIST) {
             size_t l = ziplistBlobLen((unsigned char*)o->ptr);
 
-            if ((n = rdbSaveRawString(fp,o->ptr,l)) == -1) return -1;
-            nwritten += n;
-            MOVE_BUF_PTR(fp, n);
+            nwritten += rdbSaveRawString(b,o->ptr,l);
         } else if (o->encoding == REDIS_ENCODING_SKIPLIST) {
             zset *zs = o->ptr;
             dictIterator *di = dictGetIterator(zs->dict);
             dictEntry *de;
 
-            if ((n = rdbSaveLen(fp,dictSize(zs->dict))) == -1) return -1;
-            nwritten += n;
-            MOVE_BUF_PTR(fp, n);
+            nwritten += rdbSaveLen(b,dictSize(zs->dict));
 
             while((de = dictNext(di)) != NULL) {
                 robj *eleobj = dictGetEntryKey(de);
                 double *score = dictGetEntryVal(de);
 
-                if ((n = rdbSaveStringObject(fp,eleobj)) == -1) return -1;
-                nwritten += n;
-                MOVE_BUF_PTR(fp, n);
-                if ((n = rdbSaveDoubleValue(fp,*score)) == -1) return -1;
-                nwritten += n;
-                MOVE_BUF_PTR(fp, n);
+                nwritten += rdbSaveStringObject(b,eleobj);
+                nwritten += rdbSaveDoubleValue(b,*score);
             }
             dictReleaseIterator(di);
         } else {
@@ -417,27 +409,19 @@ static int SaveObject(char *str, const robj *o)
         if (o->encoding == REDIS_ENCODING_ZIPMAP) {
             size_t l = zipmapBlobLen((unsigned char*)o->ptr);
 
-            if ((n = rdbSaveRawString(fp,o->ptr,l)) == -1) return -1;
-            nwritten += n;
-            MOVE_BUF_PTR(fp, n);
+            nwritten += rdbSaveRawString(b,o->ptr,l);
         } else {
             dictIterator *di = dictGetIterator(o->ptr);
             dictEntry *de;
 
-            if ((n = rdbSaveLen(fp,dictSize((dict*)o->ptr))) == -1) return -1;
-            nwritten += n;
-            MOVE_BUF_PTR(fp, n);
+            nwritten += rdbSaveLen(b,dictSize((dict*)o->ptr));
 
             while((de = dictNext(di)) != NULL) {
                 robj *key = dictGetEntryKey(de);
                 robj *val = dictGetEntryVal(de);
 
-                if ((n = rdbSaveStringObject(fp,key)) == -1) return -1;
-                nwritten += n;
-                MOVE_BUF_PTR(fp, n);
-                if ((n = rdbSaveStringObject(fp,val)) == -1) return -1;
-                nwritten += n;
-                MOVE_BUF_PTR(fp, n);
+                nwritten += rdbSaveStringObject(b,key);
+                nwritten += rdbSaveStringObject(b,val);
             }
             dictReleaseIterator(di);
         }
@@ -463,100 +447,41 @@ static int getObjSaveType(const robj *o)
         return o->type;
 }
 
-int serializeObjLen(const robj *o)
+/* format: type + version + [resered] + expire + value + [timestamp] */
+int serializeObjAppend(ser_buf *b, const robj *o, int expire)
 {
-    int len = -1;
-    if (o)
+    const size_t start = b->len;
+    const int otype = getObjSaveType(o)
+        + (o->rsvd_bit << 4)
+        + (server.has_dbe == 0 ? (o->ts_bit << 5) : 0);
+    rdbSaveType(b, otype);
+    rdbSaveVersion(b, o->version);
+    if (o->rsvd_bit)
     {
-        /* format: type + version + [resered] + [expired] + value */
-        len = 0;
-        const int otype = getObjSaveType(o);
-        const int t_len = rdbSaveType(0, otype);
-        len += t_len;
-        const int ver_len = rdbSaveVersion(0, o->version);
-        len += ver_len;
-        if (o->rsvd_bit)
-        {
-            const int rsvd_len = rdbSaveRsvd(0, 0);
-            len += rsvd_len;
-        }
-        const int exp_len = rdbSaveExpire(0, 0);
-        len += exp_len;
-        const int val_len = SaveObject(0, o);
-        len += val_len;
-        if (server.has_dbe == 0 && o->ts_bit)
-        {
-            const int ts_len = rdbSaveTimestamp(0, 0);
-            len += ts_len;
-        }
+        rdbSaveRsvd(b, o->reserved);
     }
-
-    return len;
-}
-
-int serializeObj2Buf(const robj *o, char *buf, int len, int expire)
-{
-    if (o && buf && len > 0)
+    rdbSaveExpire(b, expire);
+    if (SaveObject(b, o) == -1)
     {
-        char *ptr = buf;
-        int ret = 0;
-        const int otype = getObjSaveType(o)
-            + (o->rsvd_bit << 4)
-            + (server.has_dbe == 0 ? (o->ts_bit << 5) : 0);
-        ret = rdbSaveType(ptr, otype);
-        ptr += ret;
-
-        ret = rdbSaveVersion(ptr, o->version);
-        ptr += ret;
-
-        if (o->rsvd_bit)
-        {
-            ret = rdbSaveRsvd(ptr, o->reserved);
-            ptr += ret;
-        }
-
-        ret = rdbSaveExpire(ptr, expire);
-        ptr += ret;
-
-        ret = SaveObject(ptr, o);
-        ptr += ret;
-
-        if (server.has_dbe == 0 && o->ts_bit)
-        {
-            ret = rdbSaveTimestamp(ptr, o->timestamp);
-            ptr += ret;
-        }
-
-        log_debug("serializeObj2Buf() succ for version=%lld, "
-                  "expire=%d, len=%d, rsvd_bit=%d",
-                  o->version, expire, len, o->rsvd_bit);
-        log_buffer(buf, len);
-
-        return 0;
+        b->len = start;
+        return -1;
     }
-    else
+    if (server.has_dbe == 0 && o->ts_bit)
     {
-        return 1;
+        rdbSaveTimestamp(b, o->timestamp);
     }
+
+    const int len = (int)(b->len - start);
+    log_debug("serializeObjAppend() succ for version=%lld, "
+              "expire=%d, len=%d, rsvd_bit=%d",
+              o->version, expire, len, o->rsvd_bit);
+    log_buffer(b->p + start, len);
+    return len;
 }
 
 char *serializeObj(const robj *o, int *pLen)
 {
-    char *buf = 0;
-    if (o && pLen)
-    {
-        *pLen = serializeObjLen(o);
-        if (*pLen > 0)
-        {
-            buf = (char *)zmalloc(*pLen);
-            if (buf)
-            {
-                serializeObj2Buf(o, buf, *pLen, 0);
-            }
-        }
-    }
-
-    return buf;
+    return serializeObjExp(o, pLen, 0);
 }
 
 char *serializeObjExp(const robj *o, int *pLen, int expire)
@@ -564,14 +489,14 @@ char *serializeObjExp(const robj *o, int *pLen, int expire)
     char *buf = 0;
     if (o && pLen)
     {
-        *pLen = serializeObjLen(o);
-        if (*pLen > 0)
+        ser_buf *b = serializeBufGet();
+        if (serializeObjAppend(b, o, expire) > 0)
         {
-            buf = (char *)zmalloc(*pLen);
-            if (buf)
-            {
-                serializeObj2Buf(o, buf, *pLen, expire);
-            }
+            buf = serializeBufTake(b, pLen);
+        }
+        else
+        {
+            *pLen = -1;
         }
     }
 
@@ -1423,16 +1348,15 @@ void log_string2(const char *buf, int len, int tag)
     zfree(tmp);
 }
 
+/* the same as serializeObjExp() of a raw string object, without copying buf */
 char *serializeStrExp(const char *buf, int buf_len, int *pLen, int expire)
 {
-    sds buf_sds = sdsnewlen(buf, buf_len);
-
-    robj v;
-    initObject(&v, REDIS_STRING, buf_sds);
-
-    char *val = serializeObjExp(&v, pLen, expire);
-    sdsfree(buf_sds);
-    return val;
+    ser_buf *b = serializeBufGet();
+    rdbSaveType(b, REDIS_STRING);
+    rdbSaveVersion(b, 0);
+    rdbSaveExpire(b, expire);
+    rdbSaveRawString(b, (const unsigned char *)buf, buf_len);
+    return serializeBufTake(b, pLen);
 }
 
 void freeStr(char *str)
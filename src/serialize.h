@@ -3,8 +3,20 @@
 
 #include "redis.h"
 
-extern int serializeObjLen(const robj *o);
-extern int serializeObj2Buf(const robj *o, char *buf, int len, int expire);
+/* growable output buffer, one per thread from serializeBufGet() */
+typedef struct ser_buf_st
+{
+    char *p;
+    size_t len;
+    size_t cap;
+} ser_buf;
+
+extern ser_buf *serializeBufGet();
+extern void serializeBufReserve(ser_buf *b, size_t n);
+extern void serializeBufAppend(ser_buf *b, const void *p, size_t len);
+extern char *serializeBufTake(ser_buf *b, int *pLen);
+/* return: bytes appended to b, -1 on error with b unchanged */
+extern int serializeObjAppend(ser_buf *b, const robj *o, int expire);
 extern char *serializeObj(const robj *o, int *pLen);
 extern char *serializeObjExp(const robj *o, int *pLen, int expire);
 extern robj *unserializeObj(const char *s, int len, time_t *expire);
@@ -26,10 +26,10 @@ int sync_slave_start(const char *master_ip, int master_port, const char *dir, lo
     return repl_bin_slave_start(master_ip, master_port, dir, (uint64_t)bl_tag, port, ds_id, ds_key);
 }
 
-extern int sync_master_start(const char *bl_dir, const char *prefix, off_t max_size, int max_idx, redisClient *c, freeres_func f, unsigned long long ds_id_m, unsigned long long ds_id_s, const char *ds_key_s, filter_func filter)
+extern int sync_master_start(const char *bl_dir, const char *prefix, off_t max_size, int max_idx, redisClient *c, freeres_func f, unsigned long long ds_id_m, unsigned long long ds_id_s, const char *ds_key_s, filter_func filter, filter_bulk_func filter_bulk)
 {
     log_prompt("starting master: bl_dir=%s, master_ds_id=%llu, slave_ds_id=%llu, slave_ds_key=%s", bl_dir, ds_id_m, ds_id_s, ds_key_s);
-    return repl_bin_master_start(bl_dir, prefix, max_size, max_idx, c->fd, (uint64_t)c->bl_tag, (void *)c, f, ds_id_m, ds_id_s, ds_key_s, filter);
+    return repl_bin_master_start(bl_dir, prefix, max_size, max_idx, c->fd, (uint64_t)c->bl_tag, (void *)c, f, ds_id_m, ds_id_s, ds_key_s, filter, filter_bulk);
 }
 
 int sync_slave_stop(const char *master_ip, int master_port)
@@ -67,7 +67,7 @@ extern int sync_slave_start(const char *master_ip, int master_port, const char *
  * 0 - succ finish
  * 1 - fail
  */
-extern int sync_master_start(const char *bl_dir, const char *prefix, off_t max_size, int max_idx, redisClient *c, freeres_func f, unsigned long long ds_id_m, unsigned long long ds_id_s, const char *ds_key_s, filter_func filter);
+extern int sync_master_start(const char *bl_dir, const char *prefix, off_t max_size, int max_idx, redisClient *c, freeres_func f, unsigned long long ds_id_m, unsigned long long ds_id_s, const char *ds_key_s, filter_func filter, filter_bulk_func filter_bulk);
 
 extern int sync_slave_stop(const char *master_ip, int master_port);
 #endif /* _SYNC_IF_H_ */
@@ -78,45 +78,6 @@ static void setGenericCommand(redisClient *c, int nx, robj *key, robj *val, robj
         val->reserved = reserved;
     }
 
-    if (server.has_cache == 0 && server.has_dbe == 1)
-    {
-        /* dbe only */
-
-        uint64_t ver;
-        const int exist_flg = dbmng_key_exist(c->tag, key, &ver);
-        if ((nx == 1 && 1 == exist_flg)
-            || (nx == 2 && 0 == exist_flg))
-        {
-            log_info("key=%s do not meet the condition", key->ptr);
-            addReply(c, shared.czero);
-            return;
-        }
-        if (nx == 2)
-        {
-            val->visited_bit = 1;
-        }
-        if (exist_flg == 1)
-        {
-            val->version = ver + 1;
-        }
-        if (seconds)
-        {
-            robj *argv[2];
-            argv[0] = val;
-            argv[1] = createStringObjectFromLongLong((long long)(seconds));
-            dbmng_wr_bl(c->tag, OP_SETEX, key, 2, argv, c->ds_id, c->db->id);
-            dbmng_set_key(c->tag, key, 2, argv);
-            decrRefCount(argv[1]);
-        }
-        else
-        {
-            dbmng_wr_bl(c->tag, OP_SET, key, 1, &val, c->ds_id, c->db->id);
-            dbmng_set_key(c->tag, key, 1, &val);
-        }
-        addReply(c, nx != 0 ? shared.cone : shared.ok);
-        return;
-    }
-
     robj *o = lookupKeyWrite(c->db, key);
     if (nx == 1)
     {
@@ -330,15 +291,7 @@ static robj *query_key(redisClient *c)
 {
     robj *o;
 
-    if (server.has_cache == 0 && server.has_dbe == 1)
-    {
-        /* dbe only */
-        o = dbmng_lookup_key(c->tag, c->argv[1], 0);
-    }
-    else
-    {
-        o = lookupKeyRead(c->db, c->argv[1]);
-    }
+    o = lookupKeyRead(c->db, c->argv[1]);
 
     return o;
 }
@@ -352,15 +305,7 @@ static int getGenericCommand(redisClient *c, int *exist_flg, uint64_t *ver)
         *exist_flg = 0;
     }
 
-    if (server.has_cache == 0 && server.has_dbe == 1)
-    {
-        /* dbe only */
-        o = dbmng_lookup_key(c->tag, c->argv[1], 0);
-    }
-    else
-    {
-        o = lookupKeyRead(c->db, c->argv[1]);
-    }
+    o = lookupKeyRead(c->db, c->argv[1]);
     if (!o)
     {
         addReply(c, shared.nullbulk);
@@ -370,10 +315,6 @@ static int getGenericCommand(redisClient *c, int *exist_flg, uint64_t *ver)
     if (o->type != REDIS_STRING)
     {
         addReply(c,shared.wrongtypeerr);
-        if (server.has_cache == 0 && server.has_dbe == 1)
-        {
-            decrRefCount(o);
-        }
         return REDIS_ERR;
     }
     else
@@ -385,10 +326,6 @@ static int getGenericCommand(redisClient *c, int *exist_flg, uint64_t *ver)
         }
         //log_debug("get o->refcount=%d", o->refcount);
         addReplyBulk(c,o);
-        if (server.has_cache == 0 && server.has_dbe == 1)
-        {
-            decrRefCount(o);
-        }
         return REDIS_OK;
     }
 }
@@ -405,18 +342,6 @@ void getsetCommand(redisClient *c)
     if (getGenericCommand(c, &exist_flg, &ver) == REDIS_ERR) return;
     c->argv[2] = tryObjectEncoding(c->argv[2]);
 
-    if (server.has_cache == 0 && server.has_dbe == 1)
-    {
-        /* dbe only */
-        if (exist_flg)
-        {
-            c->argv[2]->version = ver + 1;
-        }
-        dbmng_wr_bl(c->tag, OP_SET, c->argv[1], 1, &c->argv[2], c->ds_id, c->db->id);
-        dbmng_set_key(c->tag, c->argv[1], 1, &c->argv[2]);
-        return;
-    }
-
     setKey(c->db,c->argv[1],c->argv[2]);
     dbmng_save_op(c->tag, OP_SET, c->argv[1], 1, &c->argv[2], c->ds_id, c->db->id);
     server.dirty++;
@@ -577,29 +502,18 @@ void setbitCommand(redisClient *c)
         return;
     }
 
-    if (server.has_cache == 0 && server.has_dbe == 1)
-    {
-        /* dbe only */
-        o = dbmng_lookup_key(c->tag, c->argv[1], 0);
-    }
-    else
-    {
-        o = lookupKeyWrite(c->db,c->argv[1]);
-    }
+    o = lookupKeyWrite(c->db,c->argv[1]);
 
     if (!o)
     {
         o = createObject(REDIS_STRING, sdsempty());
-        if (!(server.has_cache == 0 && server.has_dbe == 1))
-        {
-            dbAdd(c->db,c->argv[1],o);
-        }
+        dbAdd(c->db,c->argv[1],o);
     }
     else
     {
         if (checkType(c,o,REDIS_STRING))
         {
-            goto setbit_over;
+            return;
         }
 
         /* Create a copy when the object is shared or encoded. */
@@ -635,26 +549,11 @@ void setbitCommand(redisClient *c)
     byteval |= ((on & 0x1) << bit);
     ((char*)o->ptr)[byte] = byteval;
 
-    if (server.has_cache == 0 && server.has_dbe == 1)
-    {
-        dbmng_wr_bl(c->tag, OP_SETBIT, c->argv[1], c->argc - 2, &c->argv[2], c->ds_id, c->db->id);
-        dbmng_set_key(c->tag, c->argv[1], 1, &o);
-        decrRefCount(o);
-    }
-    else
-    {
-        dbmng_save_op(c->tag, OP_SETBIT, c->argv[1], c->argc - 2, &c->argv[2], c->ds_id, c->db->id);
-        signalModifiedKey(c->db,c->argv[1]);
-        server.dirty++;
-    }
+    dbmng_save_op(c->tag, OP_SETBIT, c->argv[1], c->argc - 2, &c->argv[2], c->ds_id, c->db->id);
+    signalModifiedKey(c->db,c->argv[1]);
+    server.dirty++;
 
     addReply(c, bitval ? shared.cone : shared.czero);
-
-setbit_over:
-    if (o && server.has_cache == 0 && server.has_dbe == 1)
-    {
-        decrRefCount(o);
-    }
 }
 
 void getbitCommand(redisClient *c)
@@ -668,33 +567,15 @@ void getbitCommand(redisClient *c)
     if (getBitOffsetFromArgument(c,c->argv[2],&bitoffset) != REDIS_OK)
         return;
 
-    if (server.has_cache == 0 && server.has_dbe == 1)
+    o = lookupKeyRead(c->db, c->argv[1]);
+    if (!o)
     {
-        /* dbe only */
-        o = dbmng_lookup_key(c->tag, c->argv[1], 0);
-        if (!o)
-        {
-            addReply(c, shared.czero);
-            return;
-        }
-        if (checkType(c, o, REDIS_STRING))
-        {
-            decrRefCount(o);
-            return;
-        }
+        addReply(c, shared.czero);
+        return;
     }
-    else
+    if (checkType(c, o, REDIS_STRING))
     {
-        o = lookupKeyRead(c->db, c->argv[1]);
-        if (!o)
-        {
-            addReply(c, shared.czero);
-            return;
-        }
-        if (checkType(c, o, REDIS_STRING))
-        {
-            return;
-        }
+        return;
     }
 
     byte = bitoffset >> 3;
@@ -711,11 +592,6 @@ void getbitCommand(redisClient *c)
     }
 
     addReply(c, bitval ? shared.cone : shared.czero);
-
-    if (server.has_cache == 0 && server.has_dbe == 1)
-    {
-        decrRefCount(o);
-    }
 }
 
 void setrangeCommand(redisClient *c)
@@ -741,14 +617,7 @@ void setrangeCommand(redisClient *c)
         return;
     }
 
-    if (server.has_cache == 0 && server.has_dbe == 1)
-    {
-        o = dbmng_lookup_key(c->tag, c->argv[1], 0);
-    }
-    else
-    {
-        o = lookupKeyWrite(c->db,c->argv[1]);
-    }
+    o = lookupKeyWrite(c->db,c->argv[1]);
 
     if (o == NULL)
     {
@@ -764,10 +633,7 @@ void setrangeCommand(redisClient *c)
             return;
 
         o = createObject(REDIS_STRING,sdsempty());
-        if (!(server.has_cache == 0 && server.has_dbe == 1))
-        {
-            dbAdd(c->db,c->argv[1],o);
-        }
+        dbAdd(c->db,c->argv[1],o);
     }
     else
     {
@@ -775,22 +641,22 @@ void setrangeCommand(redisClient *c)
 
         /* Key exists, check type */
         if (checkType(c,o,REDIS_STRING))
-            goto setrange_over;
+            return;
 
         /* Return existing string length when setting nothing */
         olen = stringObjectLen(o);
         if (sdslen(value) == 0)
         {
             addReplyLongLong(c,olen);
-            goto setrange_over;
+            return;
         }
 
         /* Return when the resulting string exceeds allowed size */
         if (checkStringLength(c,offset+sdslen(value)) != REDIS_OK)
-            goto setrange_over;
+            return;
 
         /* Create a copy when the object is shared or encoded. */
-        if ((!(server.has_cache == 0 && server.has_dbe == 1)) && (o->refcount != 1 || o->encoding != REDIS_ENCODING_RAW))
+        if (o->refcount != 1 || o->encoding != REDIS_ENCODING_RAW)
         {
             robj *decoded = getDecodedObject(o);
             o = createStringObject(decoded->ptr, sdslen(decoded->ptr));
@@ -814,30 +680,13 @@ void setrangeCommand(redisClient *c)
         }
         o->ptr = sdsgrowzero(o->ptr, new_size);
         memcpy((char*)o->ptr+offset,value,sdslen(value));
-        if (!(server.has_cache == 0 && server.has_dbe == 1))
-        {
-            signalModifiedKey(c->db,c->argv[1]);
-            server.dirty++;
-        }
+        signalModifiedKey(c->db,c->argv[1]);
+        server.dirty++;
     }
 
-    if (server.has_cache == 0 && server.has_dbe == 1)
-    {
-        dbmng_wr_bl(c->tag, OP_SETRANGE, c->argv[1], c->argc - 2, &c->argv[2], c->ds_id, c->db->id);
-        dbmng_set_key(c->tag, c->argv[1], 1, &o);
-    }
-    else
-    {
-        dbmng_save_op(c->tag, OP_SETRANGE, c->argv[1], c->argc - 2, &c->argv[2], c->ds_id, c->db->id);
-    }
+    dbmng_save_op(c->tag, OP_SETRANGE, c->argv[1], c->argc - 2, &c->argv[2], c->ds_id, c->db->id);
 
     addReplyLongLong(c,sdslen(o->ptr));
-
-setrange_over:
-    if (o && server.has_cache == 0 && server.has_dbe == 1)
-    {
-        decrRefCount(o);
-    }
 }
 
 void getrangeCommand(redisClient *c)
@@ -852,32 +701,15 @@ void getrangeCommand(redisClient *c)
     if (getLongFromObjectOrReply(c,c->argv[3],&end,NULL) != REDIS_OK)
         return;
 
-    if (server.has_cache == 0 && server.has_dbe == 1)
+    o = lookupKeyRead(c->db,c->argv[1]);
+    if (o == 0)
     {
-        o = dbmng_lookup_key(c->tag, c->argv[1], 0);
-        if (o == 0)
-        {
-            addReply(c, shared.emptybulk);
-            return;
-        }
-        if (checkType(c, o, REDIS_STRING))
-        {
-            decrRefCount(o);
-            return;
-        }
+        addReply(c, shared.emptybulk);
+        return;
     }
-    else
+    if (checkType(c, o, REDIS_STRING))
     {
-        o = lookupKeyRead(c->db,c->argv[1]);
-        if (o == 0)
-        {
-            addReply(c, shared.emptybulk);
-            return;
-        }
-        if (checkType(c, o, REDIS_STRING))
-        {
-            return;
-        }
+        return;
     }
 
     if (o->encoding == REDIS_ENCODING_INT)
@@ -908,11 +740,6 @@ void getrangeCommand(redisClient *c)
     {
         addReplyBulkCBuffer(c,(char*)str+start,end-start+1);
     }
-
-    if (server.has_cache == 0 && server.has_dbe == 1)
-    {
-        decrRefCount(o);
-    }
 }
 
 static void mgetCommandEx(redisClient *c, int ver_flg, int mc_flg, int ts_flg)
@@ -923,14 +750,7 @@ static void mgetCommandEx(redisClient *c, int ver_flg, int mc_flg, int ts_flg)
     addReplyMultiBulkLen(c, (c->argc-1) * (1 + (ver_flg ? 1 : 0) + (mc_flg ? 1 : 0) + (ts_flg ? 1 : 0)));
     for (j = 1; j < c->argc; j++)
     {
-        if (server.has_cache == 0 && server.has_dbe == 1)
-        {
-            o = dbmng_lookup_key(c->tag, c->argv[j], 0);
-        }
-        else
-        {
-            o = lookupKeyRead(c->db,c->argv[j]);
-        }
+        o = lookupKeyRead(c->db,c->argv[j]);
         if (o == 0 && mc_flg && ver_flg == 0)
         {
             server.stat_get_misses++;
@@ -1006,11 +826,6 @@ static void mgetCommandEx(redisClient *c, int ver_flg, int mc_flg, int ts_flg)
                     server.stat_get_hits++;
                 }
             }
-
-            if (server.has_cache == 0 && server.has_dbe == 1)
-            {
-                decrRefCount(o);
-            }
         }
     }
 }
@@ -1057,27 +872,13 @@ void msetGenericCommand(redisClient *c, int nx)
      * set nothing at all if at least one already key exists. */
     if (nx)
     {
-        if (server.has_cache == 0 && server.has_dbe == 1)
-        {
-            for (j = 1; j < c->argc; j += 2)
-            {
-                uint64_t ver;
-                if (1 == dbmng_key_exist(c->tag, c->argv[j], &ver))
-                {
-                    busykeys++;
-                }
-            }
-        }
-        else
+        robj *o;
+        for (j = 1; j < c->argc; j += 2)
         {
-            robj *o;
-            for (j = 1; j < c->argc; j += 2)
+            o = lookupKeyWrite(c->db,c->argv[j]);
+            if (o)
             {
-                o = lookupKeyWrite(c->db,c->argv[j]);
-                if (o)
-                {
-                    busykeys++;
-                }
+                busykeys++;
             }
         }
         if (busykeys)
@@ -1087,29 +888,13 @@ void msetGenericCommand(redisClient *c, int nx)
         }
     }
 
-    if (server.has_cache == 0 && server.has_dbe == 1)
-    {
-        for (j = 1; j < c->argc; j += 2)
-        {
-            uint64_t ver;
-            if (1 == dbmng_key_exist(c->tag, c->argv[j], &ver))
-            {
-                c->argv[j+1]->version = ver + 1;
-            }
-            dbmng_wr_bl(c->tag, OP_SET, c->argv[j], 1, &c->argv[j+1], c->ds_id, c->db->id);
-            dbmng_set_key(c->tag, c->argv[j], 1, &c->argv[j+1]);
-        }
-    }
-    else
+    for (j = 1; j < c->argc; j += 2)
     {
-        for (j = 1; j < c->argc; j += 2)
-        {
-            c->argv[j+1] = tryObjectEncoding(c->argv[j+1]);
-            setKey(c->db,c->argv[j],c->argv[j+1]);
-            dbmng_save_op(c->tag, OP_SET, c->argv[j], 1, &c->argv[j+1], c->ds_id, c->db->id);
-        }
-        server.dirty += (c->argc-1)/2;
+        c->argv[j+1] = tryObjectEncoding(c->argv[j+1]);
+        setKey(c->db,c->argv[j],c->argv[j+1]);
+        dbmng_save_op(c->tag, OP_SET, c->argv[j], 1, &c->argv[j+1], c->ds_id, c->db->id);
     }
+    server.dirty += (c->argc-1)/2;
     addReply(c, nx ? shared.cone : shared.ok);
 }
 
@@ -1145,102 +930,56 @@ static void incrDecrCommand(redisClient *c, long long offset)
     robj *o, *new;
     long seconds = 0;
 
-    if (server.has_cache == 0 && server.has_dbe == 1)
+    o = lookupKeyWrite(c->db,c->argv[1]);
+    if (o)
     {
-        time_t expire;
-        o = dbmng_lookup_key(c->tag, c->argv[1], &expire);
-        if (o)
-        {
-            seconds = expire;
-        }
-    }
-    else
-    {
-        o = lookupKeyWrite(c->db,c->argv[1]);
-        if (o)
-        {
-            seconds = getExpire(c->db, c->argv[1]);
-        }
+        seconds = getExpire(c->db, c->argv[1]);
     }
     if (o != NULL && checkType(c,o,REDIS_STRING))
     {
-        goto incr_decr_fin;
+        return;
     }
-    if (getLongLongFromObjectOrReply(c,o,&value,0) != REDIS_OK) goto incr_decr_fin;
+    if (getLongLongFromObjectOrReply(c,o,&value,0) != REDIS_OK) return;
 
     oldvalue = value;
     value += offset;
     if ((offset < 0 && value > oldvalue) || (offset > 0 && value < oldvalue))
     {
         addReplyError(c,"increment or decrement would overflow");
-        goto incr_decr_fin;
+        return;
     }
 
-    if (server.has_cache == 0 && server.has_dbe == 1)
+    new = createStringObjectFromLongLong2(value);
+    new->visited_bit = 1;
+    if (o)
     {
-        new = createStringObjectFromLongLong2(value);
-        new->visited_bit = 1;
-        if (o)
-        {
-            new->version = o->version + 1;
-            new->rsvd_bit = o->rsvd_bit;
-            new->reserved = o->reserved;
-        }
-        if (seconds > 0)
-        {
-            robj *argv[2];
-            argv[0] = new;
-            argv[1] = createStringObjectFromLongLong((long long)(seconds));
-            dbmng_wr_bl(c->tag, OP_SETEX, c->argv[1], 2, argv, c->ds_id, c->db->id);
-            dbmng_set_key(c->tag, c->argv[1], 2, argv);
-            decrRefCount(argv[1]);
-        }
-        else
-        {
-            dbmng_wr_bl(c->tag, OP_SET, c->argv[1], 1, &new, c->ds_id, c->db->id);
-            dbmng_set_key(c->tag, c->argv[1], 1, &new);
-        }
+        new->version = o->version;
+        new->rsvd_bit = o->rsvd_bit;
+        new->reserved = o->reserved;
+
+        dbOverwrite(c->db,c->argv[1],new);
     }
     else
     {
-        new = createStringObjectFromLongLong2(value);
-        new->visited_bit = 1;
-        if (o)
-        {
-            new->version = o->version;
-            new->rsvd_bit = o->rsvd_bit;
-            new->reserved = o->reserved;
-
-            dbOverwrite(c->db,c->argv[1],new);
-        }
-        else
-        {
-            dbAdd(c->db,c->argv[1],new);
-        }
-        if (seconds > 0)
-        {
-            robj *argv[2];
-            argv[0] = new;
-            argv[1] = createStringObjectFromLongLong((long long)(seconds));
-            dbmng_save_op(c->tag, OP_SETEX, c->argv[1], 2, argv, c->ds_id, c->db->id);
-            decrRefCount(argv[1]);
-        }
-        else
-        {
-            dbmng_save_op(c->tag, OP_SET, c->argv[1], 1, &new, c->ds_id, c->db->id);
-        }
-        signalModifiedKey(c->db,c->argv[1]);
-        server.dirty++;
+        dbAdd(c->db,c->argv[1],new);
     }
+    if (seconds > 0)
+    {
+        robj *argv[2];
+        argv[0] = new;
+        argv[1] = createStringObjectFromLongLong((long long)(seconds));
+        dbmng_save_op(c->tag, OP_SETEX, c->argv[1], 2, argv, c->ds_id, c->db->id);
+        decrRefCount(argv[1]);
+    }
+    else
+    {
+        dbmng_save_op(c->tag, OP_SET, c->argv[1], 1, &new, c->ds_id, c->db->id);
+    }
+    signalModifiedKey(c->db,c->argv[1]);
+    server.dirty++;
     addReply(c,shared.colon);
     addReply(c,new);
     addReply(c,shared.crlf);
-
-incr_decr_fin:
-    if (o && server.has_cache == 0 && server.has_dbe == 1)
-    {
-        decrRefCount(o);
-    }
 }
 
 static void incrDecrCommandx(redisClient *c, unsigned long long offset, int incr)
@@ -1249,51 +988,39 @@ static void incrDecrCommandx(redisClient *c, unsigned long long offset, int incr
     robj *o, *new;
     long seconds = 0;
 
-    if (server.has_cache == 0 && server.has_dbe == 1)
+    o = lookupKeyWrite(c->db,c->argv[1]);
+    if (o)
     {
-        time_t expire;
-        o = dbmng_lookup_key(c->tag, c->argv[1], &expire);
-        if (o)
-        {
-            seconds = expire;
-        }
+        seconds = getExpire(c->db, c->argv[1]);
     }
     else
     {
-        o = lookupKeyWrite(c->db,c->argv[1]);
-        if (o)
+        if (incr)
         {
-            seconds = getExpire(c->db, c->argv[1]);
+            server.stat_incr_misses++;
         }
         else
         {
-            if (incr)
-            {
-                server.stat_incr_misses++;
-            }
-            else
-            {
-                server.stat_decr_misses++;
-            }
+            server.stat_decr_misses++;
         }
     }
     if (o == 0)
     {
         addReply(c, shared.nullbulk);
         log_info("%s not exist", c->argv[1]->ptr);
-        goto incr_decr_fin_x;
+        return;
     }
     if (o != NULL && checkType(c,o,REDIS_STRING))
     {
         log_error("value of %s is non-string, type is %d", c->argv[1]->ptr, o->type);
-        goto incr_decr_fin_x;
+        return;
     }
     char *const msg = "cannot increment or decrement non-numeric value";
     if (getuLongLongFromObjectOrReply(c,o,&value,msg) != REDIS_OK)
     {
         log_error("value of %s is non-numeric: %s"
                 , c->argv[1]->ptr, o->encoding == REDIS_ENCODING_RAW ? o->ptr : "");
-        goto incr_decr_fin_x;
+        return;
     }
 
     oldvalue = value;
@@ -1316,83 +1043,49 @@ static void incrDecrCommandx(redisClient *c, unsigned long long offset, int incr
     {
         /* do nothing */
         addReplyLongLong_u(c, value);
-        goto incr_decr_fin_x;
+        return;
     }
 
-    if (server.has_cache == 0 && server.has_dbe == 1)
+    new = createStringObjectFromuLongLong2(value);
+    new->visited_bit = 1;
+    if (o)
     {
-        new = createStringObjectFromuLongLong2(value);
-        new->visited_bit = 1;
-        if (o)
-        {
-            new->version = o->version + 1;
-            new->rsvd_bit = o->rsvd_bit;
-            new->reserved = o->reserved;
-        }
-        if (seconds > 0)
-        {
-            robj *argv[2];
-            argv[0] = new;
-            argv[1] = createStringObjectFromLongLong((long long)(seconds));
-            dbmng_wr_bl(c->tag, OP_SETEX, c->argv[1], 2, argv, c->ds_id, c->db->id);
-            dbmng_set_key(c->tag, c->argv[1], 2, argv);
-            decrRefCount(argv[1]);
-        }
-        else
-        {
-            dbmng_wr_bl(c->tag, OP_SET, c->argv[1], 1, &new, c->ds_id, c->db->id);
-            dbmng_set_key(c->tag, c->argv[1], 1, &new);
-        }
+        new->version = o->version;
+        new->rsvd_bit = o->rsvd_bit;
+        new->reserved = o->reserved;
+
+        dbOverwrite(c->db,c->argv[1],new);
     }
     else
     {
-        new = createStringObjectFromuLongLong2(value);
-        new->visited_bit = 1;
-        if (o)
-        {
-            new->version = o->version;
-            new->rsvd_bit = o->rsvd_bit;
-            new->reserved = o->reserved;
-
-            dbOverwrite(c->db,c->argv[1],new);
-        }
-        else
-        {
-            dbAdd(c->db,c->argv[1],new);
-        }
-        if (seconds > 0)
-        {
-            robj *argv[2];
-            argv[0] = new;
-            argv[1] = createStringObjectFromLongLong((long long)(seconds));
-            dbmng_save_op(c->tag, OP_SETEX, c->argv[1], 2, argv, c->ds_id, c->db->id);
-            decrRefCount(argv[1]);
-        }
-        else
-        {
-            dbmng_save_op(c->tag, OP_SET, c->argv[1], 1, &new, c->ds_id, c->db->id);
-        }
-        signalModifiedKey(c->db,c->argv[1]);
-        server.dirty++;
+        dbAdd(c->db,c->argv[1],new);
+    }
+    if (seconds > 0)
+    {
+        robj *argv[2];
+        argv[0] = new;
+        argv[1] = createStringObjectFromLongLong((long long)(seconds));
+        dbmng_save_op(c->tag, OP_SETEX, c->argv[1], 2, argv, c->ds_id, c->db->id);
+        decrRefCount(argv[1]);
+    }
+    else
+    {
+        dbmng_save_op(c->tag, OP_SET, c->argv[1], 1, &new, c->ds_id, c->db->id);
+    }
+    signalModifiedKey(c->db,c->argv[1]);
+    server.dirty++;
 
-        if (incr)
-        {
-            server.stat_incr_hits++;
-        }
-        else
-        {
-            server.stat_decr_hits++;
-        }
+    if (incr)
+    {
+        server.stat_incr_hits++;
+    }
+    else
+    {
+        server.stat_decr_hits++;
     }
     addReply(c,shared.colon);
     addReply_unsigned(c,new);
     addReply(c,shared.crlf);
-
-incr_decr_fin_x:
-    if (o && server.has_cache == 0 && server.has_dbe == 1)
-    {
-        decrRefCount(o);
-    }
 }
 
 void incrCommand(redisClient *c)
@@ -1515,17 +1208,10 @@ static void appendCommand_ex(redisClient *c, int ex, int prepend)
         return;
     }
 
-    if (server.has_cache == 0 && server.has_dbe == 1)
+    o = lookupKeyWrite(c->db,c->argv[1]);
+    if (o)
     {
-        o = dbmng_lookup_key(c->tag, c->argv[1], &exp);
-    }
-    else
-    {
-        o = lookupKeyWrite(c->db,c->argv[1]);
-        if (o)
-        {
-            exp = getExpire(c->db, c->argv[1]);
-        }
+        exp = getExpire(c->db, c->argv[1]);
     }
 
     if (o == NULL)
@@ -1539,12 +1225,9 @@ static void appendCommand_ex(redisClient *c, int ex, int prepend)
         }
 
         /* Create the key */
-        if (!(server.has_cache == 0 && server.has_dbe == 1))
-        {
-            c->argv[2] = tryObjectEncoding(c->argv[2]);
-            dbAdd(c->db,c->argv[1],c->argv[2]);
-            incrRefCount(c->argv[2]);
-        }
+        c->argv[2] = tryObjectEncoding(c->argv[2]);
+        dbAdd(c->db,c->argv[1],c->argv[2]);
+        incrRefCount(c->argv[2]);
         totlen = append_len;
         val_obj = c->argv[2];
     }
@@ -1552,7 +1235,7 @@ static void appendCommand_ex(redisClient *c, int ex, int prepend)
     {
         /* Key exists, check type */
         if (checkType(c,o,REDIS_STRING))
-            goto append_error;
+            return;
 
         /* "append" is an argument, so always an sds */
         append = c->argv[2];
@@ -1561,7 +1244,7 @@ static void appendCommand_ex(redisClient *c, int ex, int prepend)
         if (ret != REDIS_OK)
         {
             log_error("append: total_len=%ld invalid, key=%s", totlen, c->argv[1]->ptr);
-            goto append_error;
+            return;
         }
 
         if (ex)
@@ -1569,30 +1252,23 @@ static void appendCommand_ex(redisClient *c, int ex, int prepend)
             o->visited_bit = 1;
         }
 
-        if (server.has_cache == 0 && server.has_dbe == 1)
-        {
-            o->version++;
+        /* If the object is shared or encoded, we have to make a copy */
+        if (o->refcount != 1 || o->encoding != REDIS_ENCODING_RAW) {
+            robj *decoded = getDecodedObject(o);
+            o = createStringObject(decoded->ptr, sdslen(decoded->ptr));
+
+            o->version = decoded->version;
+            o->rsvd_bit = decoded->rsvd_bit;
+            o->reserved = decoded->reserved;
+            o->visited_bit = decoded->visited_bit;
+            o->no_used = decoded->no_used;
+
+            decrRefCount(decoded);
+            dbOverwrite(c->db,c->argv[1],o);
         }
         else
         {
-            /* If the object is shared or encoded, we have to make a copy */
-            if (o->refcount != 1 || o->encoding != REDIS_ENCODING_RAW) {
-                robj *decoded = getDecodedObject(o);
-                o = createStringObject(decoded->ptr, sdslen(decoded->ptr));
-
-                o->version = decoded->version;
-                o->rsvd_bit = decoded->rsvd_bit;
-                o->reserved = decoded->reserved;
-                o->visited_bit = decoded->visited_bit;
-                o->no_used = decoded->no_used;
-
-                decrRefCount(decoded);
-                dbOverwrite(c->db,c->argv[1],o);
-            }
-            else
-            {
-                o->version++;
-            }
+            o->version++;
         }
 
         /* Append the value */
@@ -1625,17 +1301,9 @@ static void appendCommand_ex(redisClient *c, int ex, int prepend)
             argv[argc] = 0;
         }
 
-        if (server.has_cache == 0 && server.has_dbe == 1)
-        {
-            dbmng_wr_bl(c->tag, op, c->argv[1], argc, argv, c->ds_id, c->db->id);
-            dbmng_set_key(c->tag, c->argv[1], 1, &val_obj);
-        }
-        else
-        {
-            dbmng_save_op(c->tag, op, c->argv[1], argc, argv, c->ds_id, c->db->id);
-            signalModifiedKey(c->db,c->argv[1]);
-            server.dirty++;
-        }
+        dbmng_save_op(c->tag, op, c->argv[1], argc, argv, c->ds_id, c->db->id);
+        signalModifiedKey(c->db,c->argv[1]);
+        server.dirty++;
 
         if (argv[1])
         {
@@ -1644,12 +1312,6 @@ static void appendCommand_ex(redisClient *c, int ex, int prepend)
     }
 
     addReplyLongLong(c,totlen);
-
-append_error:
-    if (o && server.has_cache == 0 && server.has_dbe == 1)
-    {
-        decrRefCount(o);
-    }
 }
 
 void appendCommand(redisClient *c)
@@ -1704,40 +1366,18 @@ void strlenCommand(redisClient *c)
     /* strlen key */
     robj *o = 0;
 
-    if (server.has_cache == 0 && server.has_dbe == 1)
+    o = lookupKeyRead(c->db,c->argv[1]);
+    if (o == 0)
     {
-        o = dbmng_lookup_key(c->tag, c->argv[1], 0);
-        if (o == 0)
-        {
-            addReply(c, shared.czero);
-            return;
-        }
-        if (checkType(c, o, REDIS_STRING))
-        {
-            decrRefCount(o);
-            return;
-        }
+        addReply(c, shared.czero);
+        return;
     }
-    else
+    if (checkType(c, o, REDIS_STRING))
     {
-        o = lookupKeyRead(c->db,c->argv[1]);
-        if (o == 0)
-        {
-            addReply(c, shared.czero);
-            return;
-        }
-        if (checkType(c, o, REDIS_STRING))
-        {
-            return;
-        }
+        return;
     }
 
     addReplyLongLong(c,stringObjectLen(o));
-
-    if (server.has_cache == 0 && server.has_dbe == 1)
-    {
-        decrRefCount(o);
-    }
 }
 
 /* support by memcached v1.4.8 */
@@ -1784,38 +1424,6 @@ void touchCommand(redisClient *c)
     }
     robj *const key = c->argv[1];
 
-    if (server.has_cache == 0 && server.has_dbe == 1)
-    {
-        /* dbe only */
-
-        time_t expire;
-        robj *val = dbmng_lookup_key(c->tag, key, &expire);
-        if (0 == val)
-        {
-            log_info("%s not exist", key->ptr);
-            addReply(c, shared.czero);
-            return;
-        }
-        val->visited_bit = 1;
-        if (seconds != 0)
-        {
-            robj *argv[2];
-            argv[0] = val;
-            argv[1] = createStringObjectFromLongLong((long long)(seconds));
-            dbmng_wr_bl(c->tag, OP_SETEX, key, 2, argv, c->ds_id, c->db->id);
-            dbmng_set_key(c->tag, key, 2, argv);
-            decrRefCount(argv[1]);
-        }
-        else if (expire != 0)
-        {
-            dbmng_wr_bl(c->tag, OP_SET, key, 1, &val, c->ds_id, c->db->id);
-            dbmng_set_key(c->tag, key, 1, &val);
-        }
-        decrRefCount(val);
-        addReply(c, shared.cone);
-        return;
-    }
-
     robj *val = lookupKeyWrite(c->db,key);
     if (val == NULL)
     {
@@ -8,6 +8,8 @@
 
 #include "dict.h"
 
+extern void wakeupWrbl();
+
 /* return:
  * 0 - not need block
  * 1 - need block & block succ
@@ -92,3 +94,67 @@ int block_client_on_write_bl(redisClient *c)
 #endif
 }
 
+
+/* hold the reply of a write cmd until its binlog has been synced,
+ * only when binlog_fsync is always.
+ * seq_before: server.bl_enq_seq before the cmd was called
+ * return:
+ * 0 - not need block
+ * 1 - need block & block succ
+ */
+int block_client_on_bl_sync(redisClient *c, unsigned long long seq_before)
+{
+#ifndef _UPD_DBE_BY_PERIODIC_
+    if (server.binlog_fsync != APPENDFSYNC_ALWAYS
+        || server.bl_enq_seq == seq_before
+        || (c->flags & REDIS_WR_BL_WAIT))
+    {
+        /* nothing written to binlog by this cmd */
+        return 0;
+    }
+
+    c->bl_wait_seq = server.bl_enq_seq;
+    if (server.bl_synced_seq >= c->bl_wait_seq)
+    {
+        return 0;
+    }
+
+    c->block_start_time = server.ustime;
+    c->flags |= REDIS_WR_BL_WAIT;
+    aeDeleteFileEvent(server.el, c->fd, AE_WRITABLE);
+
+    lockBlWriteList();
+    listAddNodeTail(server.write_bl_clients, c);
+    unlockBlWriteList();
+
+    /* write_bl may have synced before the client was queued */
+    __sync_synchronize();
+    if (server.bl_synced_seq >= c->bl_wait_seq)
+    {
+        wakeupWrbl();
+    }
+
+    return 1;
+#else
+    (void)c;
+    (void)seq_before;
+    return 0;
+#endif
+}
+
+void unblock_client_on_bl_sync(redisClient *c)
+{
+    c->wr_bl_block_dur = server.ustime - c->block_start_time;
+    c->flags &= (~REDIS_WR_BL_WAIT);
+
+    if (c->bufpos || listLength(c->reply))
+    {
+        /* written in beforeSleep */
+        queueClientPendingWrite(c);
+    }
+
+    if (c->querybuf && sdslen(c->querybuf) > 0)
+    {
+        processInputBuffer(c);
+    }
+}
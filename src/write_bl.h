@@ -4,6 +4,8 @@
 #include "redis.h"
 
 extern int block_client_on_write_bl(redisClient *c);
+extern int block_client_on_bl_sync(redisClient *c, unsigned long long seq_before);
+extern void unblock_client_on_bl_sync(redisClient *c);
 
 
 #endif /* _WRITE_BL_H_ */